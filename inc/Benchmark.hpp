@@ -0,0 +1,87 @@
+#pragma once
+
+#include "VSLBSP.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Heap allocations are counted for the benchmarks if this is non-zero. Counting replaces the
+// global operator new for the whole program, so it is only for benchmark builds, never the daemon.
+#ifndef BLACKSTAR_COUNT_ALLOCATIONS
+#define BLACKSTAR_COUNT_ALLOCATIONS 0
+#endif
+
+namespace mercury::blackstar
+{
+    // Benchmark runs named suites of timing measurements against the BSP and writes the
+    // results to standard output as CSV, one line per measurement:
+    //   suite,test,parameter,iterations,errors,min_ns,mean_ns,max_ns,rate_per_s,allocs_per_iteration
+    // rate_per_s is the number of iterations achieved per second of measured time,
+    // allocs_per_iteration is the mean number of heap allocations (empty if not counted, which
+    // needs a BLACKSTAR_COUNT_ALLOCATIONS build)
+    class Benchmark final
+    {
+    public:
+        static constexpr bool k_countAllocations { BLACKSTAR_COUNT_ALLOCATIONS != 0 };
+
+        Benchmark() = default;
+        ~Benchmark() = default;
+
+        void build(std::shared_ptr<VSLBSP> BSP);
+
+        // Returns false if the suite is not recognised or could not be run
+        bool run(const std::string& suite);
+
+    private:
+        // Accumulates per-iteration latencies for one measurement
+        class Measurement final
+        {
+        public:
+            void add(std::chrono::steady_clock::duration latency, bool ok);
+            void add(std::chrono::steady_clock::duration latency, bool ok, uint64_t allocations);
+            void print(const std::string& suite, const std::string& test, uint32_t parameter) const;
+
+        private:
+            uint32_t m_iterations { 0u };
+            uint32_t m_errors { 0u };
+            std::chrono::nanoseconds m_min { std::chrono::nanoseconds::max() };
+            std::chrono::nanoseconds m_max { 0 };
+            std::chrono::nanoseconds m_total { 0 };
+            uint64_t m_allocations { 0u };
+            bool m_allocationsCounted { false };
+        };
+
+        // Heap allocations made by the calling thread so far, 0 if they are not counted
+        static uint64_t allocations();
+
+        bool runI2C();
+        bool runSPI();
+        bool runConvert();
+        bool runVSWR();
+        bool runDIO();
+        bool runBus();
+        bool runLog();
+        bool runMetrics();
+        bool runStatus();
+        bool runMessage();
+        bool runCapture();
+
+        static const uint32_t k_I2CIterations { 200u };
+        static const uint32_t k_SPIIterations { 2000u };
+        static const uint32_t k_convertIterations { 10000u };
+        static const uint32_t k_VSWRIterations { 200u };
+        static const uint32_t k_DIOIterations { 2000u };
+        static const uint32_t k_busIterations { 200u };
+        static const uint32_t k_logIterations { 10000u };
+        static const uint32_t k_logBurst { 128u };
+        static const uint32_t k_metricsIterations { 10000u };
+        static const uint32_t k_metricsBatch { 100u };
+        static const uint32_t k_statusIterations { 10000u };
+        static const uint32_t k_messageIterations { 10000u };
+        static const uint32_t k_captureIterations { 3000000u };
+
+        std::shared_ptr<VSLBSP> m_BSP { nullptr };
+    };
+}
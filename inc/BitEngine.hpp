@@ -0,0 +1,133 @@
+#pragma once
+
+#include "BoardTelemetry.hpp"
+#include "Heartbeat.hpp"
+#include "SnapshotRing.hpp"
+#include "VSLBSP.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace mercury::blackstar
+{
+    // BitEngine runs the detailed built-in tests away from the CAN thread. Tests are grouped by the
+    // bus they use (I2C, SPI, on-board DIO/FPGA) and each group has its own worker thread, so the
+    // groups of a refresh run concurrently and only tests on the same bus wait for each other.
+    // Every test has a time budget, a test which overruns it is reported as timed out. A refresh
+    // is published at its deadline (the longest group budget) with whatever has completed, tests
+    // which have not completed by then are reported as timed out and their late results dropped.
+    // Results are published as a versioned snapshot to a lock-free ring, and the tests which didn't
+    // pass are logged. DetailedBit asks for a background refresh if the results are stale.
+    class BitEngine final
+    {
+    public:
+        enum class Group : uint8_t
+        {
+            I2C = 0,
+            SPI,
+            DIO
+        };
+        static constexpr size_t k_numberGroups { 3u };
+
+        enum class Status : uint8_t
+        {
+            NotRun = 0,
+            Pass,
+            Fail,
+            Timeout
+        };
+
+        struct Result
+        {
+            Status status { Status::NotRun };
+            int16_t value { 0 };  // Test specific, see the test table
+            uint32_t duration_us { 0u };
+        };
+
+        static constexpr size_t k_numberTests { 10u };
+
+        struct Results
+        {
+            uint32_t version { 0u };       // Refreshes published, 0 until the first refresh completes
+            uint64_t timestamp_ns { 0u };  // CLOCK_MONOTONIC time the refresh was published
+            std::array<Result, k_numberTests> results {};
+        };
+
+        static constexpr std::chrono::milliseconds k_maxAge { 10000 };
+
+        BitEngine() = default;
+        ~BitEngine() = default;
+
+        // The board ADC tests check the board telemetry (which may be null, the tests then fail)
+        void build(std::shared_ptr<VSLBSP> BSP, std::shared_ptr<BoardTelemetry> boardTelemetry);
+
+        // Start the workers and run a first refresh
+        void run();
+        void stop();
+
+        // Progress is reported on the heartbeat (if set) at least every k_idlePeriod
+        void setHeartbeat(std::shared_ptr<Heartbeat> heartbeat);
+
+        // Ask for a refresh, never blocks (a refresh already in progress satisfies the request)
+        void requestRefresh();
+
+        // Returns false if no refresh has completed yet
+        bool latest(Results& results) const;
+
+        // Ask for a refresh if the latest results are older than k_maxAge (or there are none)
+        void refreshIfStale();
+
+        static const char *testName(size_t index);
+
+    private:
+        struct Test
+        {
+            const char *name;
+            Group group;
+            std::chrono::milliseconds budget;
+            bool (BitEngine::*function)(uint8_t parameter, int16_t& value);
+            uint8_t parameter;
+        };
+
+        static constexpr std::chrono::milliseconds k_idlePeriod { 500 };
+
+        void start();
+        void refresh();
+        void worker(Group group);
+
+        // Tests, return true on pass
+        bool testFanPSURegister(uint8_t address, int16_t& value);
+        bool testBoardADC(uint8_t channel, int16_t& value);
+        bool testSlotInputs(uint8_t parameter, int16_t& value);
+        bool testFanSpeed(uint8_t parameter, int16_t& value);
+
+        static const Test k_tests[k_numberTests];
+
+        std::shared_ptr<VSLBSP> m_BSP { nullptr };
+        std::shared_ptr<BoardTelemetry> m_boardTelemetry { nullptr };
+        std::shared_ptr<Heartbeat> m_heartbeat { nullptr };
+        std::thread m_BitEngineThread;
+        std::array<std::thread, k_numberGroups> m_workerThreads;
+        std::atomic_bool m_stopRequested { false };
+        std::atomic_bool m_refreshRequested { false };
+
+        // The engine thread waits on m_wakeCondition (refresh requests, groups completing), the
+        // workers on m_workerCondition (a new refresh generation). The mutex is never held while
+        // a test runs.
+        std::mutex m_wakeMutex;
+        std::condition_variable m_wakeCondition;
+        std::condition_variable m_workerCondition;
+        uint32_t m_generation { 0u };
+        bool m_collecting { false };
+        std::array<uint32_t, k_numberGroups> m_groupGeneration {};  // Last generation completed
+        std::array<Result, k_numberTests> m_pending {};
+
+        SnapshotRing<Results, 4u> m_results;
+    };
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "EPUHardware.hpp"
+#include "Heartbeat.hpp"
+#include "SnapshotRing.hpp"
+#include "VSLBSP.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace mercury::blackstar
+{
+    // Latest board telemetry, each group of values has its own timestamp (CLOCK_MONOTONIC) and is
+    // only valid once it has been read successfully
+    struct BoardTelemetrySnapshot
+    {
+        uint64_t scanTimestamp_ns { 0u };
+        uint64_t scanCount { 0u };
+        uint8_t validChannels { 0u };  // Bit n set if values[n] came from the last scan
+        std::array<float, EPUHardware::k_numberAnalogInputs> values {};  // Scaled, see BoardTelemetry::channel
+
+        uint64_t fanTimestamp_ns { 0u };
+        uint16_t fanRPM { 0u };
+        bool fanRPMValid { false };
+
+        uint64_t fanPSUStatusTimestamp_ns { 0u };
+        uint8_t fanPSUStatus { 0u };       // Fan/PSU controller status register (0x40)
+        uint8_t fanPSUControl { 0u };      // Fan/PSU controller control register, PSU and PA enables
+        bool fanPSUStatusValid { false };  // Both registers read
+    };
+
+    // BoardTelemetry collects the board supply voltages and temperatures (on-board ADC, every
+    // configured channel in one auto-scan pass), the fan speed and the fan/PSU controller status
+    // and enables on its own thread and publishes them to a lock-free ring, so that health checks and BIT
+    // never have to touch the buses. The analog channels are scanned every k_scanPeriod, the fan
+    // and status (slower devices on a busier bus) every k_slowDivider scans.
+    class BoardTelemetry final
+    {
+    public:
+        enum class ChannelType : uint8_t
+        {
+            Voltage,     // Volts
+            Temperature  // Degrees C
+        };
+
+        // Analog input channel, value = (input volts * scale) + offset
+        struct Channel
+        {
+            const char *name;
+            uint8_t input;
+            ChannelType type;
+            float scale;
+            float offset;
+        };
+
+        static constexpr size_t k_numberChannels { 6u };
+        static constexpr std::chrono::milliseconds k_scanPeriod { 200 };
+        static constexpr uint32_t k_slowDivider { 5u };
+
+        BoardTelemetry() = default;
+        ~BoardTelemetry() = default;
+
+        void build(std::shared_ptr<VSLBSP> BSP);
+        void run();
+        void stop();
+
+        // Progress is reported on the heartbeat (if set) after every scan
+        void setHeartbeat(std::shared_ptr<Heartbeat> heartbeat);
+
+        // Returns false if nothing has been published yet
+        bool latest(BoardTelemetrySnapshot& snapshot) const;
+
+        static const Channel& channel(size_t index);
+
+    private:
+        void start();
+        void scan(BoardTelemetrySnapshot& snapshot);
+        void readSlowDevices(BoardTelemetrySnapshot& snapshot);
+
+        std::shared_ptr<VSLBSP> m_BSP { nullptr };
+        std::shared_ptr<Heartbeat> m_heartbeat { nullptr };
+        std::thread m_boardTelemetryThread;
+        std::atomic_bool m_stopRequested { false };
+        std::mutex m_wakeMutex;
+        std::condition_variable m_wakeCondition;
+        uint8_t m_inputMask { 0u };
+
+        SnapshotRing<BoardTelemetrySnapshot, 4u> m_snapshots;
+    };
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace mercury::blackstar
+{
+    // BusScheduler serialises the transactions on one bus (I2C or SPI) between threads and grants
+    // the bus in priority order: safety actions, then state changes, then telemetry, first come
+    // first served within a priority. A transaction runs on the calling thread once the bus has
+    // been granted, so an uncontended transaction costs one mutex round trip and no thread switch.
+    // Transactions are not pre-empted, a safety action waits for at most the transaction in
+    // progress. A failed transaction can be retried with exponential backoff, the bus is released
+    // during the backoff so other transactions are not held up by a misbehaving device.
+    class BusScheduler final
+    {
+    public:
+        enum class Priority : uint8_t
+        {
+            Safety = 0,
+            State = 1,
+            Telemetry = 2
+        };
+        static constexpr size_t k_numberPriorities { 3u };
+
+        static constexpr std::chrono::microseconds k_initialBackoff { 1000 };
+
+        struct PriorityStatistics
+        {
+            uint64_t transactions { 0u };  // Calls to execute
+            uint64_t failures { 0u };      // Calls which failed after every attempt
+            uint64_t retries { 0u };       // Attempts after the first
+            uint64_t totalWait_ns { 0u };  // Request to bus granted, per attempt
+            uint64_t maxWait_ns { 0u };
+            uint64_t totalTime_ns { 0u };  // Bus granted to bus released, per attempt
+            uint64_t maxTime_ns { 0u };
+        };
+
+        struct Statistics
+        {
+            std::array<PriorityStatistics, k_numberPriorities> priorities {};
+            uint64_t busy_ns { 0u };     // Total time the bus has been granted
+            uint64_t elapsed_ns { 0u };  // Time since build
+        };
+
+        BusScheduler() = default;
+        ~BusScheduler() = default;
+
+        void build(const std::string& name);
+        const std::string& name() const;
+
+        // Run the transaction (a callable returning true on success) with exclusive use of the bus,
+        // making up to attempts attempts
+        template <typename Transaction>
+        bool execute(Priority priority, Transaction&& transaction, uint8_t attempts = 1u)
+        {
+            bool ok { false };
+            std::chrono::microseconds backoff { k_initialBackoff };
+            uint8_t attempt { 0u };
+
+            for (; !ok && (attempt < std::max<uint8_t>(attempts, 1u)); attempt++)
+            {
+                if (attempt > 0u)
+                {
+                    std::this_thread::sleep_for(backoff);
+                    backoff *= 2;
+                }
+
+                // Traced from the request so that the wait for the bus shows, the bus is released
+                // even if the transaction throws
+                Trace::Scope trace { m_name.c_str(), static_cast<uint64_t>(priority) };
+                Grant grant { *this, priority };
+                ok = transaction();
+            }
+
+            record(priority, ok, attempt - 1u);
+            return ok;
+        }
+
+        Statistics statistics() const;
+
+        // One line summary: utilisation and per-priority wait and transaction times
+        void printStatistics() const;
+
+    private:
+        // Holds the bus from construction to destruction
+        class Grant final
+        {
+        public:
+            Grant(BusScheduler& scheduler, Priority priority)
+                : m_scheduler { scheduler }, m_priority { priority }, m_granted { scheduler.acquire(priority) }
+            {
+            }
+            ~Grant()
+            {
+                m_scheduler.release(m_priority, m_granted);
+            }
+
+            Grant(const Grant&) = delete;
+            Grant& operator=(const Grant&) = delete;
+
+        private:
+            BusScheduler& m_scheduler;
+            Priority m_priority;
+            std::chrono::steady_clock::time_point m_granted;
+        };
+
+        std::chrono::steady_clock::time_point acquire(Priority priority);
+        void release(Priority priority, std::chrono::steady_clock::time_point granted);
+        void record(Priority priority, bool ok, uint8_t retries);
+
+        std::string m_name;
+        std::chrono::steady_clock::time_point m_buildTime { std::chrono::steady_clock::now() };
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_grantCondition;
+        bool m_busy { false };
+        std::array<uint32_t, k_numberPriorities> m_waiting {};
+        std::array<uint64_t, k_numberPriorities> m_nextTicket {};
+        std::array<uint64_t, k_numberPriorities> m_servingTicket {};
+        Statistics m_statistics;
+    };
+}
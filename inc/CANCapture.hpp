@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <linux/can.h>
+
+namespace mercury::blackstar
+{
+    // CANCapture records every frame the CAN client receives, with its kernel receive timestamp,
+    // into a set of memory mapped files used in rotation (path.0, path.1, ...). Recording a frame
+    // is plain stores into the mapping, no system call. A preparer thread creates, maps and
+    // pre-faults the next file while the current one is written, and writes back and unmaps a
+    // full one, so switching files on the CAN thread is only a hand over. The next file is the
+    // oldest of the rotation, so its frames are lost once the current file is started.
+    //
+    // Each file is a FileHeader followed by records (all integers little endian):
+    //   timestamp delta: signed varint (zigzag LEB128), ns from the previous record's timestamp
+    //                    (from the header's firstTimestamp_ns for the first record)
+    //   CAN ID:          varint (LEB128) of can_id, including the EFF/RTR/ERR flags
+    //   length:          one byte (0 to 8), followed by that many payload bytes
+    // so a standard frame with 8 bytes is typically 14 bytes. The header's used count is
+    // published after each record, a reader can follow a file being written. Timestamps are
+    // CLOCK_REALTIME. Only the CAN client thread may record.
+    class CANCapture final
+    {
+    public:
+        static constexpr const char *k_defaultPath { "/var/log/BlackStarECM.capture" };
+        static constexpr uint64_t k_defaultFileSize { 16u << 20 };
+        static constexpr uint32_t k_defaultFiles { 4u };
+        static constexpr uint32_t k_magic { 0x43435342u };  // "BSCC"
+        static constexpr uint16_t k_version { 1u };
+        static constexpr size_t k_maxRecordSize { 10u + 5u + 1u + CAN_MAX_DLEN };
+
+        struct FileHeader
+        {
+            uint32_t magic;
+            uint16_t version;
+            uint16_t headerSize;
+            uint64_t fileSize;
+            uint64_t sequence;  // Files written since the capture was first started, orders the files
+            uint64_t firstTimestamp_ns;
+            uint64_t lastTimestamp_ns;
+            uint64_t frames;
+            uint32_t kernelDrops;  // Frames dropped by the socket before capture (SO_RXQ_OVFL) so far
+            uint32_t reserved;
+            std::atomic<uint64_t> used;  // Bytes of records after the header
+        };
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "Capture used count must be lock-free");
+
+        CANCapture() = default;
+        ~CANCapture();
+
+        CANCapture(const CANCapture&) = delete;
+        CANCapture& operator=(const CANCapture&) = delete;
+
+        // Start a new file after the newest of any existing capture files, returns false if it
+        // could not be created. At least two files are used (one written, one prepared).
+        bool open(const std::string& path = k_defaultPath,
+                  uint64_t fileSize = k_defaultFileSize,
+                  uint32_t files = k_defaultFiles);
+        void close();
+
+        void record(uint64_t timestamp_ns, const ::can_frame& frame, uint32_t kernelDrops);
+
+        // Read a capture file, or every file of a capture (oldest first) given its path without
+        // the file number. Returns false if there are no capture files at the path.
+        static bool read(const std::string& path,
+                         const std::function<void(uint64_t timestamp_ns, const ::can_frame& frame)>& handler);
+
+    private:
+        // A created and mapped capture file
+        struct File
+        {
+            int fd { -1 };
+            uint8_t *mapping { nullptr };
+        };
+
+        void startFile(const File& file);
+        File finishFile();
+        bool nextFile();
+        void prepare();
+        File createFile(uint64_t sequence) const;
+        void releaseFile(File& file) const;
+        static bool readFile(const std::string& path,
+                             const std::function<void(uint64_t timestamp_ns, const ::can_frame& frame)>& handler,
+                             uint64_t *sequence);
+
+        std::string m_path;
+        uint64_t m_fileSize { 0u };
+        uint32_t m_files { 0u };
+        uint64_t m_sequence { 0u };
+        uint32_t m_reportedDrops { 0u };
+
+        // The file being written, only accessed by the recording thread
+        File m_file;
+        FileHeader *m_header { nullptr };
+        size_t m_offset { 0u };  // Of the next record
+        uint64_t m_previous_ns { 0u };
+
+        // Preparer thread, the state below is protected by m_preparerMutex
+        std::thread m_preparerThread;
+        std::mutex m_preparerMutex;
+        std::condition_variable m_preparerCondition;
+        bool m_stopRequested { false };
+        bool m_nextFailed { false };
+        File m_next;                   // Prepared for m_sequence + 1, fd -1 until it is ready
+        std::vector<File> m_finished;  // Full files to write back and unmap
+    };
+}
@@ -1,17 +1,25 @@
 #pragma once
 
+#include "CANCapture.hpp"
 #include "CANMessageHandler.hpp"
+#include "Heartbeat.hpp"
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <thread>
 #include <vector>
 #include <sys/socket.h>
+#include <linux/can.h>
 
 namespace mercury
 {
     namespace blackstar
     {
+        class Benchmark;
+
         class CANClient final
         {
         public:
@@ -22,7 +30,37 @@ namespace mercury
             void run();
             void stop();
 
+            // Progress is reported on the heartbeat (if set) each time round the receive loop
+            void setHeartbeat(std::shared_ptr<Heartbeat> heartbeat);
+
+            // Every frame received (error frames included) is recorded on the capture, if set before run.
+            // The capture is closed when the client terminates.
+            void setCapture(std::shared_ptr<CANCapture> capture);
+
+            // Controller error state, from the error frames received (Down if the socket is not
+            // connected), and the number of error frames received
+            enum class BusState : uint8_t
+            {
+                Active,
+                ErrorWarning,
+                ErrorPassive,
+                BusOff,
+                Down
+            };
+            BusState busState() const;
+            uint32_t errorFrameCount() const;
+
         private:
+            static constexpr int k_captureReceiveBuffer { 1 << 20 };  // Bytes, about 1.5 s of a full bus
+
+            // Reconnection backoff while the socket is down, the thread beats at the poll period
+            static constexpr std::chrono::milliseconds k_reconnectMinimumDelay { 100 };
+            static constexpr std::chrono::milliseconds k_reconnectMaximumDelay { 5000 };
+            static constexpr std::chrono::milliseconds k_reconnectPollPeriod { 100 };
+
+            // Benchmarks the frame splitting in sendMessage
+            friend class Benchmark;
+
             // clang-format off
             //static constexpr std::chrono::duration k_messageTimeout { 1s };        // One second timeout waiting between message packets
             // clang-format on
@@ -30,14 +68,23 @@ namespace mercury
             void start();
             bool connect();
             void disconnect();
+            // Every frame read is stamped with its CLOCK_REALTIME receive time, from the kernel when
+            // capturing
+            ssize_t receiveFrame(::can_frame& frame, uint64_t& timestamp_ns);
             void sendMessage(std::vector<uint8_t>& message);
+            void errorFrameReceived(const ::can_frame& frame);
 
             int m_sockfd { -1 };
             std::thread m_CANClientThread;
             std::string m_CANDevice;
             std::shared_ptr<CANMessageHandler> m_messageHandler { nullptr };
+            std::shared_ptr<Heartbeat> m_heartbeat { nullptr };
+            std::shared_ptr<CANCapture> m_capture { nullptr };
+            uint32_t m_kernelDrops { 0u };  // Socket receive queue overflows (SO_RXQ_OVFL)
             bool m_connected { false };
             std::atomic_bool m_stopRequested { false };
+            std::atomic<BusState> m_busState { BusState::Down };
+            std::atomic<uint32_t> m_errorFrameCount { 0u };
         };
     }
 }
@@ -1,26 +1,38 @@
 #pragma once
 
+#include "BitEngine.hpp"
 #include "MercuryStateHandler.hpp"
+#include "RFPowerMonitor.hpp"
+#include "VSWRProtection.hpp"
 
 // Mercury includes
 #include "system/systemlib/inc/ecmstates.hpp"
 
+#include <chrono>
 #include <linux/can.h>
 #include <memory>
 #include <vector>
 
 namespace mercury::blackstar
 {
+    class Benchmark;
+
     class CANMessageHandler final
     {
     public:
         CANMessageHandler() = default;
         ~CANMessageHandler() = default;
 
-        void build(uint8_t slotNumber, std::shared_ptr<MercuryStateHandler> stateHandler);
+        void build(uint8_t slotNumber,
+                   std::shared_ptr<MercuryStateHandler> stateHandler,
+                   std::shared_ptr<RFPowerMonitor> powerMonitor,
+                   std::shared_ptr<VSWRProtection> VSWRProtection,
+                   std::shared_ptr<BitEngine> bitEngine);
 
-        // Returns true if there is a response to send
-        bool processFrame(const can_frame& frame, std::vector<uint8_t>& response);
+        // Returns true if there is a response to send. The timestamp is the time the frame was
+        // received (CLOCK_REALTIME, as captured), so a replayed capture reassembles as it did live;
+        // zero if unknown (a capture without timestamps), no reassembly timeout is measured across it.
+        bool processFrame(const can_frame& frame, uint64_t timestamp_ns, std::vector<uint8_t>& response);
 
         // processMessage is a monolithic function written to handle all of the
         // ECM messages so that a BlackStar Module can appear to be a Longbow ECM module
@@ -31,7 +43,15 @@ namespace mercury::blackstar
 
         uint8_t recipientID();
 
+        // The handler sniffs by default: it processes the messages for every ECM slot and sends
+        // no responses. Answering, it only keeps the frames for this slot (or broadcast) and
+        // responds to the commands addressed to it, as an ECM does.
+        void setAnswering(bool answering);
+
     private:
+        // Benchmarks the CRC and response building on their own
+        friend class Benchmark;
+
         static const uint8_t k_broadcastRecipientID { 0x00 };
         static const uint8_t k_MCMRecipientID { 0x01 };
         static const uint8_t k_ECMRecipientIDBase { 0x0A };  // ECM slot 0 recipient ID
@@ -39,6 +59,9 @@ namespace mercury::blackstar
         // Actual length of message excluding fields counted as part of the encoded message length field
         static const uint8_t k_baseMessageSize { 5u };
 
+        // Length of the CRC at the end of a message
+        static const uint8_t k_CRCSize { 2u };
+
         // Length of a response message with no parameters as encoded into the length field
         static const uint8_t k_emptyResponseEncodedSize { 4u };
 
@@ -51,6 +74,9 @@ namespace mercury::blackstar
 
         static const uint8_t k_messageTypeCommand { 0xC0 };  // Message type for a command message
 
+        // A partial message is discarded if the next frame is this long after the last one
+        static constexpr std::chrono::milliseconds k_reassemblyTimeout { 1000 };
+
         // Returns true if message in the receive buffer appears to be complete based on the length field
         bool completeMessageReceived();
         bool messageAddressedToThisNode();
@@ -58,13 +84,20 @@ namespace mercury::blackstar
         bool messageCRCOK();
         uint8_t messageRecipientID();
         uint16_t messageCommandID();
+        // Returns false if the message does not contain the parameter byte at this index
+        bool messageParameter(uint8_t index, uint8_t& value);
         void populateResponse(uint16_t responseID,
                               const std::vector<uint8_t>& parameters,
                               std::vector<uint8_t>& response);
         uint16_t calculateCRC(const std::vector<uint8_t>& message);
 
         uint8_t m_recipientID { 0u };
+        bool m_answering { false };
         std::vector<uint8_t> m_receiveMessage;
+        uint64_t m_lastFrame_ns { 0u };
         std::shared_ptr<MercuryStateHandler> m_stateHandler { nullptr };
+        std::shared_ptr<RFPowerMonitor> m_powerMonitor { nullptr };
+        std::shared_ptr<VSWRProtection> m_VSWRProtection { nullptr };
+        std::shared_ptr<BitEngine> m_bitEngine { nullptr };
     };
 }
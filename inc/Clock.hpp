@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+#include <time.h>
+
+namespace mercury::blackstar
+{
+    // Clock reads the time as nanoseconds, the form every timestamp in the daemon is kept in.
+    // Monotonic times are comparable with std::chrono::steady_clock (CLOCK_MONOTONIC on Linux),
+    // real times are since the epoch.
+    class Clock final
+    {
+    public:
+        static uint64_t monotonic_ns()
+        {
+            return read_ns(CLOCK_MONOTONIC);
+        }
+
+        static uint64_t realTime_ns()
+        {
+            return read_ns(CLOCK_REALTIME);
+        }
+
+    private:
+        static uint64_t read_ns(clockid_t clock)
+        {
+            ::timespec time {};
+            ::clock_gettime(clock, &time);
+            return (static_cast<uint64_t>(time.tv_sec) * 1000000000u) + static_cast<uint64_t>(time.tv_nsec);
+        }
+    };
+}
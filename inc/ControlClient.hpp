@@ -0,0 +1,36 @@
+#pragma once
+
+#include "ControlProtocol.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mercury::blackstar
+{
+    // ControlClient sends ControlProtocol requests to the daemon over the control socket
+    class ControlClient final
+    {
+    public:
+        static constexpr std::chrono::milliseconds k_responseTimeout { 2000 };
+
+        ControlClient() = default;
+        ~ControlClient();
+
+        enum class Connection
+        {
+            Connected,
+            NoDaemon,  // No socket, or a socket left behind with nothing listening
+            Failed     // Anything else (e.g. no permission), errno is set
+        };
+
+        Connection connect(const std::string& path = ControlProtocol::k_socketPath);
+
+        // Returns false if the daemon did not respond in time
+        bool transact(uint8_t command, std::vector<uint8_t>& response);
+
+    private:
+        int m_sockfd { -1 };
+    };
+}
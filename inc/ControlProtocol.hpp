@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mercury::blackstar
+{
+    // ControlProtocol is the binary protocol on the daemon control socket, a Unix domain
+    // SOCK_SEQPACKET socket so that each request and response is one message:
+    //   Request:  version, command
+    //   Response: version, command, status, data (multi-byte values are little endian)
+    struct ControlProtocol final
+    {
+        static constexpr const char *k_socketPath { "/run/BlackStarECM.sock" };
+        static constexpr uint8_t k_version { 1u };
+        static constexpr size_t k_maxMessageSize { 64u };
+
+        static constexpr size_t k_versionField { 0u };
+        static constexpr size_t k_commandField { 1u };
+        static constexpr size_t k_statusField { 2u };
+        static constexpr size_t k_requestSize { 2u };
+        static constexpr size_t k_responseHeaderSize { 3u };
+
+        // Commands (one per one-shot option) and their response data
+        static constexpr uint8_t k_commandResetFanPSU { 0x01 };    // -i
+        static constexpr uint8_t k_commandGetRFPower { 0x02 };     // -r, 32-bit forward mV, 32-bit reverse mV
+        static constexpr uint8_t k_commandEnablePower { 0x03 };    // -E
+        static constexpr uint8_t k_commandDisablePower { 0x04 };   // -e
+        static constexpr uint8_t k_commandMutePA { 0x05 };         // -M
+        static constexpr uint8_t k_commandUnmutePA { 0x06 };       // -m
+        static constexpr uint8_t k_commandGetSlotNumber { 0x07 };  // -s, 8-bit slot number
+
+        static constexpr uint8_t k_statusOK { 0x00 };
+        static constexpr uint8_t k_statusFailed { 0x01 };
+        static constexpr uint8_t k_statusUnknownCommand { 0x02 };
+        static constexpr uint8_t k_statusBadRequest { 0x03 };
+    };
+}
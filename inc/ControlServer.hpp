@@ -0,0 +1,58 @@
+#pragma once
+
+#include "ControlProtocol.hpp"
+#include "DIOInputMonitor.hpp"
+#include "EventLoop.hpp"
+#include "MercuryStateHandler.hpp"
+#include "RFPowerMonitor.hpp"
+#include "VSLBSP.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mercury::blackstar
+{
+    // ControlServer executes ControlProtocol requests. The daemon listens for requests on the
+    // control socket, connections are served from the main event loop. One-shot options use
+    // execute() directly when there is no daemon running.
+    // RF power and the slot number come from the monitors when they are available so that these
+    // requests don't touch the hardware at all.
+    class ControlServer final
+    {
+    public:
+        ControlServer() = default;
+        ~ControlServer();
+
+        // The state handler and monitors may be null. With a state handler (in the daemon) the PA
+        // is only enabled or unmuted through it, so the commands are refused unless jamming with
+        // no VSWR trip; without one (a one-shot with no daemon) the hardware is driven directly.
+        void build(std::shared_ptr<VSLBSP> BSP,
+                   std::shared_ptr<MercuryStateHandler> stateHandler,
+                   std::shared_ptr<RFPowerMonitor> powerMonitor,
+                   std::shared_ptr<DIOInputMonitor> inputMonitor);
+
+        // Any stale socket at the path is replaced, returns false if the socket could not be created
+        bool listen(EventLoop& eventLoop, const std::string& path = ControlProtocol::k_socketPath);
+
+        void execute(const std::vector<uint8_t>& request, std::vector<uint8_t>& response);
+
+    private:
+        static constexpr size_t k_maxConnections { 8u };
+
+        void accept();
+        void receive(int fd);
+        void closeConnection(int fd);
+
+        std::shared_ptr<VSLBSP> m_BSP { nullptr };
+        std::shared_ptr<MercuryStateHandler> m_stateHandler { nullptr };
+        std::shared_ptr<RFPowerMonitor> m_powerMonitor { nullptr };
+        std::shared_ptr<DIOInputMonitor> m_inputMonitor { nullptr };
+
+        EventLoop *m_eventLoop { nullptr };
+        std::string m_path;
+        int m_listenfd { -1 };
+        std::vector<int> m_connections;
+    };
+}
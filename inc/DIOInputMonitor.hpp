@@ -0,0 +1,44 @@
+#pragma once
+
+#include "EventLoop.hpp"
+#include "VSLBSP.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace mercury::blackstar
+{
+    // DIOInputMonitor keeps a cache of the DIO input levels so that reading an input never
+    // touches the hardware. The cache is refreshed from the main event loop when a DIO interrupt
+    // signal arrives (via signalfd), or at a low rate if interrupts are not available. With
+    // interrupts the inputs are also re-read occasionally in case an edge was missed.
+    class DIOInputMonitor final
+    {
+    public:
+        static constexpr std::chrono::milliseconds k_pollPeriod { 250 };
+        static constexpr std::chrono::milliseconds k_resyncPeriod { 5000 };
+
+        DIOInputMonitor() = default;
+        ~DIOInputMonitor();
+
+        // Must be called before any other thread is started (see EventLoop::addSignal)
+        void build(std::shared_ptr<VSLBSP> BSP, EventLoop& eventLoop);
+
+        // Cached input levels, VSLBSP::k_inputX bits
+        uint8_t inputs() const;
+        uint8_t ECMSlotNumber() const;
+
+        bool interruptDriven() const;
+        uint64_t changeCount() const;
+
+    private:
+        void update();
+
+        std::shared_ptr<VSLBSP> m_BSP { nullptr };
+        std::atomic<uint8_t> m_inputs { 0u };
+        std::atomic<uint64_t> m_changeCount { 0u };
+        bool m_interruptDriven { false };
+    };
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace mercury::blackstar
+{
+    // EPUHardware is the set of hardware primitives VSLBSP needs from the EPU-4562 board: DIO
+    // channels, FPGA registers, the primary I2C bus, the SPI bus (slave select 0), the on-board
+    // analog inputs, the fan tachometer and the watchdog. VersaLogicHardware implements it with
+    // the VersaLogic API (on target only), SimulatedHardware models the board so the rest of the
+    // application can run anywhere. Channel, register and device numbers are the VersaAPI ones.
+    // All functions returning bool return false on failure.
+    class EPUHardware
+    {
+    public:
+        static constexpr size_t k_numberAnalogInputs { 8u };
+        using AnalogInputs = std::array<double, k_numberAnalogInputs>;
+
+        virtual ~EPUHardware() = default;
+
+        virtual bool open() = 0;
+        virtual void close() = 0;
+
+        // DIO channels
+        virtual void setDIODirection(uint8_t channel, bool input) = 0;
+        virtual void setDIOLevel(uint8_t channel, bool high) = 0;
+        virtual bool DIOLevel(uint8_t channel) = 0;
+
+        // DIO interrupts are delivered to this process as DIOInterruptSignal(), channels are a
+        // bit mask (bit n = channel n)
+        virtual int DIOInterruptSignal() const = 0;
+        virtual bool enableDIOInterrupts(uint32_t channels) = 0;
+        virtual void disableDIOInterrupts(uint32_t channels) = 0;
+        virtual void clearDIOInterrupts(uint32_t channels) = 0;
+
+        // FPGA registers
+        virtual bool readFPGARegister(uint32_t offset, uint8_t& data) = 0;
+        virtual bool writeFPGARegister(uint32_t offset, uint8_t data) = 0;
+
+        // Primary I2C bus
+        virtual bool setI2CFrequency(uint32_t frequency_Hz) = 0;
+        virtual uint32_t I2CMaxFrequency() = 0;  // 0 if not known
+        virtual bool readI2CRegister(uint8_t chipAddress, uint8_t address, uint8_t& data) = 0;
+        virtual bool writeI2CRegister(uint8_t chipAddress, uint8_t address, uint8_t data) = 0;
+
+        // SPI bus, data is shifted out MSB first from the top of the 32-bit frame buffer and a read
+        // returns the data clocked in during the last write
+        virtual bool configureSPI(uint32_t clockFrequency_Hz, uint8_t mode, uint32_t frameSize) = 0;
+        virtual bool setSPIFrameSize(uint32_t frameSize) = 0;
+        virtual bool writeSPIFrame(uint32_t data) = 0;
+        virtual bool readSPIFrame(uint32_t& data) = 0;
+
+        // On-board analog inputs, channels are a bit mask (bit n = channel n). Auto-scan has the
+        // ADC convert the channels in sequence so a whole scan is collected without selecting each
+        // channel. The ADC is on the SPI bus (on its own slave select) and reading it changes the
+        // SPI controller configuration, SPI must be configured again before the next frame.
+        virtual bool configureAnalogAutoScan(uint8_t channels) = 0;
+        virtual bool readAnalogInputs(uint8_t channels, AnalogInputs& volts) = 0;
+
+        // Fan tachometer
+        virtual bool fanRPM(uint8_t pulsesPerRevolution, uint16_t& RPM) = 0;
+
+        // Watchdog, setting the timeout also restarts the countdown
+        virtual bool enableWatchdog(uint8_t timeout_s) = 0;
+        virtual void setWatchdogTimeout(uint8_t timeout_s) = 0;
+        virtual void disableWatchdog() = 0;
+    };
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <sys/signalfd.h>
+
+namespace mercury::blackstar
+{
+    // EventLoop runs the main thread: it waits (epoll) on file descriptors, periodic timers and
+    // signals and calls the handler registered for each one that becomes ready.
+    // Signals are delivered through signalfd so handlers run in normal thread context rather than
+    // in a signal handler. Signals must be added before any other thread is started so that every
+    // thread inherits the blocked signal mask, otherwise the signal may be delivered to another
+    // thread (or with its default action).
+    class EventLoop final
+    {
+    public:
+        EventLoop() = default;
+        ~EventLoop();
+
+        bool build();
+
+        // Handlers are called on the thread which called run(), all add functions return false if
+        // the event source could not be created
+        bool addDescriptor(int fd, std::function<void()> handler);
+        bool addTimer(std::chrono::milliseconds period, std::function<void()> handler);
+        bool addSignal(int signalNumber, std::function<void(const signalfd_siginfo&)> handler);
+
+        // Stop watching a descriptor added with addDescriptor, the caller still owns (and closes)
+        // it. May be called from a handler, including the descriptor's own handler.
+        void removeDescriptor(int fd);
+
+        // Run until stop() is called (from any thread or from a handler)
+        void run();
+        void stop();
+
+    private:
+        struct Source
+        {
+            int fd;
+            bool owned;  // Close the descriptor when the loop is destroyed
+            std::function<void()> handler;
+            bool removed { false };
+        };
+
+        bool add(int fd, bool owned, std::function<void()> handler);
+
+        int m_epollfd { -1 };
+        int m_stopfd { -1 };
+        std::vector<std::unique_ptr<Source>> m_sources;
+        std::vector<std::unique_ptr<Source>> m_removedSources;  // Freed once the current events are handled
+        std::atomic_bool m_stopRequested { false };
+    };
+}
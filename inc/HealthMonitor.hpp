@@ -0,0 +1,123 @@
+#pragma once
+
+#include "BoardTelemetry.hpp"
+#include "CANClient.hpp"
+#include "Heartbeat.hpp"
+#include "MercuryStateHandler.hpp"
+#include "RFPowerMonitor.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace mercury::blackstar
+{
+    // HealthMonitor runs the continuous health checks on its own thread and publishes the result
+    // to the state handler as the monitored fault bits, which drive healthOK(), BitTopLevel and the
+    // "WithError" states. Every check works from published snapshots (board telemetry, RF power
+    // windows, CAN bus state) so no check touches a bus or blocks a CAN response:
+    //  - fan/PSU controller status register (0x40), no bit of the fault mask set
+    //  - PSU and PA enables read back from the fan/PSU controller match the commanded state
+    //  - RF power is plausible: present while jamming, absent while not
+    //  - CAN controller is error active (or error warning)
+    //  - board telemetry and RF power windows are fresh
+    // A fault is raised after raiseCount consecutive failed checks and cleared after clearCount
+    // consecutive passes; the RF power thresholds also have hysteresis. Status and read-back are
+    // only checked when the board telemetry has a new reading, RF power on each new window. The
+    // settings are given on the daemon command line ('K' option), see parse().
+    class HealthMonitor final
+    {
+    public:
+        struct Settings
+        {
+            std::chrono::milliseconds fanPSUPeriod { 1000 };  // Status register and read-back
+            std::chrono::milliseconds RFPeriod { 200 };
+            std::chrono::milliseconds CANPeriod { 500 };
+            std::chrono::milliseconds maxTelemetryAge { 3000 };
+            uint8_t raiseCount { 3u };
+            uint8_t clearCount { 5u };
+
+            // The fan/PSU controller status bits aren't documented in this repository, so by
+            // default no bit is a fault. Set the mask to the controller's fault bits to check them.
+            uint8_t fanPSUStatusFaultMask { 0x00 };
+
+            // PROVISIONAL: not taken from the PA or power monitor specifications, the defaults only
+            // separate "PA on" from "PA off" and should be set for the fitted PA
+            float jammingMinForward_dBm { 10.0f };  // Forward power expected while jamming
+            float mutedMaxForward_dBm { 0.0f };     // Forward power allowed while not jamming
+            float RFHysteresis_dB { 2.0f };         // Extra margin needed to clear an RF power fault
+        };
+
+        static constexpr std::chrono::milliseconds k_period { 100 };
+
+        // Update settings from a comma separated list of name=value, e.g. "rf_ms=100,status_mask=0x0C".
+        // Names: fanpsu_ms, rf_ms, can_ms, max_age_ms, raise, clear, status_mask, jamming_min_dbm,
+        // muted_max_dbm, hysteresis_db. Returns false (settings partly updated) for an unknown name
+        // or a value out of range.
+        static bool parse(const std::string& text, Settings& settings);
+
+        HealthMonitor() = default;
+        ~HealthMonitor() = default;
+
+        // The CAN client may be null (no CAN check)
+        void build(std::shared_ptr<MercuryStateHandler> stateHandler,
+                   std::shared_ptr<BoardTelemetry> boardTelemetry,
+                   std::shared_ptr<RFPowerMonitor> powerMonitor,
+                   std::shared_ptr<CANClient> client,
+                   const Settings& settings);
+        void run();
+        void stop();
+
+        // Progress is reported on the heartbeat (if set) every period
+        void setHeartbeat(std::shared_ptr<Heartbeat> heartbeat);
+
+    private:
+        // Debounced check, only accessed by the monitor thread
+        struct Check
+        {
+            const char *name;
+            uint8_t fault;
+            uint8_t failures;
+            uint8_t passes;
+            bool faulty;
+        };
+
+        void start();
+        void checkFanPSU(uint64_t now_ns);
+        void checkRFPower(uint64_t now_ns);
+        void checkCAN();
+        void update(Check& check, bool passed);
+        bool fresh(uint64_t timestamp_ns, uint64_t now_ns) const;
+
+        std::shared_ptr<MercuryStateHandler> m_stateHandler { nullptr };
+        std::shared_ptr<BoardTelemetry> m_boardTelemetry { nullptr };
+        std::shared_ptr<RFPowerMonitor> m_powerMonitor { nullptr };
+        std::shared_ptr<CANClient> m_CANClient { nullptr };
+        std::shared_ptr<Heartbeat> m_heartbeat { nullptr };
+        Settings m_settings;
+
+        std::thread m_healthMonitorThread;
+        std::atomic_bool m_stopRequested { false };
+        std::mutex m_wakeMutex;
+        std::condition_variable m_wakeCondition;
+
+        // clang-format off
+        Check m_fanPSUStatus { "fan/PSU status",   MercuryStateHandler::k_faultFanPSUStatus, 0u, 0u, false };
+        Check m_PSUReadBack  { "PSU enable",       MercuryStateHandler::k_faultPSUReadBack,  0u, 0u, false };
+        Check m_PAReadBack   { "PA enable",        MercuryStateHandler::k_faultPAReadBack,   0u, 0u, false };
+        Check m_RFPower      { "RF power",         MercuryStateHandler::k_faultRFPower,      0u, 0u, false };
+        Check m_CANBus       { "CAN bus",          MercuryStateHandler::k_faultCANBus,       0u, 0u, false };
+        Check m_boardFresh   { "board telemetry",  MercuryStateHandler::k_faultTelemetry,    0u, 0u, false };
+        Check m_RFFresh      { "RF telemetry",     MercuryStateHandler::k_faultTelemetry,    0u, 0u, false };
+        // clang-format on
+
+        uint64_t m_lastFanPSUStatus_ns { 0u };
+        uint64_t m_lastWindow_ns { 0u };
+        uint8_t m_faults { 0u };
+    };
+}
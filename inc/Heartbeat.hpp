@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Clock.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace mercury::blackstar
+{
+    // Heartbeat is a progress marker for a supervised thread: the thread calls beat() each time
+    // around its loop and the WatchdogSupervisor checks how long ago the last beat was
+    class Heartbeat final
+    {
+    public:
+        Heartbeat()
+        {
+            beat();
+        }
+        ~Heartbeat() = default;
+
+        void beat()
+        {
+            m_last_ns.store(static_cast<int64_t>(Clock::monotonic_ns()), std::memory_order_relaxed);
+        }
+
+        // Time since the last beat, signed as the thread may beat after the time is read
+        std::chrono::nanoseconds age() const
+        {
+            int64_t now_ns { static_cast<int64_t>(Clock::monotonic_ns()) };
+            return std::chrono::nanoseconds { now_ns - m_last_ns.load(std::memory_order_relaxed) };
+        }
+
+    private:
+        std::atomic<int64_t> m_last_ns { 0 };
+    };
+}
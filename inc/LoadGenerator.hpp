@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <linux/can.h>
+
+namespace mercury::blackstar
+{
+    // LoadGenerator stands in for the MCM on a CAN interface (normally vcan with the daemon
+    // answering on the simulated hardware) to find how many requests per second an ECM handles
+    // and at what latency. It sends Mercury commands, CRC'd and split into frames, to a number of
+    // ECM slots from a weighted command mix and matches each response to the oldest outstanding
+    // request of its slot with the same command ID.
+    //
+    // Open loop sends at a fixed rate whatever the responses, latency is measured from the time
+    // a request was due so that a daemon which falls behind shows its queueing delay. Closed loop
+    // keeps a number of requests outstanding per slot and sends the next as soon as one is
+    // answered, which saturates the daemon. A request not answered within the timeout is dropped.
+    //
+    // The report is written to standard output, one name=value per line:
+    //   mode, slots, duration_s, sent, responses, dropped, unmatched, not_ok, send_errors,
+    //   drop_rate, offered_per_s, throughput_per_s, latency_{mean,p50,p90,p99,p999,max}_us
+    // unmatched counts responses with no outstanding request, not_ok responses other than Ok.
+    class LoadGenerator final
+    {
+    public:
+        enum class Mode
+        {
+            Open,
+            Closed
+        };
+
+        struct Settings
+        {
+            std::string device { "vcan0" };
+            Mode mode { Mode::Open };
+            uint32_t rate_Hz { 1000u };     // Open loop, requests per second over all slots (1 to k_maxRate_Hz)
+            uint32_t outstanding { 1u };    // Closed loop, requests in flight per slot (1 to k_maxOutstanding)
+            uint8_t slots { 1u };           // Slots 0 to slots - 1
+            std::chrono::milliseconds duration { 10000 };
+            std::chrono::milliseconds timeout { 100 };
+            // Comma separated name[:weight], a name is getstate, ping, capabilities, upload (the
+            // largest UploadFile), version, serial, bit or a numeric command ID
+            std::string mix { "getstate:4,ping:2,capabilities:1,upload:1" };
+        };
+
+        static constexpr uint8_t k_maxSlots { 5u };  // CAN IDs 0x0A to 0x0E
+
+        // Far more than a 1 Mbit/s CAN bus carries, the open loop schedule needs a period of at
+        // least a nanosecond
+        static constexpr uint32_t k_maxRate_Hz { 1000000u };
+
+        // Far more than the CAN transmit queue holds
+        static constexpr uint32_t k_maxOutstanding { 1024u };
+
+        LoadGenerator() = default;
+        ~LoadGenerator();
+
+        // Returns false (with the reason on standard error) if the settings are not valid
+        bool build(const Settings& settings);
+
+        // Run for the duration or until SIGINT/SIGTERM and write the report, returns false if the
+        // CAN interface could not be opened
+        bool run();
+
+    private:
+        static constexpr uint32_t k_sendRetries { 100u };
+        static constexpr std::chrono::microseconds k_sendRetryWait { 100 };
+
+        struct Request
+        {
+            uint16_t commandID;
+            uint64_t due_ns;
+        };
+
+        struct Slot
+        {
+            std::vector<std::vector<::can_frame>> messages;  // Frames of each mix command
+            std::deque<Request> outstanding;
+            std::vector<uint8_t> buffer;  // Response reassembly
+        };
+
+        bool open();
+        void close();
+        // Returns false if the request could not be sent
+        bool send(Slot& slot, uint64_t due_ns);
+        bool sendFrame(const ::can_frame& frame);
+        void receive(uint64_t now_ns);
+        void responseReceived(Slot& slot, uint64_t now_ns);
+        void expire(uint64_t now_ns);
+        void report(uint64_t elapsed_ns);
+
+        Settings m_settings;
+        std::vector<uint16_t> m_commandIDs;
+        std::discrete_distribution<size_t> m_mix;
+        std::mt19937 m_random { 1u };
+        std::vector<Slot> m_slots;
+        int m_sockfd { -1 };
+
+        uint64_t m_sent { 0u };
+        uint64_t m_responses { 0u };
+        uint64_t m_dropped { 0u };
+        uint64_t m_unmatched { 0u };
+        uint64_t m_notOK { 0u };
+        uint64_t m_sendErrors { 0u };
+        std::vector<uint64_t> m_latencies_ns;
+    };
+}
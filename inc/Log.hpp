@@ -0,0 +1,187 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Log calls below this level are compiled out: 0 debug, 1 info, 2 warning, 3 error
+#ifndef BLACKSTAR_LOG_LEVEL
+#define BLACKSTAR_LOG_LEVEL 1
+#endif
+
+namespace mercury::blackstar
+{
+    enum class LogLevel : uint8_t
+    {
+        Debug = 0,
+        Info = 1,
+        Warning = 2,
+        Error = 3
+    };
+
+    // Log is the daemon's asynchronous logger. A log call stores a binary record (time, level, the
+    // format string pointer and the raw arguments) in a lock-free ring owned by the calling thread
+    // and returns, formatting and output are left to a background writer thread. A call never
+    // blocks or makes a system call: if the thread's ring is full the record is dropped and
+    // counted, the writer reports the number dropped. Records from different threads are written
+    // in time order within each writer pass.
+    // Formats use "{}" for each argument ("{x}" for an integer in hex), the format must be a string
+    // literal; string arguments are copied into the record. Until start() is called (and after
+    // stop()) records are formatted and written to standard output by the calling thread, so
+    // tools and one-shot actions behave as before.
+    class Log final
+    {
+    public:
+        enum class Sink : uint8_t
+        {
+            Stdout,
+            Journal,  // systemd journal native protocol, one datagram per record
+            File      // Rotated once it reaches maxFileSize, keeping files old files (path.1, ...)
+        };
+
+        struct Settings
+        {
+            Sink sink { Sink::Stdout };
+            std::string path { k_defaultPath };
+            uint64_t maxFileSize { 1u << 20 };
+            uint32_t files { 4u };
+        };
+
+        static constexpr LogLevel k_level { static_cast<LogLevel>(BLACKSTAR_LOG_LEVEL) };
+        static constexpr const char *k_defaultPath { "/var/log/BlackStarECM.log" };
+        static constexpr size_t k_maxArguments { 8u };
+        static constexpr size_t k_textSize { 128u };  // String argument bytes per record
+        static constexpr size_t k_ringSize { 256u };  // Records per thread
+        static constexpr std::chrono::milliseconds k_writePeriod { 10 };
+
+        // Start the writer thread, returns false (and keeps writing synchronously) if the sink
+        // can't be opened. Call before, and stop() after, the threads which log.
+        static bool start(const Settings& settings);
+        static void stop();
+
+        // Records dropped because a ring was full
+        static uint64_t dropped();
+
+        // Returns false if the record was dropped (always true if the level is compiled out)
+        template<typename... Args>
+        static bool debug(const char *format, const Args&... args)
+        {
+            return write<LogLevel::Debug>(format, args...);
+        }
+
+        template<typename... Args>
+        static bool info(const char *format, const Args&... args)
+        {
+            return write<LogLevel::Info>(format, args...);
+        }
+
+        template<typename... Args>
+        static bool warning(const char *format, const Args&... args)
+        {
+            return write<LogLevel::Warning>(format, args...);
+        }
+
+        template<typename... Args>
+        static bool error(const char *format, const Args&... args)
+        {
+            return write<LogLevel::Error>(format, args...);
+        }
+
+        template<LogLevel Level, typename... Args>
+        static bool write(const char *format, const Args&... args)
+        {
+            static_assert(sizeof...(Args) <= k_maxArguments, "Too many log arguments");
+
+            bool ok { true };
+            if constexpr (Level >= k_level)
+            {
+                Record *record { reserve(Level, format) };
+                ok = (record != nullptr);
+                if (ok)
+                {
+                    (encode(*record, args), ...);
+                    commit(*record);
+                }
+            }
+            return ok;
+        }
+
+        enum class ArgumentType : uint8_t
+        {
+            Signed,
+            Unsigned,
+            Float,
+            String  // Value is the offset (high 32 bits) and length of the text
+        };
+
+        struct Record
+        {
+            uint64_t time_ns;    // CLOCK_REALTIME
+            const char *format;  // String literal, formatted by the writer
+            LogLevel level;
+            bool buffered;       // In the thread's ring (the writer was running at reserve())
+            uint8_t argumentCount;
+            uint16_t textSize;
+            std::array<ArgumentType, k_maxArguments> types;
+            std::array<uint64_t, k_maxArguments> values;
+            std::array<char, k_textSize> text;
+        };
+
+        // Format a record as a line (no newline), with the "ERROR: "/"WARNING: " prefix if prefix
+        static void format(const Record& record, bool prefix, std::string& line);
+
+    private:
+        static Record *reserve(LogLevel level, const char *format);
+        static void commit(Record& record);
+        static void copyText(Record& record, size_t index, std::string_view text);
+
+        template<typename T>
+        static void encode(Record& record, const T& value)
+        {
+            // Enums are logged as their value, the cast argument takes the slot
+            if constexpr (std::is_enum<T>::value)
+            {
+                encode(record, static_cast<std::underlying_type_t<T>>(value));
+            }
+            else
+            {
+                encodeArgument(record, record.argumentCount++, value);
+            }
+        }
+
+        template<typename T>
+        static void encodeArgument(Record& record, size_t index, const T& value)
+        {
+            if constexpr (std::is_integral<T>::value && std::is_signed<T>::value)
+            {
+                record.types[index] = ArgumentType::Signed;
+                record.values[index] = static_cast<uint64_t>(static_cast<int64_t>(value));
+            }
+            else if constexpr (std::is_integral<T>::value)
+            {
+                record.types[index] = ArgumentType::Unsigned;
+                record.values[index] = static_cast<uint64_t>(value);
+            }
+            else if constexpr (std::is_floating_point<T>::value)
+            {
+                double number { static_cast<double>(value) };
+                record.types[index] = ArgumentType::Float;
+                std::memcpy(&record.values[index], &number, sizeof(number));
+            }
+            else if constexpr (std::is_pointer<std::decay_t<T>>::value)
+            {
+                copyText(record, index,
+                         (value != nullptr) ? std::string_view { value } : std::string_view { "(null)" });
+            }
+            else
+            {
+                copyText(record, index, std::string_view { value });
+            }
+        }
+    };
+}
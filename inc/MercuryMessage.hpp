@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <linux/can.h>
+
+namespace mercury::blackstar
+{
+    // MercuryMessage builds Mercury messages the way the MCM sends them, for the benchmarks and
+    // tools which drive the message handler without an MCM. A command message is:
+    //   type (0xC0), length, recipient ID, command ID (LSB, MSB), parameters, CRC (LSB, MSB)
+    // where length is the number of bytes after the recipient ID less the CRC, the CRC is
+    // CRC-CCITT over everything before it. A response has the same layout with the response ID
+    // (e.g. Ok) followed by the command ID it answers in place of the command ID. A message is
+    // sent as consecutive CAN frames of up to eight bytes with the ECM's ID as the CAN ID, in
+    // both directions.
+    class MercuryMessage final
+    {
+    public:
+        static constexpr uint8_t k_typeCommand { 0xC0 };
+        static constexpr size_t k_headerSize { 5u };  // Type to command ID
+        static constexpr size_t k_CRCSize { 2u };
+        static constexpr size_t k_maxParameters { 253u };  // Length field is one byte
+        static constexpr size_t k_frameSize { 8u };
+        static constexpr uint8_t k_MCMRecipientID { 0x01 };
+        static constexpr uint8_t k_ECMRecipientIDBase { 0x0A };  // ECM slot 0
+
+        struct Response
+        {
+            uint8_t recipientID;
+            uint16_t responseID;
+            uint16_t commandID;
+        };
+
+        static uint16_t CRC(const uint8_t *data, size_t size);
+
+        // Parameters beyond k_maxParameters are not included
+        static std::vector<uint8_t> command(uint8_t recipientID,
+                                            uint16_t commandID,
+                                            const std::vector<uint8_t>& parameters = {});
+
+        static std::vector<::can_frame> frames(canid_t CANID, const std::vector<uint8_t>& message);
+
+        // Size of the message starting at the beginning of a reassembly buffer, from its length
+        // field, or zero if the length field hasn't been received yet
+        static size_t size(const std::vector<uint8_t>& buffer);
+
+        // Returns false if the message is not a response or its CRC is wrong
+        static bool response(const uint8_t *message, size_t size, Response& response);
+    };
+}
@@ -1,11 +1,16 @@
 #pragma once
 
+#include "RFPowerMonitor.hpp"
 #include "VSLBSP.hpp"
+#include "VSWRProtection.hpp"
 
 // Mercury includes
 #include "system/systemlib/inc/ecmstates.hpp"
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 
 namespace mercury
 {
@@ -16,11 +21,32 @@ namespace mercury
         class MercuryStateHandler final
         {
         public:
+            // Health fault bits, health is OK when none are set. The initialisation and VSWR faults
+            // are raised by the state handler itself, the rest are published by the health monitor.
+            static constexpr uint8_t k_faultInitialisation { 0x01 };
+            static constexpr uint8_t k_faultVSWR { 0x02 };
+            static constexpr uint8_t k_faultFanPSUStatus { 0x04 };
+            static constexpr uint8_t k_faultPSUReadBack { 0x08 };
+            static constexpr uint8_t k_faultPAReadBack { 0x10 };
+            static constexpr uint8_t k_faultRFPower { 0x20 };
+            static constexpr uint8_t k_faultCANBus { 0x40 };
+            static constexpr uint8_t k_faultTelemetry { 0x80 };
+            static constexpr uint8_t k_monitoredFaults { k_faultFanPSUStatus | k_faultPSUReadBack | k_faultPAReadBack |
+                                                         k_faultRFPower | k_faultCANBus | k_faultTelemetry };
+
             MercuryStateHandler() = default;
             ~MercuryStateHandler() = default;
 
-            // Build the object
-            void build(std::shared_ptr<VSLBSP> BSP);
+            // Build the object, the hardware is not touched until initialise() is called
+            void build(std::shared_ptr<VSLBSP> BSP,
+                       std::shared_ptr<RFPowerMonitor> powerMonitor,
+                       std::shared_ptr<VSWRProtection> VSWRProtection);
+
+            // Enable the PSU and fans and move from Started to Initialised (health is not OK if
+            // hardwareOK is false or this fails). Until then the state reads as Started, start
+            // commands are held until initialisation completes and start jamming is ignored.
+            void initialise(bool hardwareOK);
+            bool initialised() const;
 
             // Functions to be called by CAN message handler
             void startCommandReceived();
@@ -31,17 +57,40 @@ namespace mercury
             // Functions to be called by BlackStar application handler
             void applicationLoaded();
 
-            // Get composite state ("WithError" applied if health is not OK)
+            // Functions to be called by VSWR protection, the trip from the protection thread and the
+            // clear from rearm() (on start jamming)
+            void VSWRTripped();
+            void VSWRCleared();
+
+            // Functions to be called by the control socket, the PA is only enabled or unmuted while
+            // jamming with no VSWR trip (returns false if refused or the PA could not be enabled)
+            bool enablePACommandReceived();
+            bool unmutePACommandReceived();
+
+            // Functions to be called by the health monitor, replaces the monitored fault bits
+            void setMonitoredFaults(uint8_t faults);
+
+            // Get composite state ("WithError" applied if health is not OK), these only read the
+            // cached state and health so never block
             sys::EcmState::State currentState() const;
             bool healthOK() const;
+            uint8_t healthFaults() const;
+            bool jamming() const;  // Jamming commanded, whether or not health is OK
 
         private:
+            // Called with the state mutex held
+            bool PACommandAllowed(const char *command) const;
+
             // Note - we only use the states witout "WithError" at the end of them
             // we track the health status separately and return the composite state when
             // currentState() is called
-            sys::EcmState::State m_state { sys::EcmState::Started };
-            bool m_healthOK { true };
+            std::atomic<sys::EcmState::State> m_state { sys::EcmState::Started };
+            std::mutex m_stateMutex;  // Held for state transitions
+            bool m_startRequested { false };
+            std::atomic<uint8_t> m_faults { 0u };
             std::shared_ptr<VSLBSP> m_BSP { nullptr };
+            std::shared_ptr<RFPowerMonitor> m_powerMonitor { nullptr };
+            std::shared_ptr<VSWRProtection> m_VSWRProtection { nullptr };
         };
     }
 }
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mercury::blackstar
+{
+    // Metrics is the daemon's registry of runtime counters and latency histograms. Each thread
+    // updates its own shard (allocated on its first update, cache line aligned so no two threads
+    // write to the same line), an update is a relaxed load and store with no locked instruction
+    // or system call. collect() sums the shards, so a total may be a moment out of date but never
+    // goes backwards. Threads which name themselves with registerThread() are listed with their
+    // CPU time (CLOCK_THREAD_CPUTIME_ID) whether or not they update anything.
+    class Metrics final
+    {
+    public:
+        enum class Counter : uint8_t
+        {
+            CANFramesReceived = 0,
+            CANBytesReceived,
+            CANFramesSent,
+            CANBytesSent,
+            CANSendErrors,
+            CANErrorFrames,
+            MessagesReceived,  // Complete messages, whether or not the CRC is good
+            CRCFailures,
+            NotRecognised,     // Commands answered with NotRecognised
+            ReassemblyAborts,  // Partial messages discarded
+            StartCommands,
+            StartJammingCommands,
+            StopJammingCommands,
+            ZeroiseCommands,
+            VSWRTrips
+        };
+        static constexpr size_t k_numberCounters { 15u };
+
+        enum class Histogram : uint8_t
+        {
+            MessageProcessing = 0,  // Complete message received to response ready
+            StartJamming,           // Start jamming command to PA unmuted
+            StopJamming             // Stop jamming command to PA muted and disabled
+        };
+        static constexpr size_t k_numberHistograms { 3u };
+
+        // Bucket upper bounds are k_firstBucket_ns doubling, the last bucket has no upper bound
+        static constexpr size_t k_numberBuckets { 17u };
+        static constexpr uint64_t k_firstBucket_ns { 1000u };
+
+        // Distinct command IDs counted per thread, further command IDs are not counted
+        static constexpr size_t k_commandSlots { 64u };
+
+        static constexpr size_t k_cacheLineSize { 64u };
+
+        struct HistogramSnapshot
+        {
+            std::array<uint64_t, k_numberBuckets> buckets {};  // Not cumulative
+            uint64_t count { 0u };
+            uint64_t sum_ns { 0u };
+        };
+
+        struct ThreadSnapshot
+        {
+            std::string name;
+            uint64_t CPU_ns { 0u };
+            bool running { false };
+        };
+
+        struct Snapshot
+        {
+            uint64_t timestamp_ns { 0u };  // CLOCK_REALTIME
+            std::array<uint64_t, k_numberCounters> counters {};
+            std::vector<std::pair<uint16_t, uint64_t>> commands;  // Command ID, count (ascending IDs)
+            std::array<HistogramSnapshot, k_numberHistograms> histograms {};
+            std::vector<ThreadSnapshot> threads;
+        };
+
+        // Name the calling thread so that its CPU time is reported under that name, other than on
+        // the main thread this is also the OS thread name (truncated to 15 characters)
+        static void registerThread(const char *name);
+
+        static void add(Counter counter, uint64_t value)
+        {
+            std::atomic<uint64_t>& total { shard().counters[static_cast<size_t>(counter)] };
+            total.store(total.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        static void increment(Counter counter)
+        {
+            add(counter, 1u);
+        }
+
+        static void observe(Histogram histogram, uint64_t value_ns)
+        {
+            HistogramShard& data { shard().histograms[static_cast<size_t>(histogram)] };
+            std::atomic<uint64_t>& bucket { data.buckets[bucketIndex(value_ns)] };
+            bucket.store(bucket.load(std::memory_order_relaxed) + 1u, std::memory_order_relaxed);
+            data.sum_ns.store(data.sum_ns.load(std::memory_order_relaxed) + value_ns, std::memory_order_relaxed);
+        }
+
+        // Messages received per command ID
+        static void countCommand(uint16_t commandID);
+
+        static void collect(Snapshot& snapshot);
+
+        // One counter summed over every thread
+        static uint64_t total(Counter counter);
+
+        // Prometheus metric name and help text
+        static const char *name(Counter counter);
+        static const char *help(Counter counter);
+        static const char *name(Histogram histogram);
+        static const char *help(Histogram histogram);
+
+        static uint64_t bucketBound_ns(size_t bucket)
+        {
+            return k_firstBucket_ns << bucket;
+        }
+
+        static size_t bucketIndex(uint64_t value_ns)
+        {
+            uint64_t units { (value_ns + k_firstBucket_ns - 1u) / k_firstBucket_ns };
+            size_t index { (units <= 1u) ? 0u : static_cast<size_t>(64 - __builtin_clzll(units - 1u)) };
+            return (index < k_numberBuckets) ? index : (k_numberBuckets - 1u);
+        }
+
+    private:
+        friend struct MetricsState;
+        friend struct ThreadExit;
+
+        struct HistogramShard
+        {
+            std::array<std::atomic<uint64_t>, k_numberBuckets> buckets {};
+            std::atomic<uint64_t> sum_ns { 0u };
+        };
+
+        // Written only by the owning thread. A command slot's ID (plus one, zero is free) is
+        // written once, after its count has been zeroed.
+        struct alignas(k_cacheLineSize) Shard
+        {
+            std::array<std::atomic<uint64_t>, k_numberCounters> counters {};
+            std::array<HistogramShard, k_numberHistograms> histograms {};
+            std::array<std::atomic<uint32_t>, k_commandSlots> commandIDs {};
+            std::array<std::atomic<uint64_t>, k_commandSlots> commandCounts {};
+
+            // Set by registerThread, the name is written before named is set
+            std::array<char, 16> name {};
+            std::atomic_bool named { false };
+            clockid_t CPUClock {};
+            std::atomic_bool running { true };
+            std::atomic<uint64_t> finalCPU_ns { 0u };
+        };
+
+        static Shard& shard()
+        {
+            Shard *current { t_shard };
+            return (current != nullptr) ? *current : attach();
+        }
+
+        // Allocate the calling thread's shard
+        static Shard& attach();
+
+        static inline thread_local Shard *t_shard { nullptr };
+    };
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "EventLoop.hpp"
+#include "MercuryStateHandler.hpp"
+#include "Metrics.hpp"
+#include "VSLBSP.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mercury::blackstar
+{
+    // MetricsServer serves the metrics registry, the bus scheduler statistics and the current
+    // state on a Unix domain stream socket, from the main event loop. A client connects, sends a
+    // request and reads until the server closes the connection:
+    //   "text\n"          Prometheus text exposition format
+    //   "binary\n"        the compact binary format below
+    //   "GET <path> ..."  an HTTP/1.0 request, answered with the text format (for
+    //                     curl --unix-socket or a Prometheus proxy)
+    // Binary format, multi-byte values little endian:
+    //   "BSMT", version (1 byte), CLOCK_REALTIME timestamp ns (8)
+    //   counter count (1), counters (8 each, Metrics::Counter order)
+    //   command count (2), per command: ID (2), count (8)
+    //   histogram count (1), bucket count (1), first bucket bound ns (8), per histogram:
+    //     bucket counts (8 each, not cumulative), count (8), sum ns (8)
+    //   thread count (1), per thread: name length (1), name, running (1), CPU time ns (8)
+    //   bus count (1), per bus: name length (1), name, busy ns (8), elapsed ns (8), priority
+    //     count (1), per priority: transactions, failures, retries, total wait ns, total time ns (8 each)
+    //   ECM state (2), health faults (1)
+    class MetricsServer final
+    {
+    public:
+        static constexpr const char *k_socketPath { "/run/BlackStarECM.metrics" };
+        static constexpr uint8_t k_binaryVersion { 1u };
+        static constexpr size_t k_maxRequestSize { 512u };
+
+        MetricsServer() = default;
+        ~MetricsServer();
+
+        // The state handler may be null
+        void build(std::shared_ptr<VSLBSP> BSP, std::shared_ptr<MercuryStateHandler> stateHandler);
+
+        // Any stale socket at the path is replaced, returns false if the socket could not be created
+        bool listen(EventLoop& eventLoop, const std::string& path = k_socketPath);
+
+        void text(std::string& output) const;
+        void binary(std::vector<uint8_t>& output) const;
+
+        // Client side: send a request to the daemon and read the whole reply, returns false if the
+        // daemon is not running
+        static bool fetch(const std::string& request, std::string& reply, const std::string& path = k_socketPath);
+
+    private:
+        static constexpr size_t k_maxConnections { 8u };
+
+        void accept();
+        void receive(int fd);
+        void closeConnection(int fd);
+
+        std::shared_ptr<VSLBSP> m_BSP { nullptr };
+        std::shared_ptr<MercuryStateHandler> m_stateHandler { nullptr };
+
+        EventLoop *m_eventLoop { nullptr };
+        std::string m_path;
+        int m_listenfd { -1 };
+        std::vector<int> m_connections;
+    };
+}
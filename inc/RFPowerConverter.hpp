@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace mercury::blackstar
+{
+    // Result of converting a block of RF power monitor readings
+    struct RFPowerWindow
+    {
+        uint64_t timestamp_ns { 0u };  // Timestamp of the last reading in the block
+        uint32_t sampleCount { 0u };
+        float forward_dBm { 0.0f };    // Mean power over the block
+        float reverse_dBm { 0.0f };
+        float returnLoss_dB { 0.0f };  // From mean forward and reverse power
+        float minReturnLoss_dB { 0.0f };
+        float VSWR { 1.0f };           // From mean forward and reverse power
+        float maxVSWR { 1.0f };
+    };
+
+    // RFPowerConverter turns blocks of raw RF power monitor ADC codes into calibrated forward and
+    // reverse power, return loss and VSWR.
+    // The calibration is a set of (detector voltage, power) points, expanded into per-ADC-code lookup
+    // tables (dBm and mW) so that conversion is a table gather followed by straight-line arithmetic
+    // over structure-of-arrays blocks which the compiler can vectorise. Logarithms of block averages
+    // use a mantissa lookup table instead of log10.
+    // Only the nominal log detector calibration is used: the ECM has no source of factory calibration
+    // or of the transmit frequency, so there is a single calibration for every band.
+    class RFPowerConverter final
+    {
+    public:
+        static constexpr size_t k_maxBlockSize { 64u };
+        static constexpr size_t k_ADCCodes { 4096u };
+
+        // Mercury calibration type of the nominal calibration, the only type supported
+        static constexpr uint8_t k_calibrationTypeNominal { 0u };
+
+        struct CalibrationPoint
+        {
+            uint16_t detector_mV;
+            float power_dBm;
+        };
+
+        RFPowerConverter();
+        ~RFPowerConverter() = default;
+
+        // Convert up to k_maxBlockSize readings, returns false if count is 0 or too large
+        bool convert(const uint16_t *forwardADC,
+                     const uint16_t *reverseADC,
+                     size_t count,
+                     RFPowerWindow& window) const;
+
+        // Convert a single reading (table lookups only) for per-reading checks
+        void convert(uint16_t forwardADC, uint16_t reverseADC, float& forward_dBm, float& returnLoss_dB) const;
+
+        // log10 using a mantissa lookup table, x must be > 0
+        static float fastLog10(float x);
+
+    private:
+        struct Tables
+        {
+            std::array<float, k_ADCCodes> forward_dBm;
+            std::array<float, k_ADCCodes> forward_mW;
+            std::array<float, k_ADCCodes> reverse_dBm;
+            std::array<float, k_ADCCodes> reverse_mW;
+        };
+
+        using Calibration = std::vector<CalibrationPoint>;
+
+        static void buildTable(const Calibration& points,
+                               std::array<float, k_ADCCodes>& power_dBm,
+                               std::array<float, k_ADCCodes>& power_mW);
+
+        // Built once by the constructor and only read after that
+        std::unique_ptr<Tables> m_tables;
+    };
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "Heartbeat.hpp"
+#include "RFPowerConverter.hpp"
+#include "SnapshotRing.hpp"
+#include "VSLBSP.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace mercury::blackstar
+{
+    // Single RF power monitor reading
+    struct RFPowerReading
+    {
+        uint64_t timestamp_ns { 0u };  // CLOCK_MONOTONIC time of the reading
+        uint32_t forward_mV { 0u };
+        uint32_t reverse_mV { 0u };
+        uint16_t forwardADC { 0u };
+        uint16_t reverseADC { 0u };
+    };
+
+    // Latest reading plus statistics over the most recent window of readings
+    struct RFPowerSnapshot
+    {
+        RFPowerReading latest;
+        uint64_t readingCount { 0u };  // Total number of readings taken
+        uint32_t windowSize { 0u };    // Number of readings the statistics below cover
+        uint32_t forwardMean_mV { 0u };
+        uint32_t forwardMin_mV { 0u };
+        uint32_t forwardMax_mV { 0u };
+        uint32_t reverseMean_mV { 0u };
+        uint32_t reverseMin_mV { 0u };
+        uint32_t reverseMax_mV { 0u };
+    };
+
+    // RFPowerMonitor samples the RF power monitor ADC on its own thread and publishes the
+    // readings to lock-free rings so that consumers never have to touch the SPI bus.
+    // The sample rate adapts to the jamming state: fast while jamming, slow in standby.
+    // Readings are also batch converted to calibrated power, return loss and VSWR in blocks of
+    // up to RFPowerConverter::k_maxBlockSize readings (or k_maxBlockAge, whichever comes first).
+    class RFPowerMonitor final
+    {
+    public:
+        static constexpr size_t k_readingRingSize { 1024u };
+        static constexpr size_t k_windowSize { 32u };
+
+        using ReadingRing = SnapshotRing<RFPowerReading, k_readingRingSize>;
+
+        RFPowerMonitor() = default;
+        ~RFPowerMonitor() = default;
+
+        void build(std::shared_ptr<VSLBSP> BSP);
+        void run();
+        void stop();
+
+        // Progress is reported on the heartbeat (if set) after every reading attempt
+        void setHeartbeat(std::shared_ptr<Heartbeat> heartbeat);
+
+        // Sample rates used while jamming and while not jamming
+        void setSampleRates(uint32_t jamming_Hz, uint32_t standby_Hz);
+        void setJamming(bool jamming);
+
+        // Returns false if no readings have been taken yet
+        bool latest(RFPowerSnapshot& snapshot) const;
+
+        // Returns false if no block of readings has been converted yet
+        bool latestWindow(RFPowerWindow& window) const;
+
+        // Conversion stage, for consumers which convert single readings
+        const RFPowerConverter& converter() const;
+
+        // Every reading taken, for consumers which need to follow all readings
+        const ReadingRing& readings() const;
+
+        // Called on the sampler thread after each reading is added to readings(), must be set before
+        // run()
+        void setReadingAction(std::function<void()> readingAction);
+
+    private:
+        static constexpr uint32_t k_defaultJammingRate_Hz { 1000u };
+        static constexpr uint32_t k_defaultStandbyRate_Hz { 10u };
+        static constexpr std::chrono::milliseconds k_maxBlockAge { 100 };
+
+        void start();
+        bool takeReading();
+        void publishSnapshot(const RFPowerReading& reading);
+        void convertBlock(const RFPowerReading& reading);
+        std::chrono::nanoseconds samplePeriod() const;
+
+        std::shared_ptr<VSLBSP> m_BSP { nullptr };
+        std::shared_ptr<Heartbeat> m_heartbeat { nullptr };
+        std::function<void()> m_readingAction;
+        std::thread m_RFPowerMonitorThread;
+        std::atomic_bool m_stopRequested { false };
+        std::atomic_bool m_jamming { false };
+        std::atomic<uint32_t> m_jammingRate_Hz { k_defaultJammingRate_Hz };
+        std::atomic<uint32_t> m_standbyRate_Hz { k_defaultStandbyRate_Hz };
+
+        // Used to wake the sampler early when the rate changes or stop is requested
+        std::mutex m_wakeMutex;
+        std::condition_variable m_wakeCondition;
+        bool m_wakeRequested { false };
+
+        ReadingRing m_readings;
+        SnapshotRing<RFPowerSnapshot, 4u> m_snapshots;
+
+        // Window of recent readings, only accessed by the sampler thread
+        std::array<RFPowerReading, k_windowSize> m_window {};
+        uint64_t m_forwardWindowSum_mV { 0u };
+        uint64_t m_reverseWindowSum_mV { 0u };
+
+        // Conversion stage, the block is only accessed by the sampler thread
+        RFPowerConverter m_converter;
+        SnapshotRing<RFPowerWindow, 4u> m_windows;
+        alignas(32) std::array<uint16_t, RFPowerConverter::k_maxBlockSize> m_blockForwardADC {};
+        alignas(32) std::array<uint16_t, RFPowerConverter::k_maxBlockSize> m_blockReverseADC {};
+        size_t m_blockCount { 0u };
+        uint64_t m_blockStart_ns { 0u };
+    };
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "VSLBSP.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace mercury::blackstar
+{
+    // RFPowerStreamer samples the RF power monitor at a fixed rate and streams the readings to
+    // standard output, for characterising the PA without starting a process per reading.
+    // Output is buffered and only written when the buffer is full or the stream ends.
+    //
+    // CSV output is one line per record, the first field is the record type:
+    //   sample,time_ns,forward_mV,reverse_mV
+    //   window,time_ns,count,forwardMin_mV,forwardMean_mV,forwardMax_mV,reverseMin_mV,reverseMean_mV,reverseMax_mV
+    // Binary output (all fields little endian) is a 16 byte header:
+    //   magic "BSRF", version (16 bits), reserved (16 bits), rate_Hz (32 bits), window (32 bits)
+    // followed by records, each starting with a type byte and 7 reserved bytes then time_ns (64 bits):
+    //   type 1, sample: forward_mV, reverse_mV (32 bits each), 24 bytes in total
+    //   type 2, window: count, then min, mean, max forward_mV, then reverse_mV (32 bits each), 44 bytes in total
+    // Times are from the start of the stream, a window record ends each window of readings.
+    class RFPowerStreamer final
+    {
+    public:
+        enum class Format
+        {
+            CSV,
+            Binary
+        };
+
+        struct Settings
+        {
+            uint32_t rate_Hz { 1000u };                // 1 to k_maxRate_Hz
+            std::chrono::milliseconds duration { 0 };  // Zero for no limit
+            uint64_t count { 0u };                     // Samples to take, zero for no limit
+            Format format { Format::CSV };
+            uint32_t window { 0u };                    // Readings per statistics window, zero for none
+        };
+
+        static constexpr uint32_t k_maxRate_Hz { 1000000u };
+        static constexpr uint8_t k_binaryVersion { 1u };
+        static constexpr uint8_t k_recordSample { 1u };
+        static constexpr uint8_t k_recordWindow { 2u };
+
+        RFPowerStreamer() = default;
+        ~RFPowerStreamer() = default;
+
+        void build(std::shared_ptr<VSLBSP> BSP, const Settings& settings);
+
+        // Stream until the duration or count is reached, SIGINT/SIGTERM is received or standard
+        // output is closed, then report the achieved sample rate on standard error. Returns false
+        // if the stream could not be started.
+        bool run();
+
+    private:
+        static constexpr size_t k_bufferSize { 65536u };
+        static constexpr uint32_t k_signalCheckInterval { 256u };
+
+        struct Window
+        {
+            uint32_t count { 0u };
+            uint32_t forwardMin_mV { UINT32_MAX };
+            uint32_t forwardMax_mV { 0u };
+            uint64_t forwardSum_mV { 0u };
+            uint32_t reverseMin_mV { UINT32_MAX };
+            uint32_t reverseMax_mV { 0u };
+            uint64_t reverseSum_mV { 0u };
+        };
+
+        void writeHeader();
+        void writeSample(uint64_t time_ns, uint32_t forward_mV, uint32_t reverse_mV);
+        void writeWindow(uint64_t time_ns);
+        void append(const char *data, size_t size);
+        void appendLE(uint64_t value, size_t size);
+        void flush();
+
+        std::shared_ptr<VSLBSP> m_BSP { nullptr };
+        Settings m_settings;
+        Window m_window;
+        std::vector<char> m_buffer;
+        bool m_outputFailed { false };
+    };
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "EPUHardware.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace mercury::blackstar
+{
+    // SimulatedHardware models the parts of the EPU-4562 used by VSLBSP so that the application
+    // can run without the board (e.g. against a vcan interface):
+    //   DIO channels, with GPIO1-8 (channels 0x10-0x17) mirrored in the FPGA auxiliary output
+    //   register and input change interrupts raised as the VersaAPI DIO signal;
+    //   the fan/PSU controller register file on the primary I2C bus;
+    //   the ADC122S051 RF power monitor on SPI, including its one-conversion pipeline, with
+    //   forward and reverse codes from a scriptable source while the PSU and PA are enabled and
+    //   the PA is unmuted (idle codes otherwise);
+    //   the on-board analog inputs (settable voltages, nominal board supplies and temperatures
+    //   by default) and the fan tachometer (k_fanRPM while the fans are enabled);
+    //   the watchdog, which logs instead of resetting the board.
+    // Each operation takes the time it would on the board (bus time at the configured frequency
+    // plus a fixed overhead) and the buses are serialised as they are on the board.
+    class SimulatedHardware final : public EPUHardware
+    {
+    public:
+        struct Latencies
+        {
+            std::chrono::nanoseconds DIO { 2000 };           // Per DIO channel operation
+            std::chrono::nanoseconds FPGA { 1000 };          // Per FPGA register access
+            std::chrono::nanoseconds I2COverhead { 20000 };  // Per I2C transaction, added to the bus time
+            std::chrono::nanoseconds SPIOverhead { 5000 };   // Per SPI frame, added to the bus time
+            bool busTime { true };                           // Include the time to clock the bits
+        };
+
+        // Returns the forward and reverse ADC codes for the time since the hardware was opened
+        using ADCSource = std::function<void(std::chrono::nanoseconds time, uint16_t& forward, uint16_t& reverse)>;
+
+        static constexpr uint16_t k_idleADC { 40u };
+        static constexpr uint16_t k_defaultForwardADC { 1946u };  // 25 dBm (nominal calibration)
+        static constexpr uint16_t k_defaultReverseADC { 1536u };  // 5 dBm, 20 dB return loss
+        static constexpr uint16_t k_fanRPM { 4200u };
+
+        SimulatedHardware() = default;
+        ~SimulatedHardware() override;
+
+        void setLatencies(const Latencies& latencies);
+        void setADCSource(ADCSource source);
+
+        // Script lines are "<duration_ms> <forwardADC> <reverseADC>" ('#' starts a comment), the
+        // script repeats from the start once the last line has run. Returns false if the file
+        // can't be read or has no valid lines.
+        bool loadADCScript(const std::string& path);
+
+        // Drive an input channel (raises the DIO interrupt signal if enabled for the channel)
+        void setDIOInput(uint8_t channel, bool high);
+        void setAnalogInput(uint8_t channel, double volts);
+        void setFanPSUStatus(uint8_t status);
+        uint8_t fanPSURegister(uint8_t address) const;
+
+        bool open() override;
+        void close() override;
+
+        void setDIODirection(uint8_t channel, bool input) override;
+        void setDIOLevel(uint8_t channel, bool high) override;
+        bool DIOLevel(uint8_t channel) override;
+
+        int DIOInterruptSignal() const override;
+        bool enableDIOInterrupts(uint32_t channels) override;
+        void disableDIOInterrupts(uint32_t channels) override;
+        void clearDIOInterrupts(uint32_t channels) override;
+
+        bool readFPGARegister(uint32_t offset, uint8_t& data) override;
+        bool writeFPGARegister(uint32_t offset, uint8_t data) override;
+
+        bool setI2CFrequency(uint32_t frequency_Hz) override;
+        uint32_t I2CMaxFrequency() override;
+        bool readI2CRegister(uint8_t chipAddress, uint8_t address, uint8_t& data) override;
+        bool writeI2CRegister(uint8_t chipAddress, uint8_t address, uint8_t data) override;
+
+        bool configureSPI(uint32_t clockFrequency_Hz, uint8_t mode, uint32_t frameSize) override;
+        bool setSPIFrameSize(uint32_t frameSize) override;
+        bool writeSPIFrame(uint32_t data) override;
+        bool readSPIFrame(uint32_t& data) override;
+
+        bool configureAnalogAutoScan(uint8_t channels) override;
+        bool readAnalogInputs(uint8_t channels, AnalogInputs& volts) override;
+
+        bool fanRPM(uint8_t pulsesPerRevolution, uint16_t& RPM) override;
+
+        bool enableWatchdog(uint8_t timeout_s) override;
+        void setWatchdogTimeout(uint8_t timeout_s) override;
+        void disableWatchdog() override;
+
+    private:
+        static constexpr size_t k_numberDIOChannels { 32u };
+
+        void delay(std::chrono::nanoseconds duration) const;
+        std::chrono::nanoseconds busTime(uint32_t bits, uint32_t frequency_Hz) const;
+        uint16_t convert(uint8_t channel);
+        void watchdog();
+
+        Latencies m_latencies;
+        ADCSource m_ADCSource;
+        std::chrono::steady_clock::time_point m_openTime;
+        bool m_open { false };
+
+        // DIO and FPGA state
+        mutable std::mutex m_DIOMutex;
+        std::array<bool, k_numberDIOChannels> m_DIOLevels {};
+        std::array<bool, k_numberDIOChannels> m_DIOInputs {};
+        uint32_t m_DIOInterruptsEnabled { 0u };
+        uint32_t m_DIOInterruptsPending { 0u };
+        std::array<uint8_t, 256> m_FPGARegisters {};
+
+        // I2C bus and fan/PSU controller register file
+        mutable std::mutex m_I2CMutex;
+        uint32_t m_I2CFrequency_Hz { 100000u };
+        std::array<uint8_t, 256> m_fanPSURegisters {};
+
+        // SPI bus and ADC122S051 state
+        std::mutex m_SPIMutex;
+        uint32_t m_SPIClockFrequency_Hz { 0u };
+        uint32_t m_SPIFrameSize { 0u };
+        uint32_t m_SPIReadData { 0u };
+        uint8_t m_ADCChannel { 0u };  // Channel converted in the next frame
+
+        // On-board ADC (on the SPI bus)
+        uint8_t m_analogAutoScanChannels { 0u };
+        AnalogInputs m_analogInputs { 2.545, 3.0, 2.5, 3.3, 0.85, 0.80, 0.0, 0.0 };
+
+        // Watchdog
+        std::thread m_watchdogThread;
+        std::mutex m_watchdogMutex;
+        std::condition_variable m_watchdogCondition;
+        uint8_t m_watchdogTimeout_s { 0u };
+        bool m_watchdogKicked { false };
+        std::atomic_bool m_watchdogStopRequested { false };
+    };
+}
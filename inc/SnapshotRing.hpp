@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace mercury::blackstar
+{
+    // SnapshotRing is a fixed size, lock-free ring buffer with a single writer and any number of
+    // readers. Each slot is protected by its own sequence number (seqlock) so readers never block
+    // the writer; a reader which races with the writer simply retries or reports the entry as lost.
+    // Entries are identified by their index (0 = first entry ever pushed) so a reader can follow
+    // every entry using a cursor, or just take the latest one.
+    template<typename T, size_t N>
+    class SnapshotRing final
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "SnapshotRing entries must be trivially copyable");
+        static_assert((N > 0u) && ((N & (N - 1u)) == 0u), "SnapshotRing size must be a power of two");
+
+    public:
+        SnapshotRing() = default;
+        ~SnapshotRing() = default;
+
+        // Writer: add an entry, overwriting the oldest entry if the ring is full
+        void push(const T& value)
+        {
+            uint64_t index { m_count.load(std::memory_order_relaxed) };
+            Slot& slot { m_slots[index & k_indexMask] };
+
+            // Odd sequence number marks the slot as being written
+            slot.sequence.store((index * 2u) + 1u, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.value = value;
+            slot.sequence.store((index * 2u) + 2u, std::memory_order_release);
+
+            m_count.store(index + 1u, std::memory_order_release);
+        }
+
+        // Total number of entries pushed since construction
+        uint64_t count() const
+        {
+            return m_count.load(std::memory_order_acquire);
+        }
+
+        // Reader: get the entry with the given index, returns false if the entry has not been
+        // written yet or has already been overwritten
+        bool read(uint64_t index, T& value) const
+        {
+            bool ok { false };
+
+            if (index < count())
+            {
+                const Slot& slot { m_slots[index & k_indexMask] };
+                const uint64_t expectedSequence { (index * 2u) + 2u };
+
+                if (slot.sequence.load(std::memory_order_acquire) == expectedSequence)
+                {
+                    value = slot.value;
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    ok = (slot.sequence.load(std::memory_order_relaxed) == expectedSequence);
+                }
+            }
+
+            return ok;
+        }
+
+        // Reader: get the most recent entry, returns false if nothing has been pushed yet
+        bool latest(T& value) const
+        {
+            bool ok { false };
+            uint64_t available { 0u };
+
+            // Only fails if the writer laps the reader between reading the count and the slot
+            while (!ok && ((available = count()) > 0u))
+            {
+                ok = read(available - 1u, value);
+            }
+
+            return ok;
+        }
+
+        static constexpr size_t capacity()
+        {
+            return N;
+        }
+
+    private:
+        static constexpr uint64_t k_indexMask { N - 1u };
+
+        struct alignas(64) Slot
+        {
+            std::atomic<uint64_t> sequence { 0u };
+            T value {};
+        };
+
+        std::array<Slot, N> m_slots {};
+        alignas(64) std::atomic<uint64_t> m_count { 0u };
+    };
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace mercury::blackstar
+{
+    // StartupTimer logs how long each startup phase took and how long after the start of the
+    // process it completed. Phases may run on more than one thread, each thread chains its own
+    // phases by passing the previous phase end time as the next phase start.
+    class StartupTimer final
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        StartupTimer() = default;
+        ~StartupTimer() = default;
+
+        clock::time_point start() const
+        {
+            return m_start;
+        }
+
+        // Logs the phase and returns its end time
+        clock::time_point phaseComplete(const std::string& name, clock::time_point phaseStart) const
+        {
+            clock::time_point now { clock::now() };
+            std::cout << "Startup phase " << name << " took " << std::fixed << std::setprecision(1)
+                      << milliseconds(now - phaseStart) << " ms, " << milliseconds(now - m_start)
+                      << " ms since start" << std::defaultfloat << std::endl;
+            return now;
+        }
+
+    private:
+        static double milliseconds(clock::duration duration)
+        {
+            return std::chrono::duration<double, std::milli> { duration }.count();
+        }
+
+        clock::time_point m_start { clock::now() };
+    };
+}
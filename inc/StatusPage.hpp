@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mercury::blackstar
+{
+    // StatusPage is the daemon status published in a POSIX shared memory segment for supervisory
+    // tools. The daemon updates it when the state changes and on a fixed tick, a tool maps it
+    // read-only with StatusPageReader and can read it at any rate without a system call or any
+    // effect on the daemon. This header doesn't depend on the rest of the daemon so that it can
+    // be copied into a tool on its own.
+    // The data is protected by a sequence number (seqlock): odd while the daemon is writing, a
+    // reader copies the data and retries if the sequence number changed during the copy.
+    struct StatusPage final
+    {
+        static constexpr const char *k_name { "/BlackStarECM.status" };
+        static constexpr uint32_t k_magic { 0x53534342u };  // "BCSS"
+        static constexpr uint16_t k_version { 1u };
+        static constexpr size_t k_numberBoardValues { 8u };
+
+        // Flag bits
+        static constexpr uint8_t k_flagRunning { 0x01 };  // Cleared when the daemon stops
+        static constexpr uint8_t k_flagInitialised { 0x02 };
+        static constexpr uint8_t k_flagJamming { 0x04 };
+        static constexpr uint8_t k_flagVSWRTripped { 0x08 };
+        static constexpr uint8_t k_flagRFValid { 0x10 };
+        static constexpr uint8_t k_flagFanPSUValid { 0x20 };
+
+        struct Data
+        {
+            uint64_t updateCount;   // Updates published since the daemon started
+            uint64_t timestamp_ns;  // CLOCK_MONOTONIC time of the update
+            uint64_t realTime_ns;   // CLOCK_REALTIME time of the update
+            uint32_t buildID;
+            uint32_t pid;
+
+            uint16_t state;  // Composite ECM state, as answered to GetState
+            uint8_t healthFaults;
+            uint8_t flags;
+            uint8_t CANBusState;  // CANClient::BusState
+            uint8_t ECMSlot;
+            uint8_t fanPSUStatus;
+            uint8_t fanPSUControl;
+
+            // Latest converted block of RF power readings
+            uint64_t RFTimestamp_ns;  // CLOCK_MONOTONIC
+            float forward_dBm;
+            float reverse_dBm;
+            float VSWR;
+            uint32_t VSWRTrips;
+
+            // Board ADC channels (BoardTelemetry::channel scaling), bit n of boardValid is set if
+            // boardValues[n] came from the last scan
+            float boardValues[k_numberBoardValues];
+            uint8_t boardValid;
+            uint8_t reserved[3];
+            uint32_t fanRPM;
+
+            // Totals since the daemon started
+            uint64_t CANFramesReceived;
+            uint64_t CANFramesSent;
+            uint64_t CANErrorFrames;
+            uint64_t messagesReceived;
+            uint64_t CRCFailures;
+            uint64_t I2CTransactions;
+            uint64_t I2CFailures;
+            uint64_t SPITransactions;
+            uint64_t SPIFailures;
+        };
+        static_assert(std::is_trivially_copyable<Data>::value, "StatusPage data must be trivially copyable");
+
+        struct Layout
+        {
+            uint32_t magic;  // Written last when the segment is created
+            uint16_t version;
+            uint16_t dataSize;
+            std::atomic<uint32_t> sequence;
+            uint32_t reserved;
+            Data data;
+        };
+        static_assert(std::atomic<uint32_t>::is_always_lock_free, "StatusPage sequence must be lock-free");
+    };
+
+    // StatusPageReader maps the status page read-only
+    class StatusPageReader final
+    {
+    public:
+        static constexpr uint32_t k_maxAttempts { 1000u };
+
+        StatusPageReader() = default;
+        ~StatusPageReader()
+        {
+            close();
+        }
+
+        StatusPageReader(const StatusPageReader&) = delete;
+        StatusPageReader& operator=(const StatusPageReader&) = delete;
+
+        // Returns false if the daemon isn't running (or the page is from an incompatible version)
+        bool open(const std::string& name = StatusPage::k_name)
+        {
+            close();
+
+            int fd { ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0) };
+            if (fd < 0)
+            {
+                return false;
+            }
+
+            struct stat status {};
+            bool ok { (::fstat(fd, &status) == 0) &&
+                      (static_cast<size_t>(status.st_size) >= sizeof(StatusPage::Layout)) };
+            void *address { ok ? ::mmap(nullptr, sizeof(StatusPage::Layout), PROT_READ, MAP_SHARED, fd, 0)
+                               : MAP_FAILED };
+            ::close(fd);
+            if (address == MAP_FAILED)
+            {
+                return false;
+            }
+
+            m_page = static_cast<const StatusPage::Layout *>(address);
+            if ((m_page->magic != StatusPage::k_magic) || (m_page->version != StatusPage::k_version) ||
+                (m_page->dataSize != sizeof(StatusPage::Data)))
+            {
+                close();
+                return false;
+            }
+            return true;
+        }
+
+        void close()
+        {
+            if (m_page != nullptr)
+            {
+                ::munmap(const_cast<StatusPage::Layout *>(m_page), sizeof(StatusPage::Layout));
+                m_page = nullptr;
+            }
+        }
+
+        // Copy the latest status, returns false if not open or the daemon was writing on every
+        // attempt. Check k_flagRunning and the timestamp to tell whether the status is current.
+        bool read(StatusPage::Data& data) const
+        {
+            for (uint32_t attempt = 0; (m_page != nullptr) && (attempt < k_maxAttempts); attempt++)
+            {
+                uint32_t before { m_page->sequence.load(std::memory_order_acquire) };
+                if ((before & 1u) == 0u)
+                {
+                    std::memcpy(&data, &m_page->data, sizeof(data));
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (m_page->sequence.load(std::memory_order_relaxed) == before)
+                    {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+    private:
+        const StatusPage::Layout *m_page { nullptr };
+    };
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "BoardTelemetry.hpp"
+#include "CANClient.hpp"
+#include "Heartbeat.hpp"
+#include "MercuryStateHandler.hpp"
+#include "RFPowerMonitor.hpp"
+#include "StatusPage.hpp"
+#include "VSLBSP.hpp"
+#include "VSWRProtection.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace mercury::blackstar
+{
+    // StatusPublisher keeps the shared memory status page up to date on its own thread. Every
+    // k_pollPeriod it reads the state, health, CAN bus state and fan/PSU registers (all cached, no
+    // bus access) and publishes if any of them changed, the whole page (RF power, board telemetry
+    // and the counters) is also published every k_tickPeriod. The segment is removed on stop, a
+    // reader which still has it mapped sees k_flagRunning cleared.
+    class StatusPublisher final
+    {
+    public:
+        static constexpr std::chrono::milliseconds k_pollPeriod { 10 };
+        static constexpr std::chrono::milliseconds k_tickPeriod { 200 };
+
+        StatusPublisher() = default;
+        ~StatusPublisher();
+
+        // Any of the sources may be null
+        void build(std::shared_ptr<VSLBSP> BSP,
+                   std::shared_ptr<MercuryStateHandler> stateHandler,
+                   std::shared_ptr<RFPowerMonitor> powerMonitor,
+                   std::shared_ptr<VSWRProtection> VSWRProtection,
+                   std::shared_ptr<BoardTelemetry> boardTelemetry,
+                   std::shared_ptr<CANClient> client,
+                   uint8_t ECMSlot);
+
+        // Create (or replace) the segment, returns false if it could not be created
+        bool open(const std::string& name = StatusPage::k_name);
+
+        void run();
+        void stop();
+
+        // Progress is reported on the heartbeat (if set) every poll period
+        void setHeartbeat(std::shared_ptr<Heartbeat> heartbeat);
+
+    private:
+        void start();
+
+        // Fill in the fields checked every poll, returns true if any of them changed
+        bool poll(StatusPage::Data& data);
+        void tick(StatusPage::Data& data);
+        void publish(StatusPage::Data& data);
+        void close();
+
+        std::shared_ptr<VSLBSP> m_BSP { nullptr };
+        std::shared_ptr<MercuryStateHandler> m_stateHandler { nullptr };
+        std::shared_ptr<RFPowerMonitor> m_powerMonitor { nullptr };
+        std::shared_ptr<VSWRProtection> m_VSWRProtection { nullptr };
+        std::shared_ptr<BoardTelemetry> m_boardTelemetry { nullptr };
+        std::shared_ptr<CANClient> m_CANClient { nullptr };
+        std::shared_ptr<Heartbeat> m_heartbeat { nullptr };
+        uint8_t m_ECMSlot { 0u };
+
+        StatusPage::Layout *m_page { nullptr };
+        std::string m_name;
+
+        std::thread m_statusPublisherThread;
+        std::atomic_bool m_stopRequested { false };
+        std::mutex m_wakeMutex;
+        std::condition_variable m_wakeCondition;
+    };
+}
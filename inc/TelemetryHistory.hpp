@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace mercury::blackstar
+{
+    // TelemetryHistory is a fixed size time series store in a memory mapped file, so the history
+    // survives restarts (and crashes) and can be analysed after a mission. Each metric has its own
+    // ring segment of 16 byte records: wall clock time, a fixed-point value and a sequence number.
+    // Appending is plain stores into the mapping, no system call per record; the kernel writes the
+    // pages back and sync() can be called occasionally to start the write back early.
+    // Every record is published with its sequence number (seqlock), so a record torn by a crash is
+    // dropped when the file is reopened and readers in other processes never see a partial record.
+    // Each metric must only be appended from one thread at a time.
+    class TelemetryHistory final
+    {
+    public:
+        enum class Metric : uint8_t
+        {
+            ForwardPower = 0,  // Mean over a converted block, 0.01 dBm
+            ReversePower,      // Mean over a converted block, 0.01 dBm
+            ReturnLoss,        // From the block means, 0.01 dB
+            FanPSUStatus,      // Fan/PSU controller status register (0x40)
+            State,             // Composite ECM state, on change
+            I2CFailures,       // Bus scheduler totals, on change
+            I2CRetries,
+            SPIFailures,
+            SPIRetries
+        };
+        static constexpr size_t k_numberMetrics { 9u };
+
+        struct Record
+        {
+            uint64_t time_ns { 0u };  // CLOCK_REALTIME
+            int32_t value { 0 };
+        };
+
+        static constexpr const char *k_defaultPath { "/var/log/BlackStarECM.history" };
+        static constexpr uint32_t k_version { 1u };
+
+        TelemetryHistory() = default;
+        ~TelemetryHistory();
+
+        // Open the history file, a writer creates it (or recreates it if the layout has changed)
+        // and carries on from the last complete record of each metric. Returns false if the file
+        // could not be opened (or for a reader, is not a valid history file).
+        bool open(const std::string& path = k_defaultPath, bool writable = true);
+        bool isOpen() const;
+
+        // Writer: append a record with the current time
+        void append(Metric metric, int32_t value);
+
+        // Writer: start writing dirty pages back to the file
+        void sync();
+
+        // Records of the metric with from_ns <= time_ns < to_ns, oldest first. Records are found by
+        // binary search on time, so a wall clock step backwards can hide records from a window.
+        void read(Metric metric,
+                  uint64_t from_ns,
+                  uint64_t to_ns,
+                  const std::function<void(const Record&)>& handler) const;
+
+        // Total number of records appended to the metric (including overwritten ones)
+        uint64_t count(Metric metric) const;
+
+        // Metric names (for the reader tool) and fixed-point scaling
+        static const char *name(Metric metric);
+        static bool metric(const std::string& name, Metric& metric);
+        static uint8_t decimals(Metric metric);
+
+    private:
+        struct Slot
+        {
+            uint64_t time_ns;
+            int32_t value;
+            std::atomic<uint32_t> sequence;  // Low 32 bits of index + 1, zero while being written
+        };
+        static_assert(sizeof(Slot) == 16u, "TelemetryHistory slots must be 16 bytes");
+        static_assert(std::atomic<uint32_t>::is_always_lock_free, "TelemetryHistory needs lock-free atomics");
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "TelemetryHistory needs lock-free atomics");
+
+        struct SegmentHeader
+        {
+            uint64_t offset;    // From the start of the file
+            uint64_t capacity;  // Records, a power of two
+            std::atomic<uint64_t> count;
+            uint64_t reserved;
+        };
+
+        struct FileHeader
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t metricCount;
+            uint32_t slotSize;
+            SegmentHeader segments[k_numberMetrics];
+        };
+
+        static constexpr size_t k_headerSize { 4096u };
+        static_assert(sizeof(FileHeader) <= k_headerSize, "TelemetryHistory header must fit in one page");
+
+        static size_t fileSize();
+        bool layoutValid() const;
+        void initialiseLayout();
+        void recoverCount(SegmentHeader& segment);
+        Slot *slots(Metric metric) const;
+        bool readSlot(Metric metric, uint64_t index, Record& record) const;
+
+        int m_fd { -1 };
+        void *m_mapping { nullptr };
+        size_t m_size { 0u };
+        bool m_writable { false };
+        FileHeader *m_header { nullptr };
+    };
+}
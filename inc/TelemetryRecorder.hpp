@@ -0,0 +1,75 @@
+#pragma once
+
+#include "BoardTelemetry.hpp"
+#include "Heartbeat.hpp"
+#include "MercuryStateHandler.hpp"
+#include "RFPowerMonitor.hpp"
+#include "TelemetryHistory.hpp"
+#include "VSLBSP.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace mercury::blackstar
+{
+    // TelemetryRecorder samples the telemetry sources on its own thread and appends them to the
+    // telemetry history: the latest converted RF power block (when there is a new one) and the
+    // composite state (on change) every period; the fan/PSU status (as published by the board
+    // telemetry) and the bus error counters (on change) every k_slowDivider periods. It is the
+    // only writer of every history metric and never touches the buses itself.
+    class TelemetryRecorder final
+    {
+    public:
+        static constexpr std::chrono::milliseconds k_period { 100 };
+        static constexpr uint32_t k_slowDivider { 10u };
+        static constexpr uint32_t k_syncDivider { 100u };
+
+        TelemetryRecorder() = default;
+        ~TelemetryRecorder() = default;
+
+        void build(std::shared_ptr<TelemetryHistory> history,
+                   std::shared_ptr<VSLBSP> BSP,
+                   std::shared_ptr<RFPowerMonitor> powerMonitor,
+                   std::shared_ptr<BoardTelemetry> boardTelemetry,
+                   std::shared_ptr<MercuryStateHandler> stateHandler);
+        void run();
+        void stop();
+
+        // Progress is reported on the heartbeat (if set) every period
+        void setHeartbeat(std::shared_ptr<Heartbeat> heartbeat);
+
+    private:
+        void start();
+        void recordPower();
+        void recordState();
+        void recordFanPSUStatus();
+        void recordBusErrors();
+        void recordOnChange(TelemetryHistory::Metric metric, int64_t value, int64_t& last);
+
+        std::shared_ptr<TelemetryHistory> m_history { nullptr };
+        std::shared_ptr<VSLBSP> m_BSP { nullptr };
+        std::shared_ptr<RFPowerMonitor> m_powerMonitor { nullptr };
+        std::shared_ptr<BoardTelemetry> m_boardTelemetry { nullptr };
+        std::shared_ptr<MercuryStateHandler> m_stateHandler { nullptr };
+        std::shared_ptr<Heartbeat> m_heartbeat { nullptr };
+
+        std::thread m_telemetryRecorderThread;
+        std::atomic_bool m_stopRequested { false };
+        std::mutex m_wakeMutex;
+        std::condition_variable m_wakeCondition;
+
+        // Only accessed by the recorder thread, the last values are -1 until the first is recorded
+        uint64_t m_lastBlock_ns { 0u };
+        uint64_t m_lastFanPSUStatus_ns { 0u };
+        int64_t m_lastState { -1 };
+        int64_t m_lastI2CFailures { -1 };
+        int64_t m_lastI2CRetries { -1 };
+        int64_t m_lastSPIFailures { -1 };
+        int64_t m_lastSPIRetries { -1 };
+    };
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Clock.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Tracepoints are compiled in if this is non-zero, otherwise they compile to nothing
+#ifndef BLACKSTAR_TRACE
+#define BLACKSTAR_TRACE 0
+#endif
+
+namespace mercury::blackstar
+{
+    template<bool Enabled>
+    class TraceScope;
+
+    // Trace records the frame lifecycle (CAN client, message handler, state handler and bus
+    // transactions) as timed events for latency investigations. Each thread records into its own
+    // lock-free ring, which keeps the most recent k_ringSize events; dump() writes the events of
+    // the last window from every ring as a Chrome trace (JSON, loads in Perfetto or
+    // chrome://tracing). Tracepoints are a TraceScope policy selected at compile time by
+    // BLACKSTAR_TRACE, in a build without it they are empty inline objects and generate no code.
+    // Event names must be string literals (or otherwise outlive any dump).
+    class Trace final
+    {
+    public:
+        static constexpr bool k_enabled { BLACKSTAR_TRACE != 0 };
+        static constexpr size_t k_ringSize { 16384u };  // Events per thread
+        static constexpr std::chrono::milliseconds k_defaultWindow { 1000 };
+        static constexpr const char *k_dumpDirectory { "/var/log" };
+
+        // Times the enclosing scope: Trace::Scope scope { "name" };
+        using Scope = TraceScope<k_enabled>;
+
+        // A zero duration event
+        static void instant(const char *name, uint64_t argument = 0u)
+        {
+            if constexpr (k_enabled)
+            {
+                record(name, Clock::monotonic_ns(), 0u, argument);
+            }
+        }
+
+        // Write the events which started in the last window, returns false if tracing is not
+        // compiled in or the file could not be written
+        static bool dump(const std::string& path, std::chrono::milliseconds window = k_defaultWindow);
+
+        // Dump to a timestamped file in k_dumpDirectory, returns the path (empty on failure)
+        static std::string dump(std::chrono::milliseconds window = k_defaultWindow);
+
+        static void record(const char *name, uint64_t start_ns, uint64_t duration_ns, uint64_t argument);
+    };
+
+    template<>
+    class TraceScope<false> final
+    {
+    public:
+        explicit TraceScope(const char *, uint64_t = 0u)
+        {
+        }
+
+        void setArgument(uint64_t)
+        {
+        }
+    };
+
+    template<>
+    class TraceScope<true> final
+    {
+    public:
+        explicit TraceScope(const char *name, uint64_t argument = 0u)
+            : m_name { name }, m_argument { argument }, m_start_ns { Clock::monotonic_ns() }
+        {
+        }
+
+        ~TraceScope()
+        {
+            Trace::record(m_name, m_start_ns, Clock::monotonic_ns() - m_start_ns, m_argument);
+        }
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+
+        // For an argument only known part way through the scope (e.g. the command ID)
+        void setArgument(uint64_t argument)
+        {
+            m_argument = argument;
+        }
+
+    private:
+        const char *m_name;
+        uint64_t m_argument;
+        uint64_t m_start_ns;
+    };
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "VSLBSP.hpp"
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <linux/can.h>
+
+namespace mercury::blackstar
+{
+    // TrafficReplay feeds recorded CAN traffic through a CAN message handler and state handler
+    // on the simulated BSP, to check the responses against a golden file and to measure the
+    // handler on real command mixes. Capture formats (detected from the content):
+    //   candump log (candump -l):            (1436509052.249713) can0 00A#C0020A3800A1B2
+    //   candump output, with or without -t:  (1436509052.249713)  can0  00A   [8]  C0 02 0A 38 ...
+    //   pcap with the SocketCAN link type (tcpdump -i can0 -w)
+    //   CAN client capture (CANCapture), a single file or the path of the whole capture
+    // Frames are replayed at the recorded pace or as fast as possible. The handler sniffs (as in
+    // the field) unless answering, either way every response it builds is checked.
+    //
+    // A golden file has one line per response: the capture frame number (from 1) which completed
+    // the message, 1 if the response would be sent (0 if not), and the response bytes in hex.
+    // The report is written to standard output, one name=value per line:
+    //   frames, responses, sent, passes, elapsed_s, frames_per_s, responses_per_s,
+    //   ns_per_frame, golden (none, written, match or mismatch), mismatches
+    class TrafficReplay final
+    {
+    public:
+        enum class Pace
+        {
+            Recorded,
+            Fast
+        };
+
+        struct Settings
+        {
+            std::string path;
+            Pace pace { Pace::Fast };
+            std::string golden;           // Golden file to check against (or write), empty for none
+            bool writeGolden { false };   // Write the golden file instead of checking it
+            bool answering { false };     // CANMessageHandler::setAnswering
+            uint32_t passes { 1u };       // Fast passes over the capture, only the first is checked
+        };
+
+        struct Frame
+        {
+            uint64_t timestamp_ns;  // From the capture, zero if it has no timestamps
+            ::can_frame frame;
+        };
+
+        static constexpr size_t k_reportedMismatches { 10u };
+
+        TrafficReplay() = default;
+        ~TrafficReplay() = default;
+
+        void build(std::shared_ptr<VSLBSP> BSP, const Settings& settings);
+
+        // Returns false if the capture or golden file could not be read (or written), or the
+        // responses did not match the golden file
+        bool run();
+
+        // Returns false if the file could not be read or isn't a recognised format
+        static bool load(const std::string& path, std::vector<Frame>& frames);
+
+    private:
+        static bool loadCandump(std::istream& input, std::vector<Frame>& frames);
+        static bool loadPcap(std::istream& input, std::vector<Frame>& frames);
+
+        std::shared_ptr<VSLBSP> m_BSP { nullptr };
+        Settings m_settings;
+    };
+}
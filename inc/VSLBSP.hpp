@@ -1,16 +1,30 @@
 #pragma once
+#include "BusScheduler.hpp"
+#include "EPUHardware.hpp"
+
+#include <atomic>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 
 namespace mercury::blackstar
 {
     class VSLBSP final
     {
     public:
-        VSLBSP();
+        // I2C and SPI transactions are serialised per bus and granted in priority order, callers
+        // pass the priority of the action the transaction is part of
+        using BusPriority = BusScheduler::Priority;
+
+        // All hardware access goes through the hardware primitives, either the VersaLogic API
+        // (VersaLogicHardware) or a simulated board (SimulatedHardware)
+        explicit VSLBSP(std::shared_ptr<EPUHardware> hardware);
         ~VSLBSP();
         
-        // Initialise function opens the VersaLogic API
-        bool initialise();
+        // Initialise function opens the hardware, the I2C bus is run at the requested
+        // frequency (limited to the bus maximum) if the fan/PSU controller passes a read-back
+        // self-test at that frequency, otherwise it falls back to 100 kHz
+        bool initialise(uint32_t I2CFrequency_Hz = k_I2CDefaultFrequency_Hz);
         
         // LED control functions
         void setRFLEDOn();
@@ -22,28 +36,139 @@ namespace mercury::blackstar
         void mutePA();
         void unmutePA();
 
-        // Fan/PSU (I2C) control functions
-        bool resetFanPSUController();
-        bool enableFans();
-        bool disableFans();
-        bool enablePSU();
-        bool disablePSU();
-        bool enablePA();
-        bool disablePA();
+        // DIO output group control - sets every output in mask to its level in levels together.
+        // Uses a single FPGA output register write when the register has been verified on this
+        // board, otherwise one library call per output. Levels are held in a shadow latch so
+        // outputs() and read-modify-write never touch the hardware.
+        void setOutputs(uint8_t mask, uint8_t levels);
+        uint8_t outputs() const;
+
+        // Select the output register (true) or per-output library calls (false), returns false if
+        // the output register was requested but is not available
+        bool setOutputRegisterEnabled(bool enabled);
+        bool outputRegisterAvailable() const;
+
+        // DIO output group bits, these are the on-board GPIO bit positions in the FPGA register
+        static constexpr uint8_t k_outputPAMuteN { 0x08 };    // GPIO4, low = PA muted
+        static constexpr uint8_t k_outputPPSSelect { 0x10 };  // GPIO5, low = internal GNSS receiver
+        static constexpr uint8_t k_outputRFLED { 0x20 };      // GPIO6, high = LED on
+        static constexpr uint8_t k_outputGNSSReset { 0x40 };  // GPIO7, low = GNSS receiver out of reset
+        static constexpr uint8_t k_outputAlertLED { 0x80 };   // GPIO8, high = LED on
+
+        // Fan/PSU (I2C) control functions, reads and read-modify-writes are retried with backoff
+        bool resetFanPSUController(BusPriority priority = BusPriority::State);
+        bool enableFans(BusPriority priority = BusPriority::State);
+        bool disableFans(BusPriority priority = BusPriority::State);
+        bool enablePSU(BusPriority priority = BusPriority::State);
+        bool disablePSU(BusPriority priority = BusPriority::State);
+        bool enablePA(BusPriority priority = BusPriority::State);
+        bool disablePA(BusPriority priority = BusPriority::State);
+        bool getFanPSUStatus(uint8_t& status, BusPriority priority = BusPriority::Telemetry);
+        bool getFanPSUControl(uint8_t& control, BusPriority priority = BusPriority::Telemetry);
+
+        // Fan/PSU control register bits, for checking the enables read back from getFanPSUControl
+        static constexpr uint8_t k_fanPSUControlPSUEnable { 0x01 };
+        static constexpr uint8_t k_fanPSUControlPAEnable { 0x04 };
 
         // RF Power Monitor (SPI) functions
-        bool getRFPowerMonitorReadings(uint32_t& forward_uV, uint32_t& reverse_uV);
+        bool getRFPowerMonitorReadings(uint32_t& forward_mV, uint32_t& reverse_mV);
+        bool getRFPowerMonitorADCReadings(uint16_t& forwardADC,
+                                          uint16_t& reverseADC,
+                                          BusPriority priority = BusPriority::Telemetry);
+        static uint32_t ADCToMillivolts(uint32_t ADC);
+
+        // Streaming RF Power Monitor acquisition keeps the ADC pipeline primed so every SPI
+        // transaction returns a useful conversion. 4-byte frames (both channels per transaction)
+        // are used if allowed and supported, otherwise alternating 2-byte frames.
+        bool startRFPowerMonitorStream(bool allowWideFrames = true);
+        void stopRFPowerMonitorStream();
+        bool readRFPowerMonitorStream(uint16_t& forwardADC,
+                                      uint16_t& reverseADC,
+                                      BusPriority priority = BusPriority::Telemetry);
+        uint32_t RFPowerMonitorStreamFrameSize() const;  // 0 if not streaming
+
+        // Board telemetry functions: on-board analog inputs (auto-scan, see EPUHardware) and the fan
+        // tachometer. The board ADC shares the SPI bus with the RF power monitor, the RF power
+        // monitor SPI configuration (and stream, if running) is restored after each scan.
+        bool configureBoardADC(uint8_t channels, BusPriority priority = BusPriority::Telemetry);
+        bool readBoardADC(uint8_t channels,
+                          EPUHardware::AnalogInputs& volts,
+                          BusPriority priority = BusPriority::Telemetry);
+        bool getFanRPM(uint16_t& RPM);
 
         // ECM slot number function
         uint8_t ECMSlotNumber();
 
+        // DIO input functions, inputs are returned as GPIO bit positions (k_inputX)
+        uint8_t inputs();
+        int inputInterruptSignal() const;
+        // Enable input change interrupts, delivered to this process as inputInterruptSignal(),
+        // returns false if interrupts are not available. The signal must be blocked or handled first.
+        bool enableInputInterrupts();
+        void disableInputInterrupts();
+        void acknowledgeInputInterrupts();
+
+        // DIO input bits
+        static constexpr uint8_t k_inputECMSlot0 { 0x01 };  // GPIO1
+        static constexpr uint8_t k_inputECMSlot1 { 0x02 };  // GPIO2
+        static constexpr uint8_t k_inputECMSlot2 { 0x04 };  // GPIO3
+        static constexpr uint8_t k_inputECMSlotMask { k_inputECMSlot0 | k_inputECMSlot1 | k_inputECMSlot2 };
+
+        // Hardware watchdog functions, kickWatchdog reloads the watchdog with the enabled timeout
+        bool enableWatchdog(uint8_t timeout_s);
+        void kickWatchdog();
+        void disableWatchdog();
+
+        // I2C bus frequency functions
+        bool setI2CFrequency(uint32_t frequency_Hz);
+        uint32_t I2CFrequency() const;
+        uint32_t I2CMaxFrequency() const;
+        bool I2CSelfTest();
+
+        // Bus schedulers, for statistics
+        const BusScheduler& I2CBus() const;
+        const BusScheduler& SPIBus() const;
+
+        // I2C bus frequencies (Hz)
+        static constexpr uint32_t k_I2CStandardFrequency_Hz { 100000u };
+        static constexpr uint32_t k_I2CFastFrequency_Hz { 400000u };
+        static constexpr uint32_t k_I2CDefaultFrequency_Hz { k_I2CFastFrequency_Hz };
+
     private:
         // Fan/PSU register control
-        bool readFanPSURegister(uint8_t address, uint8_t& data);
-        bool writeFanPSURegister(uint8_t address, uint8_t data);
-        bool setFanPSURegisterBits(uint8_t address, uint8_t mask);
-        bool clearFanPSURegisterBits(uint8_t address, uint8_t mask);
+        bool readFanPSURegister(uint8_t address, uint8_t& data, BusPriority priority);
+        bool setFanPSURegisterBits(uint8_t address, uint8_t mask, BusPriority priority);
+        bool clearFanPSURegisterBits(uint8_t address, uint8_t mask, BusPriority priority);
+
+        // Called with the I2C bus granted
+        bool readFanPSURegisterLocked(uint8_t address, uint8_t& data);
+        bool writeFanPSURegisterLocked(uint8_t address, uint8_t data);
+        bool I2CSelfTestLocked();
+
+        // RF Power Monitor helpers, called with the SPI bus granted
+        bool readRFPowerMonitorADCLocked(uint16_t& forwardADC, uint16_t& reverseADC);
+        bool startRFPowerMonitorStreamLocked(bool allowWideFrames);
+        void stopRFPowerMonitorStreamLocked();
+        bool readRFPowerMonitorStreamLocked(uint16_t& forwardADC, uint16_t& reverseADC);
+        bool restoreRFPowerMonitorSPILocked();
+        static uint32_t streamControl();
+
+        // DIO output group helpers
+        bool probeOutputRegister();
+        void setOutputsPerChannel(uint8_t mask, uint8_t levels);
     
+        std::shared_ptr<EPUHardware> m_hardware;
+        BusScheduler m_I2CBus;
+        BusScheduler m_SPIBus;
         bool m_APIOpen { false };
+        uint32_t m_I2CFrequency_Hz { k_I2CStandardFrequency_Hz };
+        uint32_t m_I2CMaxFrequency_Hz { k_I2CStandardFrequency_Hz };
+        std::atomic<uint32_t> m_RFPowerMonitorStreamFrameSize { 0u };
+        uint8_t m_watchdogTimeout_s { 0u };
+
+        mutable std::mutex m_outputMutex;
+        uint8_t m_outputShadow { 0u };
+        bool m_outputRegisterAvailable { false };
+        bool m_outputRegisterEnabled { false };
     };
 }
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Heartbeat.hpp"
+#include "RFPowerConverter.hpp"
+#include "RFPowerMonitor.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace mercury::blackstar
+{
+    // VSWRProtection follows every RF power monitor reading on a high priority thread and trips
+    // when the VSWR (from calibrated forward and reverse power) reaches the trip threshold. The thread
+    // sleeps until the sampler notifies it of a new reading, and the trip action (mute the PA) is
+    // called from the thread so that the time from the breaching reading to the mute is bounded by
+    // the thread's wake-up latency plus the mute time.
+    // A trip latches until rearm() is called (when jamming is restarted): with the PA muted there is
+    // no forward power to measure, so there is no clear threshold, the VSWR can't be seen to fall.
+    class VSWRProtection final
+    {
+    public:
+        struct Statistics
+        {
+            uint32_t tripCount;
+            uint32_t deadlineMisses;
+            uint64_t lastLatency_ns;  // Breaching reading timestamp to trip action complete
+            uint64_t maxLatency_ns;
+            uint64_t readingsLost;    // Readings overwritten before the protection loop saw them
+        };
+
+        // Threshold is VSWR x 100, e.g. 300 = 3.00:1
+        static constexpr uint16_t k_defaultTrip_cVSWR { 300u };
+        static constexpr std::chrono::milliseconds k_idlePeriod { 20 };
+        static constexpr std::chrono::microseconds k_tripDeadline { 1000 };
+
+        VSWRProtection() = default;
+        ~VSWRProtection() = default;
+
+        // The readings and converter must outlive this object, the clear action is called by rearm()
+        // if the protection had tripped
+        void build(const RFPowerMonitor::ReadingRing& readings,
+                   const RFPowerConverter& converter,
+                   std::function<void()> tripAction,
+                   std::function<void()> clearAction);
+        void run();
+        void stop();
+
+        // Called by the writer of the readings after each reading is pushed
+        void notify();
+
+        // Progress is reported on the heartbeat (if set) on every wake-up, at least every k_idlePeriod
+        void setHeartbeat(std::shared_ptr<Heartbeat> heartbeat);
+
+        // Returns false if the threshold is invalid (it must be above 1.00:1)
+        bool setTripThreshold(uint16_t trip_cVSWR);
+        uint16_t tripThreshold() const;
+
+        // Readings with forward power below this level are not assessed
+        void setMinimumForwardPower(float power_dBm);
+
+        void rearm();
+        bool tripped() const;
+        Statistics statistics() const;
+
+    private:
+        void start();
+        void assess(const RFPowerReading& reading);
+        static float VSWRToReturnLoss(uint16_t VSWR_c);
+
+        const RFPowerMonitor::ReadingRing *m_readings { nullptr };
+        const RFPowerConverter *m_converter { nullptr };
+        std::function<void()> m_tripAction;
+        std::function<void()> m_clearAction;
+        std::shared_ptr<Heartbeat> m_heartbeat { nullptr };
+
+        std::thread m_VSWRProtectionThread;
+        std::atomic_bool m_stopRequested { false };
+        std::atomic_bool m_tripped { false };
+        std::atomic<float> m_minimumForward_dBm { 10.0f };
+        std::atomic<uint16_t> m_trip_cVSWR { k_defaultTrip_cVSWR };
+
+        // Used to wake the protection thread when there is a new reading or stop is requested
+        std::mutex m_wakeMutex;
+        std::condition_variable m_wakeCondition;
+        bool m_wakeRequested { false };
+
+        std::atomic<uint32_t> m_tripCount { 0u };
+        std::atomic<uint32_t> m_deadlineMisses { 0u };
+        std::atomic<uint64_t> m_lastLatency_ns { 0u };
+        std::atomic<uint64_t> m_maxLatency_ns { 0u };
+        std::atomic<uint64_t> m_readingsLost { 0u };
+
+        // Trip threshold as return loss, derived when the threshold changes and only accessed by
+        // the protection thread
+        uint16_t m_cachedTrip_cVSWR { 0u };
+        float m_tripReturnLoss_dB { 0.0f };
+    };
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "EPUHardware.hpp"
+
+namespace mercury::blackstar
+{
+    // EPU-4562 hardware access through the VersaLogic API (VL_OSALib), this is the only part of
+    // the application which uses the VersaLogic API directly
+    class VersaLogicHardware final : public EPUHardware
+    {
+    public:
+        VersaLogicHardware() = default;
+        ~VersaLogicHardware() override;
+
+        bool open() override;
+        void close() override;
+
+        void setDIODirection(uint8_t channel, bool input) override;
+        void setDIOLevel(uint8_t channel, bool high) override;
+        bool DIOLevel(uint8_t channel) override;
+
+        int DIOInterruptSignal() const override;
+        bool enableDIOInterrupts(uint32_t channels) override;
+        void disableDIOInterrupts(uint32_t channels) override;
+        void clearDIOInterrupts(uint32_t channels) override;
+
+        bool readFPGARegister(uint32_t offset, uint8_t& data) override;
+        bool writeFPGARegister(uint32_t offset, uint8_t data) override;
+
+        bool setI2CFrequency(uint32_t frequency_Hz) override;
+        uint32_t I2CMaxFrequency() override;
+        bool readI2CRegister(uint8_t chipAddress, uint8_t address, uint8_t& data) override;
+        bool writeI2CRegister(uint8_t chipAddress, uint8_t address, uint8_t data) override;
+
+        bool configureSPI(uint32_t clockFrequency_Hz, uint8_t mode, uint32_t frameSize) override;
+        bool setSPIFrameSize(uint32_t frameSize) override;
+        bool writeSPIFrame(uint32_t data) override;
+        bool readSPIFrame(uint32_t& data) override;
+
+        bool configureAnalogAutoScan(uint8_t channels) override;
+        bool readAnalogInputs(uint8_t channels, AnalogInputs& volts) override;
+
+        bool fanRPM(uint8_t pulsesPerRevolution, uint16_t& RPM) override;
+
+        bool enableWatchdog(uint8_t timeout_s) override;
+        void setWatchdogTimeout(uint8_t timeout_s) override;
+        void disableWatchdog() override;
+
+    private:
+        bool m_open { false };
+    };
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Heartbeat.hpp"
+#include "VSLBSP.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mercury::blackstar
+{
+    // WatchdogSupervisor kicks the EPU hardware watchdog only while every supervised thread has
+    // reported progress (Heartbeat::beat) within its own deadline. If a thread misses its deadline
+    // the kicks stop and the board is reset when the hardware watchdog expires; the thread which
+    // stalled is logged and written to a stall record file which is reported after the restart.
+    // In soft mode the hardware watchdog is not enabled and stalls are only logged.
+    class WatchdogSupervisor final
+    {
+    public:
+        static constexpr uint8_t k_defaultTimeout_s { 10u };
+        static constexpr uint8_t k_minimumTimeout_s { 1u };
+        static constexpr uint8_t k_maximumTimeout_s { 255u };  // EPUHardware takes the timeout as 8 bits
+        static constexpr std::chrono::milliseconds k_checkPeriod { 250 };
+
+        WatchdogSupervisor() = default;
+        ~WatchdogSupervisor() = default;
+
+        void build(std::shared_ptr<VSLBSP> BSP,
+                   bool softMode,
+                   uint8_t timeout_s = k_defaultTimeout_s,
+                   const std::string& stallRecordPath = k_defaultStallRecordPath);
+
+        // Threads must be added before run() is called
+        std::shared_ptr<Heartbeat> addThread(const std::string& name, std::chrono::milliseconds deadline);
+
+        void run();
+        void stop();
+
+        // Name of the most recent thread to miss its deadline (empty if none has)
+        std::string lastStalledThread() const;
+
+    private:
+        static constexpr const char *k_defaultStallRecordPath { "/var/log/BlackStarECM.watchdog" };
+
+        struct SupervisedThread
+        {
+            std::string name;
+            std::chrono::milliseconds deadline;
+            std::shared_ptr<Heartbeat> heartbeat;
+            bool stalled;
+        };
+
+        void start();
+        bool check();
+        void recordStall(const SupervisedThread& thread, std::chrono::nanoseconds age);
+        void reportPreviousStall();
+
+        std::shared_ptr<VSLBSP> m_BSP { nullptr };
+        bool m_softMode { true };
+        uint8_t m_timeout_s { k_defaultTimeout_s };
+        std::string m_stallRecordPath;
+        std::vector<SupervisedThread> m_threads;
+
+        std::thread m_watchdogThread;
+        std::atomic_bool m_stopRequested { false };
+        std::mutex m_wakeMutex;
+        std::condition_variable m_wakeCondition;
+
+        mutable std::mutex m_stallMutex;
+        std::string m_lastStalledThread;
+    };
+}
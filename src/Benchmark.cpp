@@ -0,0 +1,903 @@
+#include "Benchmark.hpp"
+#include "CANCapture.hpp"
+#include "CANClient.hpp"
+#include "CANMessageHandler.hpp"
+#include "Clock.hpp"
+#include "Log.hpp"
+#include "MercuryMessage.hpp"
+#include "MercuryStateHandler.hpp"
+#include "Metrics.hpp"
+#include "RFPowerConverter.hpp"
+#include "RFPowerMonitor.hpp"
+#include "StatusPublisher.hpp"
+#include "VSWRProtection.hpp"
+
+// Mercury includes
+#include "system/systemlib/inc/commands.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if BLACKSTAR_COUNT_ALLOCATIONS
+// Heap allocations made by each thread. The global operator new is replaced so that the
+// benchmarks can report allocations per iteration, it is otherwise the default allocation.
+static thread_local uint64_t t_allocations { 0u };
+
+void *operator new(std::size_t size)
+{
+    t_allocations++;
+    void *block { std::malloc((size > 0u) ? size : 1u) };
+    if (block == nullptr)
+    {
+        throw std::bad_alloc {};
+    }
+    return block;
+}
+
+void operator delete(void *block) noexcept
+{
+    std::free(block);
+}
+
+void operator delete(void *block, std::size_t) noexcept
+{
+    std::free(block);
+}
+#endif
+
+namespace mercury::blackstar
+{
+    namespace sys = embedded::system;
+
+    void Benchmark::build(std::shared_ptr<VSLBSP> BSP)
+    {
+        m_BSP = BSP;
+    }
+
+    bool Benchmark::run(const std::string& suite)
+    {
+        bool ok { false };
+
+        std::cout << "suite,test,parameter,iterations,errors,min_ns,mean_ns,max_ns,rate_per_s,allocs_per_iteration"
+                  << std::endl;
+
+        if (m_BSP != nullptr)
+        {
+            if (suite == "i2c")
+            {
+                ok = runI2C();
+            }
+            else if (suite == "spi")
+            {
+                ok = runSPI();
+            }
+            else if (suite == "convert")
+            {
+                ok = runConvert();
+            }
+            else if (suite == "vswr")
+            {
+                ok = runVSWR();
+            }
+            else if (suite == "dio")
+            {
+                ok = runDIO();
+            }
+            else if (suite == "bus")
+            {
+                ok = runBus();
+            }
+            else if (suite == "log")
+            {
+                ok = runLog();
+            }
+            else if (suite == "metrics")
+            {
+                ok = runMetrics();
+            }
+            else if (suite == "status")
+            {
+                ok = runStatus();
+            }
+            else if (suite == "message")
+            {
+                ok = runMessage();
+            }
+            else if (suite == "capture")
+            {
+                ok = runCapture();
+            }
+            else
+            {
+                std::cout << "ERROR: unknown benchmark suite " << suite << std::endl;
+            }
+        }
+
+        return ok;
+    }
+
+    bool Benchmark::runI2C()
+    {
+        using clock = std::chrono::steady_clock;
+
+        // Measure at standard mode, fast mode and the bus maximum (if that is different)
+        uint32_t configuredFrequency_Hz { m_BSP->I2CFrequency() };
+        std::vector<uint32_t> frequencies { VSLBSP::k_I2CStandardFrequency_Hz };
+        if (m_BSP->I2CMaxFrequency() >= VSLBSP::k_I2CFastFrequency_Hz)
+        {
+            frequencies.push_back(VSLBSP::k_I2CFastFrequency_Hz);
+        }
+        if (m_BSP->I2CMaxFrequency() > frequencies.back())
+        {
+            frequencies.push_back(m_BSP->I2CMaxFrequency());
+        }
+
+        bool ok { true };
+        for (uint32_t frequency_Hz : frequencies)
+        {
+            if (m_BSP->setI2CFrequency(frequency_Hz))
+            {
+                // Single register read transactions
+                Measurement read;
+                for (uint32_t i = 0; i < k_I2CIterations; i++)
+                {
+                    uint8_t status { 0u };
+                    clock::time_point start { clock::now() };
+                    bool readOK { m_BSP->getFanPSUStatus(status) };
+                    read.add(clock::now() - start, readOK);
+                }
+                read.print("i2c", "read", frequency_Hz);
+
+                // Complete self-test (repeated reads plus a write and read-back)
+                Measurement selfTest;
+                clock::time_point start { clock::now() };
+                bool selfTestOK { m_BSP->I2CSelfTest() };
+                selfTest.add(clock::now() - start, selfTestOK);
+                selfTest.print("i2c", "selftest", frequency_Hz);
+            }
+            else
+            {
+                ok = false;
+            }
+        }
+
+        // Leave the bus at the frequency selected during initialisation
+        m_BSP->setI2CFrequency(configuredFrequency_Hz);
+
+        return ok;
+    }
+
+    bool Benchmark::runSPI()
+    {
+        using clock = std::chrono::steady_clock;
+
+        // Each iteration is one forward/reverse reading pair, parameter is the number of SPI
+        // transactions used per reading
+        Measurement single;
+        for (uint32_t i = 0; i < k_SPIIterations; i++)
+        {
+            uint32_t forward_mV { 0u };
+            uint32_t reverse_mV { 0u };
+            clock::time_point start { clock::now() };
+            bool readOK { m_BSP->getRFPowerMonitorReadings(forward_mV, reverse_mV) };
+            single.add(clock::now() - start, readOK);
+        }
+        single.print("spi", "single", 3u);
+
+        // Streaming with alternating 2-byte frames and then (if supported) 4-byte frames
+        bool ok { true };
+        for (bool wideFrames : { false, true })
+        {
+            if (m_BSP->startRFPowerMonitorStream(wideFrames))
+            {
+                bool isWide { m_BSP->RFPowerMonitorStreamFrameSize() > 2u };
+                Measurement stream;
+                for (uint32_t i = 0; i < k_SPIIterations; i++)
+                {
+                    uint16_t forwardADC { 0u };
+                    uint16_t reverseADC { 0u };
+                    clock::time_point start { clock::now() };
+                    bool readOK { m_BSP->readRFPowerMonitorStream(forwardADC, reverseADC) };
+                    stream.add(clock::now() - start, readOK);
+                }
+                m_BSP->stopRFPowerMonitorStream();
+
+                // Don't report the 2-byte stream twice if 4-byte frames are not supported
+                if (!wideFrames || isWide)
+                {
+                    stream.print("spi", isWide ? "stream4" : "stream2", isWide ? 1u : 2u);
+                }
+            }
+            else
+            {
+                ok = false;
+            }
+        }
+
+        return ok;
+    }
+
+    bool Benchmark::runConvert()
+    {
+        using clock = std::chrono::steady_clock;
+
+        // Batch conversion of a full block of readings, parameter is the block size
+        RFPowerConverter converter;
+        uint16_t forwardADC[RFPowerConverter::k_maxBlockSize];
+        uint16_t reverseADC[RFPowerConverter::k_maxBlockSize];
+        for (size_t i = 0; i < RFPowerConverter::k_maxBlockSize; i++)
+        {
+            forwardADC[i] = static_cast<uint16_t>(2000u + (i * 7u));
+            reverseADC[i] = static_cast<uint16_t>(1000u + (i * 3u));
+        }
+
+        Measurement convert;
+        for (uint32_t i = 0; i < k_convertIterations; i++)
+        {
+            RFPowerWindow window;
+            clock::time_point start { clock::now() };
+            bool convertOK { converter.convert(forwardADC, reverseADC, RFPowerConverter::k_maxBlockSize, window) };
+            convert.add(clock::now() - start, convertOK);
+        }
+        convert.print("convert", "block", RFPowerConverter::k_maxBlockSize);
+
+        return true;
+    }
+
+    bool Benchmark::runVSWR()
+    {
+        using clock = std::chrono::steady_clock;
+
+        // Simulated RF power monitor: readings are pushed at the jamming sample rate into a ring, and
+        // the VSWR protection following it is notified, exactly as the sampler thread would, with a
+        // mismatch injected at a random point. Each iteration is the time from the first breaching reading to
+        // the trip action completing, parameter is the sample period in microseconds.
+        // Readings are forward 2048 (+30 dBm nominal), reverse 1024 (50 dB return loss) normally and
+        // reverse 2000 (about 2 dB return loss, VSWR 9:1) when breaching.
+        static const uint16_t k_forwardADC { 2048u };
+        static const uint16_t k_matchedReverseADC { 1024u };
+        static const uint16_t k_breachReverseADC { 2000u };
+        static const std::chrono::microseconds k_samplePeriod { 1000 };
+        static const uint32_t k_maxBreachReadings { 100u };
+
+        std::unique_ptr<RFPowerMonitor::ReadingRing> readings { std::make_unique<RFPowerMonitor::ReadingRing>() };
+        RFPowerConverter converter;
+        VSWRProtection protection;
+        std::atomic<int64_t> trip_ns { 0 };
+
+        // clang-format off
+        protection.build(*readings,
+                         converter,
+                         [&trip_ns] ()
+                         {
+                             trip_ns = static_cast<int64_t>(Clock::monotonic_ns());
+                         },
+                         [] () {});
+        // clang-format on
+        protection.run();
+
+        auto pushReading = [&readings, &protection] (uint16_t reverseADC) -> int64_t
+        {
+            RFPowerReading reading;
+            reading.forwardADC = k_forwardADC;
+            reading.reverseADC = reverseADC;
+            reading.forward_mV = VSLBSP::ADCToMillivolts(reading.forwardADC);
+            reading.reverse_mV = VSLBSP::ADCToMillivolts(reading.reverseADC);
+            reading.timestamp_ns = Clock::monotonic_ns();
+            readings->push(reading);
+            protection.notify();
+            return static_cast<int64_t>(reading.timestamp_ns);
+        };
+
+        std::mt19937 random { 1u };
+        std::uniform_int_distribution<uint32_t> matchedReadings { 2u, 10u };
+        Measurement breachToMute;
+        for (uint32_t i = 0; i < k_VSWRIterations; i++)
+        {
+            for (uint32_t j = matchedReadings(random); j > 0u; j--)
+            {
+                pushReading(k_matchedReverseADC);
+                std::this_thread::sleep_for(k_samplePeriod);
+            }
+
+            // Keep breaching (as a real mismatch would) until the protection trips
+            trip_ns = 0;
+            int64_t breach_ns { pushReading(k_breachReverseADC) };
+            clock::time_point nextSample { clock::now() + k_samplePeriod };
+            uint32_t breachReadings { 1u };
+            while ((trip_ns == 0) && (breachReadings < k_maxBreachReadings))
+            {
+                std::this_thread::yield();
+                if (clock::now() >= nextSample)
+                {
+                    pushReading(k_breachReverseADC);
+                    nextSample += k_samplePeriod;
+                    breachReadings++;
+                }
+            }
+
+            bool tripped { trip_ns != 0 };
+            std::chrono::nanoseconds latency { tripped ? (trip_ns - breach_ns) : 0 };
+            breachToMute.add(latency, tripped && (latency <= VSWRProtection::k_tripDeadline));
+
+            // As if jamming had been restarted after the fault was acknowledged
+            pushReading(k_matchedReverseADC);
+            std::this_thread::sleep_for(k_samplePeriod);
+            protection.rearm();
+        }
+
+        protection.stop();
+        breachToMute.print("vswr", "breach_to_mute", static_cast<uint32_t>(k_samplePeriod.count()));
+
+        return true;
+    }
+
+    bool Benchmark::runDIO()
+    {
+        using clock = std::chrono::steady_clock;
+
+        // Each iteration toggles a group of outputs (LEDs only, so this is safe with the PA powered),
+        // parameter is the number of outputs in the group. Measured through the FPGA output register
+        // (if available) and through per-channel library calls.
+        static const uint8_t k_groups[] { VSLBSP::k_outputAlertLED, VSLBSP::k_outputAlertLED | VSLBSP::k_outputRFLED };
+
+        uint8_t initialOutputs { m_BSP->outputs() };
+
+        for (bool useRegister : { true, false })
+        {
+            if (!m_BSP->setOutputRegisterEnabled(useRegister))
+            {
+                std::cout << "WARNING: DIO output register not available" << std::endl;
+                continue;
+            }
+
+            for (uint8_t group : k_groups)
+            {
+                Measurement update;
+                for (uint32_t i = 0; i < k_DIOIterations; i++)
+                {
+                    uint8_t levels { ((i & 1u) != 0u) ? group : static_cast<uint8_t>(0u) };
+                    clock::time_point start { clock::now() };
+                    m_BSP->setOutputs(group, levels);
+                    update.add(clock::now() - start, true);
+                }
+                update.print("dio", useRegister ? "register" : "perchannel",
+                             static_cast<uint32_t>(__builtin_popcount(group)));
+            }
+        }
+
+        // Put the outputs back as they were and use the register again if it is available
+        m_BSP->setOutputRegisterEnabled(m_BSP->outputRegisterAvailable());
+        m_BSP->setOutputs(VSLBSP::k_outputAlertLED | VSLBSP::k_outputRFLED, initialOutputs);
+
+        return true;
+    }
+
+    bool Benchmark::runBus()
+    {
+        using clock = std::chrono::steady_clock;
+
+        // Each iteration is a fan/PSU status read (request to completion, including the wait for the
+        // bus) at each priority while background threads keep the I2C bus busy with telemetry reads,
+        // parameter is the number of background threads
+        static const uint32_t k_backgroundThreads[] { 0u, 2u };
+        static const struct
+        {
+            VSLBSP::BusPriority priority;
+            const char *name;
+        } k_priorities[] { { VSLBSP::BusPriority::Safety, "safety" },
+                           { VSLBSP::BusPriority::State, "state" },
+                           { VSLBSP::BusPriority::Telemetry, "telemetry" } };
+
+        bool ok { true };
+        for (uint32_t numberThreads : k_backgroundThreads)
+        {
+            std::atomic_bool stopBackground { false };
+            std::vector<std::thread> background;
+            for (uint32_t i = 0; i < numberThreads; i++)
+            {
+                // clang-format off
+                background.emplace_back([&] ()
+                                        {
+                                            uint8_t status { 0u };
+                                            while (!stopBackground)
+                                            {
+                                                m_BSP->getFanPSUStatus(status, VSLBSP::BusPriority::Telemetry);
+                                            }
+                                        });
+                // clang-format on
+            }
+
+            for (const auto& priority : k_priorities)
+            {
+                Measurement read;
+                for (uint32_t i = 0; i < k_busIterations; i++)
+                {
+                    uint8_t status { 0u };
+                    clock::time_point start { clock::now() };
+                    bool readOK { m_BSP->getFanPSUStatus(status, priority.priority) };
+                    read.add(clock::now() - start, readOK);
+                    ok = ok && readOK;
+                }
+                read.print("bus", priority.name, numberThreads);
+            }
+
+            stopBackground = true;
+            for (auto& thread : background)
+            {
+                thread.join();
+            }
+        }
+
+        return ok;
+    }
+
+    bool Benchmark::runLog()
+    {
+        using clock = std::chrono::steady_clock;
+
+        // Each iteration logs the received message line from the CAN thread: through an output
+        // stream flushed with std::endl (as std::cout was used), through the asynchronous logger
+        // and through a level which is compiled out. Output goes to /dev/null. Calls are made in
+        // bursts with a pause for the writer in between, errors are records dropped.
+        static const uint8_t k_recipientID { 0x0A };
+        static const uint16_t k_commandID { 0x0201 };
+
+        std::ofstream stream { "/dev/null" };
+        Measurement streamed;
+        for (uint32_t i = 0; i < k_logIterations; i++)
+        {
+            clock::time_point start { clock::now() };
+            stream << "Received message, Recipient ID 0x" << std::hex << +k_recipientID << ", Command ID 0x"
+                   << +k_commandID << std::endl;
+            streamed.add(clock::now() - start, stream.good());
+        }
+        streamed.print("log", "ostream", 0u);
+
+        Log::Settings settings;
+        settings.sink = Log::Sink::File;
+        settings.path = "/dev/null";
+        if (!Log::start(settings))
+        {
+            return false;
+        }
+
+        Measurement logged;
+        Measurement compiledOut;
+        for (uint32_t i = 0; i < k_logIterations; i++)
+        {
+            clock::time_point start { clock::now() };
+            bool ok { Log::info("Received message, Recipient ID 0x{x}, Command ID 0x{x}", k_recipientID, k_commandID) };
+            logged.add(clock::now() - start, ok);
+
+            start = clock::now();
+            ok = Log::debug("Received message, Recipient ID 0x{x}, Command ID 0x{x}", k_recipientID, k_commandID);
+            compiledOut.add(clock::now() - start, ok);
+
+            if ((i % k_logBurst) == (k_logBurst - 1u))
+            {
+                std::this_thread::sleep_for(Log::k_writePeriod * 2);
+            }
+        }
+        Log::stop();
+
+        logged.print("log", "async", 0u);
+        compiledOut.print("log", "compiled_out", static_cast<uint32_t>(Log::k_level));
+
+        return true;
+    }
+
+    bool Benchmark::runMetrics()
+    {
+        using clock = std::chrono::steady_clock;
+
+        // Each iteration is a batch of k_metricsBatch updates while background threads update the
+        // same metrics, parameter is the number of background threads. "shared_atomic" is the
+        // alternative of one atomic counter shared by every thread.
+        static const uint32_t k_backgroundThreads[] { 0u, 3u };
+        std::atomic<uint64_t> shared { 0u };
+
+        for (uint32_t numberThreads : k_backgroundThreads)
+        {
+            std::atomic_bool stopBackground { false };
+            std::vector<std::thread> background;
+            for (uint32_t i = 0; i < numberThreads; i++)
+            {
+                // clang-format off
+                background.emplace_back([&] ()
+                                        {
+                                            while (!stopBackground)
+                                            {
+                                                Metrics::increment(Metrics::Counter::CANFramesReceived);
+                                                shared.fetch_add(1u);
+                                            }
+                                        });
+                // clang-format on
+            }
+
+            Measurement incremented;
+            Measurement sharedAtomic;
+            Measurement observed;
+            Measurement command;
+            for (uint32_t i = 0; i < k_metricsIterations; i++)
+            {
+                clock::time_point start { clock::now() };
+                for (uint32_t update = 0; update < k_metricsBatch; update++)
+                {
+                    Metrics::increment(Metrics::Counter::CANFramesReceived);
+                }
+                incremented.add(clock::now() - start, true);
+
+                start = clock::now();
+                for (uint32_t update = 0; update < k_metricsBatch; update++)
+                {
+                    shared.fetch_add(1u);
+                }
+                sharedAtomic.add(clock::now() - start, true);
+
+                start = clock::now();
+                for (uint32_t update = 0; update < k_metricsBatch; update++)
+                {
+                    Metrics::observe(Metrics::Histogram::MessageProcessing, update * 1000u);
+                }
+                observed.add(clock::now() - start, true);
+
+                start = clock::now();
+                for (uint32_t update = 0; update < k_metricsBatch; update++)
+                {
+                    Metrics::countCommand(static_cast<uint16_t>(update % 8u));
+                }
+                command.add(clock::now() - start, true);
+            }
+
+            stopBackground = true;
+            for (auto& thread : background)
+            {
+                thread.join();
+            }
+
+            incremented.print("metrics", "increment", numberThreads);
+            sharedAtomic.print("metrics", "shared_atomic", numberThreads);
+            observed.print("metrics", "observe", numberThreads);
+            command.print("metrics", "command", numberThreads);
+        }
+
+        return true;
+    }
+
+    bool Benchmark::runStatus()
+    {
+        using clock = std::chrono::steady_clock;
+
+        // Each iteration is one read of the status page by a tool while the publisher updates it
+        // from the bus statistics, errors are reads which gave up
+        static const char *k_name { "/BlackStarECM.status.benchmark" };
+
+        StatusPublisher publisher;
+        publisher.build(m_BSP, nullptr, nullptr, nullptr, nullptr, nullptr, 0u);
+        StatusPageReader reader;
+        if (!publisher.open(k_name) || !reader.open(k_name))
+        {
+            return false;
+        }
+        publisher.run();
+
+        Measurement read;
+        for (uint32_t i = 0; i < k_statusIterations; i++)
+        {
+            StatusPage::Data data;
+            clock::time_point start { clock::now() };
+            bool ok { reader.read(data) };
+            read.add(clock::now() - start, ok);
+        }
+
+        publisher.stop();
+        read.print("status", "read", 0u);
+
+        return true;
+    }
+
+    bool Benchmark::runMessage()
+    {
+        using clock = std::chrono::steady_clock;
+
+        // The CAN client's path for one received message: reassembly, CRC check, dispatch and the
+        // response, driven with the frames the MCM sends. Each processFrame iteration is a whole
+        // message (the parameter is its number of frames), errors are messages without a
+        // response. The message handler logs every message so the asynchronous log is running,
+        // as in the daemon.
+        static const uint8_t k_slot { 0u };
+        static const uint8_t k_recipientID { 0x0A };
+        static const canid_t k_MCMCANID { 0x0A };
+
+        // clang-format off
+        static const struct
+        {
+            const char *name;
+            uint16_t commandID;
+            size_t numberParameters;
+        } k_messages[] {
+            { "getstate",     sys::Command::GetState,                 0u                             },
+            { "ping",         sys::Command::Ping,                     0u                             },
+            { "capabilities", sys::Command::GetEcmModuleCapabilities, 0u                             },
+            { "upload",       sys::Command::UploadFile,               MercuryMessage::k_maxParameters }
+        };
+        static const size_t k_CRCSizes[] { 8u, 64u, 255u };
+        static const size_t k_responseParameters[] { 0u, 16u, 246u };
+        // clang-format on
+
+        Log::Settings settings;
+        settings.sink = Log::Sink::File;
+        settings.path = "/dev/null";
+        if (!Log::start(settings))
+        {
+            return false;
+        }
+
+        std::shared_ptr<MercuryStateHandler> stateHandler { std::make_shared<MercuryStateHandler>() };
+        stateHandler->build(m_BSP, nullptr, nullptr);
+        std::shared_ptr<CANMessageHandler> handler { std::make_shared<CANMessageHandler>() };
+        handler->build(k_slot, stateHandler, nullptr, nullptr, nullptr);
+
+        std::mt19937 random { 1u };
+        std::vector<uint8_t> response;
+        for (const auto& message : k_messages)
+        {
+            std::vector<uint8_t> parameters(message.numberParameters);
+            std::generate(parameters.begin(), parameters.end(), [&random] () { return random() & 0xFF; });
+            std::vector<::can_frame> frames { MercuryMessage::frames(
+                k_MCMCANID, MercuryMessage::command(k_recipientID, message.commandID, parameters)) };
+
+            Measurement processed;
+            for (uint32_t i = 0; i < k_messageIterations; i++)
+            {
+                uint64_t timestamp_ns { Clock::realTime_ns() };
+                uint64_t allocationsBefore { allocations() };
+                clock::time_point start { clock::now() };
+                for (const ::can_frame& frame : frames)
+                {
+                    handler->processFrame(frame, timestamp_ns, response);
+                }
+                processed.add(clock::now() - start, !response.empty(), allocations() - allocationsBefore);
+                response.clear();
+            }
+            processed.print("message", message.name, static_cast<uint32_t>(frames.size()));
+        }
+
+        // Reassembly on its own: the frames before the last of a large message
+        {
+            std::vector<::can_frame> frames { MercuryMessage::frames(
+                k_MCMCANID,
+                MercuryMessage::command(k_recipientID,
+                                        sys::Command::UploadFile,
+                                        std::vector<uint8_t>(MercuryMessage::k_maxParameters))) };
+
+            Measurement reassembled;
+            for (uint32_t i = 0; i < (k_messageIterations / frames.size()); i++)
+            {
+                for (size_t frame = 0; frame < frames.size(); frame++)
+                {
+                    uint64_t timestamp_ns { Clock::realTime_ns() };
+                    uint64_t allocationsBefore { allocations() };
+                    clock::time_point start { clock::now() };
+                    handler->processFrame(frames[frame], timestamp_ns, response);
+                    if ((frame + 1u) < frames.size())
+                    {
+                        reassembled.add(clock::now() - start, response.empty(), allocations() - allocationsBefore);
+                    }
+                }
+                response.clear();
+            }
+            reassembled.print("message", "reassembly", MercuryMessage::k_frameSize);
+        }
+
+        for (size_t size : k_CRCSizes)
+        {
+            std::vector<uint8_t> bytes(size);
+            std::generate(bytes.begin(), bytes.end(), [&random] () { return random() & 0xFF; });
+
+            Measurement CRC;
+            for (uint32_t i = 0; i < k_messageIterations; i++)
+            {
+                uint64_t allocationsBefore { allocations() };
+                clock::time_point start { clock::now() };
+                volatile uint16_t result { handler->calculateCRC(bytes) };
+                CRC.add(clock::now() - start, true, allocations() - allocationsBefore);
+                (void)result;
+            }
+            CRC.print("message", "crc", static_cast<uint32_t>(size));
+        }
+
+        for (size_t numberParameters : k_responseParameters)
+        {
+            std::vector<uint8_t> parameters(numberParameters);
+
+            Measurement populated;
+            for (uint32_t i = 0; i < k_messageIterations; i++)
+            {
+                uint64_t allocationsBefore { allocations() };
+                clock::time_point start { clock::now() };
+                handler->populateResponse(sys::Command::Ok, parameters, response);
+                populated.add(clock::now() - start, !response.empty(), allocations() - allocationsBefore);
+            }
+            populated.print("message", "populate_response", static_cast<uint32_t>(numberParameters));
+        }
+
+        // Frame splitting in the CAN client, written to /dev/null rather than a CAN socket so the
+        // write is the cheapest system call possible; the parameter is the response size in bytes
+        int fd { ::open("/dev/null", O_WRONLY | O_CLOEXEC) };
+        if (fd >= 0)
+        {
+            CANClient client;
+            client.m_messageHandler = handler;
+            client.m_sockfd = fd;
+
+            for (size_t numberParameters : k_responseParameters)
+            {
+                std::vector<uint8_t> parameters(numberParameters);
+                handler->populateResponse(sys::Command::Ok, parameters, response);
+
+                Measurement sent;
+                for (uint32_t i = 0; i < k_messageIterations; i++)
+                {
+                    std::vector<uint8_t> message { response };
+                    client.m_connected = true;
+                    uint64_t allocationsBefore { allocations() };
+                    clock::time_point start { clock::now() };
+                    client.sendMessage(message);
+                    sent.add(clock::now() - start, client.m_connected, allocations() - allocationsBefore);
+                }
+                sent.print("message", "send_message", static_cast<uint32_t>(response.size()));
+            }
+
+            client.m_connected = false;
+            client.m_sockfd = -1;
+            ::close(fd);
+        }
+
+        Log::stop();
+
+        return fd >= 0;
+    }
+
+    bool Benchmark::runCapture()
+    {
+        using clock = std::chrono::steady_clock;
+
+        // Each record iteration is one received frame captured, timestamped as on a fully loaded
+        // 1 Mbit/s bus (8 byte standard frames, about 9000 per second) into the default size and
+        // number of files, the iterations fill more than two so that rotation is included; the
+        // parameter is the file size in KiB. Frames are recorded far faster than a bus delivers
+        // them, so a rotation may wait for the next file to be prepared (max_ns). The read
+        // iteration is the whole capture read back, errors are frames which didn't match.
+        static const char *k_path { "/tmp/BlackStarECM.capture.benchmark" };
+        static const uint64_t k_fileSize { CANCapture::k_defaultFileSize };
+        static const uint32_t k_files { CANCapture::k_defaultFiles };
+        static const uint64_t k_framePeriod_ns { 111000u };
+
+        Log::Settings settings;
+        settings.sink = Log::Sink::File;
+        settings.path = "/dev/null";
+        if (!Log::start(settings))
+        {
+            return false;
+        }
+
+        for (uint32_t file = 0; file < k_files; file++)
+        {
+            ::unlink((std::string { k_path } + "." + std::to_string(file)).c_str());
+        }
+
+        CANCapture capture;
+        bool ok { capture.open(k_path, k_fileSize, k_files) };
+        if (ok)
+        {
+            std::mt19937 random { 1u };
+            ::can_frame frame {};
+            frame.can_dlc = MercuryMessage::k_frameSize;
+            uint64_t timestamp_ns { 1500000000000000000u };
+
+            Measurement recorded;
+            for (uint32_t i = 0; i < k_captureIterations; i++)
+            {
+                frame.can_id = 0x0A + (random() & 0x07);
+                std::generate(frame.data, frame.data + frame.can_dlc, [&random] () { return random() & 0xFF; });
+                timestamp_ns += k_framePeriod_ns + (random() & 0xFFF);
+
+                uint64_t allocationsBefore { allocations() };
+                clock::time_point start { clock::now() };
+                capture.record(timestamp_ns, frame, 0u);
+                recorded.add(clock::now() - start, true, allocations() - allocationsBefore);
+            }
+            capture.close();
+
+            // The files hold the most recent frames, check they are the last ones recorded
+            uint32_t numberFrames { 0u };
+            uint64_t lastTimestamp_ns { 0u };
+            clock::time_point start { clock::now() };
+            ok = CANCapture::read(k_path, [&numberFrames, &lastTimestamp_ns] (uint64_t timestamp_ns, const ::can_frame&)
+                                  {
+                                      numberFrames++;
+                                      lastTimestamp_ns = timestamp_ns;
+                                  });
+            Measurement read;
+            read.add(clock::now() - start, ok && (lastTimestamp_ns == timestamp_ns));
+
+            recorded.print("capture", "record", static_cast<uint32_t>(k_fileSize >> 10));
+            read.print("capture", "read", numberFrames);
+        }
+
+        for (uint32_t file = 0; file < k_files; file++)
+        {
+            ::unlink((std::string { k_path } + "." + std::to_string(file)).c_str());
+        }
+        Log::stop();
+
+        return ok;
+    }
+
+    uint64_t Benchmark::allocations()
+    {
+#if BLACKSTAR_COUNT_ALLOCATIONS
+        return t_allocations;
+#else
+        return 0u;
+#endif
+    }
+
+    void Benchmark::Measurement::add(std::chrono::steady_clock::duration latency, bool ok, uint64_t allocations)
+    {
+        add(latency, ok);
+        m_allocations += allocations;
+        m_allocationsCounted = k_countAllocations;
+    }
+
+    void Benchmark::Measurement::add(std::chrono::steady_clock::duration latency, bool ok)
+    {
+        std::chrono::nanoseconds latency_ns { std::chrono::duration_cast<std::chrono::nanoseconds>(latency) };
+
+        m_iterations++;
+        m_total += latency_ns;
+        if (latency_ns < m_min)
+        {
+            m_min = latency_ns;
+        }
+        if (latency_ns > m_max)
+        {
+            m_max = latency_ns;
+        }
+        if (!ok)
+        {
+            m_errors++;
+        }
+    }
+
+    void Benchmark::Measurement::print(const std::string& suite, const std::string& test, uint32_t parameter) const
+    {
+        int64_t min_ns { (m_iterations > 0u) ? m_min.count() : 0 };
+        int64_t mean_ns { (m_iterations > 0u) ? (m_total.count() / m_iterations) : 0 };
+        uint64_t rate_per_s { (m_total.count() > 0) ? ((m_iterations * 1000000000ull) / m_total.count()) : 0u };
+
+        char allocations[32] {};
+        if (m_allocationsCounted && (m_iterations > 0u))
+        {
+            std::snprintf(allocations, sizeof(allocations), "%.2f",
+                          static_cast<double>(m_allocations) / static_cast<double>(m_iterations));
+        }
+
+        std::cout << suite << "," << test << "," << std::dec << parameter << "," << m_iterations << "," << m_errors
+                  << "," << min_ns << "," << mean_ns << "," << m_max.count() << "," << rate_per_s << ","
+                  << allocations << std::endl;
+    }
+}
@@ -0,0 +1,322 @@
+#include "BitEngine.hpp"
+#include "BoardTelemetry.hpp"
+#include "Clock.hpp"
+#include "Log.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mercury::blackstar
+{
+    // clang-format off
+    // Test table, values are: fan/PSU registers as read, board ADC channels (from the latest board
+    // telemetry scan) in hundredths of a volt or degree C, the ECM slot number and fan speed in RPM
+    const BitEngine::Test BitEngine::k_tests[BitEngine::k_numberTests]
+    {
+        { "fan_psu_status",    Group::I2C, std::chrono::milliseconds { 50 }, &BitEngine::testFanPSURegister, 0u },
+        { "fan_psu_control",   Group::I2C, std::chrono::milliseconds { 50 }, &BitEngine::testFanPSURegister, 1u },
+        { "supply_28V",        Group::SPI, std::chrono::milliseconds { 20 }, &BitEngine::testBoardADC,       0u },
+        { "supply_12V",        Group::SPI, std::chrono::milliseconds { 20 }, &BitEngine::testBoardADC,       1u },
+        { "supply_5V",         Group::SPI, std::chrono::milliseconds { 20 }, &BitEngine::testBoardADC,       2u },
+        { "supply_3V3",        Group::SPI, std::chrono::milliseconds { 20 }, &BitEngine::testBoardADC,       3u },
+        { "PA_temperature",    Group::SPI, std::chrono::milliseconds { 20 }, &BitEngine::testBoardADC,       4u },
+        { "board_temperature", Group::SPI, std::chrono::milliseconds { 20 }, &BitEngine::testBoardADC,       5u },
+        { "slot_inputs",       Group::DIO, std::chrono::milliseconds { 10 }, &BitEngine::testSlotInputs,     0u },
+        { "fan_speed",         Group::DIO, std::chrono::milliseconds { 10 }, &BitEngine::testFanSpeed,       0u }
+    };
+
+    // Pass limits for the board ADC channels (BoardTelemetry::channel order). PROVISIONAL: these
+    // are placeholders (supplies nominal +/-5%, 28 V +/-15%, typical industrial temperature
+    // ranges), not taken from the supply, PA or board specifications.
+    static const float k_boardADCLimits[BoardTelemetry::k_numberChannels][2]
+    {
+        {  23.8f, 32.2f },
+        {  11.4f, 12.6f },
+        {  4.75f, 5.25f },
+        { 3.135f, 3.465f },
+        { -40.0f, 85.0f },
+        { -40.0f, 70.0f }
+    };
+
+    static const uint16_t k_minFanRPM { 1000u };
+
+    // Board ADC results older than this (a scan missed) fail, the telemetry scans every 200 ms
+    static const std::chrono::milliseconds k_maxBoardADCAge { 1000 };
+    // clang-format on
+
+    void BitEngine::build(std::shared_ptr<VSLBSP> BSP, std::shared_ptr<BoardTelemetry> boardTelemetry)
+    {
+        m_BSP = BSP;
+        m_boardTelemetry = boardTelemetry;
+    }
+
+    void BitEngine::run()
+    {
+        m_stopRequested = false;
+        m_refreshRequested = true;
+
+        // clang-format off
+        for (size_t group = 0; group < k_numberGroups; group++)
+        {
+            m_workerThreads[group] = std::thread { [this, group] ()
+                                                   {
+                                                       worker(static_cast<Group>(group));
+                                                   }
+                                                 };
+        }
+        m_BitEngineThread = std::thread { [&] ()
+                                          {
+                                              start();
+                                          }
+                                        };
+        // clang-format on
+    }
+
+    void BitEngine::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock { m_wakeMutex };
+            m_stopRequested = true;
+        }
+        m_wakeCondition.notify_one();
+        m_workerCondition.notify_all();
+
+        if (m_BitEngineThread.joinable())
+        {
+            m_BitEngineThread.join();
+        }
+        for (std::thread& thread : m_workerThreads)
+        {
+            if (thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+    void BitEngine::setHeartbeat(std::shared_ptr<Heartbeat> heartbeat)
+    {
+        m_heartbeat = heartbeat;
+    }
+
+    void BitEngine::requestRefresh()
+    {
+        // The mutex isn't taken so the CAN thread never waits for it, a wake up which is missed
+        // while the engine thread is between checking the flag and waiting is picked up at the
+        // end of the idle period
+        if (!m_refreshRequested.exchange(true))
+        {
+            m_wakeCondition.notify_one();
+        }
+    }
+
+    bool BitEngine::latest(Results& results) const
+    {
+        return m_results.latest(results);
+    }
+
+    void BitEngine::refreshIfStale()
+    {
+        Results results;
+        if (!latest(results) || ((Clock::monotonic_ns() - results.timestamp_ns) >
+                                 static_cast<uint64_t>(std::chrono::nanoseconds { k_maxAge }.count())))
+        {
+            requestRefresh();
+        }
+    }
+
+    const char *BitEngine::testName(size_t index)
+    {
+        return (index < k_numberTests) ? k_tests[index].name : "";
+    }
+
+    void BitEngine::start()
+    {
+        Metrics::registerThread("BitEngine");
+
+        while (!m_stopRequested)
+        {
+            if (m_refreshRequested)
+            {
+                refresh();
+                m_refreshRequested = false;
+            }
+
+            if (m_heartbeat != nullptr)
+            {
+                m_heartbeat->beat();
+            }
+
+            std::unique_lock<std::mutex> lock { m_wakeMutex };
+            m_wakeCondition.wait_for(lock, k_idlePeriod, [&] ()
+                                     { return m_stopRequested.load() || m_refreshRequested.load(); });
+        }
+    }
+
+    void BitEngine::refresh()
+    {
+        // The refresh deadline is the longest group budget
+        std::array<std::chrono::milliseconds, k_numberGroups> groupBudgets {};
+        for (const Test& test : k_tests)
+        {
+            groupBudgets[static_cast<size_t>(test.group)] += test.budget;
+        }
+        std::chrono::steady_clock::time_point deadline { std::chrono::steady_clock::now() +
+                                                         *std::max_element(groupBudgets.begin(), groupBudgets.end()) };
+
+        Results results;
+        {
+            std::unique_lock<std::mutex> lock { m_wakeMutex };
+            uint32_t generation { ++m_generation };
+            m_pending.fill(Result {});
+            m_collecting = true;
+            m_workerCondition.notify_all();
+
+            m_wakeCondition.wait_until(lock, deadline, [&] ()
+                                       {
+                                           return m_stopRequested.load() ||
+                                                  std::all_of(m_groupGeneration.begin(), m_groupGeneration.end(),
+                                                              [generation] (uint32_t completed)
+                                                              { return completed == generation; });
+                                       });
+
+            // Anything still outstanding has run out of time, its result is dropped when it arrives
+            m_collecting = false;
+            results.results = m_pending;
+        }
+
+        for (Result& result : results.results)
+        {
+            if (result.status == Status::NotRun)
+            {
+                result.status = Status::Timeout;
+            }
+        }
+
+        Results previous;
+        results.version = m_results.latest(previous) ? (previous.version + 1u) : 1u;
+        results.timestamp_ns = Clock::monotonic_ns();
+        m_results.push(results);
+
+        for (size_t index = 0; index < k_numberTests; index++)
+        {
+            const Result& result { results.results[index] };
+            if (result.status != Status::Pass)
+            {
+                Log::warning("BIT {} {}, value {}", k_tests[index].name,
+                             (result.status == Status::Timeout) ? "timed out" : "failed", result.value);
+            }
+        }
+    }
+
+    void BitEngine::worker(Group group)
+    {
+        // clang-format off
+        static const char *k_workerNames[k_numberGroups] { "BitI2C", "BitSPI", "BitDIO" };
+        // clang-format on
+        Metrics::registerThread(k_workerNames[static_cast<size_t>(group)]);
+
+        uint32_t generation { 0u };
+
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock { m_wakeMutex };
+                m_workerCondition.wait(lock, [&] () { return m_stopRequested.load() || (m_generation != generation); });
+                if (m_stopRequested)
+                {
+                    break;
+                }
+                generation = m_generation;
+            }
+
+            for (size_t index = 0; index < k_numberTests; index++)
+            {
+                const Test& test { k_tests[index] };
+                if (test.group != group)
+                {
+                    continue;
+                }
+
+                {
+                    // Give up on the rest of the group once the refresh has been published
+                    std::lock_guard<std::mutex> lock { m_wakeMutex };
+                    if (m_stopRequested || !m_collecting || (m_generation != generation))
+                    {
+                        break;
+                    }
+                }
+
+                Result result;
+                std::chrono::steady_clock::time_point started { std::chrono::steady_clock::now() };
+                bool passed { (this->*test.function)(test.parameter, result.value) };
+                std::chrono::steady_clock::duration elapsed { std::chrono::steady_clock::now() - started };
+
+                result.duration_us = static_cast<uint32_t>(
+                    std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+                result.status = (elapsed > test.budget) ? Status::Timeout : (passed ? Status::Pass : Status::Fail);
+
+                std::lock_guard<std::mutex> lock { m_wakeMutex };
+                if (m_collecting && (m_generation == generation))
+                {
+                    m_pending[index] = result;
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock { m_wakeMutex };
+                m_groupGeneration[static_cast<size_t>(group)] = generation;
+            }
+            m_wakeCondition.notify_one();
+        }
+    }
+
+    bool BitEngine::testFanPSURegister(uint8_t parameter, int16_t& value)
+    {
+        // Status must have no bits set, control must have the PSU enabled
+        uint8_t data { 0u };
+        bool passed { false };
+        if (parameter == 0u)
+        {
+            passed = m_BSP->getFanPSUStatus(data) && (data == 0u);
+        }
+        else
+        {
+            passed = m_BSP->getFanPSUControl(data) && ((data & VSLBSP::k_fanPSUControlPSUEnable) != 0u);
+        }
+        value = data;
+        return passed;
+    }
+
+    bool BitEngine::testBoardADC(uint8_t channel, int16_t& value)
+    {
+        // The ADC is in auto-scan for the board telemetry, a conversion here would take the next
+        // result of the scan sequence, so the test checks the latest scan instead
+        BoardTelemetrySnapshot snapshot;
+        bool published { (m_boardTelemetry != nullptr) && m_boardTelemetry->latest(snapshot) };
+        uint64_t maxAge_ns { static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(k_maxBoardADCAge).count()) };
+        bool passed { published && ((snapshot.validChannels & (1u << channel)) != 0u) &&
+                      ((Clock::monotonic_ns() - snapshot.scanTimestamp_ns) <= maxAge_ns) };
+        float reading { passed ? snapshot.values[channel] : 0.0f };
+
+        value = static_cast<int16_t>(std::lround(std::max(std::min(reading * 100.0f, 32767.0f), -32768.0f)));
+        return passed && (reading >= k_boardADCLimits[channel][0]) && (reading <= k_boardADCLimits[channel][1]);
+    }
+
+    bool BitEngine::testSlotInputs(uint8_t, int16_t& value)
+    {
+        // Any slot number is valid, the test is that the inputs can be read
+        value = static_cast<int16_t>(m_BSP->inputs() & VSLBSP::k_inputECMSlotMask);
+        return true;
+    }
+
+    bool BitEngine::testFanSpeed(uint8_t, int16_t& value)
+    {
+        uint16_t RPM { 0u };
+        bool passed { m_BSP->getFanRPM(RPM) && (RPM >= k_minFanRPM) };
+        value = static_cast<int16_t>(std::min<uint16_t>(RPM, INT16_MAX));
+        return passed;
+    }
+}
@@ -1,110 +1,721 @@
 #include "VSLBSP.hpp"
+#include "Benchmark.hpp"
+#include "BitEngine.hpp"
+#include "BoardTelemetry.hpp"
 #include "BuildID.hpp"
+#include "CANCapture.hpp"
 #include "CANClient.hpp"
 #include "CANMessageHandler.hpp"
+#include "Clock.hpp"
+#include "ControlClient.hpp"
+#include "ControlServer.hpp"
+#include "DIOInputMonitor.hpp"
+#include "EventLoop.hpp"
+#include "HealthMonitor.hpp"
+#include "LoadGenerator.hpp"
+#include "Log.hpp"
 #include "MercuryStateHandler.hpp"
+#include "Metrics.hpp"
+#include "MetricsServer.hpp"
+#include "RFPowerMonitor.hpp"
+#include "RFPowerStreamer.hpp"
+#include "SimulatedHardware.hpp"
+#include "StartupTimer.hpp"
+#include "StatusPage.hpp"
+#include "StatusPublisher.hpp"
+#include "TelemetryHistory.hpp"
+#include "TelemetryRecorder.hpp"
+#include "Trace.hpp"
+#include "TrafficReplay.hpp"
+#include "VersaLogicHardware.hpp"
+#include "VSWRProtection.hpp"
+#include "WatchdogSupervisor.hpp"
 
+#include <chrono>
+#include <cerrno>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <csignal>
+#include <ctime>
 #include <iostream>
 #include <iomanip>
+#include <string>
+#include <thread>
+#include <vector>
 #include <unistd.h>
 
 namespace bs = mercury::blackstar;
 
 const std::string k_CANDevice { "can0" };
 
-bool keepRunning { true };
+// Longest duration accepted on the command line (a year)
+const double k_maxDuration_s { 31536000.0 };
 
-void signalHandler(int signalNumber)
+// Control protocol command for a one-shot action switch, zero if the switch isn't a one-shot
+static uint8_t oneShotCommand(int action)
 {
-    keepRunning = false;
+    switch (action)
+    {
+        case 'i':
+            // 'i' option - initialise fan/PSU controller
+            return bs::ControlProtocol::k_commandResetFanPSU;
+        case 'r':
+            // 'r' option - get RF power readings
+            return bs::ControlProtocol::k_commandGetRFPower;
+        case 'E':
+            // 'E' option - enable PSU, fans & PA
+            return bs::ControlProtocol::k_commandEnablePower;
+        case 'e':
+            // 'e' option - disable PSU, fans & PA
+            return bs::ControlProtocol::k_commandDisablePower;
+        case 'M':
+            // 'M' option - mute PA
+            return bs::ControlProtocol::k_commandMutePA;
+        case 'm':
+            // 'm' option - unmute PA
+            return bs::ControlProtocol::k_commandUnmutePA;
+        case 's':
+            // 's' option - report ECM slot number
+            return bs::ControlProtocol::k_commandGetSlotNumber;
+        default:
+            return 0u;
+    }
+}
+
+// The output is the same whether the daemon or this process executed the one-shot, returns false
+// if the one-shot failed
+static bool printOneShotResponse(const std::vector<uint8_t>& response)
+{
+    const size_t headerSize { bs::ControlProtocol::k_responseHeaderSize };
+    bool ok { (response.size() >= headerSize) &&
+              (response[bs::ControlProtocol::k_statusField] == bs::ControlProtocol::k_statusOK) };
+    uint8_t command { ok ? response[bs::ControlProtocol::k_commandField] : uint8_t { 0u } };
+
+    if ((command == bs::ControlProtocol::k_commandGetRFPower) && (response.size() == (headerSize + 8u)))
+    {
+        uint32_t forward_mV { 0u };
+        uint32_t reverse_mV { 0u };
+        for (size_t i = 0; i < 4u; i++)
+        {
+            forward_mV |= static_cast<uint32_t>(response[headerSize + i]) << (8u * i);
+            reverse_mV |= static_cast<uint32_t>(response[headerSize + 4u + i]) << (8u * i);
+        }
+        std::cout << forward_mV << "," << reverse_mV << std::endl;
+    }
+    else if ((command == bs::ControlProtocol::k_commandGetSlotNumber) && (response.size() == (headerSize + 1u)))
+    {
+        std::cout << "ECM slot number: " << +response[headerSize] << std::endl;
+    }
+    else if (ok)
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "ERROR" << std::endl;
+    }
+    return ok;
+}
+
+// History time argument in seconds since the epoch, or before now if negative
+static uint64_t historyTime_ns(const char *argument)
+{
+    double time_s { std::strtod(argument, nullptr) };
+    if (time_s < 0.0)
+    {
+        time_s += std::chrono::duration<double> { std::chrono::system_clock::now().time_since_epoch() }.count();
+    }
+    return (time_s > 0.0) ? static_cast<uint64_t>(time_s * 1e9) : 0u;
+}
+
+// Whole number argument (decimal, hex or octal), returns false unless all of the argument is a
+// number from minimum to maximum
+static bool parseNumber(const char *argument, uint64_t minimum, uint64_t maximum, uint64_t& value)
+{
+    char *end { nullptr };
+    errno = 0;
+    unsigned long long number { std::strtoull(argument, &end, 0) };
+
+    // strtoull negates a leading minus sign rather than rejecting it
+    bool ok { (end != argument) && (*end == '\0') && (errno == 0) && (std::strchr(argument, '-') == nullptr) &&
+              (number >= minimum) && (number <= maximum) };
+    if (ok)
+    {
+        value = number;
+    }
+    return ok;
+}
+
+// Duration argument in seconds (e.g. 2.5), returns false unless all of the argument is a number
+// from 0 to k_maxDuration_s
+static bool parseDuration(const char *argument, std::chrono::milliseconds& duration)
+{
+    char *end { nullptr };
+    double duration_s { std::strtod(argument, &end) };
+    bool ok { (end != argument) && (*end == '\0') && (duration_s >= 0.0) && (duration_s <= k_maxDuration_s) };
+    if (ok)
+    {
+        duration = std::chrono::milliseconds { std::llround(duration_s * 1000.0) };
+    }
+    return ok;
+}
+
+// Print the history of one metric (or every metric) as CSV lines: metric,time_ns,value
+static bool printHistory(const std::string& metricName, uint64_t from_ns, uint64_t to_ns)
+{
+    bs::TelemetryHistory history;
+    if (!history.open(bs::TelemetryHistory::k_defaultPath, false))
+    {
+        return false;
+    }
+
+    bool found { false };
+    for (size_t i = 0; i < bs::TelemetryHistory::k_numberMetrics; i++)
+    {
+        bs::TelemetryHistory::Metric metric { static_cast<bs::TelemetryHistory::Metric>(i) };
+        if ((metricName != "all") && (metricName != bs::TelemetryHistory::name(metric)))
+        {
+            continue;
+        }
+        found = true;
+
+        int32_t divisor { 1 };
+        for (uint8_t decimal = 0u; decimal < bs::TelemetryHistory::decimals(metric); decimal++)
+        {
+            divisor *= 10;
+        }
+
+        // clang-format off
+        history.read(metric, from_ns, to_ns, [&] (const bs::TelemetryHistory::Record& record)
+                     {
+                         std::cout << bs::TelemetryHistory::name(metric) << "," << record.time_ns << ",";
+                         if (divisor > 1)
+                         {
+                             int32_t magnitude { std::abs(record.value) };
+                             std::cout << ((record.value < 0) ? "-" : "") << (magnitude / divisor) << "."
+                                       << std::setfill('0') << std::setw(bs::TelemetryHistory::decimals(metric))
+                                       << (magnitude % divisor);
+                         }
+                         else
+                         {
+                             std::cout << record.value;
+                         }
+                         std::cout << "\n";
+                     });
+        // clang-format on
+    }
+    std::cout << std::flush;
+
+    if (!found)
+    {
+        std::cout << "ERROR: unknown telemetry history metric " << metricName << std::endl;
+    }
+    return found;
+}
+
+// Print the daemon's shared memory status page as name=value lines
+static bool printStatus()
+{
+    bs::StatusPageReader reader;
+    bs::StatusPage::Data data {};
+    if (!reader.open() || !reader.read(data))
+    {
+        std::cout << "ERROR: BlackStarECM status page not available" << std::endl;
+        return false;
+    }
+
+    uint64_t now_ns { bs::Clock::monotonic_ns() };
+
+    // clang-format off
+    std::cout << "running=" << (((data.flags & bs::StatusPage::k_flagRunning) != 0u) ? 1 : 0) << "\n"
+              << "age_ms=" << ((now_ns - data.timestamp_ns) / 1000000u) << "\n"
+              << "updates=" << data.updateCount << "\n"
+              << "build_id=0x" << std::hex << std::setfill('0') << std::setw(8) << data.buildID << std::dec << "\n"
+              << "pid=" << data.pid << "\n"
+              << "state=" << data.state << "\n"
+              << "health_faults=0x" << std::hex << +data.healthFaults << std::dec << "\n"
+              << "flags=0x" << std::hex << +data.flags << std::dec << "\n"
+              << "can_bus_state=" << +data.CANBusState << "\n"
+              << "ecm_slot=" << +data.ECMSlot << "\n"
+              << "forward_dBm=" << data.forward_dBm << "\n"
+              << "reverse_dBm=" << data.reverse_dBm << "\n"
+              << "vswr=" << data.VSWR << "\n"
+              << "vswr_trips=" << data.VSWRTrips << "\n"
+              << "fan_rpm=" << data.fanRPM << "\n"
+              << "can_frames_received=" << data.CANFramesReceived << "\n"
+              << "can_frames_sent=" << data.CANFramesSent << "\n"
+              << "can_error_frames=" << data.CANErrorFrames << "\n"
+              << "messages_received=" << data.messagesReceived << "\n"
+              << "crc_failures=" << data.CRCFailures << "\n"
+              << "i2c_transactions=" << data.I2CTransactions << "\n"
+              << "i2c_failures=" << data.I2CFailures << "\n"
+              << "spi_transactions=" << data.SPITransactions << "\n"
+              << "spi_failures=" << data.SPIFailures << std::endl;
+    // clang-format on
+    return true;
 }
 
 int main(int argc, char *argv[])
 {
-    signal(SIGINT, signalHandler);
-    std::shared_ptr<bs::VSLBSP> BSP = std::make_shared<bs::VSLBSP>();
-
-    if (BSP->initialise())
-    {
-        bool runMainLoop { false };
-
-        // Check for command line switches - these cause this application to perform a single
-        // action and then exit, if there is no recognised switch then main loop runs until
-        // kill signal is received
-        uint32_t forward_uV { 0u };
-        uint32_t reverse_uV { 0u };
-        bool ok { true };
-        bool outputDone { false };
-        switch (getopt(argc, argv, "dEediMmrs"))
-        {
-            case 'i':
-                // 'i' option - initialise fan/PSU controller
-                ok = BSP->resetFanPSUController();
-                break;
-
-            case 'r':
-                // 'r' option - just get RF power readings and print to standard output
-                ok = BSP->getRFPowerMonitorReadings(forward_uV, reverse_uV);
-                if (ok)
-                {
-                    std::cout << forward_uV << "," << reverse_uV << std::endl;
-                    outputDone = true;
-                }
-                break;
-
-            case 'E':
-                // 'E' option - enable PSU & fans
-                ok = BSP->enableFans() && BSP->enablePSU() && BSP->enablePA();
-                BSP->setRFLEDOff();
-                break;
-
-            case 'e':
-                // 'e' option - disable PSU, fans & PA
-                BSP->mutePA();
-                ok = BSP->disableFans() && BSP->disablePSU() && BSP->disablePA();
-                BSP->setRFLEDOff();
-                break;
-
-            case 'M':
-                // 'M' option - mute PA
-                BSP->mutePA();
-                ok = true;
-                BSP->setRFLEDOff();
-                break;
-
-            case 'm':
-                // 'm' option - unmute PA
-                BSP->unmutePA();
-                ok = true;
-                BSP->setRFLEDOn();
-                break;
-
-            case 's':
-                // 's' option - report ECM slot number
-                std::cout << "ECM slot number: " << +BSP->ECMSlotNumber() << std::endl;
-                outputDone = true;
-                break;
-
-            default:
-                runMainLoop = true;
-                break;
-        }
-
-        if (!runMainLoop)
-        {
-            // If not running main loop then just output command success
-            if (!outputDone)
-            {
-                if (ok)
+    bs::StartupTimer startup;
+
+    // Check for command line switches - action switches cause this application to perform a single
+    // action and then exit, if there is no recognised action switch then main loop runs until
+    // kill signal is received. Setting switches (which take an argument) apply to all actions.
+    int action { -1 };
+    uint32_t I2CFrequency_Hz { bs::VSLBSP::k_I2CDefaultFrequency_Hz };
+    bool watchdogSoftMode { false };
+    uint8_t watchdogTimeout_s { bs::WatchdogSupervisor::k_defaultTimeout_s };
+    std::string benchmarkSuite;
+    std::string CANDevice { k_CANDevice };
+    bool simulate { false };
+    std::string ADCScript;
+    bs::RFPowerStreamer::Settings streamSettings;
+    bool streamRFPower { false };
+    std::string historyMetric;
+    uint64_t historyFrom_ns { 0u };
+    uint64_t historyTo_ns { UINT64_MAX };
+    bs::Log::Settings logSettings;
+    bool answerCommands { false };
+    std::string capturePath;
+    bs::LoadGenerator::Settings loadSettings;
+    bs::TrafficReplay::Settings replaySettings;
+    bs::HealthMonitor::Settings healthSettings;
+    uint16_t VSWRTrip_cVSWR { bs::VSWRProtection::k_defaultTrip_cVSWR };
+    bool logSpecified { false };
+    int option { -1 };
+    while ((option = getopt(argc, argv, "A:ab:C:c:D:dEeF:f:g:H:I:iJ:j:K:k:L:MmN:n:o:Ppq:R:rSsT:t:uV:W:w:x:Y:")) != -1)
+    {
+        if (option == 'S')
+        {
+            // 'S' option - use the simulated EPU hardware instead of the VersaLogic API
+            simulate = true;
+        }
+        else if (option == 'A')
+        {
+            // 'A' option - simulated RF power monitor ADC script (implies 'S')
+            simulate = true;
+            ADCScript = optarg;
+        }
+        else if (option == 'a')
+        {
+            // 'a' option - answer the MCM commands addressed to this slot, otherwise only sniff
+            answerCommands = true;
+            replaySettings.answering = true;
+        }
+        else if (option == 'C')
+        {
+            // 'C' option - capture every CAN frame received to rotating files, path.0 to path.3 (e.g.
+            // /var/log/BlackStarECM.capture), replayed with 'Y'
+            capturePath = optarg;
+        }
+        else if (option == 'c')
+        {
+            // 'c' option - CAN device (e.g. vcan0 with the simulated hardware)
+            CANDevice = optarg;
+        }
+        else if (option == 'f')
+        {
+            // 'f' option - I2C bus frequency (Hz), the standard frequency is always used below that
+            char *end { nullptr };
+            unsigned long frequency_Hz { std::strtoul(optarg, &end, 0) };
+            if ((end == optarg) || (*end != '\0') || (frequency_Hz < bs::VSLBSP::k_I2CStandardFrequency_Hz) ||
+                (frequency_Hz > UINT32_MAX))
+            {
+                std::cout << "ERROR: I2C frequency must be at least " << bs::VSLBSP::k_I2CStandardFrequency_Hz
+                          << " Hz" << std::endl;
+                return EXIT_FAILURE;
+            }
+            I2CFrequency_Hz = static_cast<uint32_t>(frequency_Hz);
+        }
+        else if (option == 'R')
+        {
+            // 'R' option - RF power streaming sample rate (Hz), streams the 'r' readings
+            uint64_t rate_Hz { 0u };
+            if (!parseNumber(optarg, 1u, bs::RFPowerStreamer::k_maxRate_Hz, rate_Hz))
+            {
+                std::cout << "ERROR: RF power streaming rate must be 1 to " << bs::RFPowerStreamer::k_maxRate_Hz
+                          << " Hz" << std::endl;
+                return EXIT_FAILURE;
+            }
+            streamSettings.rate_Hz = static_cast<uint32_t>(rate_Hz);
+            streamRFPower = true;
+        }
+        else if (option == 't')
+        {
+            // 't' option - RF power streaming duration (seconds)
+            if (!parseDuration(optarg, streamSettings.duration))
+            {
+                std::cout << "ERROR: duration must be 0 to " << static_cast<uint64_t>(k_maxDuration_s) << " s"
+                          << std::endl;
+                return EXIT_FAILURE;
+            }
+            streamRFPower = true;
+        }
+        else if (option == 'D')
+        {
+            // 'D' option - load generator duration (seconds)
+            if (!parseDuration(optarg, loadSettings.duration))
+            {
+                std::cout << "ERROR: duration must be 0 to " << static_cast<uint64_t>(k_maxDuration_s) << " s"
+                          << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (option == 'q')
+        {
+            // 'q' option - load generator open loop rate (requests per second)
+            uint64_t rate_Hz { 0u };
+            if (!parseNumber(optarg, 1u, bs::LoadGenerator::k_maxRate_Hz, rate_Hz))
+            {
+                std::cout << "ERROR: load generator rate must be 1 to " << bs::LoadGenerator::k_maxRate_Hz
+                          << " per second" << std::endl;
+                return EXIT_FAILURE;
+            }
+            loadSettings.rate_Hz = static_cast<uint32_t>(rate_Hz);
+        }
+        else if (option == 'k')
+        {
+            // 'k' option - load generator closed loop requests outstanding per slot
+            uint64_t outstanding { 0u };
+            if (!parseNumber(optarg, 1u, bs::LoadGenerator::k_maxOutstanding, outstanding))
+            {
+                std::cout << "ERROR: load generator requests outstanding must be 1 to "
+                          << bs::LoadGenerator::k_maxOutstanding << std::endl;
+                return EXIT_FAILURE;
+            }
+            loadSettings.outstanding = static_cast<uint32_t>(outstanding);
+        }
+        else if (option == 'N')
+        {
+            // 'N' option - load generator number of ECM slots (from slot 0)
+            uint64_t slots { 0u };
+            if (!parseNumber(optarg, 1u, bs::LoadGenerator::k_maxSlots, slots))
+            {
+                std::cout << "ERROR: load generator slots must be 1 to " << +bs::LoadGenerator::k_maxSlots << std::endl;
+                return EXIT_FAILURE;
+            }
+            loadSettings.slots = static_cast<uint8_t>(slots);
+        }
+        else if (option == 'x')
+        {
+            // 'x' option - load generator command mix, e.g. "getstate:4,ping:1,upload:1"
+            loadSettings.mix = optarg;
+        }
+        else if (option == 'n')
+        {
+            // 'n' option - RF power streaming sample count
+            if (!parseNumber(optarg, 0u, UINT64_MAX, streamSettings.count))
+            {
+                std::cout << "ERROR: invalid RF power streaming sample count " << optarg << std::endl;
+                return EXIT_FAILURE;
+            }
+            streamRFPower = true;
+        }
+        else if (option == 'I')
+        {
+            // 'I' option - CAN replay passes, the first is checked against the golden file
+            uint64_t passes { 0u };
+            if (!parseNumber(optarg, 1u, UINT32_MAX, passes))
+            {
+                std::cout << "ERROR: CAN replay passes must be 1 to " << UINT32_MAX << std::endl;
+                return EXIT_FAILURE;
+            }
+            replaySettings.passes = static_cast<uint32_t>(passes);
+        }
+        else if (option == 'p')
+        {
+            // 'p' option - replay CAN traffic at the recorded pace rather than as fast as possible
+            replaySettings.pace = bs::TrafficReplay::Pace::Recorded;
+        }
+        else if ((option == 'j') || (option == 'J'))
+        {
+            // 'j' option - check the replayed responses against a golden file, 'J' - write it
+            replaySettings.golden = optarg;
+            replaySettings.writeGolden = (option == 'J');
+        }
+        else if (option == 'o')
+        {
+            // 'o' option - RF power streaming output format, "csv" or "binary"
+            std::string format { optarg };
+            if ((format != "csv") && (format != "binary"))
+            {
+                std::cout << "ERROR: RF power streaming format must be csv or binary" << std::endl;
+                return EXIT_FAILURE;
+            }
+            streamSettings.format = (format == "binary") ? bs::RFPowerStreamer::Format::Binary
+                                                         : bs::RFPowerStreamer::Format::CSV;
+            streamRFPower = true;
+        }
+        else if (option == 'W')
+        {
+            // 'W' option - RF power streaming statistics window (readings)
+            uint64_t window { 0u };
+            if (!parseNumber(optarg, 0u, UINT32_MAX, window))
+            {
+                std::cout << "ERROR: invalid RF power streaming window " << optarg << std::endl;
+                return EXIT_FAILURE;
+            }
+            streamSettings.window = static_cast<uint32_t>(window);
+            streamRFPower = true;
+        }
+        else if (option == 'F')
+        {
+            // 'F' option - telemetry history window start (seconds since the epoch, or before now if negative)
+            historyFrom_ns = historyTime_ns(optarg);
+        }
+        else if (option == 'T')
+        {
+            // 'T' option - telemetry history window end (as 'F')
+            historyTo_ns = historyTime_ns(optarg);
+        }
+        else if (option == 'K')
+        {
+            // 'K' option - health monitor settings, e.g. "rf_ms=100,status_mask=0x0C" (see HealthMonitor::parse)
+            if (!bs::HealthMonitor::parse(optarg, healthSettings))
+            {
+                std::cout << "ERROR: invalid health monitor settings " << optarg << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (option == 'V')
+        {
+            // 'V' option - VSWR protection trip threshold, e.g. 3.0 for 3.00:1
+            char *end { nullptr };
+            double VSWR { std::strtod(optarg, &end) };
+            if ((end == optarg) || (*end != '\0') || !(VSWR >= 1.01) || (VSWR > 655.35))
+            {
+                std::cout << "ERROR: VSWR trip threshold must be 1.01 to 655.35" << std::endl;
+                return EXIT_FAILURE;
+            }
+            VSWRTrip_cVSWR = static_cast<uint16_t>(std::lround(VSWR * 100.0));
+        }
+        else if (option == 'L')
+        {
+            // 'L' option - daemon log output, "stdout", "journal" or a log file path (rotated)
+            std::string sink { optarg };
+            logSpecified = true;
+            if (sink == "stdout")
+            {
+                logSettings.sink = bs::Log::Sink::Stdout;
+            }
+            else if (sink == "journal")
+            {
+                logSettings.sink = bs::Log::Sink::Journal;
+            }
+            else
+            {
+                logSettings.sink = bs::Log::Sink::File;
+                logSettings.path = sink;
+            }
+        }
+        else if (option == 'w')
+        {
+            // 'w' option - hardware watchdog timeout (seconds), or "soft" to only log stalls
+            watchdogSoftMode = (std::string { optarg } == "soft");
+            if (!watchdogSoftMode)
+            {
+                char *end { nullptr };
+                unsigned long timeout_s { std::strtoul(optarg, &end, 0) };
+                if ((end == optarg) || (*end != '\0') || (timeout_s < bs::WatchdogSupervisor::k_minimumTimeout_s) ||
+                    (timeout_s > bs::WatchdogSupervisor::k_maximumTimeout_s))
                 {
-                    std::cout << "OK" << std::endl;
+                    std::cout << "ERROR: watchdog timeout must be " << +bs::WatchdogSupervisor::k_minimumTimeout_s
+                              << " to " << +bs::WatchdogSupervisor::k_maximumTimeout_s << " s, or soft" << std::endl;
+                    return EXIT_FAILURE;
                 }
-                else
+                watchdogTimeout_s = static_cast<uint8_t>(timeout_s);
+            }
+        }
+        else
+        {
+            if (option == 'b')
+            {
+                // 'b' option - benchmark suite name
+                benchmarkSuite = optarg;
+            }
+            else if (option == 'H')
+            {
+                // 'H' option - print the telemetry history of a metric (or "all")
+                historyMetric = optarg;
+            }
+            else if (option == 'Y')
+            {
+                // 'Y' option - replay a CAN capture through the message handler
+                replaySettings.path = optarg;
+            }
+            else if (option == 'g')
+            {
+                // 'g' option - load generator mode, "open" or "closed" loop
+                std::string mode { optarg };
+                if ((mode != "open") && (mode != "closed"))
                 {
-                    std::cout << "ERROR" << std::endl;
+                    std::cout << "ERROR: load generator mode must be open or closed" << std::endl;
+                    return EXIT_FAILURE;
                 }
+                loadSettings.mode = (mode == "closed") ? bs::LoadGenerator::Mode::Closed
+                                                       : bs::LoadGenerator::Mode::Open;
+            }
+            // Only the first action switch is used
+            if (action == -1)
+            {
+                action = option;
+            }
+        }
+    }
+
+    // The telemetry history is read straight from the file, the daemon may be running or not
+    if (action == 'H')
+    {
+        return printHistory(historyMetric, historyFrom_ns, historyTo_ns) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // 'u' option - print the daemon's status page, read from shared memory without involving the daemon
+    if (action == 'u')
+    {
+        return printStatus() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // 'g' option - stand in for the MCM and load a daemon over CAN (-c), no hardware is used
+    if (action == 'g')
+    {
+        loadSettings.device = CANDevice;
+        bs::LoadGenerator generator;
+        return (generator.build(loadSettings) && generator.run()) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // 'P' option - print the daemon's metrics (Prometheus text format)
+    if (action == 'P')
+    {
+        std::string metrics;
+        if (!bs::MetricsServer::fetch("text\n", metrics))
+        {
+            std::cout << "ERROR: BlackStarECM daemon is not running" << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << metrics << std::flush;
+        return EXIT_SUCCESS;
+    }
+
+    // Streaming settings turn the 'r' action into a stream, it needs the SPI bus to itself
+    streamRFPower = streamRFPower && (action == 'r');
+    if (streamRFPower)
+    {
+        bs::ControlClient controlClient;
+        bs::ControlClient::Connection connection { controlClient.connect() };
+        if (connection == bs::ControlClient::Connection::Connected)
+        {
+            std::cout << "ERROR: BlackStarECM daemon is running, stop it before streaming RF power" << std::endl;
+            return EXIT_FAILURE;
+        }
+        else if (connection == bs::ControlClient::Connection::Failed)
+        {
+            std::cout << "ERROR: could not connect to the BlackStarECM control socket (" << std::strerror(errno)
+                      << ")" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // Standard output only carries the stream, anything else goes to standard error
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    // One-shot actions go to the daemon when it is running so that they don't initialise the
+    // hardware underneath it, the hardware is only accessed directly when there is no daemon
+    uint8_t command { streamRFPower ? uint8_t { 0u } : oneShotCommand(action) };
+    if (command != 0u)
+    {
+        bs::ControlClient controlClient;
+        bs::ControlClient::Connection connection { controlClient.connect() };
+        if (connection == bs::ControlClient::Connection::Connected)
+        {
+            std::vector<uint8_t> response;
+            if (!controlClient.transact(command, response))
+            {
+                response.clear();
+            }
+            return printOneShotResponse(response) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (connection == bs::ControlClient::Connection::Failed)
+        {
+            // The daemon may be running, so the hardware isn't touched
+            std::cout << "ERROR: could not connect to the BlackStarECM control socket (" << std::strerror(errno)
+                      << ")" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // A replay runs on the simulated hardware, the handler's log is discarded unless asked for
+    if (action == 'Y')
+    {
+        simulate = true;
+        if (!logSpecified)
+        {
+            logSettings.sink = bs::Log::Sink::File;
+            logSettings.path = "/dev/null";
+        }
+    }
+
+    std::shared_ptr<bs::EPUHardware> hardware;
+    if (simulate)
+    {
+        std::shared_ptr<bs::SimulatedHardware> simulatedHardware { std::make_shared<bs::SimulatedHardware>() };
+        if (!ADCScript.empty() && !simulatedHardware->loadADCScript(ADCScript))
+        {
+            return EXIT_FAILURE;
+        }
+        hardware = simulatedHardware;
+    }
+    else
+    {
+        hardware = std::make_shared<bs::VersaLogicHardware>();
+    }
+    std::shared_ptr<bs::VSLBSP> BSP = std::make_shared<bs::VSLBSP>(hardware);
+
+    if (BSP->initialise(I2CFrequency_Hz))
+    {
+        if (command != 0u)
+        {
+            // No daemon running so execute the one-shot in this process
+            bs::ControlServer controlServer;
+            controlServer.build(BSP, nullptr, nullptr, nullptr);
+            std::vector<uint8_t> response;
+            controlServer.execute({ bs::ControlProtocol::k_version, command }, response);
+            if (!printOneShotResponse(response))
+            {
+                return EXIT_FAILURE;
+            }
+        }
+        else if (streamRFPower)
+        {
+            bs::RFPowerStreamer streamer;
+            streamer.build(BSP, streamSettings);
+            if (!streamer.run())
+            {
+                return EXIT_FAILURE;
+            }
+        }
+        else if (action == 'Y')
+        {
+            bs::TrafficReplay replay;
+            replay.build(BSP, replaySettings);
+            bs::Log::start(logSettings);
+            bool ok { replay.run() };
+            bs::Log::stop();
+            if (!ok)
+            {
+                return EXIT_FAILURE;
+            }
+        }
+        else if (action == 'b')
+        {
+            // 'b' option - run a benchmark suite and print the results to standard output
+            bs::Benchmark benchmark;
+            benchmark.build(BSP);
+            if (!benchmark.run(benchmarkSuite))
+            {
+                std::cout << "ERROR" << std::endl;
+                return EXIT_FAILURE;
             }
         }
         else
@@ -115,38 +726,195 @@ int main(int argc, char *argv[])
                       << std::setfill('0') << std::setw(8) << std::right << std::hex
                       << bs::k_buildID << std::endl;
             // clang-format on
-            if (BSP->resetFanPSUController())
-            {
-                // Initialise hardware to safe values
-                BSP->disablePA();
-                BSP->setRFLEDOff();
-                BSP->disablePSU();
-                BSP->disableFans();
-            }
-            else
+
+            // From here on the daemon threads log through the asynchronous logger
+            if (!bs::Log::start(logSettings))
             {
-                std::cout << "ERROR: could not initialise fan/PSU controller" << std::endl;
+                std::cout << "WARNING: logging to standard output" << std::endl;
             }
+            bs::StartupTimer::clock::time_point phase { startup.phaseComplete("BSP", startup.start()) };
+
+            // Startup is phased so that the CAN interface is answering (state Started) as early as
+            // possible, the fan/PSU controller and the RF power monitor are brought up on their own
+            // thread while the CAN client runs
+
+            // The main thread runs the event loop, signals are routed to it before any other thread
+            // is started so that every thread inherits the blocked signal mask
+            bs::EventLoop eventLoop;
+            eventLoop.build();
+            eventLoop.addSignal(SIGINT, [&eventLoop] (const signalfd_siginfo&) { eventLoop.stop(); });
+            eventLoop.addSignal(SIGTERM, [&eventLoop] (const signalfd_siginfo&) { eventLoop.stop(); });
+
+            // SIGUSR1 dumps the last second of tracepoints (in a BLACKSTAR_TRACE build)
+            eventLoop.addSignal(SIGUSR1, [] (const signalfd_siginfo&) { bs::Trace::dump(); });
 
-            // Make the CAN message handler, CAN client and the Mercury state handler
+            std::shared_ptr<bs::DIOInputMonitor> inputMonitor { std::make_shared<bs::DIOInputMonitor>() };
+            inputMonitor->build(BSP, eventLoop);
+
+            // Every thread which must keep running reports progress to the watchdog supervisor
+            std::shared_ptr<bs::WatchdogSupervisor> watchdog { std::make_shared<bs::WatchdogSupervisor>() };
+            watchdog->build(BSP, watchdogSoftMode, watchdogTimeout_s);
+            std::shared_ptr<bs::Heartbeat> eventLoopHeartbeat {
+                watchdog->addThread("EventLoop", std::chrono::milliseconds { 2000 }) };
+            eventLoop.addTimer(std::chrono::milliseconds { 500 },
+                               [eventLoopHeartbeat] () { eventLoopHeartbeat->beat(); });
+            phase = startup.phaseComplete("events", phase);
+
+            // Make the CAN message handler, CAN client, the Mercury state handler and RF power monitor
             std::shared_ptr<bs::CANMessageHandler> messageHandler { std::make_shared<bs::CANMessageHandler>() };
             std::shared_ptr<bs::MercuryStateHandler> stateHandler { std::make_shared<bs::MercuryStateHandler>() };
-            bs::CANClient client;
+            std::shared_ptr<bs::RFPowerMonitor> powerMonitor { std::make_shared<bs::RFPowerMonitor>() };
+            std::shared_ptr<bs::VSWRProtection> VSWRProtection { std::make_shared<bs::VSWRProtection>() };
+            std::shared_ptr<bs::BoardTelemetry> boardTelemetry { std::make_shared<bs::BoardTelemetry>() };
+            std::shared_ptr<bs::BitEngine> bitEngine { std::make_shared<bs::BitEngine>() };
+            std::shared_ptr<bs::TelemetryHistory> history { std::make_shared<bs::TelemetryHistory>() };
+            std::shared_ptr<bs::CANClient> client { std::make_shared<bs::CANClient>() };
+            bs::TelemetryRecorder recorder;
+            bs::HealthMonitor healthMonitor;
+
+            // The state handler owns the VSWR protection so the protection actions only hold a weak
+            // reference back to the state handler
+            std::weak_ptr<bs::MercuryStateHandler> weakStateHandler { stateHandler };
+
+            powerMonitor->build(BSP);
+            boardTelemetry->build(BSP);
+            bitEngine->build(BSP, boardTelemetry);
+            // clang-format off
+            VSWRProtection->build(powerMonitor->readings(),
+                                  powerMonitor->converter(),
+                                  [weakStateHandler] ()
+                                  {
+                                      if (auto handler = weakStateHandler.lock()) { handler->VSWRTripped(); }
+                                  },
+                                  [weakStateHandler] ()
+                                  {
+                                      if (auto handler = weakStateHandler.lock()) { handler->VSWRCleared(); }
+                                  });
+            // clang-format on
+            VSWRProtection->setTripThreshold(VSWRTrip_cVSWR);
+            powerMonitor->setReadingAction([VSWRProtection] () { VSWRProtection->notify(); });
+            stateHandler->build(BSP, powerMonitor, VSWRProtection);
+            messageHandler->build(inputMonitor->ECMSlotNumber(), stateHandler, powerMonitor, VSWRProtection, bitEngine);
+            messageHandler->setAnswering(answerCommands);
+            client->build(CANDevice, messageHandler);
+            if (!capturePath.empty())
+            {
+                std::shared_ptr<bs::CANCapture> capture { std::make_shared<bs::CANCapture>() };
+                if (capture->open(capturePath))
+                {
+                    client->setCapture(capture);
+                }
+            }
 
-            stateHandler->build(BSP);
-            messageHandler->build(BSP->ECMSlotNumber(), stateHandler);
-            client.build(k_CANDevice, messageHandler);
+            client->setHeartbeat(watchdog->addThread("CAN", std::chrono::milliseconds { 1000 }));
+            powerMonitor->setHeartbeat(watchdog->addThread("RFPowerMonitor", std::chrono::milliseconds { 1000 }));
+            VSWRProtection->setHeartbeat(watchdog->addThread("VSWRProtection", std::chrono::milliseconds { 100 }));
+            boardTelemetry->setHeartbeat(watchdog->addThread("BoardTelemetry", std::chrono::milliseconds { 2000 }));
+            healthMonitor.build(stateHandler, boardTelemetry, powerMonitor, client, healthSettings);
+            healthMonitor.setHeartbeat(watchdog->addThread("HealthMonitor", std::chrono::milliseconds { 1000 }));
+            bitEngine->setHeartbeat(watchdog->addThread("BitEngine", std::chrono::milliseconds { 2000 }));
 
-            // Run the CAN client
-            client.run();
+            client->run();
+            phase = startup.phaseComplete("CAN", phase);
 
-            // Keep going until kill signal is received
-            while (keepRunning)
+            // Supervisory tools read the status page from shared memory
+            std::shared_ptr<bs::StatusPublisher> statusPublisher { std::make_shared<bs::StatusPublisher>() };
+            statusPublisher->build(BSP, stateHandler, powerMonitor, VSWRProtection, boardTelemetry, client,
+                                   inputMonitor->ECMSlotNumber());
+            if (statusPublisher->open())
             {
+                statusPublisher->setHeartbeat(
+                    watchdog->addThread("StatusPublisher", std::chrono::milliseconds { 1000 }));
+                statusPublisher->run();
             }
 
-            // Stop the CAN client
-            client.stop();
+            // One-shot actions from other processes are served from the event loop
+            bs::ControlServer controlServer;
+            controlServer.build(BSP, stateHandler, powerMonitor, inputMonitor);
+            controlServer.listen(eventLoop);
+
+            // Metrics are served from the event loop too
+            bs::MetricsServer metricsServer;
+            metricsServer.build(BSP, stateHandler);
+            metricsServer.listen(eventLoop);
+            phase = startup.phaseComplete("control", phase);
+
+            // clang-format off
+            auto initialiseHardware = [&, phase] ()
+            {
+                bs::StartupTimer::clock::time_point hardwarePhase { phase };
+
+                // Initialise hardware to safe values
+                bool hardwareOK { BSP->resetFanPSUController() };
+                if (hardwareOK)
+                {
+                    BSP->disablePA();
+                    BSP->setRFLEDOff();
+                    BSP->disablePSU();
+                    BSP->disableFans();
+                }
+                else
+                {
+                    std::cout << "ERROR: could not initialise fan/PSU controller" << std::endl;
+                }
+                hardwarePhase = startup.phaseComplete("fan/PSU reset", hardwarePhase);
+
+                // The RF power monitor and VSWR protection must be running before the state
+                // handler allows jamming
+                powerMonitor->run();
+                VSWRProtection->run();
+                hardwarePhase = startup.phaseComplete("RF monitor", hardwarePhase);
+
+                boardTelemetry->run();
+
+                stateHandler->initialise(hardwareOK);
+                healthMonitor.run();
+                bitEngine->run();
+                hardwarePhase = startup.phaseComplete("PSU/fans", hardwarePhase);
+
+                // The history file is created (or its records recovered) here rather than before
+                // the CAN client starts, a missing history is not fatal
+                if (history->open())
+                {
+                    recorder.build(history, BSP, powerMonitor, boardTelemetry, stateHandler);
+                    recorder.setHeartbeat(watchdog->addThread("TelemetryRecorder", std::chrono::milliseconds { 1000 }));
+                    recorder.run();
+                }
+                else
+                {
+                    std::cout << "WARNING: telemetry history will not be recorded" << std::endl;
+                }
+                hardwarePhase = startup.phaseComplete("history", hardwarePhase);
+
+                // Only supervise once every supervised thread is running
+                watchdog->run();
+                startup.phaseComplete("watchdog", hardwarePhase);
+            };
+            // clang-format on
+            std::thread hardwareInitialisation { initialiseHardware };
+
+            // Keep going until kill signal is received
+            bs::Metrics::registerThread("EventLoop");
+            eventLoop.run();
+
+            // Let hardware initialisation finish, then stop the watchdog supervisor (disabling the
+            // hardware watchdog) first so that stopping the other threads doesn't look like a stall,
+            // then the health monitor, status publisher, telemetry recorder, CAN client, BIT engine,
+            // board telemetry, VSWR protection and RF power monitor sampler
+            hardwareInitialisation.join();
+            watchdog->stop();
+            healthMonitor.stop();
+            statusPublisher->stop();
+            recorder.stop();
+            client->stop();
+            bitEngine->stop();
+            boardTelemetry->stop();
+            VSWRProtection->stop();
+            powerMonitor->stop();
+            bs::Log::stop();
+
+            BSP->I2CBus().printStatistics();
+            BSP->SPIBus().printStatistics();
         }
     }
     else
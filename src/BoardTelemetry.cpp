@@ -0,0 +1,150 @@
+#include "BoardTelemetry.hpp"
+#include "Clock.hpp"
+#include "Log.hpp"
+#include "Metrics.hpp"
+
+namespace mercury::blackstar
+{
+    // clang-format off
+    // Supplies are measured through resistive dividers, temperatures with 10 mV/C sensors with a
+    // 500 mV offset at 0 C. PROVISIONAL: the input allocation, divider ratios and sensor type are
+    // placeholders, they aren't documented in this repository and must be checked against the
+    // BlackStar board schematic before the values are relied on.
+    static const BoardTelemetry::Channel k_channels[BoardTelemetry::k_numberChannels]
+    {
+        { "supply_28V",        0u, BoardTelemetry::ChannelType::Voltage,     11.0f,   0.0f },
+        { "supply_12V",        1u, BoardTelemetry::ChannelType::Voltage,      4.0f,   0.0f },
+        { "supply_5V",         2u, BoardTelemetry::ChannelType::Voltage,      2.0f,   0.0f },
+        { "supply_3V3",        3u, BoardTelemetry::ChannelType::Voltage,      1.0f,   0.0f },
+        { "PA_temperature",    4u, BoardTelemetry::ChannelType::Temperature, 100.0f, -50.0f },
+        { "board_temperature", 5u, BoardTelemetry::ChannelType::Temperature, 100.0f, -50.0f }
+    };
+    // clang-format on
+
+    void BoardTelemetry::build(std::shared_ptr<VSLBSP> BSP)
+    {
+        m_BSP = BSP;
+
+        m_inputMask = 0u;
+        for (const Channel& channel : k_channels)
+        {
+            m_inputMask |= static_cast<uint8_t>(1u << channel.input);
+        }
+    }
+
+    void BoardTelemetry::run()
+    {
+        m_stopRequested = false;
+
+        // clang-format off
+        m_boardTelemetryThread = std::thread { [&] ()
+                                               {
+                                                   start();
+                                               }
+                                             };
+        // clang-format on
+    }
+
+    void BoardTelemetry::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock { m_wakeMutex };
+            m_stopRequested = true;
+        }
+        m_wakeCondition.notify_one();
+
+        if (m_boardTelemetryThread.joinable())
+        {
+            m_boardTelemetryThread.join();
+        }
+
+        if (m_BSP != nullptr)
+        {
+            m_BSP->configureBoardADC(0u);
+        }
+    }
+
+    void BoardTelemetry::setHeartbeat(std::shared_ptr<Heartbeat> heartbeat)
+    {
+        m_heartbeat = heartbeat;
+    }
+
+    bool BoardTelemetry::latest(BoardTelemetrySnapshot& snapshot) const
+    {
+        return m_snapshots.latest(snapshot);
+    }
+
+    const BoardTelemetry::Channel& BoardTelemetry::channel(size_t index)
+    {
+        return k_channels[index];
+    }
+
+    void BoardTelemetry::start()
+    {
+        Metrics::registerThread("BoardTelemetry");
+
+        using clock = std::chrono::steady_clock;
+
+        if (!m_BSP->configureBoardADC(m_inputMask))
+        {
+            Log::warning("board ADC auto-scan not available, channels will be converted one at a time");
+        }
+
+        BoardTelemetrySnapshot snapshot;
+        clock::time_point nextScan { clock::now() };
+        uint32_t tick { 0u };
+
+        while (!m_stopRequested)
+        {
+            scan(snapshot);
+            if ((tick++ % k_slowDivider) == 0u)
+            {
+                readSlowDevices(snapshot);
+            }
+            m_snapshots.push(snapshot);
+
+            if (m_heartbeat != nullptr)
+            {
+                m_heartbeat->beat();
+            }
+
+            nextScan += k_scanPeriod;
+            std::unique_lock<std::mutex> lock { m_wakeMutex };
+            m_wakeCondition.wait_until(lock, nextScan, [&] () { return m_stopRequested.load(); });
+        }
+    }
+
+    void BoardTelemetry::scan(BoardTelemetrySnapshot& snapshot)
+    {
+        EPUHardware::AnalogInputs volts {};
+        bool ok { m_BSP->readBoardADC(m_inputMask, volts) };
+
+        snapshot.scanTimestamp_ns = Clock::monotonic_ns();
+        snapshot.scanCount++;
+        snapshot.validChannels = 0u;
+        if (ok)
+        {
+            for (size_t i = 0; i < k_numberChannels; i++)
+            {
+                const Channel& channel { k_channels[i] };
+                snapshot.values[i] = (static_cast<float>(volts[channel.input]) * channel.scale) + channel.offset;
+                snapshot.validChannels |= static_cast<uint8_t>(1u << i);
+            }
+        }
+    }
+
+    void BoardTelemetry::readSlowDevices(BoardTelemetrySnapshot& snapshot)
+    {
+        uint16_t RPM { 0u };
+        snapshot.fanRPMValid = m_BSP->getFanRPM(RPM);
+        snapshot.fanRPM = RPM;
+        snapshot.fanTimestamp_ns = Clock::monotonic_ns();
+
+        uint8_t status { 0u };
+        uint8_t control { 0u };
+        snapshot.fanPSUStatusValid = m_BSP->getFanPSUStatus(status) && m_BSP->getFanPSUControl(control);
+        snapshot.fanPSUStatus = status;
+        snapshot.fanPSUControl = control;
+        snapshot.fanPSUStatusTimestamp_ns = Clock::monotonic_ns();
+    }
+}
@@ -0,0 +1,133 @@
+#include "BusScheduler.hpp"
+
+#include <iomanip>
+#include <iostream>
+
+namespace mercury::blackstar
+{
+    static const char *const k_priorityNames[BusScheduler::k_numberPriorities] { "safety", "state", "telemetry" };
+
+    void BusScheduler::build(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+        m_name = name;
+        m_buildTime = std::chrono::steady_clock::now();
+        m_statistics = Statistics {};
+    }
+
+    const std::string& BusScheduler::name() const
+    {
+        return m_name;
+    }
+
+    BusScheduler::Statistics BusScheduler::statistics() const
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+        Statistics statistics { m_statistics };
+        statistics.elapsed_ns = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_buildTime)
+                .count());
+        return statistics;
+    }
+
+    void BusScheduler::printStatistics() const
+    {
+        Statistics stats { statistics() };
+        double utilisation { (stats.elapsed_ns > 0u) ? (100.0 * static_cast<double>(stats.busy_ns) /
+                                                        static_cast<double>(stats.elapsed_ns))
+                                                     : 0.0 };
+
+        std::cout << m_name << " bus: utilisation " << std::fixed << std::setprecision(2) << utilisation << "%";
+        for (size_t i = 0; i < k_numberPriorities; i++)
+        {
+            const PriorityStatistics& priority { stats.priorities[i] };
+            uint64_t attempts { priority.transactions + priority.retries };
+            if (attempts > 0u)
+            {
+                std::cout << ", " << k_priorityNames[i] << " " << std::dec << priority.transactions
+                          << " (failed " << priority.failures << ", retries " << priority.retries << ") wait mean/max "
+                          << (priority.totalWait_ns / attempts / 1000u) << "/" << (priority.maxWait_ns / 1000u)
+                          << " us time mean/max " << (priority.totalTime_ns / attempts / 1000u) << "/"
+                          << (priority.maxTime_ns / 1000u) << " us";
+            }
+        }
+        std::cout << std::defaultfloat << std::endl;
+    }
+
+    std::chrono::steady_clock::time_point BusScheduler::acquire(Priority priority)
+    {
+        size_t index { static_cast<size_t>(priority) };
+        std::chrono::steady_clock::time_point requested { std::chrono::steady_clock::now() };
+        std::unique_lock<std::mutex> lock { m_mutex };
+
+        uint64_t ticket { m_nextTicket[index]++ };
+        m_waiting[index]++;
+
+        // Granted when the bus is free, this is the oldest request at its priority and nothing is
+        // waiting at a higher priority
+        // clang-format off
+        m_grantCondition.wait(lock, [&] ()
+                              {
+                                  bool higherWaiting { false };
+                                  for (size_t i = 0; i < index; i++)
+                                  {
+                                      higherWaiting = higherWaiting || (m_waiting[i] > 0u);
+                                  }
+                                  return !m_busy && !higherWaiting && (m_servingTicket[index] == ticket);
+                              });
+        // clang-format on
+
+        m_busy = true;
+        m_waiting[index]--;
+        m_servingTicket[index]++;
+
+        std::chrono::steady_clock::time_point granted { std::chrono::steady_clock::now() };
+        uint64_t wait_ns { static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(granted - requested).count()) };
+        PriorityStatistics& statistics { m_statistics.priorities[index] };
+        statistics.totalWait_ns += wait_ns;
+        statistics.maxWait_ns = std::max(statistics.maxWait_ns, wait_ns);
+
+        return granted;
+    }
+
+    void BusScheduler::release(Priority priority, std::chrono::steady_clock::time_point granted)
+    {
+        uint64_t time_ns { static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - granted).count()) };
+        bool waiters { false };
+
+        {
+            std::lock_guard<std::mutex> lock { m_mutex };
+            m_busy = false;
+
+            PriorityStatistics& statistics { m_statistics.priorities[static_cast<size_t>(priority)] };
+            statistics.totalTime_ns += time_ns;
+            statistics.maxTime_ns = std::max(statistics.maxTime_ns, time_ns);
+            m_statistics.busy_ns += time_ns;
+
+            for (uint32_t waiting : m_waiting)
+            {
+                waiters = waiters || (waiting > 0u);
+            }
+        }
+
+        // Every waiter has to re-check as only the one at the front of the highest priority can go
+        if (waiters)
+        {
+            m_grantCondition.notify_all();
+        }
+    }
+
+    void BusScheduler::record(Priority priority, bool ok, uint8_t retries)
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+        PriorityStatistics& statistics { m_statistics.priorities[static_cast<size_t>(priority)] };
+        statistics.transactions++;
+        statistics.retries += retries;
+        if (!ok)
+        {
+            statistics.failures++;
+        }
+    }
+}
@@ -0,0 +1,387 @@
+#include "CANCapture.hpp"
+#include "Log.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mercury::blackstar
+{
+    static_assert(std::is_standard_layout<CANCapture::FileHeader>::value, "Capture header must be standard layout");
+
+    static uint8_t *putVarint(uint8_t *output, uint64_t value)
+    {
+        while (value >= 0x80u)
+        {
+            *output++ = static_cast<uint8_t>(value | 0x80u);
+            value >>= 7;
+        }
+        *output++ = static_cast<uint8_t>(value);
+        return output;
+    }
+
+    // Returns false if the varint runs past the end
+    static bool getVarint(const uint8_t *& input, const uint8_t *end, uint64_t& value)
+    {
+        value = 0u;
+        for (uint32_t shift = 0; (input < end) && (shift < 64u); shift += 7u)
+        {
+            uint8_t byte { *input++ };
+            value |= static_cast<uint64_t>(byte & 0x7Fu) << shift;
+            if ((byte & 0x80u) == 0u)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    CANCapture::~CANCapture()
+    {
+        close();
+    }
+
+    bool CANCapture::open(const std::string& path, uint64_t fileSize, uint32_t files)
+    {
+        close();
+
+        m_path = path;
+        m_fileSize = std::max<uint64_t>(fileSize, sizeof(FileHeader) + k_maxRecordSize);
+        m_files = std::max(files, 2u);
+
+        // Carry on after the newest file of an earlier capture, so a restart doesn't overwrite it
+        m_sequence = 0u;
+        for (uint32_t file = 0; file < m_files; file++)
+        {
+            uint64_t sequence { 0u };
+            if (readFile(m_path + "." + std::to_string(file), nullptr, &sequence))
+            {
+                m_sequence = std::max(m_sequence, sequence + 1u);
+            }
+        }
+
+        // The first file is prepared here, the preparer then keeps the next one ready
+        File file { createFile(m_sequence) };
+        if (file.fd < 0)
+        {
+            return false;
+        }
+        startFile(file);
+
+        m_stopRequested = false;
+        m_nextFailed = false;
+        m_finished.reserve(m_files);
+
+        // clang-format off
+        m_preparerThread = std::thread { [&] ()
+                                         {
+                                             prepare();
+                                         }
+                                       };
+        // clang-format on
+        return true;
+    }
+
+    void CANCapture::close()
+    {
+        if (!m_preparerThread.joinable())
+        {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock { m_preparerMutex };
+            m_stopRequested = true;
+        }
+        m_preparerCondition.notify_all();
+        m_preparerThread.join();
+
+        if (m_header != nullptr)
+        {
+            File file { finishFile() };
+            releaseFile(file);
+        }
+
+        // A prepared file which was never started has no magic number, it is ignored by read()
+        releaseFile(m_next);
+        Log::info("CAN capture stopped, {} frames dropped by the kernel", m_reportedDrops);
+    }
+
+    void CANCapture::record(uint64_t timestamp_ns, const ::can_frame& frame, uint32_t kernelDrops)
+    {
+        // Capture stops (with the error logged once) if the next file can't be created
+        if (m_header == nullptr)
+        {
+            return;
+        }
+        if (((m_offset + k_maxRecordSize) > m_fileSize) && !nextFile())
+        {
+            return;
+        }
+
+        if (m_header->frames == 0u)
+        {
+            m_header->firstTimestamp_ns = timestamp_ns;
+            m_previous_ns = timestamp_ns;
+        }
+
+        // Zigzag so that a wall clock step backwards is still a small delta
+        int64_t delta_ns { static_cast<int64_t>(timestamp_ns - m_previous_ns) };
+        uint64_t zigzag { (static_cast<uint64_t>(delta_ns) << 1) ^ static_cast<uint64_t>(delta_ns >> 63) };
+        uint8_t length { std::min<uint8_t>(frame.can_dlc, CAN_MAX_DLEN) };
+
+        uint8_t *output { putVarint(m_file.mapping + m_offset, zigzag) };
+        output = putVarint(output, frame.can_id);
+        *output++ = length;
+        std::memcpy(output, frame.data, length);
+        m_offset = static_cast<size_t>((output + length) - m_file.mapping);
+        m_previous_ns = timestamp_ns;
+
+        m_header->lastTimestamp_ns = timestamp_ns;
+        m_header->frames++;
+        m_header->kernelDrops = kernelDrops;
+        m_header->used.store(m_offset - sizeof(FileHeader), std::memory_order_release);
+    }
+
+    void CANCapture::startFile(const File& file)
+    {
+        // The new file is zero filled, the magic number goes in last so a reader never accepts a
+        // header which isn't set up
+        m_file = file;
+        m_header = reinterpret_cast<FileHeader *>(m_file.mapping);
+        m_header->version = k_version;
+        m_header->headerSize = sizeof(FileHeader);
+        m_header->fileSize = m_fileSize;
+        m_header->sequence = m_sequence;
+        m_header->kernelDrops = m_reportedDrops;
+        std::atomic_thread_fence(std::memory_order_release);
+        m_header->magic = k_magic;
+        m_offset = sizeof(FileHeader);
+
+        Log::info("CAN capture writing {}.{}", m_path, m_sequence % m_files);
+    }
+
+    CANCapture::File CANCapture::finishFile()
+    {
+        if (m_header->kernelDrops != m_reportedDrops)
+        {
+            Log::warning("{} CAN frames dropped by the kernel before capture", m_header->kernelDrops - m_reportedDrops);
+            m_reportedDrops = m_header->kernelDrops;
+        }
+
+        File file { m_file };
+        m_file = File {};
+        m_header = nullptr;
+        return file;
+    }
+
+    bool CANCapture::nextFile()
+    {
+        // Hand the full file to the preparer and start the one it has ready. This only waits if
+        // the next file is still being prepared, which takes a whole file of frames to happen.
+        File finished { finishFile() };
+        File next;
+        bool failed { false };
+        {
+            std::unique_lock<std::mutex> lock { m_preparerMutex };
+            m_finished.push_back(finished);
+            m_preparerCondition.notify_all();
+            m_preparerCondition.wait(lock, [&] () { return (m_next.fd >= 0) || m_nextFailed; });
+            std::swap(next, m_next);
+            failed = m_nextFailed;
+        }
+        m_preparerCondition.notify_all();
+
+        if (failed)
+        {
+            return false;
+        }
+        m_sequence++;
+        startFile(next);
+        return true;
+    }
+
+    void CANCapture::prepare()
+    {
+        Metrics::registerThread("CANCapture");
+
+        uint64_t sequence { m_sequence + 1u };
+        std::unique_lock<std::mutex> lock { m_preparerMutex };
+        while (true)
+        {
+            // clang-format off
+            m_preparerCondition.wait(lock, [&] ()
+                                     {
+                                         return m_stopRequested || !m_finished.empty() ||
+                                                ((m_next.fd < 0) && !m_nextFailed);
+                                     });
+            // clang-format on
+
+            // Full files first, so they are written back even if the capture is stopping
+            while (!m_finished.empty())
+            {
+                File file { m_finished.back() };
+                m_finished.pop_back();
+                lock.unlock();
+                releaseFile(file);
+                lock.lock();
+            }
+
+            if (m_stopRequested)
+            {
+                break;
+            }
+
+            if ((m_next.fd < 0) && !m_nextFailed)
+            {
+                lock.unlock();
+                File file { createFile(sequence) };
+                lock.lock();
+
+                m_next = file;
+                m_nextFailed = (file.fd < 0);
+                sequence++;
+                m_preparerCondition.notify_all();
+            }
+        }
+    }
+
+    CANCapture::File CANCapture::createFile(uint64_t sequence) const
+    {
+        std::string path { m_path + "." + std::to_string(sequence % m_files) };
+        File file;
+        file.fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        void *mapping { MAP_FAILED };
+        if ((file.fd >= 0) && (::ftruncate(file.fd, static_cast<off_t>(m_fileSize)) == 0))
+        {
+            mapping = ::mmap(nullptr, m_fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0);
+        }
+        if (mapping == MAP_FAILED)
+        {
+            Log::error("could not create CAN capture file {} ({})", path, std::strerror(errno));
+            if (file.fd >= 0)
+            {
+                ::close(file.fd);
+            }
+            return File {};
+        }
+        file.mapping = static_cast<uint8_t *>(mapping);
+
+        // MAP_POPULATE only read faults the pages of a shared mapping, the first record on each
+        // page would still take a write fault. Writing every page here makes them present and
+        // writable before recording starts. A page which the kernel writes back before it is
+        // recorded into (dirty pages expire after 30 s by default) is write protected again.
+        size_t pageSize { static_cast<size_t>(::sysconf(_SC_PAGESIZE)) };
+        volatile uint8_t *bytes { file.mapping };
+        for (size_t offset = 0; offset < m_fileSize; offset += pageSize)
+        {
+            bytes[offset] = 0u;
+        }
+        return file;
+    }
+
+    void CANCapture::releaseFile(File& file) const
+    {
+        if (file.fd >= 0)
+        {
+            // Start the write back now, the pages are written whether or not the daemon survives
+            ::msync(file.mapping, m_fileSize, MS_ASYNC);
+            ::munmap(file.mapping, m_fileSize);
+            ::close(file.fd);
+            file = File {};
+        }
+    }
+
+    bool CANCapture::read(const std::string& path,
+                          const std::function<void(uint64_t timestamp_ns, const ::can_frame& frame)>& handler)
+    {
+        if (readFile(path, handler, nullptr))
+        {
+            return true;
+        }
+
+        // A whole capture, the files are numbered from zero
+        std::vector<std::pair<uint64_t, std::string>> files;
+        uint64_t sequence { 0u };
+        for (uint32_t file = 0; readFile(path + "." + std::to_string(file), nullptr, &sequence); file++)
+        {
+            files.push_back({ sequence, path + "." + std::to_string(file) });
+        }
+        std::sort(files.begin(), files.end());
+
+        for (const auto& file : files)
+        {
+            readFile(file.second, handler, nullptr);
+        }
+        return !files.empty();
+    }
+
+    bool CANCapture::readFile(const std::string& path,
+                              const std::function<void(uint64_t timestamp_ns, const ::can_frame& frame)>& handler,
+                              uint64_t *sequence)
+    {
+        int fd { ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat status {};
+        size_t size { (::fstat(fd, &status) == 0) ? static_cast<size_t>(status.st_size) : 0u };
+        void *mapping { (size >= sizeof(FileHeader)) ? ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0)
+                                                     : MAP_FAILED };
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+
+        const uint8_t *bytes { static_cast<const uint8_t *>(mapping) };
+        const FileHeader *header { static_cast<const FileHeader *>(mapping) };
+        bool ok { (header->magic == k_magic) && (header->version == k_version) &&
+                  (header->headerSize == sizeof(FileHeader)) };
+
+        if (ok && (sequence != nullptr))
+        {
+            *sequence = header->sequence;
+        }
+
+        if (ok && handler)
+        {
+            uint64_t used { header->used.load(std::memory_order_acquire) };
+            const uint8_t *input { bytes + sizeof(FileHeader) };
+            const uint8_t *end { bytes + std::min<uint64_t>(size, sizeof(FileHeader) + used) };
+            uint64_t timestamp_ns { header->firstTimestamp_ns };
+
+            uint64_t zigzag { 0u };
+            uint64_t CANID { 0u };
+            while (getVarint(input, end, zigzag) && getVarint(input, end, CANID) && (input < end))
+            {
+                ::can_frame frame {};
+                frame.can_id = static_cast<canid_t>(CANID);
+                frame.can_dlc = std::min<uint8_t>(*input++, CAN_MAX_DLEN);
+                if ((end - input) < frame.can_dlc)
+                {
+                    break;
+                }
+                std::memcpy(frame.data, input, frame.can_dlc);
+                input += frame.can_dlc;
+
+                int64_t delta_ns { static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1u) };
+                timestamp_ns += static_cast<uint64_t>(delta_ns);
+                handler(timestamp_ns, frame);
+            }
+        }
+
+        ::munmap(mapping, size);
+        return ok;
+    }
+}
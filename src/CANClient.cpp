@@ -1,14 +1,20 @@
 #include "CANClient.hpp"
+#include "Clock.hpp"
+#include "Log.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
 
 #include <net/if.h>
 #include <linux/can.h>
+#include <linux/can/error.h>
 #include <linux/can/raw.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
+#include <cerrno>
 #include <cstring>
 #include <algorithm>
-#include <iostream>
+#include <ctime>
 
 namespace mercury::blackstar
 {
@@ -20,6 +26,9 @@ namespace mercury::blackstar
 
     void CANClient::run()
     {
+        // Bind the socket before returning so the caller knows the CAN interface is up
+        connect();
+
         // clang-format off
         m_CANClientThread = std::thread { [&] ()
                                           {
@@ -35,42 +44,109 @@ namespace mercury::blackstar
         m_CANClientThread.join();
     }
 
+    void CANClient::setHeartbeat(std::shared_ptr<Heartbeat> heartbeat)
+    {
+        m_heartbeat = heartbeat;
+    }
+
+    void CANClient::setCapture(std::shared_ptr<CANCapture> capture)
+    {
+        m_capture = capture;
+    }
+
+    CANClient::BusState CANClient::busState() const
+    {
+        return m_busState;
+    }
+
+    uint32_t CANClient::errorFrameCount() const
+    {
+        return m_errorFrameCount;
+    }
+
     void CANClient::start()
     {
-        // Attempt to connect to the CAN device
-        if (connect())
+        Metrics::registerThread("CAN");
+
+        // The thread keeps running (and beating) while the socket is down so that a missing or
+        // failed CAN interface doesn't stop the watchdog being kicked, the connection is retried
+        // with a backoff
+        std::chrono::milliseconds reconnectDelay { k_reconnectMinimumDelay };
+        std::chrono::steady_clock::time_point nextConnect { std::chrono::steady_clock::now() + reconnectDelay };
+
+        // Keep looping until the thread is requested to stop
+        while (!m_stopRequested)
         {
-            // Keep looping until the thread is requested to stop
-            while (!m_stopRequested)
+            if (m_heartbeat != nullptr)
+            {
+                m_heartbeat->beat();
+            }
+
+            if (!m_connected)
             {
-                // Read data from socket if it is still connected
-                if (m_connected)
+                std::chrono::steady_clock::time_point now { std::chrono::steady_clock::now() };
+                if (now < nextConnect)
                 {
-                    int numberBytesRead { 0 };
-                    ::can_frame recvFrame;
-
-                    numberBytesRead = ::read(m_sockfd, &recvFrame, sizeof(recvFrame));
-                    if (numberBytesRead == 0)
-                    {
-                        // Read returns 0 to indicate that the other side has disconnected,
-                        // it returns -1 for no data when still connected
-                        std::cout << "Socket disconnected";
-                        break;
-                    }
-                    else if ((numberBytesRead > 0) && (m_messageHandler != nullptr))
-                    {
-                        // Process frame returns true if there is a response to send
-                        std::vector<uint8_t> response;
-                        if (m_messageHandler->processFrame(recvFrame, response))
-                        {
-                            sendMessage(response);
-                        }
-                    }
+                    std::chrono::milliseconds wait { std::chrono::ceil<std::chrono::milliseconds>(nextConnect - now) };
+                    std::this_thread::sleep_for(std::min(wait, k_reconnectPollPeriod));
                 }
-            };
-            disconnect();
+                else if (connect())
+                {
+                    reconnectDelay = k_reconnectMinimumDelay;
+                }
+                else
+                {
+                    reconnectDelay = std::min(reconnectDelay * 2, k_reconnectMaximumDelay);
+                    nextConnect = now + reconnectDelay;
+                }
+                continue;
+            }
+
+            // Read data from socket while it is still connected
+            ::can_frame recvFrame;
+            uint64_t timestamp_ns { 0u };
+
+            ssize_t numberBytesRead { receiveFrame(recvFrame, timestamp_ns) };
+            if ((numberBytesRead > 0) && (m_capture != nullptr))
+            {
+                m_capture->record(timestamp_ns, recvFrame, m_kernelDrops);
+            }
+
+            if ((numberBytesRead == 0) || ((numberBytesRead < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) &&
+                                           (errno != EINTR)))
+            {
+                // Read returns 0 to indicate that the other side has disconnected, it returns -1
+                // with EAGAIN for no data when still connected (anything else is an interface
+                // which has gone down)
+                Log::warning("CAN socket disconnected, reconnecting");
+                disconnect();
+                nextConnect = std::chrono::steady_clock::now() + reconnectDelay;
+            }
+            else if ((numberBytesRead > 0) && ((recvFrame.can_id & CAN_ERR_FLAG) != 0u))
+            {
+                errorFrameReceived(recvFrame);
+            }
+            else if ((numberBytesRead > 0) && (m_messageHandler != nullptr))
+            {
+                Trace::Scope trace { "CANClient::frame", recvFrame.can_id };
+                Metrics::increment(Metrics::Counter::CANFramesReceived);
+                Metrics::add(Metrics::Counter::CANBytesReceived, recvFrame.can_dlc);
+
+                // Process frame returns true if there is a response to send
+                std::vector<uint8_t> response;
+                if (m_messageHandler->processFrame(recvFrame, timestamp_ns, response))
+                {
+                    sendMessage(response);
+                }
+            }
+        }
+        disconnect();
+
+        if (m_capture != nullptr)
+        {
+            m_capture->close();
         }
-        std::cout << "CAN client terminating" << std::endl;
+        Log::info("CAN client terminating");
     }
 
     bool CANClient::connect()
@@ -91,21 +167,41 @@ namespace mercury::blackstar
             address.can_family = AF_CAN;
             address.can_ifindex = request.ifr_ifindex;
 
+            // Receive controller state changes and bus-off as error frames
+            ::can_err_mask_t errorMask { CAN_ERR_CRTL | CAN_ERR_BUSOFF | CAN_ERR_RESTARTED };
+            ::setsockopt(m_sockfd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &errorMask, sizeof(errorMask));
+
+            if (m_capture != nullptr)
+            {
+                // Kernel receive timestamps and the count of frames dropped by the socket, and a
+                // receive queue deep enough to ride out the capture opening its next file. Forcing
+                // the size past rmem_max needs CAP_NET_ADMIN, otherwise take what rmem_max allows.
+                int enable { 1 };
+                int receiveBuffer { k_captureReceiveBuffer };
+                ::setsockopt(m_sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+                ::setsockopt(m_sockfd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+                if (::setsockopt(m_sockfd, SOL_SOCKET, SO_RCVBUFFORCE, &receiveBuffer, sizeof(receiveBuffer)) != 0)
+                {
+                    ::setsockopt(m_sockfd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+                }
+            }
+
             // Attempt to bind the socket
             if (::bind(m_sockfd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) >= 0)
             {
                 // If connect returned >= 0 then the connection was successful
                 m_connected = true;
-                std::cout << "Connected CAN socket using device " << m_CANDevice << std::endl;
+                m_busState = BusState::Active;
+                Log::info("Connected CAN socket using device {}", m_CANDevice);
             }
             else
             {
-                std::cout << "ERROR: could not bind CAN socket" << std::endl;
+                Log::error("could not bind CAN socket");
             }
         }
         else
         {
-            std::cout << "ERROR: could not create CAN socket" << std::endl;
+            Log::error("could not create CAN socket");
         }
 
         return m_connected;
@@ -119,10 +215,57 @@ namespace mercury::blackstar
         }
         m_sockfd = -1;
         m_connected = false;
+        m_busState = BusState::Down;
+    }
+
+    ssize_t CANClient::receiveFrame(::can_frame& frame, uint64_t& timestamp_ns)
+    {
+        if (m_capture == nullptr)
+        {
+            // No kernel timestamps without a capture, the frame is stamped as it is read
+            ssize_t numberBytesRead { ::read(m_sockfd, &frame, sizeof(frame)) };
+            if (numberBytesRead > 0)
+            {
+                timestamp_ns = Clock::realTime_ns();
+            }
+            return numberBytesRead;
+        }
+
+        ::iovec vector { &frame, sizeof(frame) };
+        alignas(::cmsghdr) uint8_t control[CMSG_SPACE(sizeof(::timespec)) + CMSG_SPACE(sizeof(uint32_t))];
+        ::msghdr message {};
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t numberBytesRead { ::recvmsg(m_sockfd, &message, 0) };
+        if (numberBytesRead > 0)
+        {
+            ::timespec time {};
+            bool kernelTime { false };
+            for (::cmsghdr *header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header))
+            {
+                if ((header->cmsg_level == SOL_SOCKET) && (header->cmsg_type == SO_TIMESTAMPNS))
+                {
+                    std::memcpy(&time, CMSG_DATA(header), sizeof(time));
+                    kernelTime = true;
+                }
+                else if ((header->cmsg_level == SOL_SOCKET) && (header->cmsg_type == SO_RXQ_OVFL))
+                {
+                    std::memcpy(&m_kernelDrops, CMSG_DATA(header), sizeof(m_kernelDrops));
+                }
+            }
+            timestamp_ns = kernelTime ? ((static_cast<uint64_t>(time.tv_sec) * 1000000000u) +
+                                         static_cast<uint64_t>(time.tv_nsec))
+                                      : Clock::realTime_ns();
+        }
+        return numberBytesRead;
     }
 
     void CANClient::sendMessage(std::vector<uint8_t>& message)
     {
+        Trace::Scope trace { "CANClient::sendMessage", message.size() };
         if (m_messageHandler != nullptr)
         {
             ::can_frame sendFrame;
@@ -151,9 +294,48 @@ namespace mercury::blackstar
                 // Send CAN frame
                 if (::write(m_sockfd, &sendFrame, sizeof(sendFrame)) != sizeof(sendFrame))
                 {
+                    Metrics::increment(Metrics::Counter::CANSendErrors);
                     m_connected = false;
                 }
+                else
+                {
+                    Metrics::increment(Metrics::Counter::CANFramesSent);
+                    Metrics::add(Metrics::Counter::CANBytesSent, sendFrame.can_dlc);
+                }
+            }
+        }
+    }
+
+    void CANClient::errorFrameReceived(const ::can_frame& frame)
+    {
+        m_errorFrameCount++;
+        Metrics::increment(Metrics::Counter::CANErrorFrames);
+
+        // The most severe state reported by the frame wins, the controller reports its recovery to
+        // error active with a restarted frame (after bus-off) or a controller status frame
+        if ((frame.can_id & CAN_ERR_BUSOFF) != 0u)
+        {
+            m_busState = BusState::BusOff;
+        }
+        else if ((frame.can_id & CAN_ERR_CRTL) != 0u)
+        {
+            uint8_t status { frame.data[1] };
+            if ((status & (CAN_ERR_CRTL_RX_PASSIVE | CAN_ERR_CRTL_TX_PASSIVE)) != 0u)
+            {
+                m_busState = BusState::ErrorPassive;
+            }
+            else if ((status & (CAN_ERR_CRTL_RX_WARNING | CAN_ERR_CRTL_TX_WARNING)) != 0u)
+            {
+                m_busState = BusState::ErrorWarning;
+            }
+            else if ((status & CAN_ERR_CRTL_ACTIVE) != 0u)
+            {
+                m_busState = BusState::Active;
             }
         }
+        else if ((frame.can_id & CAN_ERR_RESTARTED) != 0u)
+        {
+            m_busState = BusState::Active;
+        }
     }
 }
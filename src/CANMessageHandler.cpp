@@ -1,12 +1,15 @@
 #include "CANMessageHandler.hpp"
+#include "Log.hpp"
+#include "MercuryMessage.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
 
 // Mercury includes
 #include "system/systemlib/inc/commands.hpp"
 #include "system/systemlib/inc/ecmstates.hpp"
 #include "system/systemlib/inc/version.hpp"
 
-#include <iostream>
-#include <boost/crc.hpp>
+#include <algorithm>
 
 namespace mercury
 {
@@ -14,23 +17,51 @@ namespace mercury
 
     namespace blackstar
     {
-        void CANMessageHandler::build(uint8_t slotNumber, std::shared_ptr<MercuryStateHandler> stateHandler)
+        void CANMessageHandler::build(uint8_t slotNumber,
+                                      std::shared_ptr<MercuryStateHandler> stateHandler,
+                                      std::shared_ptr<RFPowerMonitor> powerMonitor,
+                                      std::shared_ptr<VSWRProtection> VSWRProtection,
+                                      std::shared_ptr<BitEngine> bitEngine)
         {
             m_recipientID = k_ECMRecipientIDBase + slotNumber;
             m_stateHandler = stateHandler;
+            m_powerMonitor = powerMonitor;
+            m_VSWRProtection = VSWRProtection;
+            m_bitEngine = bitEngine;
 
-            std::cout << "CAN message handler using module ID 0x" << std::hex << +m_recipientID << std::endl;
+            Log::info("CAN message handler using module ID 0x{x}", m_recipientID);
         }
 
-        bool CANMessageHandler::processFrame(const can_frame& frame, std::vector<uint8_t>& response)
+        bool CANMessageHandler::processFrame(const can_frame& frame,
+                                             uint64_t timestamp_ns,
+                                             std::vector<uint8_t>& response)
         {
-            // If we only wanted to keep frames with CAN ID equal to our recipient ID or broadcast
-            // ID then we'd do this:
-            // if (frame.can_id == m_recipientID || frame.can_id == k_broadcastRecipientID)
-            // But keep frames with CAN ID equal to any ECM slot...
+            Trace::Scope trace { "CANMessageHandler::processFrame", frame.can_id };
+
+            // When answering only keep frames with CAN ID equal to our recipient ID or broadcast
+            // ID, when sniffing keep frames with CAN ID equal to any ECM slot...
             // Slot 1 ECM = 0xA, Slot 5 ECM = 0xE
-            if ((frame.can_id >= 0xA) && (frame.can_id <= 0xE))
+            bool keep { (frame.can_id >= 0xA) && (frame.can_id <= 0xE) };
+            if (m_answering)
+            {
+                keep = (frame.can_id == m_recipientID) || (frame.can_id == k_broadcastRecipientID);
+            }
+
+            if (keep)
             {
+                // A partial message which has stalled (a lost frame or a sender which was reset)
+                // would otherwise be prepended to every message after it. The gap is signed, a wall
+                // clock step backwards doesn't abort the message, and nor does an unknown (zero) time.
+                int64_t gap_ns { static_cast<int64_t>(timestamp_ns - m_lastFrame_ns) };
+                if (!m_receiveMessage.empty() && (timestamp_ns != 0u) && (m_lastFrame_ns != 0u) &&
+                    (gap_ns > std::chrono::duration_cast<std::chrono::nanoseconds>(k_reassemblyTimeout).count()))
+                {
+                    Log::warning("partial message of {} bytes discarded", m_receiveMessage.size());
+                    Metrics::increment(Metrics::Counter::ReassemblyAborts);
+                    m_receiveMessage.clear();
+                }
+                m_lastFrame_ns = timestamp_ns;
+
                 for (uint8_t byte = 0; byte < frame.can_dlc; byte++)
                 {
                     m_receiveMessage.push_back(frame.data[byte]);
@@ -45,6 +76,11 @@ namespace mercury
             return m_recipientID;
         }
 
+        void CANMessageHandler::setAnswering(bool answering)
+        {
+            m_answering = answering;
+        }
+
         bool CANMessageHandler::completeMessageReceived()
         {
             bool retVal { false };
@@ -145,6 +181,21 @@ namespace mercury
             return retVal;
         }
 
+        bool CANMessageHandler::messageParameter(uint8_t index, uint8_t& value)
+        {
+            bool retVal { false };
+
+            // Parameters lie between the command ID and the CRC
+            size_t position { static_cast<size_t>(k_parametersStartField) + index };
+            if ((position + k_CRCSize) < m_receiveMessage.size())
+            {
+                value = m_receiveMessage.at(position);
+                retVal = true;
+            }
+
+            return retVal;
+        }
+
         void CANMessageHandler::populateResponse(uint16_t responseID,
                                                  const std::vector<uint8_t>& parameters,
                                                  std::vector<uint8_t>& response)
@@ -176,11 +227,7 @@ namespace mercury
 
         uint16_t CANMessageHandler::calculateCRC(const std::vector<uint8_t>& message)
         {
-            boost::crc_ccitt_type result;
-            uint8_t bytes[message.size()];
-            std::copy(message.begin(), message.end(), bytes);
-            result.process_bytes(bytes, message.size());
-            return result.checksum();
+            return MercuryMessage::CRC(message.data(), message.size());
         }
 
         // Return true if there is a response to send
@@ -190,6 +237,10 @@ namespace mercury
 
             if (completeMessageReceived())
             {
+                Trace::Scope trace { "CANMessageHandler::processMessage" };
+                std::chrono::steady_clock::time_point received { std::chrono::steady_clock::now() };
+                Metrics::increment(Metrics::Counter::MessagesReceived);
+
                 if (messageCRCOK())
                 {
                     // If we wanted to make sure we are only processing messages addressed to this node
@@ -199,13 +250,14 @@ namespace mercury
                         uint16_t commandID { messageCommandID() };
                         uint16_t responseID { sys::Command::NotRecognised };
                         uint8_t recipientID { messageRecipientID() };
-                        std::cout << "Received message, Recipient ID 0x" << +recipientID << ", Command ID 0x"
-                                  << +commandID << std::endl;
+                        Log::info("Received message, Recipient ID 0x{x}, Command ID 0x{x}", recipientID, commandID);
+                        Metrics::countCommand(commandID);
+                        trace.setArgument(commandID);
                         std::vector<uint8_t> parameters;
 
-                        // If message is addressed to this node then send a response...
-                        // Commented out - not sending responses, just sniffing messages
-                        // sendResponse = messageAddressedToThisNode();
+                        // If message is addressed to this node then send a response, unless
+                        // just sniffing messages
+                        sendResponse = m_answering && messageAddressedToThisNode();
 
                         if (commandID == sys::Command::Ping)
                         {
@@ -294,21 +346,21 @@ namespace mercury
                         else if (commandID == sys::Command::BitTopLevel)
                         {
                             responseID = sys::Command::Ok;
-                            // 1 byte response: 0 = OK, other values = not OK
-                            if (m_stateHandler->healthOK())
-                            {
-                                parameters.push_back(0x00);
-                            }
-                            else
-                            {
-                                parameters.push_back(0xFF);
-                            }
+                            // 1 byte response: 0 = OK, other values = not OK (the health fault bits, see
+                            // MercuryStateHandler), answered from the cached health
+                            parameters.push_back(m_stateHandler->healthFaults());
                         }
                         else if (commandID == sys::Command::DetailedBit)
                         {
                             responseID = sys::Command::Ok;
 
-                            // TODO: extract values from ECM module
+                            // The detailed BIT payload is encoded by the Mercury systemlib, which isn't
+                            // part of this build, so nothing is returned until it is; stale results
+                            // are still refreshed in the background and the failures logged
+                            if (m_bitEngine != nullptr)
+                            {
+                                m_bitEngine->refreshIfStale();
+                            }
                         }
                         else if (commandID == sys::Command::UploadMission)
                         {
@@ -407,14 +459,23 @@ namespace mercury
                         else if (commandID == sys::Command::GetReturnLoss)
                         {
                             responseID = sys::Command::Ok;
+
+                            // The return loss payload is encoded by the Mercury systemlib, which isn't
+                            // part of this build, so nothing is returned until it is; the converted
+                            // VSWR is on the status page (-u)
                         }
                         else if (commandID == sys::Command::GetVswrThresholds)
                         {
                             responseID = sys::Command::Ok;
+
+                            // The threshold payload is encoded by the Mercury systemlib, which isn't
+                            // part of this build, so nothing is returned until it is; the trip
+                            // threshold is set with the -V option
                         }
                         else if (commandID == sys::Command::SetVswrThresholds)
                         {
-                            responseID = sys::Command::Ok;
+                            // Refused (see GetVswrThresholds) rather than acknowledged and ignored
+                            Log::warning("VSWR thresholds can't be set over CAN");
                         }
                         else if (commandID == sys::Command::GetNumberOfVswrThresholds)
                         {
@@ -483,10 +544,24 @@ namespace mercury
                         else if (commandID == sys::Command::GetCalibrationType)
                         {
                             responseID = sys::Command::Ok;
+
+                            // 1 byte calibration type, only the nominal calibration is supported (see
+                            // RFPowerConverter)
+                            parameters.push_back(RFPowerConverter::k_calibrationTypeNominal);
                         }
                         else if (commandID == sys::Command::SetCalibrationType)
                         {
-                            responseID = sys::Command::Ok;
+                            // Any type other than the nominal calibration (or a missing type) is
+                            // refused rather than acknowledged and ignored
+                            uint8_t type { 0u };
+                            if (messageParameter(0u, type) && (type == RFPowerConverter::k_calibrationTypeNominal))
+                            {
+                                responseID = sys::Command::Ok;
+                            }
+                            else
+                            {
+                                Log::warning("calibration type {} not supported", type);
+                            }
                         }
                         else if (commandID == sys::Command::GetPowerMonitorRevision)
                         {
@@ -568,6 +643,10 @@ namespace mercury
                         else if (commandID == sys::Command::EcmGetPowerMonitorReading)
                         {
                             responseID = sys::Command::Ok;
+
+                            // The reading payload is not defined by the Mercury protocol (systemlib
+                            // commands), so no readings are returned until it is; the sampled readings
+                            // are available from the control socket (-r) and the status page
                         }
                         else if (commandID == sys::Command::EcmGetSynthFrequency)
                         {
@@ -702,12 +781,22 @@ namespace mercury
                             parameters.push_back(0x00);
                         }
 
+                        if (responseID == sys::Command::NotRecognised)
+                        {
+                            Metrics::increment(Metrics::Counter::NotRecognised);
+                        }
+
                         populateResponse(responseID, parameters, response);
+                        Metrics::observe(Metrics::Histogram::MessageProcessing,
+                                         static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                                   std::chrono::steady_clock::now() - received)
+                                                                   .count()));
                     }
                 }
                 else
                 {
-                    std::cout << "ERROR: message failed CRC check" << std::endl;
+                    Metrics::increment(Metrics::Counter::CRCFailures);
+                    Log::error("message failed CRC check");
                 }
 
                 // Clear the message vector after processing a complete message
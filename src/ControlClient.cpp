@@ -0,0 +1,76 @@
+#include "ControlClient.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace mercury::blackstar
+{
+    ControlClient::~ControlClient()
+    {
+        if (m_sockfd >= 0)
+        {
+            ::close(m_sockfd);
+        }
+    }
+
+    ControlClient::Connection ControlClient::connect(const std::string& path)
+    {
+        sockaddr_un address {};
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            errno = ENAMETOOLONG;
+            return Connection::Failed;
+        }
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1u);
+
+        m_sockfd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (m_sockfd < 0)
+        {
+            return Connection::Failed;
+        }
+
+        timeval timeout {};
+        timeout.tv_sec = static_cast<time_t>(k_responseTimeout.count() / 1000);
+        timeout.tv_usec = static_cast<suseconds_t>((k_responseTimeout.count() % 1000) * 1000);
+        ::setsockopt(m_sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        if (::connect(m_sockfd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            // Only no socket, or a socket left behind with nothing listening, means no daemon; the
+            // daemon may well be running if the socket can't be used (e.g. EACCES)
+            int error { errno };
+            ::close(m_sockfd);
+            m_sockfd = -1;
+            errno = error;
+            return ((error == ENOENT) || (error == ECONNREFUSED)) ? Connection::NoDaemon : Connection::Failed;
+        }
+        return Connection::Connected;
+    }
+
+    bool ControlClient::transact(uint8_t command, std::vector<uint8_t>& response)
+    {
+        const uint8_t request[ControlProtocol::k_requestSize] { ControlProtocol::k_version, command };
+        if ((m_sockfd < 0) || (::send(m_sockfd, request, sizeof(request), MSG_NOSIGNAL) !=
+                               static_cast<ssize_t>(sizeof(request))))
+        {
+            return false;
+        }
+
+        uint8_t buffer[ControlProtocol::k_maxMessageSize];
+        ssize_t count { ::recv(m_sockfd, buffer, sizeof(buffer), 0) };
+        if (count < static_cast<ssize_t>(ControlProtocol::k_responseHeaderSize))
+        {
+            return false;
+        }
+
+        response.assign(buffer, buffer + count);
+        return (response[ControlProtocol::k_versionField] == ControlProtocol::k_version) &&
+               (response[ControlProtocol::k_commandField] == command);
+    }
+}
@@ -0,0 +1,228 @@
+#include "ControlServer.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace mercury::blackstar
+{
+    static void appendLE32(std::vector<uint8_t>& data, uint32_t value)
+    {
+        for (size_t i = 0; i < sizeof(value); i++)
+        {
+            data.push_back(static_cast<uint8_t>(value >> (8u * i)));
+        }
+    }
+
+    ControlServer::~ControlServer()
+    {
+        for (int fd : m_connections)
+        {
+            ::close(fd);
+        }
+
+        if (m_listenfd >= 0)
+        {
+            ::close(m_listenfd);
+            ::unlink(m_path.c_str());
+        }
+    }
+
+    void ControlServer::build(std::shared_ptr<VSLBSP> BSP,
+                              std::shared_ptr<MercuryStateHandler> stateHandler,
+                              std::shared_ptr<RFPowerMonitor> powerMonitor,
+                              std::shared_ptr<DIOInputMonitor> inputMonitor)
+    {
+        m_BSP = BSP;
+        m_stateHandler = stateHandler;
+        m_powerMonitor = powerMonitor;
+        m_inputMonitor = inputMonitor;
+    }
+
+    bool ControlServer::listen(EventLoop& eventLoop, const std::string& path)
+    {
+        sockaddr_un address {};
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            Log::error("control socket path too long: {}", path);
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1u);
+
+        m_listenfd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_listenfd < 0)
+        {
+            Log::error("could not create control socket ({})", std::strerror(errno));
+            return false;
+        }
+
+        // A socket left behind by a previous run would make bind fail
+        ::unlink(path.c_str());
+        bool ok { (::bind(m_listenfd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) &&
+                  (::listen(m_listenfd, static_cast<int>(k_maxConnections)) == 0) };
+        if (ok)
+        {
+            m_path = path;
+            m_eventLoop = &eventLoop;
+            ok = eventLoop.addDescriptor(m_listenfd, [this] () { accept(); });
+        }
+        else
+        {
+            Log::error("could not listen on control socket {} ({})", path, std::strerror(errno));
+        }
+
+        if (!ok)
+        {
+            ::close(m_listenfd);
+            m_listenfd = -1;
+        }
+        return ok;
+    }
+
+    void ControlServer::execute(const std::vector<uint8_t>& request, std::vector<uint8_t>& response)
+    {
+        uint8_t command { (request.size() > ControlProtocol::k_commandField)
+                              ? request[ControlProtocol::k_commandField]
+                              : uint8_t { 0u } };
+        response.assign({ ControlProtocol::k_version, command, ControlProtocol::k_statusOK });
+
+        if ((request.size() != ControlProtocol::k_requestSize) ||
+            (request[ControlProtocol::k_versionField] != ControlProtocol::k_version))
+        {
+            response[ControlProtocol::k_statusField] = ControlProtocol::k_statusBadRequest;
+            return;
+        }
+
+        bool ok { true };
+        RFPowerSnapshot snapshot;
+        uint32_t forward_mV { 0u };
+        uint32_t reverse_mV { 0u };
+        switch (command)
+        {
+            case ControlProtocol::k_commandResetFanPSU:
+                ok = m_BSP->resetFanPSUController();
+                break;
+
+            case ControlProtocol::k_commandGetRFPower:
+                // The latest monitor reading if the monitor is running, otherwise read the ADC
+                if ((m_powerMonitor != nullptr) && m_powerMonitor->latest(snapshot))
+                {
+                    forward_mV = snapshot.latest.forward_mV;
+                    reverse_mV = snapshot.latest.reverse_mV;
+                }
+                else
+                {
+                    ok = m_BSP->getRFPowerMonitorReadings(forward_mV, reverse_mV);
+                }
+                if (ok)
+                {
+                    appendLE32(response, forward_mV);
+                    appendLE32(response, reverse_mV);
+                }
+                break;
+
+            case ControlProtocol::k_commandEnablePower:
+                ok = m_BSP->enableFans() && m_BSP->enablePSU() &&
+                     ((m_stateHandler != nullptr) ? m_stateHandler->enablePACommandReceived() : m_BSP->enablePA());
+                if (m_stateHandler == nullptr)
+                {
+                    m_BSP->setRFLEDOff();
+                }
+                break;
+
+            case ControlProtocol::k_commandDisablePower:
+                m_BSP->setOutputs(VSLBSP::k_outputPAMuteN | VSLBSP::k_outputRFLED, 0u);
+                // Switching off is a safety action, it goes ahead of any telemetry on the bus
+                ok = m_BSP->disableFans(VSLBSP::BusPriority::Safety) &&
+                     m_BSP->disablePSU(VSLBSP::BusPriority::Safety) && m_BSP->disablePA(VSLBSP::BusPriority::Safety);
+                break;
+
+            case ControlProtocol::k_commandMutePA:
+                m_BSP->setOutputs(VSLBSP::k_outputPAMuteN | VSLBSP::k_outputRFLED, 0u);
+                break;
+
+            case ControlProtocol::k_commandUnmutePA:
+                if (m_stateHandler != nullptr)
+                {
+                    ok = m_stateHandler->unmutePACommandReceived();
+                }
+                else
+                {
+                    m_BSP->setOutputs(VSLBSP::k_outputPAMuteN | VSLBSP::k_outputRFLED,
+                                      VSLBSP::k_outputPAMuteN | VSLBSP::k_outputRFLED);
+                }
+                break;
+
+            case ControlProtocol::k_commandGetSlotNumber:
+                response.push_back((m_inputMonitor != nullptr) ? m_inputMonitor->ECMSlotNumber()
+                                                               : m_BSP->ECMSlotNumber());
+                break;
+
+            default:
+                response[ControlProtocol::k_statusField] = ControlProtocol::k_statusUnknownCommand;
+                return;
+        }
+
+        if (!ok)
+        {
+            response[ControlProtocol::k_statusField] = ControlProtocol::k_statusFailed;
+        }
+    }
+
+    void ControlServer::accept()
+    {
+        int fd { -1 };
+        while ((fd = ::accept4(m_listenfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+        {
+            if ((m_connections.size() >= k_maxConnections) ||
+                !m_eventLoop->addDescriptor(fd, [this, fd] () { receive(fd); }))
+            {
+                Log::warning("control connection refused");
+                ::close(fd);
+            }
+            else
+            {
+                m_connections.push_back(fd);
+            }
+        }
+    }
+
+    void ControlServer::receive(int fd)
+    {
+        uint8_t buffer[ControlProtocol::k_maxMessageSize];
+        ssize_t count { 0 };
+        while ((count = ::recv(fd, buffer, sizeof(buffer), 0)) > 0)
+        {
+            std::vector<uint8_t> request { buffer, buffer + count };
+            std::vector<uint8_t> response;
+            execute(request, response);
+
+            // Responses are far smaller than the socket buffer, a client which isn't reading
+            // them is dropped
+            if (::send(fd, response.data(), response.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(response.size()))
+            {
+                count = 0;
+                break;
+            }
+        }
+
+        // Zero is an orderly shutdown by the client
+        if ((count == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK)))
+        {
+            closeConnection(fd);
+        }
+    }
+
+    void ControlServer::closeConnection(int fd)
+    {
+        m_eventLoop->removeDescriptor(fd);
+        ::close(fd);
+        m_connections.erase(std::remove(m_connections.begin(), m_connections.end(), fd), m_connections.end());
+    }
+}
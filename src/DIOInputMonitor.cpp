@@ -0,0 +1,83 @@
+#include "DIOInputMonitor.hpp"
+#include "Log.hpp"
+
+namespace mercury::blackstar
+{
+    DIOInputMonitor::~DIOInputMonitor()
+    {
+        if (m_interruptDriven && (m_BSP != nullptr))
+        {
+            m_BSP->disableInputInterrupts();
+        }
+    }
+
+    void DIOInputMonitor::build(std::shared_ptr<VSLBSP> BSP, EventLoop& eventLoop)
+    {
+        m_BSP = BSP;
+        m_inputs = m_BSP->inputs();
+
+        // The signal has to be routed to the signalfd before interrupts are enabled, the default
+        // action for a real-time signal is to terminate the process
+        // clang-format off
+        m_interruptDriven = eventLoop.addSignal(m_BSP->inputInterruptSignal(), [this] (const signalfd_siginfo&)
+                                                {
+                                                    m_BSP->acknowledgeInputInterrupts();
+                                                    update();
+                                                }) &&
+                            m_BSP->enableInputInterrupts();
+        // clang-format on
+
+        if (!eventLoop.addTimer(m_interruptDriven ? k_resyncPeriod : k_pollPeriod, [this] () { update(); }))
+        {
+            Log::error("could not start DIO input timer");
+        }
+
+        if (m_interruptDriven)
+        {
+            Log::info("DIO inputs interrupt driven");
+        }
+        else
+        {
+            Log::warning("DIO interrupts not available, polling inputs every {} ms", k_pollPeriod.count());
+        }
+    }
+
+    uint8_t DIOInputMonitor::inputs() const
+    {
+        return m_inputs;
+    }
+
+    uint8_t DIOInputMonitor::ECMSlotNumber() const
+    {
+        return m_inputs & VSLBSP::k_inputECMSlotMask;
+    }
+
+    bool DIOInputMonitor::interruptDriven() const
+    {
+        return m_interruptDriven;
+    }
+
+    uint64_t DIOInputMonitor::changeCount() const
+    {
+        return m_changeCount;
+    }
+
+    void DIOInputMonitor::update()
+    {
+        uint8_t inputs { m_BSP->inputs() };
+        uint8_t previous { m_inputs.exchange(inputs) };
+
+        if (inputs != previous)
+        {
+            m_changeCount++;
+            Log::info("DIO inputs changed from 0x{x} to 0x{x}", previous, inputs);
+
+            // The slot number is only read at startup so a change needs a restart to take effect
+            if (((inputs ^ previous) & VSLBSP::k_inputECMSlotMask) != 0u)
+            {
+                Log::warning("ECM slot inputs changed (slot {}), restart required",
+                             inputs & VSLBSP::k_inputECMSlotMask);
+            }
+        }
+    }
+}
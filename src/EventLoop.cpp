@@ -0,0 +1,200 @@
+#include "EventLoop.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace mercury::blackstar
+{
+    static const int k_maxEventsPerWait { 16 };
+
+    EventLoop::~EventLoop()
+    {
+        for (auto& source : m_sources)
+        {
+            if (source->owned)
+            {
+                ::close(source->fd);
+            }
+        }
+
+        if (m_epollfd >= 0)
+        {
+            ::close(m_epollfd);
+        }
+    }
+
+    bool EventLoop::build()
+    {
+        m_epollfd = ::epoll_create1(EPOLL_CLOEXEC);
+        if (m_epollfd < 0)
+        {
+            std::cout << "ERROR: could not create event loop (" << std::strerror(errno) << ")" << std::endl;
+            return false;
+        }
+
+        // stop() writes to this so that it can wake the loop from any thread
+        m_stopfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        // clang-format off
+        return (m_stopfd >= 0) && add(m_stopfd, true, [this] ()
+                                      {
+                                          uint64_t count { 0u };
+                                          while (::read(m_stopfd, &count, sizeof(count)) > 0) {}
+                                      });
+        // clang-format on
+    }
+
+    bool EventLoop::addDescriptor(int fd, std::function<void()> handler)
+    {
+        return add(fd, false, handler);
+    }
+
+    bool EventLoop::addTimer(std::chrono::milliseconds period, std::function<void()> handler)
+    {
+        int fd { ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC) };
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        itimerspec timerSpec {};
+        timerSpec.it_interval.tv_sec = static_cast<time_t>(period.count() / 1000);
+        timerSpec.it_interval.tv_nsec = static_cast<long>((period.count() % 1000) * 1000000);
+        timerSpec.it_value = timerSpec.it_interval;
+        if (::timerfd_settime(fd, 0, &timerSpec, nullptr) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        // clang-format off
+        return add(fd, true, [fd, handler] ()
+                   {
+                       // Missed expiries are coalesced into one call
+                       uint64_t expiries { 0u };
+                       if (::read(fd, &expiries, sizeof(expiries)) > 0)
+                       {
+                           handler();
+                       }
+                   });
+        // clang-format on
+    }
+
+    bool EventLoop::addSignal(int signalNumber, std::function<void(const signalfd_siginfo&)> handler)
+    {
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, signalNumber);
+
+        // Block the signal so it stays pending for the signalfd instead of being delivered
+        if (::pthread_sigmask(SIG_BLOCK, &signals, nullptr) != 0)
+        {
+            return false;
+        }
+
+        int fd { ::signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC) };
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        // clang-format off
+        return add(fd, true, [fd, handler] ()
+                   {
+                       signalfd_siginfo info;
+                       while (::read(fd, &info, sizeof(info)) == static_cast<ssize_t>(sizeof(info)))
+                       {
+                           handler(info);
+                       }
+                   });
+        // clang-format on
+    }
+
+    void EventLoop::removeDescriptor(int fd)
+    {
+        for (auto source = m_sources.begin(); source != m_sources.end(); ++source)
+        {
+            if (((*source)->fd == fd) && !(*source)->owned)
+            {
+                ::epoll_ctl(m_epollfd, EPOLL_CTL_DEL, fd, nullptr);
+                (*source)->removed = true;
+                m_removedSources.push_back(std::move(*source));
+                m_sources.erase(source);
+                break;
+            }
+        }
+    }
+
+    void EventLoop::run()
+    {
+        epoll_event events[k_maxEventsPerWait];
+
+        while (!m_stopRequested)
+        {
+            int count { ::epoll_wait(m_epollfd, events, k_maxEventsPerWait, -1) };
+            if ((count < 0) && (errno != EINTR))
+            {
+                std::cout << "ERROR: event loop wait failed (" << std::strerror(errno) << ")" << std::endl;
+                break;
+            }
+
+            for (int i = 0; (i < count) && !m_stopRequested; i++)
+            {
+                // A source may have been removed by an earlier handler in this batch
+                Source *source { static_cast<Source*>(events[i].data.ptr) };
+                if (!source->removed)
+                {
+                    source->handler();
+                }
+            }
+            m_removedSources.clear();
+        }
+    }
+
+    void EventLoop::stop()
+    {
+        m_stopRequested = true;
+
+        // Wake the loop if it is waiting
+        uint64_t one { 1u };
+        ssize_t written { ::write(m_stopfd, &one, sizeof(one)) };
+        static_cast<void>(written);
+    }
+
+    bool EventLoop::add(int fd, bool owned, std::function<void()> handler)
+    {
+        if (m_epollfd < 0)
+        {
+            if (owned)
+            {
+                ::close(fd);
+            }
+            return false;
+        }
+
+        m_sources.push_back(std::make_unique<Source>(Source { fd, owned, handler }));
+
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.ptr = m_sources.back().get();
+        bool ok { ::epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &event) == 0 };
+        if (!ok)
+        {
+            std::cout << "ERROR: could not add event source (" << std::strerror(errno) << ")" << std::endl;
+            if (owned)
+            {
+                ::close(fd);
+            }
+            m_sources.pop_back();
+        }
+
+        return ok;
+    }
+}
@@ -0,0 +1,270 @@
+#include "HealthMonitor.hpp"
+#include "Clock.hpp"
+#include "Log.hpp"
+#include "Metrics.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+namespace mercury::blackstar
+{
+    bool HealthMonitor::parse(const std::string& text, Settings& settings)
+    {
+        std::stringstream list { text };
+        std::string entry;
+        while (std::getline(list, entry, ','))
+        {
+            size_t separator { entry.find('=') };
+            if (separator == std::string::npos)
+            {
+                return false;
+            }
+            std::string name { entry.substr(0, separator) };
+            const char *value { entry.c_str() + separator + 1u };
+
+            char *end { nullptr };
+            unsigned long integer { std::strtoul(value, &end, 0) };
+            bool integerOK { (end != value) && (*end == '\0') };
+            double real { std::strtod(value, &end) };
+            bool realOK { (end != value) && (*end == '\0') && std::isfinite(real) };
+
+            // Periods and counts must be at least 1, periods are limited to a minute
+            bool periodOK { integerOK && (integer >= 1u) && (integer <= 60000u) };
+            bool countOK { integerOK && (integer >= 1u) && (integer <= UINT8_MAX) };
+
+            if ((name == "fanpsu_ms") && periodOK)
+            {
+                settings.fanPSUPeriod = std::chrono::milliseconds { integer };
+            }
+            else if ((name == "rf_ms") && periodOK)
+            {
+                settings.RFPeriod = std::chrono::milliseconds { integer };
+            }
+            else if ((name == "can_ms") && periodOK)
+            {
+                settings.CANPeriod = std::chrono::milliseconds { integer };
+            }
+            else if ((name == "max_age_ms") && periodOK)
+            {
+                settings.maxTelemetryAge = std::chrono::milliseconds { integer };
+            }
+            else if ((name == "raise") && countOK)
+            {
+                settings.raiseCount = static_cast<uint8_t>(integer);
+            }
+            else if ((name == "clear") && countOK)
+            {
+                settings.clearCount = static_cast<uint8_t>(integer);
+            }
+            else if ((name == "status_mask") && integerOK && (integer <= UINT8_MAX))
+            {
+                settings.fanPSUStatusFaultMask = static_cast<uint8_t>(integer);
+            }
+            else if ((name == "jamming_min_dbm") && realOK)
+            {
+                settings.jammingMinForward_dBm = static_cast<float>(real);
+            }
+            else if ((name == "muted_max_dbm") && realOK)
+            {
+                settings.mutedMaxForward_dBm = static_cast<float>(real);
+            }
+            else if ((name == "hysteresis_db") && realOK && (real >= 0.0))
+            {
+                settings.RFHysteresis_dB = static_cast<float>(real);
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void HealthMonitor::build(std::shared_ptr<MercuryStateHandler> stateHandler,
+                              std::shared_ptr<BoardTelemetry> boardTelemetry,
+                              std::shared_ptr<RFPowerMonitor> powerMonitor,
+                              std::shared_ptr<CANClient> client,
+                              const Settings& settings)
+    {
+        m_stateHandler = stateHandler;
+        m_boardTelemetry = boardTelemetry;
+        m_powerMonitor = powerMonitor;
+        m_CANClient = client;
+        m_settings = settings;
+    }
+
+    void HealthMonitor::run()
+    {
+        m_stopRequested = false;
+
+        // clang-format off
+        m_healthMonitorThread = std::thread { [&] ()
+                                              {
+                                                  start();
+                                              }
+                                            };
+        // clang-format on
+    }
+
+    void HealthMonitor::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock { m_wakeMutex };
+            m_stopRequested = true;
+        }
+        m_wakeCondition.notify_one();
+
+        if (m_healthMonitorThread.joinable())
+        {
+            m_healthMonitorThread.join();
+        }
+    }
+
+    void HealthMonitor::setHeartbeat(std::shared_ptr<Heartbeat> heartbeat)
+    {
+        m_heartbeat = heartbeat;
+    }
+
+    void HealthMonitor::start()
+    {
+        Metrics::registerThread("HealthMonitor");
+
+        using clock = std::chrono::steady_clock;
+
+        clock::time_point nextCheck { clock::now() };
+        clock::time_point nextFanPSU { nextCheck };
+        clock::time_point nextRFPower { nextCheck };
+        clock::time_point nextCAN { nextCheck };
+
+        while (!m_stopRequested)
+        {
+            clock::time_point now { clock::now() };
+            uint64_t now_ns { Clock::monotonic_ns() };
+
+            if (now >= nextFanPSU)
+            {
+                checkFanPSU(now_ns);
+                nextFanPSU += m_settings.fanPSUPeriod;
+            }
+            if (now >= nextRFPower)
+            {
+                checkRFPower(now_ns);
+                nextRFPower += m_settings.RFPeriod;
+            }
+            if ((m_CANClient != nullptr) && (now >= nextCAN))
+            {
+                checkCAN();
+                nextCAN += m_settings.CANPeriod;
+            }
+
+            // Only the monitored bits are replaced, publish when they change
+            uint8_t faults { 0u };
+            for (const Check *check : { &m_fanPSUStatus, &m_PSUReadBack, &m_PAReadBack, &m_RFPower, &m_CANBus,
+                                        &m_boardFresh, &m_RFFresh })
+            {
+                faults |= check->faulty ? check->fault : 0u;
+            }
+            if (faults != m_faults)
+            {
+                m_faults = faults;
+                m_stateHandler->setMonitoredFaults(faults);
+            }
+
+            if (m_heartbeat != nullptr)
+            {
+                m_heartbeat->beat();
+            }
+
+            nextCheck += k_period;
+            std::unique_lock<std::mutex> lock { m_wakeMutex };
+            m_wakeCondition.wait_until(lock, nextCheck, [&] () { return m_stopRequested.load(); });
+        }
+    }
+
+    void HealthMonitor::checkFanPSU(uint64_t now_ns)
+    {
+        BoardTelemetrySnapshot snapshot;
+        bool published { (m_boardTelemetry != nullptr) && m_boardTelemetry->latest(snapshot) };
+
+        // A failed register read counts as stale, so a dead I2C bus shows up as a telemetry fault
+        update(m_boardFresh,
+               published && snapshot.fanPSUStatusValid && fresh(snapshot.fanPSUStatusTimestamp_ns, now_ns));
+
+        if (published && snapshot.fanPSUStatusValid && (snapshot.fanPSUStatusTimestamp_ns != m_lastFanPSUStatus_ns))
+        {
+            m_lastFanPSUStatus_ns = snapshot.fanPSUStatusTimestamp_ns;
+
+            update(m_fanPSUStatus, (snapshot.fanPSUStatus & m_settings.fanPSUStatusFaultMask) == 0u);
+
+            // The PSU is enabled by initialisation and stays on, the PA is only enabled while
+            // jamming. Commands change the enables just after the state so a reading taken in
+            // between fails once, the debounce covers that.
+            if (m_stateHandler->initialised())
+            {
+                bool PSUEnabled { (snapshot.fanPSUControl & VSLBSP::k_fanPSUControlPSUEnable) != 0u };
+                bool PAEnabled { (snapshot.fanPSUControl & VSLBSP::k_fanPSUControlPAEnable) != 0u };
+                update(m_PSUReadBack, PSUEnabled);
+                update(m_PAReadBack, PAEnabled == m_stateHandler->jamming());
+            }
+        }
+    }
+
+    void HealthMonitor::checkRFPower(uint64_t now_ns)
+    {
+        RFPowerWindow window;
+        bool published { (m_powerMonitor != nullptr) && m_powerMonitor->latestWindow(window) };
+
+        update(m_RFFresh, published && fresh(window.timestamp_ns, now_ns));
+
+        if (published && (window.timestamp_ns != m_lastWindow_ns))
+        {
+            m_lastWindow_ns = window.timestamp_ns;
+
+            // A VSWR trip mutes the PA and is a fault in its own right, no power is expected
+            bool expectPower { m_stateHandler->jamming() &&
+                               ((m_stateHandler->healthFaults() & MercuryStateHandler::k_faultVSWR) == 0u) };
+
+            // Once raised, the threshold to clear is moved by the hysteresis
+            float hysteresis_dB { m_RFPower.faulty ? m_settings.RFHysteresis_dB : 0.0f };
+            bool passed { expectPower ? (window.forward_dBm >= (m_settings.jammingMinForward_dBm + hysteresis_dB))
+                                      : (window.forward_dBm <= (m_settings.mutedMaxForward_dBm - hysteresis_dB)) };
+            update(m_RFPower, passed);
+        }
+    }
+
+    void HealthMonitor::checkCAN()
+    {
+        CANClient::BusState state { m_CANClient->busState() };
+        update(m_CANBus, (state == CANClient::BusState::Active) || (state == CANClient::BusState::ErrorWarning));
+    }
+
+    void HealthMonitor::update(Check& check, bool passed)
+    {
+        if (passed)
+        {
+            check.failures = 0u;
+            if (check.faulty && (++check.passes >= m_settings.clearCount))
+            {
+                check.faulty = false;
+                Log::info("Health check {} passed, fault cleared", check.name);
+            }
+        }
+        else
+        {
+            check.passes = 0u;
+            if (!check.faulty && (++check.failures >= m_settings.raiseCount))
+            {
+                check.faulty = true;
+                Log::warning("health check {} failed, fault raised", check.name);
+            }
+        }
+    }
+
+    bool HealthMonitor::fresh(uint64_t timestamp_ns, uint64_t now_ns) const
+    {
+        uint64_t maxAge_ns { static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(m_settings.maxTelemetryAge).count()) };
+        return (timestamp_ns <= now_ns) ? ((now_ns - timestamp_ns) <= maxAge_ns) : true;
+    }
+}
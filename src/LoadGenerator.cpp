@@ -0,0 +1,432 @@
+#include "LoadGenerator.hpp"
+#include "Clock.hpp"
+#include "MercuryMessage.hpp"
+
+// Mercury includes
+#include "system/systemlib/inc/commands.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <net/if.h>
+#include <linux/can/raw.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace mercury::blackstar
+{
+    namespace sys = embedded::system;
+
+    // clang-format off
+    static const struct
+    {
+        const char *name;
+        uint16_t commandID;
+        size_t numberParameters;
+    } k_commands[] {
+        { "getstate",     sys::Command::GetState,                 0u                              },
+        { "ping",         sys::Command::Ping,                     0u                              },
+        { "capabilities", sys::Command::GetEcmModuleCapabilities, 0u                              },
+        { "upload",       sys::Command::UploadFile,               MercuryMessage::k_maxParameters },
+        { "version",      sys::Command::GetSoftwareVersionNumber, 0u                              },
+        { "serial",       sys::Command::GetSerialNumber,          0u                              },
+        { "bit",          sys::Command::BitTopLevel,              0u                              }
+    };
+    // clang-format on
+
+    LoadGenerator::~LoadGenerator()
+    {
+        close();
+    }
+
+    bool LoadGenerator::build(const Settings& settings)
+    {
+        m_settings = settings;
+        m_settings.rate_Hz = std::min(std::max(m_settings.rate_Hz, 1u), k_maxRate_Hz);
+        m_settings.outstanding = std::min(std::max(m_settings.outstanding, 1u), k_maxOutstanding);
+
+        if ((m_settings.slots == 0u) || (m_settings.slots > k_maxSlots))
+        {
+            std::cerr << "ERROR: load generator slots must be 1 to " << +k_maxSlots << std::endl;
+            return false;
+        }
+
+        // Parse the mix into command IDs and weights, and the number of parameters to send
+        std::vector<double> weights;
+        std::vector<size_t> numberParameters;
+        std::stringstream mix { m_settings.mix };
+        std::string entry;
+        while (std::getline(mix, entry, ','))
+        {
+            size_t separator { entry.find(':') };
+            std::string name { entry.substr(0, separator) };
+            double weight { (separator != std::string::npos) ? std::strtod(entry.c_str() + separator + 1u, nullptr)
+                                                             : 1.0 };
+
+            const auto command { std::find_if(std::begin(k_commands), std::end(k_commands),
+                                              [&name] (const auto& command) { return name == command.name; }) };
+            char *end { nullptr };
+            unsigned long commandID { std::strtoul(name.c_str(), &end, 0) };
+            if (command != std::end(k_commands))
+            {
+                m_commandIDs.push_back(command->commandID);
+                numberParameters.push_back(command->numberParameters);
+            }
+            else if (!name.empty() && (*end == '\0') && (commandID <= UINT16_MAX))
+            {
+                m_commandIDs.push_back(static_cast<uint16_t>(commandID));
+                numberParameters.push_back(0u);
+            }
+            else
+            {
+                std::cerr << "ERROR: unknown load generator command " << name << std::endl;
+                return false;
+            }
+            weights.push_back(std::max(weight, 0.0));
+        }
+
+        if (m_commandIDs.empty())
+        {
+            std::cerr << "ERROR: load generator command mix is empty" << std::endl;
+            return false;
+        }
+        m_mix = std::discrete_distribution<size_t> { weights.begin(), weights.end() };
+
+        // Every message is built once, upload parameters are arbitrary
+        m_slots.resize(m_settings.slots);
+        for (size_t slot = 0; slot < m_slots.size(); slot++)
+        {
+            uint8_t recipientID { static_cast<uint8_t>(MercuryMessage::k_ECMRecipientIDBase + slot) };
+            for (size_t command = 0; command < m_commandIDs.size(); command++)
+            {
+                std::vector<uint8_t> parameters(numberParameters[command]);
+                std::generate(parameters.begin(), parameters.end(), [this] () { return m_random() & 0xFF; });
+                m_slots[slot].messages.push_back(MercuryMessage::frames(
+                    recipientID, MercuryMessage::command(recipientID, m_commandIDs[command], parameters)));
+            }
+        }
+
+        return true;
+    }
+
+    bool LoadGenerator::run()
+    {
+        if (!open())
+        {
+            return false;
+        }
+
+        // The stop signals are taken through a descriptor so that the report is still written
+        sigset_t signals;
+        sigset_t previousSignals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        ::pthread_sigmask(SIG_BLOCK, &signals, &previousSignals);
+        int signalfd { ::signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC) };
+
+        const uint64_t period_ns { 1000000000u / m_settings.rate_Hz };
+        const uint64_t timeout_ns { static_cast<uint64_t>(std::chrono::nanoseconds { m_settings.timeout }.count()) };
+        const uint64_t start_ns { Clock::monotonic_ns() };
+        const uint64_t end_ns { start_ns +
+                                static_cast<uint64_t>(std::chrono::nanoseconds { m_settings.duration }.count()) };
+        uint64_t nextSend_ns { start_ns };
+        uint64_t sendingEnd_ns { end_ns };
+        size_t nextSlot { 0u };
+        bool sending { true };
+        bool stopRequested { false };
+
+        // Requests are sent until the end, then the outstanding ones have until the timeout to
+        // be answered
+        while (true)
+        {
+            uint64_t now { Clock::monotonic_ns() };
+            if (sending && (stopRequested || (now >= end_ns)))
+            {
+                sending = false;
+                sendingEnd_ns = std::min(now, end_ns);
+            }
+            if (!sending && std::all_of(m_slots.begin(), m_slots.end(),
+                                        [] (const Slot& slot) { return slot.outstanding.empty(); }))
+            {
+                break;
+            }
+
+            uint64_t wake_ns { now + timeout_ns };
+            if (sending && (m_settings.mode == Mode::Open))
+            {
+                // Catch up on every request due, the rate doesn't depend on the responses
+                for (; nextSend_ns <= now; nextSend_ns += period_ns)
+                {
+                    send(m_slots[nextSlot], nextSend_ns);
+                    nextSlot = (nextSlot + 1u) % m_slots.size();
+                }
+                wake_ns = nextSend_ns;
+            }
+            else if (sending)
+            {
+                for (Slot& slot : m_slots)
+                {
+                    bool ok { true };
+                    while (ok && (slot.outstanding.size() < m_settings.outstanding))
+                    {
+                        ok = send(slot, Clock::monotonic_ns());
+                    }
+                }
+            }
+
+            for (const Slot& slot : m_slots)
+            {
+                if (!slot.outstanding.empty())
+                {
+                    wake_ns = std::min(wake_ns, slot.outstanding.front().due_ns + timeout_ns);
+                }
+            }
+
+            now = Clock::monotonic_ns();
+            uint64_t wait_ns { (wake_ns > now) ? (wake_ns - now) : 0u };
+            ::timespec wait { static_cast<time_t>(wait_ns / 1000000000u), static_cast<long>(wait_ns % 1000000000u) };
+            ::pollfd descriptors[2] { { m_sockfd, POLLIN, 0 }, { signalfd, POLLIN, 0 } };
+            if (::ppoll(descriptors, (signalfd >= 0) ? 2u : 1u, &wait, nullptr) > 0)
+            {
+                signalfd_siginfo info;
+                if ((signalfd >= 0) && (::read(signalfd, &info, sizeof(info)) == static_cast<ssize_t>(sizeof(info))))
+                {
+                    stopRequested = true;
+                }
+                receive(Clock::monotonic_ns());
+            }
+            expire(Clock::monotonic_ns());
+        }
+        if (signalfd >= 0)
+        {
+            ::close(signalfd);
+        }
+        ::pthread_sigmask(SIG_SETMASK, &previousSignals, nullptr);
+        close();
+
+        report(sendingEnd_ns - start_ns);
+        return true;
+    }
+
+    bool LoadGenerator::open()
+    {
+        m_sockfd = ::socket(PF_CAN, SOCK_RAW | SOCK_CLOEXEC, CAN_RAW);
+        if (m_sockfd < 0)
+        {
+            std::cerr << "ERROR: could not create CAN socket" << std::endl;
+            return false;
+        }
+
+        ::ifreq request {};
+        ::sockaddr_can address {};
+        std::strncpy(request.ifr_name, m_settings.device.c_str(), sizeof(request.ifr_name) - 1u);
+        bool bound { ::ioctl(m_sockfd, SIOCGIFINDEX, &request) >= 0 };
+        if (bound)
+        {
+            address.can_family = AF_CAN;
+            address.can_ifindex = request.ifr_ifindex;
+            bound = ::bind(m_sockfd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) >= 0;
+        }
+        if (!bound)
+        {
+            std::cerr << "ERROR: could not bind CAN socket to " << m_settings.device << std::endl;
+            close();
+            return false;
+        }
+
+        // Only the ECM IDs of the target slots carry responses
+        std::vector<::can_filter> filters;
+        for (size_t slot = 0; slot < m_slots.size(); slot++)
+        {
+            filters.push_back({ static_cast<canid_t>(MercuryMessage::k_ECMRecipientIDBase + slot), CAN_SFF_MASK });
+        }
+        ::setsockopt(m_sockfd, SOL_CAN_RAW, CAN_RAW_FILTER, filters.data(),
+                     static_cast<socklen_t>(filters.size() * sizeof(::can_filter)));
+        return true;
+    }
+
+    void LoadGenerator::close()
+    {
+        if (m_sockfd >= 0)
+        {
+            ::close(m_sockfd);
+        }
+        m_sockfd = -1;
+    }
+
+    bool LoadGenerator::send(Slot& slot, uint64_t due_ns)
+    {
+        size_t command { m_mix(m_random) };
+
+        // A message which can't be sent whole is dropped, the ECM discards the partial message
+        // when it times out
+        bool ok { true };
+        for (const ::can_frame& frame : slot.messages[command])
+        {
+            ok = ok && sendFrame(frame);
+        }
+
+        if (ok)
+        {
+            m_sent++;
+            slot.outstanding.push_back({ m_commandIDs[command], due_ns });
+        }
+        else
+        {
+            m_sendErrors++;
+        }
+        return ok;
+    }
+
+    bool LoadGenerator::sendFrame(const ::can_frame& frame)
+    {
+        // The interface queue fills at a high rate (ENOBUFS), give it a moment to drain
+        for (uint32_t attempt = 0; attempt < k_sendRetries; attempt++)
+        {
+            if (::write(m_sockfd, &frame, sizeof(frame)) == static_cast<ssize_t>(sizeof(frame)))
+            {
+                return true;
+            }
+            if ((errno != ENOBUFS) && (errno != EAGAIN))
+            {
+                break;
+            }
+            ::timespec wait { 0, static_cast<long>(std::chrono::nanoseconds { k_sendRetryWait }.count()) };
+            ::nanosleep(&wait, nullptr);
+        }
+        return false;
+    }
+
+    void LoadGenerator::receive(uint64_t now_ns)
+    {
+        ::can_frame frame;
+        while (::recv(m_sockfd, &frame, sizeof(frame), MSG_DONTWAIT) == static_cast<ssize_t>(sizeof(frame)))
+        {
+            size_t slot { static_cast<size_t>(frame.can_id & CAN_SFF_MASK) - MercuryMessage::k_ECMRecipientIDBase };
+            if (((frame.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG)) != 0u) || (slot >= m_slots.size()))
+            {
+                continue;
+            }
+
+            // A frame which can't start a message means the start was missed
+            std::vector<uint8_t>& buffer { m_slots[slot].buffer };
+            if (buffer.empty() && ((frame.can_dlc == 0u) || (frame.data[0] != MercuryMessage::k_typeCommand)))
+            {
+                continue;
+            }
+            buffer.insert(buffer.end(), frame.data, frame.data + std::min<uint8_t>(frame.can_dlc, CAN_MAX_DLEN));
+
+            size_t size { MercuryMessage::size(buffer) };
+            if ((size > 0u) && (buffer.size() >= size))
+            {
+                responseReceived(m_slots[slot], now_ns);
+            }
+        }
+    }
+
+    void LoadGenerator::responseReceived(Slot& slot, uint64_t now_ns)
+    {
+        size_t size { MercuryMessage::size(slot.buffer) };
+        MercuryMessage::Response response;
+        bool ok { MercuryMessage::response(slot.buffer.data(), size, response) &&
+                  (response.recipientID == MercuryMessage::k_MCMRecipientID) };
+        slot.buffer.clear();
+        if (!ok)
+        {
+            return;
+        }
+
+        // The ECM answers in order, requests ahead of the one answered have been lost
+        while (!slot.outstanding.empty() && (slot.outstanding.front().commandID != response.commandID))
+        {
+            slot.outstanding.pop_front();
+            m_dropped++;
+        }
+
+        if (slot.outstanding.empty())
+        {
+            m_unmatched++;
+            return;
+        }
+
+        m_responses++;
+        m_notOK += (response.responseID != sys::Command::Ok) ? 1u : 0u;
+        uint64_t due_ns { slot.outstanding.front().due_ns };
+        m_latencies_ns.push_back((now_ns > due_ns) ? (now_ns - due_ns) : 0u);
+        slot.outstanding.pop_front();
+    }
+
+    void LoadGenerator::expire(uint64_t now_ns)
+    {
+        const uint64_t timeout_ns { static_cast<uint64_t>(std::chrono::nanoseconds { m_settings.timeout }.count()) };
+
+        for (Slot& slot : m_slots)
+        {
+            while (!slot.outstanding.empty() && ((slot.outstanding.front().due_ns + timeout_ns) <= now_ns))
+            {
+                slot.outstanding.pop_front();
+                m_dropped++;
+            }
+        }
+    }
+
+    void LoadGenerator::report(uint64_t elapsed_ns)
+    {
+        std::sort(m_latencies_ns.begin(), m_latencies_ns.end());
+        auto percentile_us = [this] (double fraction)
+        {
+            if (m_latencies_ns.empty())
+            {
+                return 0.0;
+            }
+            size_t index { std::min(m_latencies_ns.size() - 1u,
+                                    static_cast<size_t>(fraction * static_cast<double>(m_latencies_ns.size()))) };
+            return static_cast<double>(m_latencies_ns[index]) / 1000.0;
+        };
+
+        double mean_us { 0.0 };
+        for (uint64_t latency_ns : m_latencies_ns)
+        {
+            mean_us += static_cast<double>(latency_ns) / 1000.0;
+        }
+        mean_us = m_latencies_ns.empty() ? 0.0 : (mean_us / static_cast<double>(m_latencies_ns.size()));
+
+        double elapsed_s { static_cast<double>(std::max<uint64_t>(elapsed_ns, 1u)) / 1e9 };
+        double dropRate { (m_sent > 0u) ? (static_cast<double>(m_dropped) / static_cast<double>(m_sent)) : 0.0 };
+
+        // clang-format off
+        std::cout << std::fixed << std::setprecision(3)
+                  << "mode=" << ((m_settings.mode == Mode::Open) ? "open" : "closed") << "\n"
+                  << "slots=" << +m_settings.slots << "\n"
+                  << "duration_s=" << elapsed_s << "\n"
+                  << "sent=" << m_sent << "\n"
+                  << "responses=" << m_responses << "\n"
+                  << "dropped=" << m_dropped << "\n"
+                  << "unmatched=" << m_unmatched << "\n"
+                  << "not_ok=" << m_notOK << "\n"
+                  << "send_errors=" << m_sendErrors << "\n"
+                  << std::setprecision(6) << "drop_rate=" << dropRate << "\n" << std::setprecision(3)
+                  << "offered_per_s=" << (static_cast<double>(m_sent) / elapsed_s) << "\n"
+                  << "throughput_per_s=" << (static_cast<double>(m_responses) / elapsed_s) << "\n"
+                  << "latency_mean_us=" << mean_us << "\n"
+                  << "latency_p50_us=" << percentile_us(0.5) << "\n"
+                  << "latency_p90_us=" << percentile_us(0.9) << "\n"
+                  << "latency_p99_us=" << percentile_us(0.99) << "\n"
+                  << "latency_p999_us=" << percentile_us(0.999) << "\n"
+                  << "latency_max_us=" << (m_latencies_ns.empty() ? 0.0 : (m_latencies_ns.back() / 1000.0))
+                  << std::endl;
+        // clang-format on
+    }
+}
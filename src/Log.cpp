@@ -0,0 +1,472 @@
+#include "Log.hpp"
+#include "Clock.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace mercury::blackstar
+{
+    // clang-format off
+    static const char *k_journalSocketPath { "/run/systemd/journal/socket" };
+    static const char *k_journalIdentifier { "BlackStarECM" };
+    // clang-format on
+
+    // Single producer (the owning thread), single consumer (the writer) ring of records
+    struct LogRing
+    {
+        std::array<Log::Record, Log::k_ringSize> records;
+        alignas(64) std::atomic<uint64_t> head { 0u };
+        alignas(64) std::atomic<uint64_t> tail { 0u };
+        std::atomic<uint64_t> dropped { 0u };
+    };
+
+    // Shared by the logging threads and the writer, function static so that it is constructed
+    // before the first log call whatever the static initialisation order
+    struct LogState
+    {
+        std::mutex ringsMutex;  // Held to add a ring or take the list of rings, never to log
+        std::vector<std::unique_ptr<LogRing>> rings;
+        std::atomic_bool running { false };
+        std::atomic_bool stopRequested { false };
+        std::thread writer;
+        Log::Settings settings;
+
+        // Only accessed by the writer (and start/stop)
+        int fd { -1 };
+        uint64_t fileSize { 0u };
+        bool rotate { false };  // Only regular files are rotated
+        ::sockaddr_un journalAddress {};
+        uint64_t reportedDropped { 0u };
+    };
+
+    static LogState& state()
+    {
+        static LogState s_state;
+        return s_state;
+    }
+
+    static LogRing& threadRing()
+    {
+        thread_local LogRing *t_ring { nullptr };
+        if (t_ring == nullptr)
+        {
+            // First log call on this thread, rings live until the process exits
+            std::unique_ptr<LogRing> ring { std::make_unique<LogRing>() };
+            t_ring = ring.get();
+            std::lock_guard<std::mutex> lock { state().ringsMutex };
+            state().rings.push_back(std::move(ring));
+        }
+        return *t_ring;
+    }
+
+    static int journalPriority(LogLevel level)
+    {
+        switch (level)
+        {
+            case LogLevel::Debug:
+                return 7;
+            case LogLevel::Info:
+                return 6;
+            case LogLevel::Warning:
+                return 4;
+            default:
+                return 3;
+        }
+    }
+
+    static bool writeAll(int fd, const std::string& buffer)
+    {
+        size_t written { 0u };
+        while (written < buffer.size())
+        {
+            ssize_t result { ::write(fd, buffer.data() + written, buffer.size() - written) };
+            if (result <= 0)
+            {
+                return false;
+            }
+            written += static_cast<size_t>(result);
+        }
+        return true;
+    }
+
+    static bool openFile(LogState& s)
+    {
+        s.fd = ::open(s.settings.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        struct stat status {};
+        bool regular { (s.fd >= 0) && (::fstat(s.fd, &status) == 0) && S_ISREG(status.st_mode) };
+        s.fileSize = regular ? static_cast<uint64_t>(status.st_size) : 0u;
+        s.rotate = regular;
+        return s.fd >= 0;
+    }
+
+    static void rotateFile(LogState& s)
+    {
+        ::close(s.fd);
+        for (uint32_t file = s.settings.files; file > 1u; file--)
+        {
+            std::string from { s.settings.path + "." + std::to_string(file - 1u) };
+            std::string to { s.settings.path + "." + std::to_string(file) };
+            ::rename(from.c_str(), to.c_str());
+        }
+        std::string first { s.settings.path + ".1" };
+        if (s.settings.files > 0u)
+        {
+            ::rename(s.settings.path.c_str(), first.c_str());
+        }
+        else
+        {
+            ::unlink(s.settings.path.c_str());
+        }
+        openFile(s);
+    }
+
+    static void appendTime(uint64_t time_ns, std::string& buffer)
+    {
+        ::time_t seconds { static_cast<::time_t>(time_ns / 1000000000u) };
+        ::tm local {};
+        ::localtime_r(&seconds, &local);
+
+        char text[40];
+        size_t length { ::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &local) };
+        std::snprintf(text + length, sizeof(text) - length, ".%06u ",
+                      static_cast<unsigned>((time_ns % 1000000000u) / 1000u));
+        buffer += text;
+    }
+
+    // Write a batch of records (in time order) to the sink
+    static void writeRecords(LogState& s, const std::vector<Log::Record>& records)
+    {
+        std::string buffer;
+        std::string line;
+
+        if (s.settings.sink == Log::Sink::Journal)
+        {
+            for (const Log::Record& record : records)
+            {
+                line.clear();
+                Log::format(record, false, line);
+                buffer = "PRIORITY=" + std::to_string(journalPriority(record.level)) + "\nSYSLOG_IDENTIFIER=" +
+                         k_journalIdentifier + "\nMESSAGE=" + line + "\n";
+                if (::sendto(s.fd, buffer.data(), buffer.size(), MSG_NOSIGNAL,
+                             reinterpret_cast<const ::sockaddr *>(&s.journalAddress), sizeof(s.journalAddress)) < 0)
+                {
+                    // No journal, standard output is usually captured by the service manager anyway
+                    line.clear();
+                    Log::format(record, true, line);
+                    line += "\n";
+                    writeAll(STDOUT_FILENO, line);
+                }
+            }
+            return;
+        }
+
+        for (const Log::Record& record : records)
+        {
+            if (s.settings.sink == Log::Sink::File)
+            {
+                appendTime(record.time_ns, buffer);
+            }
+            Log::format(record, true, buffer);
+            buffer += "\n";
+        }
+
+        if (s.settings.sink == Log::Sink::File)
+        {
+            if (s.rotate && (s.fileSize > 0u) && ((s.fileSize + buffer.size()) > s.settings.maxFileSize))
+            {
+                rotateFile(s);
+            }
+            if ((s.fd >= 0) && writeAll(s.fd, buffer))
+            {
+                s.fileSize += buffer.size();
+            }
+        }
+        else
+        {
+            writeAll(STDOUT_FILENO, buffer);
+        }
+    }
+
+    // Drain every ring, returns false if there was nothing to write
+    static bool drain(LogState& s, std::vector<Log::Record>& records)
+    {
+        records.clear();
+
+        uint64_t dropped { 0u };
+        {
+            std::lock_guard<std::mutex> lock { s.ringsMutex };
+            for (std::unique_ptr<LogRing>& ring : s.rings)
+            {
+                uint64_t tail { ring->tail.load(std::memory_order_relaxed) };
+                uint64_t head { ring->head.load(std::memory_order_acquire) };
+                for (; tail != head; tail++)
+                {
+                    records.push_back(ring->records[tail & (Log::k_ringSize - 1u)]);
+                }
+                ring->tail.store(tail, std::memory_order_release);
+                dropped += ring->dropped.load(std::memory_order_relaxed);
+            }
+        }
+
+        // Keep each thread's records in order, interleave threads by time
+        std::stable_sort(records.begin(), records.end(),
+                         [] (const Log::Record& a, const Log::Record& b) { return a.time_ns < b.time_ns; });
+
+        if (dropped != s.reportedDropped)
+        {
+            Log::Record report {};
+            report.time_ns = records.empty() ? 0u : records.back().time_ns;
+            report.format = "{} log records dropped";
+            report.level = LogLevel::Warning;
+            report.argumentCount = 1u;
+            report.types[0] = Log::ArgumentType::Unsigned;
+            report.values[0] = dropped - s.reportedDropped;
+            records.push_back(report);
+            s.reportedDropped = dropped;
+        }
+
+        return !records.empty();
+    }
+
+    static_assert((Log::k_ringSize & (Log::k_ringSize - 1u)) == 0u, "Log ring size must be a power of two");
+
+    bool Log::start(const Settings& settings)
+    {
+        LogState& s { state() };
+        if (s.running)
+        {
+            return true;
+        }
+
+        s.settings = settings;
+        bool ok { true };
+        if (settings.sink == Sink::File)
+        {
+            ok = openFile(s);
+            if (!ok)
+            {
+                std::cout << "ERROR: could not open log file " << settings.path << std::endl;
+            }
+        }
+        else if (settings.sink == Sink::Journal)
+        {
+            s.fd = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+            s.journalAddress.sun_family = AF_UNIX;
+            std::strncpy(s.journalAddress.sun_path, k_journalSocketPath, sizeof(s.journalAddress.sun_path) - 1u);
+            ok = (s.fd >= 0);
+            if (!ok)
+            {
+                std::cout << "ERROR: could not create journal socket" << std::endl;
+            }
+        }
+
+        if (ok)
+        {
+            // Anything already written to standard output must come out first
+            std::cout << std::flush;
+
+            s.stopRequested = false;
+            s.running = true;
+
+            // The writer starts before the event loop takes over the signals, it is created with
+            // every signal blocked so that a signal for the event loop is never delivered to it
+            sigset_t signals;
+            sigset_t previousSignals;
+            sigfillset(&signals);
+            ::pthread_sigmask(SIG_BLOCK, &signals, &previousSignals);
+
+            // clang-format off
+            s.writer = std::thread { [&s] ()
+                                     {
+                                         Metrics::registerThread("Log");
+                                         std::vector<Log::Record> records;
+                                         records.reserve(k_ringSize);
+                                         while (!s.stopRequested)
+                                         {
+                                             std::this_thread::sleep_for(k_writePeriod);
+                                             if (drain(s, records))
+                                             {
+                                                 writeRecords(s, records);
+                                             }
+                                         }
+                                     }
+                                   };
+            // clang-format on
+            ::pthread_sigmask(SIG_SETMASK, &previousSignals, nullptr);
+        }
+
+        return ok;
+    }
+
+    void Log::stop()
+    {
+        LogState& s { state() };
+        if (!s.running)
+        {
+            return;
+        }
+
+        s.stopRequested = true;
+        if (s.writer.joinable())
+        {
+            s.writer.join();
+        }
+
+        // Anything logged while the writer was stopping
+        std::vector<Log::Record> records;
+        if (drain(s, records))
+        {
+            writeRecords(s, records);
+        }
+        s.running = false;
+
+        if (s.fd >= 0)
+        {
+            ::close(s.fd);
+            s.fd = -1;
+        }
+    }
+
+    uint64_t Log::dropped()
+    {
+        LogState& s { state() };
+        uint64_t dropped { 0u };
+        std::lock_guard<std::mutex> lock { s.ringsMutex };
+        for (std::unique_ptr<LogRing>& ring : s.rings)
+        {
+            dropped += ring->dropped.load(std::memory_order_relaxed);
+        }
+        return dropped;
+    }
+
+    Log::Record *Log::reserve(LogLevel level, const char *format)
+    {
+        thread_local Record t_unbuffered {};
+
+        Record *record { &t_unbuffered };
+        if (state().running)
+        {
+            LogRing& ring { threadRing() };
+            uint64_t head { ring.head.load(std::memory_order_relaxed) };
+            if ((head - ring.tail.load(std::memory_order_acquire)) >= k_ringSize)
+            {
+                ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1u, std::memory_order_relaxed);
+                return nullptr;
+            }
+            record = &ring.records[head & (k_ringSize - 1u)];
+        }
+
+        record->time_ns = Clock::realTime_ns();
+        record->format = format;
+        record->level = level;
+        record->buffered = (record != &t_unbuffered);
+        record->argumentCount = 0u;
+        record->textSize = 0u;
+        return record;
+    }
+
+    void Log::commit(Record& record)
+    {
+        // Decided by reserve(), the writer may have started or stopped since
+        if (record.buffered)
+        {
+            LogRing& ring { threadRing() };
+            ring.head.store(ring.head.load(std::memory_order_relaxed) + 1u, std::memory_order_release);
+        }
+        else
+        {
+            std::string line;
+            format(record, true, line);
+            std::cout << line << std::endl;
+        }
+    }
+
+    void Log::copyText(Record& record, size_t index, std::string_view text)
+    {
+        size_t length { std::min(text.size(), k_textSize - record.textSize) };
+        std::memcpy(record.text.data() + record.textSize, text.data(), length);
+
+        record.types[index] = ArgumentType::String;
+        record.values[index] = (static_cast<uint64_t>(record.textSize) << 32) | length;
+        record.textSize = static_cast<uint16_t>(record.textSize + length);
+    }
+
+    void Log::format(const Record& record, bool prefix, std::string& line)
+    {
+        if (prefix && (record.level == LogLevel::Error))
+        {
+            line += "ERROR: ";
+        }
+        else if (prefix && (record.level == LogLevel::Warning))
+        {
+            line += "WARNING: ";
+        }
+
+        size_t argument { 0u };
+        for (const char *c = record.format; *c != '\0'; c++)
+        {
+            bool hex { (c[0] == '{') && (c[1] == 'x') && (c[2] == '}') };
+            if (((c[0] != '{') || (c[1] != '}')) && !hex)
+            {
+                line += *c;
+                continue;
+            }
+            c += hex ? 2 : 1;
+
+            if (argument >= record.argumentCount)
+            {
+                line += "{?}";
+                continue;
+            }
+
+            char text[32];
+            uint64_t value { record.values[argument] };
+            switch (record.types[argument])
+            {
+                case ArgumentType::Signed:
+                    if (hex)
+                    {
+                        std::snprintf(text, sizeof(text), "%" PRIx64, value);
+                    }
+                    else
+                    {
+                        std::snprintf(text, sizeof(text), "%" PRId64, static_cast<int64_t>(value));
+                    }
+                    line += text;
+                    break;
+                case ArgumentType::Unsigned:
+                    std::snprintf(text, sizeof(text), hex ? "%" PRIx64 : "%" PRIu64, value);
+                    line += text;
+                    break;
+                case ArgumentType::Float:
+                {
+                    double number { 0.0 };
+                    std::memcpy(&number, &value, sizeof(number));
+                    std::snprintf(text, sizeof(text), "%g", number);
+                    line += text;
+                    break;
+                }
+                case ArgumentType::String:
+                    line.append(record.text.data() + (value >> 32), value & 0xFFFFFFFFu);
+                    break;
+            }
+            argument++;
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#include "MercuryMessage.hpp"
+
+#include <algorithm>
+#include <boost/crc.hpp>
+
+namespace mercury::blackstar
+{
+    uint16_t MercuryMessage::CRC(const uint8_t *data, size_t size)
+    {
+        boost::crc_ccitt_type result;
+        result.process_bytes(data, size);
+        return result.checksum();
+    }
+
+    std::vector<uint8_t> MercuryMessage::command(uint8_t recipientID,
+                                                 uint16_t commandID,
+                                                 const std::vector<uint8_t>& parameters)
+    {
+        size_t numberParameters { std::min(parameters.size(), k_maxParameters) };
+
+        std::vector<uint8_t> message;
+        message.reserve(k_headerSize + numberParameters + k_CRCSize);
+        message.push_back(k_typeCommand);
+        message.push_back(static_cast<uint8_t>(numberParameters + 2u));
+        message.push_back(recipientID);
+        message.push_back(static_cast<uint8_t>(commandID & 0xFF));
+        message.push_back(static_cast<uint8_t>(commandID >> 8));
+        message.insert(message.end(), parameters.begin(), parameters.begin() + numberParameters);
+
+        uint16_t CRC { MercuryMessage::CRC(message.data(), message.size()) };
+        message.push_back(static_cast<uint8_t>(CRC & 0xFF));
+        message.push_back(static_cast<uint8_t>(CRC >> 8));
+        return message;
+    }
+
+    std::vector<::can_frame> MercuryMessage::frames(canid_t CANID, const std::vector<uint8_t>& message)
+    {
+        std::vector<::can_frame> frames;
+        frames.reserve((message.size() + k_frameSize - 1u) / k_frameSize);
+
+        for (size_t offset = 0; offset < message.size(); offset += k_frameSize)
+        {
+            ::can_frame frame {};
+            frame.can_id = CANID;
+            frame.can_dlc = static_cast<uint8_t>(std::min(k_frameSize, message.size() - offset));
+            std::copy_n(message.begin() + offset, frame.can_dlc, frame.data);
+            frames.push_back(frame);
+        }
+        return frames;
+    }
+
+    size_t MercuryMessage::size(const std::vector<uint8_t>& buffer)
+    {
+        return (buffer.size() > 1u) ? (buffer[1] + k_headerSize) : 0u;
+    }
+
+    bool MercuryMessage::response(const uint8_t *message, size_t size, Response& response)
+    {
+        // Type, length, recipient, response ID, command ID and the CRC
+        if ((size < (k_headerSize + 2u + k_CRCSize)) || (message[0] != k_typeCommand) ||
+            (size != (message[1] + k_headerSize)))
+        {
+            return false;
+        }
+
+        uint16_t CRC { static_cast<uint16_t>(message[size - 2u] | (message[size - 1u] << 8)) };
+        if (MercuryMessage::CRC(message, size - k_CRCSize) != CRC)
+        {
+            return false;
+        }
+
+        response.recipientID = message[2];
+        response.responseID = static_cast<uint16_t>(message[3] | (message[4] << 8));
+        response.commandID = static_cast<uint16_t>(message[5] | (message[6] << 8));
+        return true;
+    }
+}
@@ -1,6 +1,8 @@
 #include "MercuryStateHandler.hpp"
+#include "Log.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
 
-#include <iostream>
 #include <thread>
 #include <chrono>
 
@@ -10,19 +12,56 @@ namespace mercury
 
     namespace blackstar
     {
+        static uint64_t elapsed_ns(std::chrono::steady_clock::time_point since)
+        {
+            return static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count());
+        }
 
-        void MercuryStateHandler::build(std::shared_ptr<VSLBSP> BSP)
+        void MercuryStateHandler::build(std::shared_ptr<VSLBSP> BSP,
+                                        std::shared_ptr<RFPowerMonitor> powerMonitor,
+                                        std::shared_ptr<VSWRProtection> VSWRProtection)
         {
             m_BSP = BSP;
-            m_BSP->enablePSU();
-            m_BSP->enableFans();
+            m_powerMonitor = powerMonitor;
+            m_VSWRProtection = VSWRProtection;
+        }
+
+        void MercuryStateHandler::initialise(bool hardwareOK)
+        {
+            bool ok { m_BSP->enablePSU() };
+            ok = m_BSP->enableFans() && ok;
+
+            if (!hardwareOK || !ok)
+            {
+                Log::error("hardware initialisation failed");
+                m_faults |= k_faultInitialisation;
+            }
+
+            // Apply a start command which arrived while initialising
+            std::lock_guard<std::mutex> lock { m_stateMutex };
+            m_state = m_startRequested ? sys::EcmState::StandbyNoMission : sys::EcmState::Initialised;
+        }
+
+        bool MercuryStateHandler::initialised() const
+        {
+            return m_state != sys::EcmState::Started;
         }
 
         // Functions to be called by CAN message handler
         void MercuryStateHandler::startCommandReceived()
         {
-            // If the state initialised or an earlier state then move to StandbyNoMission
-            if (m_state <= sys::EcmState::Initialised)
+            Trace::Scope trace { "MercuryStateHandler::startCommandReceived" };
+            Metrics::increment(Metrics::Counter::StartCommands);
+            std::lock_guard<std::mutex> lock { m_stateMutex };
+
+            // If the state initialised or an earlier state then move to StandbyNoMission, while
+            // initialising the move is made once initialisation is complete
+            if (m_state == sys::EcmState::Started)
+            {
+                m_startRequested = true;
+            }
+            else if (m_state <= sys::EcmState::Initialised)
             {
                 m_state = sys::EcmState::StandbyNoMission;
             }
@@ -30,24 +69,71 @@ namespace mercury
 
         void MercuryStateHandler::startJammingCommandReceived()
         {
-            std::cout << "Start Jamming Command Received" << std::endl;
-            m_state = sys::EcmState::Jamming;
-            m_BSP->setRFLEDOn();
+            Trace::Scope trace { "MercuryStateHandler::startJammingCommandReceived" };
+            Log::info("Start Jamming Command Received");
+            Metrics::increment(Metrics::Counter::StartJammingCommands);
+            std::chrono::steady_clock::time_point received { std::chrono::steady_clock::now() };
+
+            // The PSU, fans and VSWR protection must be up before the PA is unmuted, checked under
+            // the state lock so initialise() can't be part way through
+            {
+                std::lock_guard<std::mutex> lock { m_stateMutex };
+                if (m_state == sys::EcmState::Started)
+                {
+                    Log::warning("start jamming ignored, hardware still initialising");
+                    return;
+                }
+                m_state = sys::EcmState::Jamming;
+            }
+
+            // A new jamming command acknowledges any VSWR fault, if the fault is still present
+            // then the protection will trip again as soon as there is forward power
+            if (m_VSWRProtection != nullptr)
+            {
+                m_VSWRProtection->rearm();
+            }
+
+            // Unmute and light the RF LED together so the LED never disagrees with the PA
             m_BSP->enablePA();
-            m_BSP->unmutePA();
+            m_BSP->setOutputs(VSLBSP::k_outputPAMuteN | VSLBSP::k_outputRFLED,
+                              VSLBSP::k_outputPAMuteN | VSLBSP::k_outputRFLED);
+            Metrics::observe(Metrics::Histogram::StartJamming, elapsed_ns(received));
+
+            // Sample RF power at the fast rate while jamming
+            if (m_powerMonitor != nullptr)
+            {
+                m_powerMonitor->setJamming(true);
+            }
         }
 
         void MercuryStateHandler::stopJammingCommandReceived()
         {
-            std::cout << "Stop Jamming Command Received" << std::endl;
-            m_state = sys::EcmState::StandbyWithMission;
-            m_BSP->setRFLEDOff();
-            m_BSP->mutePA();
-            m_BSP->disablePA();
+            Trace::Scope trace { "MercuryStateHandler::stopJammingCommandReceived" };
+            Log::info("Stop Jamming Command Received");
+            Metrics::increment(Metrics::Counter::StopJammingCommands);
+            std::chrono::steady_clock::time_point received { std::chrono::steady_clock::now() };
+            {
+                std::lock_guard<std::mutex> lock { m_stateMutex };
+                if (m_state != sys::EcmState::Started)
+                {
+                    m_state = sys::EcmState::StandbyWithMission;
+                }
+            }
+            m_BSP->setOutputs(VSLBSP::k_outputPAMuteN | VSLBSP::k_outputRFLED, 0u);
+            m_BSP->disablePA(VSLBSP::BusPriority::Safety);
+            Metrics::observe(Metrics::Histogram::StopJamming, elapsed_ns(received));
+
+            if (m_powerMonitor != nullptr)
+            {
+                m_powerMonitor->setJamming(false);
+            }
         }
 
         void MercuryStateHandler::zeroiseCommandReceived()
         {
+            Trace::Scope trace { "MercuryStateHandler::zeroiseCommandReceived" };
+            Metrics::increment(Metrics::Counter::ZeroiseCommands);
+            std::lock_guard<std::mutex> lock { m_stateMutex };
             if (sys::EcmState::isStandby(m_state))
             {
                 m_state = sys::EcmState::StandbyNoMission;
@@ -58,18 +144,88 @@ namespace mercury
         // Functions to be called by BlackStar application handler
         void MercuryStateHandler::applicationLoaded()
         {
+            std::lock_guard<std::mutex> lock { m_stateMutex };
             if (sys::EcmState::isStandbyNoMission(m_state))
             {
                 m_state = sys::EcmState::StandbyWithMission;
             }
         }
 
+        // Functions to be called by VSWR protection
+        void MercuryStateHandler::VSWRTripped()
+        {
+            Trace::Scope trace { "MercuryStateHandler::VSWRTripped" };
+            // The fault is raised before the mute so that a control socket unmute racing with the
+            // trip sees it (see unmutePACommandReceived). Mute, RF LED off and alert LED on in one
+            // output update (the PA mute is the first output changed if the update falls back to
+            // per-channel writes).
+            m_faults |= k_faultVSWR;
+            m_BSP->setOutputs(VSLBSP::k_outputPAMuteN | VSLBSP::k_outputRFLED | VSLBSP::k_outputAlertLED,
+                              VSLBSP::k_outputAlertLED);
+            Metrics::increment(Metrics::Counter::VSWRTrips);
+        }
+
+        void MercuryStateHandler::VSWRCleared()
+        {
+            // The PA stays muted until the next start jamming command
+            m_faults &= static_cast<uint8_t>(~k_faultVSWR);
+            m_BSP->setAlertLEDOff();
+        }
+
+        // Functions to be called by the control socket
+        bool MercuryStateHandler::enablePACommandReceived()
+        {
+            std::lock_guard<std::mutex> lock { m_stateMutex };
+            return PACommandAllowed("PA enable") && m_BSP->enablePA();
+        }
+
+        bool MercuryStateHandler::unmutePACommandReceived()
+        {
+            std::lock_guard<std::mutex> lock { m_stateMutex };
+            if (!PACommandAllowed("PA unmute"))
+            {
+                return false;
+            }
+
+            m_BSP->setOutputs(VSLBSP::k_outputPAMuteN | VSLBSP::k_outputRFLED,
+                              VSLBSP::k_outputPAMuteN | VSLBSP::k_outputRFLED);
+
+            // A trip which raced with the unmute may have muted before it, mute again
+            if ((m_faults & k_faultVSWR) != 0u)
+            {
+                m_BSP->setOutputs(VSLBSP::k_outputPAMuteN | VSLBSP::k_outputRFLED, 0u);
+                return false;
+            }
+            return true;
+        }
+
+        bool MercuryStateHandler::PACommandAllowed(const char *command) const
+        {
+            bool allowed { (m_state == sys::EcmState::Jamming) && ((m_faults & k_faultVSWR) == 0u) };
+            if (!allowed)
+            {
+                Log::warning("{} refused, {}", command,
+                             ((m_faults & k_faultVSWR) != 0u) ? "VSWR protection tripped" : "not jamming");
+            }
+            return allowed;
+        }
+
+        void MercuryStateHandler::setMonitoredFaults(uint8_t faults)
+        {
+            uint8_t current { m_faults };
+            uint8_t updated { 0u };
+            do
+            {
+                updated = static_cast<uint8_t>((current & ~k_monitoredFaults) | (faults & k_monitoredFaults));
+            } while (!m_faults.compare_exchange_weak(current, updated));
+        }
+
         sys::EcmState::State MercuryStateHandler::currentState() const
         {
             sys::EcmState::State state { m_state };
 
             // If health is not OK then map the current state to the corresponding "WithError" state
-            if (!m_healthOK)
+            if (!healthOK())
             {
                 if (state == sys::EcmState::StandbyNoMission)
                 {
@@ -90,7 +246,17 @@ namespace mercury
 
         bool MercuryStateHandler::healthOK() const
         {
-            return m_healthOK;
+            return m_faults == 0u;
+        }
+
+        uint8_t MercuryStateHandler::healthFaults() const
+        {
+            return m_faults;
+        }
+
+        bool MercuryStateHandler::jamming() const
+        {
+            return m_state == sys::EcmState::Jamming;
         }
     }
 }
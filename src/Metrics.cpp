@@ -0,0 +1,226 @@
+#include "Metrics.hpp"
+#include "Clock.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace mercury::blackstar
+{
+    // clang-format off
+    static const char *k_counterNames[Metrics::k_numberCounters][2]
+    {
+        { "blackstar_can_frames_received_total",    "CAN data frames received" },
+        { "blackstar_can_bytes_received_total",     "CAN data bytes received" },
+        { "blackstar_can_frames_sent_total",        "CAN frames sent" },
+        { "blackstar_can_bytes_sent_total",         "CAN data bytes sent" },
+        { "blackstar_can_send_errors_total",        "CAN frames which could not be sent" },
+        { "blackstar_can_error_frames_total",       "CAN error frames received" },
+        { "blackstar_messages_received_total",      "Complete Mercury messages received" },
+        { "blackstar_crc_failures_total",           "Mercury messages which failed the CRC check" },
+        { "blackstar_not_recognised_total",         "Mercury commands answered with NotRecognised" },
+        { "blackstar_reassembly_aborts_total",      "Partial Mercury messages discarded" },
+        { "blackstar_start_commands_total",         "Start commands received" },
+        { "blackstar_start_jamming_commands_total", "Start jamming commands received" },
+        { "blackstar_stop_jamming_commands_total",  "Stop jamming commands received" },
+        { "blackstar_zeroise_commands_total",       "Zeroise commands received" },
+        { "blackstar_vswr_trips_total",             "VSWR protection trips" }
+    };
+
+    static const char *k_histogramNames[Metrics::k_numberHistograms][2]
+    {
+        { "blackstar_message_processing_seconds", "Complete message received to response ready" },
+        { "blackstar_start_jamming_seconds",      "Start jamming command to PA unmuted" },
+        { "blackstar_stop_jamming_seconds",       "Stop jamming command to PA muted and disabled" }
+    };
+    // clang-format on
+
+    // Every shard ever allocated, function static so that it is constructed before the first
+    // update whatever the static initialisation order
+    struct MetricsState
+    {
+        std::mutex shardsMutex;  // Held to add a shard or walk the list, never to update
+        std::vector<std::unique_ptr<Metrics::Shard>> shards;
+    };
+
+    static MetricsState& state()
+    {
+        static MetricsState s_state;
+        return s_state;
+    }
+
+    static uint64_t CPUTime_ns(clockid_t clock)
+    {
+        ::timespec time {};
+        if (::clock_gettime(clock, &time) != 0)
+        {
+            return 0u;
+        }
+        return (static_cast<uint64_t>(time.tv_sec) * 1000000000u) + static_cast<uint64_t>(time.tv_nsec);
+    }
+
+    // Records the CPU time of a named thread when it exits, its clock is invalid from then on
+    struct ThreadExit
+    {
+        Metrics::Shard *shard { nullptr };
+
+        ~ThreadExit()
+        {
+            if (shard != nullptr)
+            {
+                shard->finalCPU_ns = CPUTime_ns(CLOCK_THREAD_CPUTIME_ID);
+                shard->running = false;
+            }
+        }
+    };
+
+    Metrics::Shard& Metrics::attach()
+    {
+        // Shards live until the process exits so their totals outlive the thread
+        std::unique_ptr<Shard> shard { std::make_unique<Shard>() };
+        t_shard = shard.get();
+        std::lock_guard<std::mutex> lock { state().shardsMutex };
+        state().shards.push_back(std::move(shard));
+        return *t_shard;
+    }
+
+    void Metrics::registerThread(const char *name)
+    {
+        thread_local ThreadExit t_exit;
+
+        Shard& current { shard() };
+        std::strncpy(current.name.data(), name, current.name.size() - 1u);
+
+        // The main thread's name is the process name, leave that alone for ps and pidof
+        if (::getpid() != static_cast<pid_t>(::syscall(SYS_gettid)))
+        {
+            ::pthread_setname_np(::pthread_self(), current.name.data());
+        }
+
+        if (::pthread_getcpuclockid(::pthread_self(), &current.CPUClock) == 0)
+        {
+            t_exit.shard = &current;
+            current.named = true;
+        }
+    }
+
+    void Metrics::countCommand(uint16_t commandID)
+    {
+        Shard& current { shard() };
+        uint32_t key { static_cast<uint32_t>(commandID) + 1u };
+
+        // Linear probe from the low bits of the ID, only this thread adds IDs
+        for (size_t probe = 0; probe < k_commandSlots; probe++)
+        {
+            size_t slot { (commandID + probe) % k_commandSlots };
+            uint32_t slotKey { current.commandIDs[slot].load(std::memory_order_relaxed) };
+            if (slotKey == 0u)
+            {
+                current.commandCounts[slot].store(0u, std::memory_order_relaxed);
+                current.commandIDs[slot].store(key, std::memory_order_release);
+                slotKey = key;
+            }
+            if (slotKey == key)
+            {
+                std::atomic<uint64_t>& count { current.commandCounts[slot] };
+                count.store(count.load(std::memory_order_relaxed) + 1u, std::memory_order_relaxed);
+                return;
+            }
+        }
+    }
+
+    void Metrics::collect(Snapshot& snapshot)
+    {
+        snapshot = Snapshot {};
+        snapshot.timestamp_ns = Clock::realTime_ns();
+
+        std::map<uint16_t, uint64_t> commands;
+
+        std::lock_guard<std::mutex> lock { state().shardsMutex };
+        for (const std::unique_ptr<Shard>& shard : state().shards)
+        {
+            for (size_t counter = 0; counter < k_numberCounters; counter++)
+            {
+                snapshot.counters[counter] += shard->counters[counter].load(std::memory_order_relaxed);
+            }
+
+            for (size_t histogram = 0; histogram < k_numberHistograms; histogram++)
+            {
+                const HistogramShard& data { shard->histograms[histogram] };
+                HistogramSnapshot& total { snapshot.histograms[histogram] };
+                for (size_t bucket = 0; bucket < k_numberBuckets; bucket++)
+                {
+                    uint64_t count { data.buckets[bucket].load(std::memory_order_relaxed) };
+                    total.buckets[bucket] += count;
+                    total.count += count;
+                }
+                total.sum_ns += data.sum_ns.load(std::memory_order_relaxed);
+            }
+
+            for (size_t slot = 0; slot < k_commandSlots; slot++)
+            {
+                uint32_t key { shard->commandIDs[slot].load(std::memory_order_acquire) };
+                if (key != 0u)
+                {
+                    commands[static_cast<uint16_t>(key - 1u)] += shard->commandCounts[slot].load(
+                        std::memory_order_relaxed);
+                }
+            }
+
+            if (shard->named.load(std::memory_order_acquire))
+            {
+                ThreadSnapshot thread;
+                thread.name = shard->name.data();
+                thread.running = shard->running;
+                thread.CPU_ns = thread.running ? CPUTime_ns(shard->CPUClock) : 0u;
+
+                // The clock goes away when the thread exits, the final reading is taken then
+                if (!thread.running || (thread.CPU_ns == 0u))
+                {
+                    thread.CPU_ns = shard->finalCPU_ns;
+                }
+                snapshot.threads.push_back(thread);
+            }
+        }
+
+        snapshot.commands.assign(commands.begin(), commands.end());
+    }
+
+    uint64_t Metrics::total(Counter counter)
+    {
+        uint64_t sum { 0u };
+        std::lock_guard<std::mutex> lock { state().shardsMutex };
+        for (const std::unique_ptr<Shard>& shard : state().shards)
+        {
+            sum += shard->counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    const char *Metrics::name(Counter counter)
+    {
+        return k_counterNames[static_cast<size_t>(counter)][0];
+    }
+
+    const char *Metrics::help(Counter counter)
+    {
+        return k_counterNames[static_cast<size_t>(counter)][1];
+    }
+
+    const char *Metrics::name(Histogram histogram)
+    {
+        return k_histogramNames[static_cast<size_t>(histogram)][0];
+    }
+
+    const char *Metrics::help(Histogram histogram)
+    {
+        return k_histogramNames[static_cast<size_t>(histogram)][1];
+    }
+}
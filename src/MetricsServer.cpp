@@ -0,0 +1,385 @@
+#include "MetricsServer.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace mercury::blackstar
+{
+    // clang-format off
+    static const char *k_priorityNames[BusScheduler::k_numberPriorities] { "safety", "state", "telemetry" };
+    static const char *k_binaryMagic { "BSMT" };
+    // clang-format on
+
+    static const std::chrono::milliseconds k_fetchTimeout { 2000 };
+
+    static void appendLE(std::vector<uint8_t>& data, uint64_t value, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            data.push_back(static_cast<uint8_t>(value >> (8u * i)));
+        }
+    }
+
+    static void appendName(std::vector<uint8_t>& data, const std::string& name)
+    {
+        size_t length { std::min<size_t>(name.size(), UINT8_MAX) };
+        data.push_back(static_cast<uint8_t>(length));
+        data.insert(data.end(), name.begin(), name.begin() + static_cast<std::ptrdiff_t>(length));
+    }
+
+    static std::string seconds(uint64_t time_ns)
+    {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.9g", static_cast<double>(time_ns) / 1e9);
+        return text;
+    }
+
+    static void header(std::string& output, const char *name, const char *help, const char *type)
+    {
+        output += std::string { "# HELP " } + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+    }
+
+    MetricsServer::~MetricsServer()
+    {
+        for (int fd : m_connections)
+        {
+            ::close(fd);
+        }
+
+        if (m_listenfd >= 0)
+        {
+            ::close(m_listenfd);
+            ::unlink(m_path.c_str());
+        }
+    }
+
+    void MetricsServer::build(std::shared_ptr<VSLBSP> BSP, std::shared_ptr<MercuryStateHandler> stateHandler)
+    {
+        m_BSP = BSP;
+        m_stateHandler = stateHandler;
+    }
+
+    bool MetricsServer::listen(EventLoop& eventLoop, const std::string& path)
+    {
+        sockaddr_un address {};
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            Log::error("metrics socket path too long: {}", path);
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1u);
+
+        m_listenfd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_listenfd < 0)
+        {
+            Log::error("could not create metrics socket ({})", std::strerror(errno));
+            return false;
+        }
+
+        // A socket left behind by a previous run would make bind fail
+        ::unlink(path.c_str());
+        bool ok { (::bind(m_listenfd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) &&
+                  (::listen(m_listenfd, static_cast<int>(k_maxConnections)) == 0) };
+        if (ok)
+        {
+            m_path = path;
+            m_eventLoop = &eventLoop;
+            ok = eventLoop.addDescriptor(m_listenfd, [this] () { accept(); });
+        }
+        else
+        {
+            Log::error("could not listen on metrics socket {} ({})", path, std::strerror(errno));
+        }
+
+        if (!ok)
+        {
+            ::close(m_listenfd);
+            m_listenfd = -1;
+        }
+        return ok;
+    }
+
+    void MetricsServer::text(std::string& output) const
+    {
+        Metrics::Snapshot snapshot;
+        Metrics::collect(snapshot);
+        output.clear();
+
+        for (size_t counter = 0; counter < Metrics::k_numberCounters; counter++)
+        {
+            const char *name { Metrics::name(static_cast<Metrics::Counter>(counter)) };
+            header(output, name, Metrics::help(static_cast<Metrics::Counter>(counter)), "counter");
+            output += std::string { name } + " " + std::to_string(snapshot.counters[counter]) + "\n";
+        }
+
+        header(output, "blackstar_commands_total", "Mercury command messages received by command ID", "counter");
+        for (const std::pair<uint16_t, uint64_t>& command : snapshot.commands)
+        {
+            char label[16];
+            std::snprintf(label, sizeof(label), "0x%04x", command.first);
+            output += std::string { "blackstar_commands_total{command=\"" } + label + "\"} " +
+                      std::to_string(command.second) + "\n";
+        }
+
+        for (size_t histogram = 0; histogram < Metrics::k_numberHistograms; histogram++)
+        {
+            const char *name { Metrics::name(static_cast<Metrics::Histogram>(histogram)) };
+            const Metrics::HistogramSnapshot& data { snapshot.histograms[histogram] };
+            header(output, name, Metrics::help(static_cast<Metrics::Histogram>(histogram)), "histogram");
+
+            uint64_t cumulative { 0u };
+            for (size_t bucket = 0; bucket < Metrics::k_numberBuckets; bucket++)
+            {
+                cumulative += data.buckets[bucket];
+                bool last { (bucket + 1u) == Metrics::k_numberBuckets };
+                std::string bound { last ? std::string { "+Inf" } : seconds(Metrics::bucketBound_ns(bucket)) };
+                output += std::string { name } + "_bucket{le=\"" + bound + "\"} " + std::to_string(cumulative) + "\n";
+            }
+            output += std::string { name } + "_sum " + seconds(data.sum_ns) + "\n";
+            output += std::string { name } + "_count " + std::to_string(data.count) + "\n";
+        }
+
+        header(output, "blackstar_thread_cpu_seconds_total", "CPU time used by each named thread", "counter");
+        for (const Metrics::ThreadSnapshot& thread : snapshot.threads)
+        {
+            output += "blackstar_thread_cpu_seconds_total{thread=\"" + thread.name + "\"} " + seconds(thread.CPU_ns) +
+                      "\n";
+        }
+
+        // The bus scheduler keeps its own statistics, the families are written a bus at a time
+        std::vector<std::pair<std::string, BusScheduler::Statistics>> buses;
+        if (m_BSP != nullptr)
+        {
+            buses.emplace_back(m_BSP->I2CBus().name(), m_BSP->I2CBus().statistics());
+            buses.emplace_back(m_BSP->SPIBus().name(), m_BSP->SPIBus().statistics());
+        }
+
+        // clang-format off
+        static const char *k_busFamilies[4][2]
+        {
+            { "blackstar_bus_transactions_total", "Bus transactions requested" },
+            { "blackstar_bus_failures_total",     "Bus transactions which failed after every attempt" },
+            { "blackstar_bus_retries_total",      "Bus transaction attempts after the first" },
+            { "blackstar_bus_wait_seconds_total", "Time waiting for the bus to be granted" }
+        };
+        // clang-format on
+        for (size_t family = 0; family < 4u; family++)
+        {
+            header(output, k_busFamilies[family][0], k_busFamilies[family][1], "counter");
+            for (const std::pair<std::string, BusScheduler::Statistics>& bus : buses)
+            {
+                for (size_t priority = 0; priority < BusScheduler::k_numberPriorities; priority++)
+                {
+                    const BusScheduler::PriorityStatistics& statistics { bus.second.priorities[priority] };
+                    uint64_t values[4] { statistics.transactions, statistics.failures, statistics.retries,
+                                         statistics.totalWait_ns };
+                    output += std::string { k_busFamilies[family][0] } + "{bus=\"" + bus.first + "\",priority=\"" +
+                              k_priorityNames[priority] + "\"} " +
+                              ((family == 3u) ? seconds(values[family]) : std::to_string(values[family])) + "\n";
+                }
+            }
+        }
+
+        header(output, "blackstar_bus_busy_seconds_total", "Time the bus has been granted", "counter");
+        for (const std::pair<std::string, BusScheduler::Statistics>& bus : buses)
+        {
+            output += "blackstar_bus_busy_seconds_total{bus=\"" + bus.first + "\"} " + seconds(bus.second.busy_ns) +
+                      "\n";
+        }
+
+        if (m_stateHandler != nullptr)
+        {
+            header(output, "blackstar_ecm_state", "Composite ECM state", "gauge");
+            output += "blackstar_ecm_state " + std::to_string(m_stateHandler->currentState()) + "\n";
+            header(output, "blackstar_health_faults", "Health fault bits", "gauge");
+            output += "blackstar_health_faults " + std::to_string(m_stateHandler->healthFaults()) + "\n";
+        }
+    }
+
+    void MetricsServer::binary(std::vector<uint8_t>& output) const
+    {
+        Metrics::Snapshot snapshot;
+        Metrics::collect(snapshot);
+
+        output.assign(k_binaryMagic, k_binaryMagic + std::strlen(k_binaryMagic));
+        output.push_back(k_binaryVersion);
+        appendLE(output, snapshot.timestamp_ns, 8u);
+
+        output.push_back(static_cast<uint8_t>(Metrics::k_numberCounters));
+        for (uint64_t counter : snapshot.counters)
+        {
+            appendLE(output, counter, 8u);
+        }
+
+        appendLE(output, snapshot.commands.size(), 2u);
+        for (const std::pair<uint16_t, uint64_t>& command : snapshot.commands)
+        {
+            appendLE(output, command.first, 2u);
+            appendLE(output, command.second, 8u);
+        }
+
+        output.push_back(static_cast<uint8_t>(Metrics::k_numberHistograms));
+        output.push_back(static_cast<uint8_t>(Metrics::k_numberBuckets));
+        appendLE(output, Metrics::k_firstBucket_ns, 8u);
+        for (const Metrics::HistogramSnapshot& histogram : snapshot.histograms)
+        {
+            for (uint64_t bucket : histogram.buckets)
+            {
+                appendLE(output, bucket, 8u);
+            }
+            appendLE(output, histogram.count, 8u);
+            appendLE(output, histogram.sum_ns, 8u);
+        }
+
+        size_t threads { std::min<size_t>(snapshot.threads.size(), UINT8_MAX) };
+        output.push_back(static_cast<uint8_t>(threads));
+        for (size_t thread = 0; thread < threads; thread++)
+        {
+            appendName(output, snapshot.threads[thread].name);
+            output.push_back(snapshot.threads[thread].running ? 1u : 0u);
+            appendLE(output, snapshot.threads[thread].CPU_ns, 8u);
+        }
+
+        output.push_back((m_BSP != nullptr) ? 2u : 0u);
+        if (m_BSP != nullptr)
+        {
+            for (const BusScheduler *bus : { &m_BSP->I2CBus(), &m_BSP->SPIBus() })
+            {
+                BusScheduler::Statistics statistics { bus->statistics() };
+                appendName(output, bus->name());
+                appendLE(output, statistics.busy_ns, 8u);
+                appendLE(output, statistics.elapsed_ns, 8u);
+                output.push_back(static_cast<uint8_t>(BusScheduler::k_numberPriorities));
+                for (const BusScheduler::PriorityStatistics& priority : statistics.priorities)
+                {
+                    appendLE(output, priority.transactions, 8u);
+                    appendLE(output, priority.failures, 8u);
+                    appendLE(output, priority.retries, 8u);
+                    appendLE(output, priority.totalWait_ns, 8u);
+                    appendLE(output, priority.totalTime_ns, 8u);
+                }
+            }
+        }
+
+        sys::EcmState::State state { (m_stateHandler != nullptr) ? m_stateHandler->currentState()
+                                                                 : sys::EcmState::Unknown };
+        appendLE(output, static_cast<uint64_t>(state), 2u);
+        output.push_back((m_stateHandler != nullptr) ? m_stateHandler->healthFaults() : uint8_t { 0u });
+    }
+
+    bool MetricsServer::fetch(const std::string& request, std::string& reply, const std::string& path)
+    {
+        sockaddr_un address {};
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1u);
+
+        int fd { ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) };
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        timeval timeout {};
+        timeout.tv_sec = static_cast<time_t>(k_fetchTimeout.count() / 1000);
+        timeout.tv_usec = static_cast<suseconds_t>((k_fetchTimeout.count() % 1000) * 1000);
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        bool ok { (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) &&
+                  (::send(fd, request.data(), request.size(), MSG_NOSIGNAL) ==
+                   static_cast<ssize_t>(request.size())) };
+
+        // The server closes the connection once the reply has been sent
+        reply.clear();
+        char buffer[4096];
+        ssize_t count { 0 };
+        while (ok && ((count = ::recv(fd, buffer, sizeof(buffer), 0)) > 0))
+        {
+            reply.append(buffer, static_cast<size_t>(count));
+        }
+        ok = ok && (count == 0);
+
+        ::close(fd);
+        return ok;
+    }
+
+    void MetricsServer::accept()
+    {
+        int fd { -1 };
+        while ((fd = ::accept4(m_listenfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+        {
+            if ((m_connections.size() >= k_maxConnections) ||
+                !m_eventLoop->addDescriptor(fd, [this, fd] () { receive(fd); }))
+            {
+                Log::warning("metrics connection refused");
+                ::close(fd);
+            }
+            else
+            {
+                m_connections.push_back(fd);
+            }
+        }
+    }
+
+    void MetricsServer::receive(int fd)
+    {
+        // A request arrives in one piece, anything which isn't recognised gets the text format
+        char buffer[k_maxRequestSize];
+        ssize_t count { ::recv(fd, buffer, sizeof(buffer), 0) };
+        if ((count < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            return;
+        }
+
+        if (count > 0)
+        {
+            std::string request { buffer, static_cast<size_t>(count) };
+            std::string reply;
+            if (request.compare(0, 6u, "binary") == 0)
+            {
+                std::vector<uint8_t> data;
+                binary(data);
+                reply.assign(data.begin(), data.end());
+            }
+            else if (request.compare(0, 4u, "GET ") == 0)
+            {
+                std::string body;
+                text(body);
+                reply = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                        std::to_string(body.size()) + "\r\n\r\n" + body;
+            }
+            else
+            {
+                text(reply);
+            }
+
+            // Replies are far smaller than the socket buffer, a client which isn't reading them
+            // gets a truncated reply
+            if (::send(fd, reply.data(), reply.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(reply.size()))
+            {
+                Log::warning("metrics reply truncated");
+            }
+        }
+
+        closeConnection(fd);
+    }
+
+    void MetricsServer::closeConnection(int fd)
+    {
+        m_eventLoop->removeDescriptor(fd);
+        ::close(fd);
+        m_connections.erase(std::remove(m_connections.begin(), m_connections.end(), fd), m_connections.end());
+    }
+}
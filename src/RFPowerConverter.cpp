@@ -0,0 +1,156 @@
+#include "RFPowerConverter.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mercury::blackstar
+{
+    // clang-format off
+    // Nominal log detector response (25 mV/dB), the same for the forward and reverse channels
+    static const std::vector<RFPowerConverter::CalibrationPoint> k_nominalCalibration { {  500u, -50.0f },
+                                                                                         { 2500u,  30.0f } };
+    // clang-format on
+
+    // ADC reference voltage and range, as used by VSLBSP::ADCToMillivolts
+    static const float k_ADCReference_mV { 5000.0f };
+
+    // Limit of |reflection coefficient|^2 so that VSWR stays finite with total reflection
+    static const float k_maxGammaSquared { 0.9801f };  // |gamma| = 0.99, VSWR = 199
+    static const float k_minPower_mW { 1.0e-12f };
+
+    // log10 of mantissa values 1.0 to 2.0 in k_logTableSize steps
+    static const size_t k_logTableSize { 256u };
+    static const float k_log10Of2 { 0.30102999566f };
+
+    static std::array<float, k_logTableSize + 1u> makeLogTable()
+    {
+        std::array<float, k_logTableSize + 1u> table {};
+        for (size_t i = 0; i <= k_logTableSize; i++)
+        {
+            table[i] = std::log10(1.0f + (static_cast<float>(i) / k_logTableSize));
+        }
+        return table;
+    }
+
+    static const std::array<float, k_logTableSize + 1u> k_logTable { makeLogTable() };
+
+    RFPowerConverter::RFPowerConverter()
+        : m_tables { std::make_unique<Tables>() }
+    {
+        buildTable(k_nominalCalibration, m_tables->forward_dBm, m_tables->forward_mW);
+        buildTable(k_nominalCalibration, m_tables->reverse_dBm, m_tables->reverse_mW);
+    }
+
+    bool RFPowerConverter::convert(const uint16_t *forwardADC,
+                                   const uint16_t *reverseADC,
+                                   size_t count,
+                                   RFPowerWindow& window) const
+    {
+        if ((count == 0u) || (count > k_maxBlockSize))
+        {
+            return false;
+        }
+
+        const Tables *tables { m_tables.get() };
+
+        // Gather calibrated power for each reading
+        alignas(32) float forward_mW[k_maxBlockSize];
+        alignas(32) float reverse_mW[k_maxBlockSize];
+        alignas(32) float returnLoss_dB[k_maxBlockSize];
+        for (size_t i = 0; i < count; i++)
+        {
+            const uint16_t forwardCode { static_cast<uint16_t>(forwardADC[i] & (k_ADCCodes - 1u)) };
+            const uint16_t reverseCode { static_cast<uint16_t>(reverseADC[i] & (k_ADCCodes - 1u)) };
+            forward_mW[i] = tables->forward_mW[forwardCode];
+            reverse_mW[i] = tables->reverse_mW[reverseCode];
+            returnLoss_dB[i] = tables->forward_dBm[forwardCode] - tables->reverse_dBm[reverseCode];
+        }
+
+        // Per-reading VSWR and block statistics, branch free so the loop vectorises
+        float forwardSum_mW { 0.0f };
+        float reverseSum_mW { 0.0f };
+        float maxGammaSquared { 0.0f };
+        float minReturnLoss_dB { returnLoss_dB[0] };
+        for (size_t i = 0; i < count; i++)
+        {
+            forwardSum_mW += forward_mW[i];
+            reverseSum_mW += reverse_mW[i];
+            float gammaSquared { reverse_mW[i] / std::max(forward_mW[i], k_minPower_mW) };
+            maxGammaSquared = std::max(maxGammaSquared, std::min(gammaSquared, k_maxGammaSquared));
+            minReturnLoss_dB = std::min(minReturnLoss_dB, returnLoss_dB[i]);
+        }
+
+        const float inverseCount { 1.0f / static_cast<float>(count) };
+        const float forwardMean_mW { std::max(forwardSum_mW * inverseCount, k_minPower_mW) };
+        const float reverseMean_mW { std::max(reverseSum_mW * inverseCount, k_minPower_mW) };
+        const float gamma { std::sqrt(std::min(reverseMean_mW / forwardMean_mW, k_maxGammaSquared)) };
+        const float maxGamma { std::sqrt(maxGammaSquared) };
+
+        window.sampleCount = static_cast<uint32_t>(count);
+        window.forward_dBm = 10.0f * fastLog10(forwardMean_mW);
+        window.reverse_dBm = 10.0f * fastLog10(reverseMean_mW);
+        window.returnLoss_dB = window.forward_dBm - window.reverse_dBm;
+        window.minReturnLoss_dB = minReturnLoss_dB;
+        window.VSWR = (1.0f + gamma) / (1.0f - gamma);
+        window.maxVSWR = (1.0f + maxGamma) / (1.0f - maxGamma);
+
+        return true;
+    }
+
+    void RFPowerConverter::convert(uint16_t forwardADC,
+                                   uint16_t reverseADC,
+                                   float& forward_dBm,
+                                   float& returnLoss_dB) const
+    {
+        const uint16_t forwardCode { static_cast<uint16_t>(forwardADC & (k_ADCCodes - 1u)) };
+        const uint16_t reverseCode { static_cast<uint16_t>(reverseADC & (k_ADCCodes - 1u)) };
+        forward_dBm = m_tables->forward_dBm[forwardCode];
+        returnLoss_dB = forward_dBm - m_tables->reverse_dBm[reverseCode];
+    }
+
+    float RFPowerConverter::fastLog10(float x)
+    {
+        // x = mantissa * 2^exponent with mantissa in [0.5, 1), rescale the mantissa to [1, 2) and
+        // interpolate between table entries
+        int exponent { 0 };
+        float mantissa { std::frexp(x, &exponent) * 2.0f };
+        exponent--;
+
+        float position { (mantissa - 1.0f) * k_logTableSize };
+        size_t index { std::min(static_cast<size_t>(position), k_logTableSize - 1u) };
+        float fraction { position - static_cast<float>(index) };
+        float log10Mantissa { k_logTable[index] + (fraction * (k_logTable[index + 1u] - k_logTable[index])) };
+
+        return log10Mantissa + (static_cast<float>(exponent) * k_log10Of2);
+    }
+
+    void RFPowerConverter::buildTable(const Calibration& points,
+                                      std::array<float, k_ADCCodes>& power_dBm,
+                                      std::array<float, k_ADCCodes>& power_mW)
+    {
+        Calibration sorted { points };
+        std::sort(sorted.begin(),
+                  sorted.end(),
+                  [] (const CalibrationPoint& a, const CalibrationPoint& b) { return a.detector_mV < b.detector_mV; });
+
+        // Piecewise linear interpolation between calibration points, extrapolating the end
+        // segments for detector voltages outside the calibrated range
+        size_t segment { 0u };
+        for (size_t code = 0; code < k_ADCCodes; code++)
+        {
+            float detector_mV { (static_cast<float>(code) * k_ADCReference_mV) / k_ADCCodes };
+            while (((segment + 2u) < sorted.size()) && (detector_mV > sorted[segment + 1u].detector_mV))
+            {
+                segment++;
+            }
+
+            const CalibrationPoint& low { sorted[segment] };
+            const CalibrationPoint& high { sorted[segment + 1u] };
+            float span_mV { std::max(static_cast<float>(high.detector_mV) - low.detector_mV, 1.0f) };
+            float slope_dBPermV { (high.power_dBm - low.power_dBm) / span_mV };
+
+            power_dBm[code] = low.power_dBm + ((detector_mV - low.detector_mV) * slope_dBPermV);
+            power_mW[code] = std::pow(10.0f, power_dBm[code] / 10.0f);
+        }
+    }
+}
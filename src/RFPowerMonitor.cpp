@@ -0,0 +1,249 @@
+#include "RFPowerMonitor.hpp"
+#include "Clock.hpp"
+#include "Log.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+
+namespace mercury::blackstar
+{
+    void RFPowerMonitor::build(std::shared_ptr<VSLBSP> BSP)
+    {
+        m_BSP = BSP;
+    }
+
+    void RFPowerMonitor::run()
+    {
+        m_stopRequested = false;
+
+        // clang-format off
+        m_RFPowerMonitorThread = std::thread { [&] ()
+                                               {
+                                                   start();
+                                               }
+                                             };
+        // clang-format on
+    }
+
+    void RFPowerMonitor::stop()
+    {
+        m_stopRequested = true;
+        {
+            std::lock_guard<std::mutex> lock { m_wakeMutex };
+            m_wakeRequested = true;
+        }
+        m_wakeCondition.notify_one();
+
+        if (m_RFPowerMonitorThread.joinable())
+        {
+            m_RFPowerMonitorThread.join();
+        }
+    }
+
+    void RFPowerMonitor::setHeartbeat(std::shared_ptr<Heartbeat> heartbeat)
+    {
+        m_heartbeat = heartbeat;
+    }
+
+    void RFPowerMonitor::setSampleRates(uint32_t jamming_Hz, uint32_t standby_Hz)
+    {
+        m_jammingRate_Hz = std::max(jamming_Hz, 1u);
+        m_standbyRate_Hz = std::max(standby_Hz, 1u);
+        {
+            std::lock_guard<std::mutex> lock { m_wakeMutex };
+            m_wakeRequested = true;
+        }
+        m_wakeCondition.notify_one();
+    }
+
+    void RFPowerMonitor::setJamming(bool jamming)
+    {
+        // Wake the sampler so that a change to the fast rate takes effect immediately rather
+        // than after the remainder of a slow standby period
+        if (m_jamming.exchange(jamming) != jamming)
+        {
+            {
+                std::lock_guard<std::mutex> lock { m_wakeMutex };
+                m_wakeRequested = true;
+            }
+            m_wakeCondition.notify_one();
+        }
+    }
+
+    bool RFPowerMonitor::latest(RFPowerSnapshot& snapshot) const
+    {
+        return m_snapshots.latest(snapshot);
+    }
+
+    bool RFPowerMonitor::latestWindow(RFPowerWindow& window) const
+    {
+        return m_windows.latest(window);
+    }
+
+    const RFPowerConverter& RFPowerMonitor::converter() const
+    {
+        return m_converter;
+    }
+
+    const RFPowerMonitor::ReadingRing& RFPowerMonitor::readings() const
+    {
+        return m_readings;
+    }
+
+    void RFPowerMonitor::setReadingAction(std::function<void()> readingAction)
+    {
+        m_readingAction = readingAction;
+    }
+
+    void RFPowerMonitor::start()
+    {
+        Metrics::registerThread("RFPowerMonitor");
+
+        using clock = std::chrono::steady_clock;
+
+        clock::time_point nextSample { clock::now() };
+        uint32_t consecutiveFailures { 0u };
+
+        // Continuous sampling so keep the ADC pipeline primed rather than paying for a discarded
+        // conversion on every reading
+        if ((m_BSP != nullptr) && m_BSP->startRFPowerMonitorStream())
+        {
+            Log::info("RF power monitor streaming with {}-byte SPI frames", m_BSP->RFPowerMonitorStreamFrameSize());
+        }
+
+        while (!m_stopRequested)
+        {
+            if (takeReading())
+            {
+                consecutiveFailures = 0u;
+            }
+            else if (consecutiveFailures++ == 0u)
+            {
+                // Only report the first of a run of failures
+                Log::error("RF power monitor reading failed");
+            }
+
+            if (m_heartbeat != nullptr)
+            {
+                m_heartbeat->beat();
+            }
+
+            // Schedule from the previous sample time so the rate doesn't drift, but don't try to
+            // catch up if we have fallen behind (e.g. after a long SPI transaction)
+            nextSample += samplePeriod();
+            clock::time_point now { clock::now() };
+            if (nextSample < now)
+            {
+                nextSample = now;
+            }
+
+            std::unique_lock<std::mutex> lock { m_wakeMutex };
+            m_wakeCondition.wait_until(lock, nextSample, [&] () { return m_wakeRequested; });
+            if (m_wakeRequested)
+            {
+                // Rate changed or stop requested, sample again straight away
+                m_wakeRequested = false;
+                nextSample = clock::now();
+            }
+        }
+
+        if (m_BSP != nullptr)
+        {
+            m_BSP->stopRFPowerMonitorStream();
+        }
+    }
+
+    bool RFPowerMonitor::takeReading()
+    {
+        bool ok { false };
+        RFPowerReading reading;
+
+        if (m_BSP != nullptr)
+        {
+            ok = m_BSP->getRFPowerMonitorADCReadings(reading.forwardADC, reading.reverseADC);
+        }
+
+        if (ok)
+        {
+            reading.timestamp_ns = Clock::monotonic_ns();
+            reading.forward_mV = VSLBSP::ADCToMillivolts(reading.forwardADC);
+            reading.reverse_mV = VSLBSP::ADCToMillivolts(reading.reverseADC);
+            m_readings.push(reading);
+            if (m_readingAction)
+            {
+                m_readingAction();
+            }
+            publishSnapshot(reading);
+            convertBlock(reading);
+        }
+
+        return ok;
+    }
+
+    void RFPowerMonitor::publishSnapshot(const RFPowerReading& reading)
+    {
+        RFPowerSnapshot snapshot;
+        snapshot.latest = reading;
+        snapshot.readingCount = m_readings.count();
+
+        // Replace the oldest reading in the window and update the running sums
+        RFPowerReading& oldest { m_window[(snapshot.readingCount - 1u) % k_windowSize] };
+        m_forwardWindowSum_mV += reading.forward_mV;
+        m_reverseWindowSum_mV += reading.reverse_mV;
+        if (snapshot.readingCount > k_windowSize)
+        {
+            m_forwardWindowSum_mV -= oldest.forward_mV;
+            m_reverseWindowSum_mV -= oldest.reverse_mV;
+        }
+        oldest = reading;
+
+        snapshot.windowSize = static_cast<uint32_t>(std::min<uint64_t>(snapshot.readingCount, k_windowSize));
+        snapshot.forwardMean_mV = static_cast<uint32_t>(m_forwardWindowSum_mV / snapshot.windowSize);
+        snapshot.reverseMean_mV = static_cast<uint32_t>(m_reverseWindowSum_mV / snapshot.windowSize);
+        snapshot.forwardMin_mV = reading.forward_mV;
+        snapshot.forwardMax_mV = reading.forward_mV;
+        snapshot.reverseMin_mV = reading.reverse_mV;
+        snapshot.reverseMax_mV = reading.reverse_mV;
+        for (uint32_t i = 0; i < snapshot.windowSize; i++)
+        {
+            snapshot.forwardMin_mV = std::min(snapshot.forwardMin_mV, m_window[i].forward_mV);
+            snapshot.forwardMax_mV = std::max(snapshot.forwardMax_mV, m_window[i].forward_mV);
+            snapshot.reverseMin_mV = std::min(snapshot.reverseMin_mV, m_window[i].reverse_mV);
+            snapshot.reverseMax_mV = std::max(snapshot.reverseMax_mV, m_window[i].reverse_mV);
+        }
+
+        m_snapshots.push(snapshot);
+    }
+
+    void RFPowerMonitor::convertBlock(const RFPowerReading& reading)
+    {
+        if (m_blockCount == 0u)
+        {
+            m_blockStart_ns = reading.timestamp_ns;
+        }
+        m_blockForwardADC[m_blockCount] = reading.forwardADC;
+        m_blockReverseADC[m_blockCount] = reading.reverseADC;
+        m_blockCount++;
+
+        // Convert when the block is full, or when it has been filling for too long at slow
+        // sample rates so that the converted window doesn't go stale
+        uint64_t blockAge_ns { reading.timestamp_ns - m_blockStart_ns };
+        if ((m_blockCount == m_blockForwardADC.size()) ||
+            (blockAge_ns >= static_cast<uint64_t>(std::chrono::nanoseconds { k_maxBlockAge }.count())))
+        {
+            RFPowerWindow window;
+            if (m_converter.convert(m_blockForwardADC.data(), m_blockReverseADC.data(), m_blockCount, window))
+            {
+                window.timestamp_ns = reading.timestamp_ns;
+                m_windows.push(window);
+            }
+            m_blockCount = 0u;
+        }
+    }
+
+    std::chrono::nanoseconds RFPowerMonitor::samplePeriod() const
+    {
+        uint32_t rate_Hz { m_jamming ? m_jammingRate_Hz.load() : m_standbyRate_Hz.load() };
+        return std::chrono::nanoseconds { 1000000000u / rate_Hz };
+    }
+}
@@ -0,0 +1,251 @@
+#include "RFPowerStreamer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+
+#include <pthread.h>
+#include <unistd.h>
+
+namespace mercury::blackstar
+{
+    using clock = std::chrono::steady_clock;
+
+    void RFPowerStreamer::build(std::shared_ptr<VSLBSP> BSP, const Settings& settings)
+    {
+        m_BSP = BSP;
+        m_settings = settings;
+        m_settings.rate_Hz = std::min(std::max(m_settings.rate_Hz, 1u), k_maxRate_Hz);
+        m_buffer.reserve(k_bufferSize);
+    }
+
+    bool RFPowerStreamer::run()
+    {
+        if ((m_BSP == nullptr) || !m_BSP->startRFPowerMonitorStream())
+        {
+            std::cerr << "ERROR: could not start RF power monitor stream" << std::endl;
+            return false;
+        }
+
+        // The stop signals are blocked and waited for between samples, so the stream stops
+        // cleanly with the buffer written out. SIGPIPE is blocked so that a closed pipe shows up
+        // as a write error instead.
+        sigset_t signals;
+        sigset_t blockedSignals;
+        sigset_t previousSignals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        blockedSignals = signals;
+        sigaddset(&blockedSignals, SIGPIPE);
+        ::pthread_sigmask(SIG_BLOCK, &blockedSignals, &previousSignals);
+        m_outputFailed = false;
+
+        writeHeader();
+
+        const clock::duration period { std::chrono::nanoseconds { 1000000000u / m_settings.rate_Hz } };
+        const clock::time_point start { clock::now() };
+        const clock::time_point end { (m_settings.duration.count() > 0) ? (start + m_settings.duration)
+                                                                         : clock::time_point::max() };
+        clock::time_point nextSample { start };
+        clock::time_point now { start };
+        uint64_t attempts { 0u };
+        uint64_t samples { 0u };
+        uint64_t failures { 0u };
+        uint64_t overruns { 0u };
+        uint64_t firstSample_ns { 0u };
+        uint64_t lastSample_ns { 0u };
+        bool interrupted { false };
+
+        while (!interrupted && !m_outputFailed && (now < end) &&
+               ((m_settings.count == 0u) || (attempts < m_settings.count)))
+        {
+            if (nextSample > now)
+            {
+                std::chrono::nanoseconds wait { nextSample - now };
+                timespec timeout { static_cast<time_t>(wait.count() / 1000000000),
+                                   static_cast<long>(wait.count() % 1000000000) };
+                interrupted = (::sigtimedwait(&signals, nullptr, &timeout) >= 0);
+            }
+            else if ((attempts % k_signalCheckInterval) == 0u)
+            {
+                // Running flat out, only check for a signal occasionally
+                timespec noWait {};
+                interrupted = (::sigtimedwait(&signals, nullptr, &noWait) >= 0);
+            }
+            if (interrupted)
+            {
+                break;
+            }
+
+            uint16_t forwardADC { 0u };
+            uint16_t reverseADC { 0u };
+            bool ok { m_BSP->readRFPowerMonitorStream(forwardADC, reverseADC) };
+            now = clock::now();
+            attempts++;
+
+            if (ok)
+            {
+                uint64_t time_ns { static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count()) };
+                writeSample(time_ns, VSLBSP::ADCToMillivolts(forwardADC), VSLBSP::ADCToMillivolts(reverseADC));
+                if ((m_settings.window > 0u) && (m_window.count >= m_settings.window))
+                {
+                    writeWindow(time_ns);
+                }
+                firstSample_ns = (samples == 0u) ? time_ns : firstSample_ns;
+                lastSample_ns = time_ns;
+                samples++;
+            }
+            else
+            {
+                failures++;
+            }
+
+            // Keep to the requested sample times, if a whole period has been missed then start
+            // again from now rather than trying to catch up
+            nextSample += period;
+            if ((now - nextSample) > period)
+            {
+                overruns++;
+                nextSample = now;
+            }
+        }
+
+        now = clock::now();
+        if ((m_settings.window > 0u) && (m_window.count > 0u))
+        {
+            // Partial last window
+            writeWindow(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count()));
+        }
+        flush();
+
+        m_BSP->stopRFPowerMonitorStream();
+        ::pthread_sigmask(SIG_SETMASK, &previousSignals, nullptr);
+
+        // Standard output carries the data so the summary goes to standard error. The achieved
+        // rate is measured over the sample intervals so it doesn't depend on where the stream
+        // started or stopped relative to the samples.
+        double elapsed_s { std::chrono::duration<double> { now - start }.count() };
+        double sampling_s { static_cast<double>(lastSample_ns - firstSample_ns) / 1e9 };
+        double achieved_Hz { (sampling_s > 0.0) ? (static_cast<double>(samples - 1u) / sampling_s) : 0.0 };
+        std::cerr << "Requested " << m_settings.rate_Hz << " Hz, achieved " << std::fixed << std::setprecision(1)
+                  << achieved_Hz << " Hz (" << std::setprecision(1)
+                  << (100.0 * achieved_Hz / static_cast<double>(m_settings.rate_Hz)) << "%) over "
+                  << std::setprecision(3) << elapsed_s << " s: " << samples << " samples, " << failures
+                  << " failed, " << overruns << " overruns" << std::defaultfloat << std::endl;
+        return true;
+    }
+
+    void RFPowerStreamer::writeHeader()
+    {
+        if (m_settings.format == Format::Binary)
+        {
+            append("BSRF", 4u);
+            appendLE(k_binaryVersion, 2u);
+            appendLE(0u, 2u);
+            appendLE(m_settings.rate_Hz, 4u);
+            appendLE(m_settings.window, 4u);
+        }
+    }
+
+    void RFPowerStreamer::writeSample(uint64_t time_ns, uint32_t forward_mV, uint32_t reverse_mV)
+    {
+        if (m_settings.format == Format::Binary)
+        {
+            appendLE(k_recordSample, 8u);
+            appendLE(time_ns, 8u);
+            appendLE(forward_mV, 4u);
+            appendLE(reverse_mV, 4u);
+        }
+        else
+        {
+            char line[64];
+            int length { std::snprintf(line, sizeof(line), "sample,%llu,%u,%u\n",
+                                       static_cast<unsigned long long>(time_ns), forward_mV, reverse_mV) };
+            append(line, static_cast<size_t>(length));
+        }
+
+        m_window.count++;
+        m_window.forwardMin_mV = std::min(m_window.forwardMin_mV, forward_mV);
+        m_window.forwardMax_mV = std::max(m_window.forwardMax_mV, forward_mV);
+        m_window.forwardSum_mV += forward_mV;
+        m_window.reverseMin_mV = std::min(m_window.reverseMin_mV, reverse_mV);
+        m_window.reverseMax_mV = std::max(m_window.reverseMax_mV, reverse_mV);
+        m_window.reverseSum_mV += reverse_mV;
+    }
+
+    void RFPowerStreamer::writeWindow(uint64_t time_ns)
+    {
+        uint32_t forwardMean_mV { static_cast<uint32_t>(m_window.forwardSum_mV / m_window.count) };
+        uint32_t reverseMean_mV { static_cast<uint32_t>(m_window.reverseSum_mV / m_window.count) };
+
+        if (m_settings.format == Format::Binary)
+        {
+            appendLE(k_recordWindow, 8u);
+            appendLE(time_ns, 8u);
+            appendLE(m_window.count, 4u);
+            appendLE(m_window.forwardMin_mV, 4u);
+            appendLE(forwardMean_mV, 4u);
+            appendLE(m_window.forwardMax_mV, 4u);
+            appendLE(m_window.reverseMin_mV, 4u);
+            appendLE(reverseMean_mV, 4u);
+            appendLE(m_window.reverseMax_mV, 4u);
+        }
+        else
+        {
+            char line[128];
+            int length { std::snprintf(line, sizeof(line), "window,%llu,%u,%u,%u,%u,%u,%u,%u\n",
+                                       static_cast<unsigned long long>(time_ns), m_window.count,
+                                       m_window.forwardMin_mV, forwardMean_mV, m_window.forwardMax_mV,
+                                       m_window.reverseMin_mV, reverseMean_mV, m_window.reverseMax_mV) };
+            append(line, static_cast<size_t>(length));
+        }
+
+        m_window = Window {};
+    }
+
+    void RFPowerStreamer::append(const char *data, size_t size)
+    {
+        if ((m_buffer.size() + size) > k_bufferSize)
+        {
+            flush();
+        }
+        m_buffer.insert(m_buffer.end(), data, data + size);
+    }
+
+    void RFPowerStreamer::appendLE(uint64_t value, size_t size)
+    {
+        char bytes[sizeof(value)];
+        for (size_t i = 0; i < size; i++)
+        {
+            bytes[i] = static_cast<char>(value >> (8u * i));
+        }
+        append(bytes, size);
+    }
+
+    void RFPowerStreamer::flush()
+    {
+        size_t written { 0u };
+        while (written < m_buffer.size())
+        {
+            ssize_t count { ::write(STDOUT_FILENO, m_buffer.data() + written, m_buffer.size() - written) };
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                // Reader has gone away (e.g. the end of a pipe), discard the rest
+                m_outputFailed = true;
+                break;
+            }
+            written += static_cast<size_t>(count);
+        }
+        m_buffer.clear();
+    }
+}
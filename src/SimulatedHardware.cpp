@@ -0,0 +1,572 @@
+#include "SimulatedHardware.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <signal.h>
+#include <unistd.h>
+
+namespace mercury::blackstar
+{
+    // clang-format off
+    static const int k_DIOInterruptSignal            { 57 };    // SIG_VL_DIO
+    static const uint8_t k_firstAuxOutputChannel     { 0x10 };  // DIO_CHANNEL_17, GPIO1
+    static const uint32_t k_FPGABoardIDRegister      { 0x00 };
+    static const uint32_t k_FPGAAuxOutputRegister    { 0x23 };  // BENGAL_AUX_OUT
+    static const uint8_t k_boardIDEPU4562            { 0x18 };  // VL_BOARD_EPU_4562
+    static const uint8_t k_PAMuteNChannel            { 0x13 };  // GPIO4
+
+    static const uint32_t k_I2CMaxFrequency_Hz       { 400000u };
+    static const uint32_t k_I2CReadBits              { 39u };   // Start, address, register, restart, address, data
+    static const uint32_t k_I2CWriteBits             { 29u };   // Start, address, register, data
+    static const uint8_t k_fanPSUChipAddress         { 0x15 };
+    static const uint8_t k_fanPSUControlRegister     { 0x00 };
+    static const uint8_t k_fanPSUFan1Register        { 0x01 };
+    static const uint8_t k_fanPSUFan2Register        { 0x02 };
+    static const uint8_t k_fanPSUResetRegister       { 0x7F };
+    static const uint8_t k_fanPSUResetCode           { 0x34 };
+    static const uint8_t k_fanPSUControlRFEnabled    { 0x05 };  // PSU and PA enabled
+    static const uint8_t k_fanPSUFanEnableBits       { 0x13 };
+
+    static const uint32_t k_SPIMaxClockFrequency_Hz  { 6000000u };
+    static const uint8_t k_ADCChannelBit             { 0x08 };  // Control byte ADD0, IN1/IN2
+    static const uint16_t k_ADCDataMask              { 0x0FFF };
+
+    static const uint32_t k_boardADCClockFrequency_Hz { 6000000u };
+    static const uint32_t k_boardADCFrameSize         { 4u };  // ADS8668 32-bit frames
+
+    // Delays shorter than this are spun rather than slept, a sleep would overshoot them
+    static const std::chrono::microseconds k_spinLimit { 100 };
+    // clang-format on
+
+    SimulatedHardware::~SimulatedHardware()
+    {
+        close();
+    }
+
+    void SimulatedHardware::setLatencies(const Latencies& latencies)
+    {
+        m_latencies = latencies;
+    }
+
+    void SimulatedHardware::setADCSource(ADCSource source)
+    {
+        std::lock_guard<std::mutex> lock { m_SPIMutex };
+        m_ADCSource = source;
+    }
+
+    bool SimulatedHardware::loadADCScript(const std::string& path)
+    {
+        struct Segment
+        {
+            std::chrono::milliseconds end;
+            uint16_t forward;
+            uint16_t reverse;
+        };
+
+        std::ifstream file { path };
+        std::string line;
+        std::vector<Segment> segments;
+        std::chrono::milliseconds end { 0 };
+
+        while (std::getline(file, line))
+        {
+            std::istringstream fields { line.substr(0, line.find('#')) };
+            unsigned int duration_ms { 0u };
+            unsigned int forward { 0u };
+            unsigned int reverse { 0u };
+
+            if ((fields >> duration_ms >> forward >> reverse) && (duration_ms > 0u))
+            {
+                end += std::chrono::milliseconds { duration_ms };
+                segments.push_back(Segment { end,
+                                             static_cast<uint16_t>(forward & k_ADCDataMask),
+                                             static_cast<uint16_t>(reverse & k_ADCDataMask) });
+            }
+        }
+
+        bool ok { !segments.empty() };
+
+        if (ok)
+        {
+            // clang-format off
+            setADCSource([segments, end] (std::chrono::nanoseconds time, uint16_t& forward, uint16_t& reverse)
+                         {
+                             std::chrono::nanoseconds position { time % end };
+                             for (const auto& segment : segments)
+                             {
+                                 if (position < segment.end)
+                                 {
+                                     forward = segment.forward;
+                                     reverse = segment.reverse;
+                                     break;
+                                 }
+                             }
+                         });
+            // clang-format on
+            std::cout << "Simulated ADC script " << path << ": " << std::dec << segments.size() << " segments, "
+                      << end.count() << " ms" << std::endl;
+        }
+        else
+        {
+            std::cout << "ERROR: could not load simulated ADC script " << path << std::endl;
+        }
+
+        return ok;
+    }
+
+    void SimulatedHardware::setDIOInput(uint8_t channel, bool high)
+    {
+        bool raise { false };
+
+        if (channel < k_numberDIOChannels)
+        {
+            std::lock_guard<std::mutex> lock { m_DIOMutex };
+            uint32_t bit { 1u << channel };
+
+            if (m_DIOInputs[channel] && (m_DIOLevels[channel] != high))
+            {
+                raise = ((m_DIOInterruptsEnabled & bit) != 0u) && ((m_DIOInterruptsPending & bit) == 0u);
+                if ((m_DIOInterruptsEnabled & bit) != 0u)
+                {
+                    m_DIOInterruptsPending |= bit;
+                }
+            }
+            m_DIOLevels[channel] = high;
+        }
+
+        // As on the board, one signal per interrupt until the status is cleared
+        if (raise)
+        {
+            ::kill(::getpid(), k_DIOInterruptSignal);
+        }
+    }
+
+    void SimulatedHardware::setAnalogInput(uint8_t channel, double volts)
+    {
+        std::lock_guard<std::mutex> lock { m_SPIMutex };
+        if (channel < k_numberAnalogInputs)
+        {
+            m_analogInputs[channel] = volts;
+        }
+    }
+
+    void SimulatedHardware::setFanPSUStatus(uint8_t status)
+    {
+        static const uint8_t k_fanPSUStatus1Register { 0x40 };
+
+        std::lock_guard<std::mutex> lock { m_I2CMutex };
+        m_fanPSURegisters[k_fanPSUStatus1Register] = status;
+    }
+
+    uint8_t SimulatedHardware::fanPSURegister(uint8_t address) const
+    {
+        std::lock_guard<std::mutex> lock { m_I2CMutex };
+        return m_fanPSURegisters[address];
+    }
+
+    bool SimulatedHardware::open()
+    {
+        if (!m_open)
+        {
+            m_openTime = std::chrono::steady_clock::now();
+            m_open = true;
+
+            std::lock_guard<std::mutex> lock { m_DIOMutex };
+            m_FPGARegisters[k_FPGABoardIDRegister] = k_boardIDEPU4562;
+
+            std::cout << "Using simulated EPU-4562 hardware" << std::endl;
+        }
+
+        return m_open;
+    }
+
+    void SimulatedHardware::close()
+    {
+        if (m_open)
+        {
+            disableWatchdog();
+            m_open = false;
+        }
+    }
+
+    void SimulatedHardware::setDIODirection(uint8_t channel, bool input)
+    {
+        delay(m_latencies.DIO);
+
+        if (channel < k_numberDIOChannels)
+        {
+            std::lock_guard<std::mutex> lock { m_DIOMutex };
+            m_DIOInputs[channel] = input;
+        }
+    }
+
+    void SimulatedHardware::setDIOLevel(uint8_t channel, bool high)
+    {
+        delay(m_latencies.DIO);
+
+        if (channel < k_numberDIOChannels)
+        {
+            std::lock_guard<std::mutex> lock { m_DIOMutex };
+            if (!m_DIOInputs[channel])
+            {
+                m_DIOLevels[channel] = high;
+            }
+        }
+    }
+
+    bool SimulatedHardware::DIOLevel(uint8_t channel)
+    {
+        delay(m_latencies.DIO);
+
+        std::lock_guard<std::mutex> lock { m_DIOMutex };
+        return (channel < k_numberDIOChannels) && m_DIOLevels[channel];
+    }
+
+    int SimulatedHardware::DIOInterruptSignal() const
+    {
+        return k_DIOInterruptSignal;
+    }
+
+    bool SimulatedHardware::enableDIOInterrupts(uint32_t channels)
+    {
+        std::lock_guard<std::mutex> lock { m_DIOMutex };
+        m_DIOInterruptsPending &= ~channels;
+        m_DIOInterruptsEnabled |= channels;
+        return true;
+    }
+
+    void SimulatedHardware::disableDIOInterrupts(uint32_t channels)
+    {
+        std::lock_guard<std::mutex> lock { m_DIOMutex };
+        m_DIOInterruptsEnabled &= ~channels;
+    }
+
+    void SimulatedHardware::clearDIOInterrupts(uint32_t channels)
+    {
+        std::lock_guard<std::mutex> lock { m_DIOMutex };
+        m_DIOInterruptsPending &= ~channels;
+    }
+
+    bool SimulatedHardware::readFPGARegister(uint32_t offset, uint8_t& data)
+    {
+        delay(m_latencies.FPGA);
+
+        std::lock_guard<std::mutex> lock { m_DIOMutex };
+        bool ok { offset < m_FPGARegisters.size() };
+
+        if (ok && (offset == k_FPGAAuxOutputRegister))
+        {
+            // GPIO1-8 pin levels
+            data = 0u;
+            for (uint8_t bit = 0; bit < 8u; bit++)
+            {
+                data |= m_DIOLevels[k_firstAuxOutputChannel + bit] ? static_cast<uint8_t>(1u << bit) : 0u;
+            }
+        }
+        else if (ok)
+        {
+            data = m_FPGARegisters[offset];
+        }
+
+        return ok;
+    }
+
+    bool SimulatedHardware::writeFPGARegister(uint32_t offset, uint8_t data)
+    {
+        delay(m_latencies.FPGA);
+
+        std::lock_guard<std::mutex> lock { m_DIOMutex };
+        bool ok { (offset < m_FPGARegisters.size()) && (offset != k_FPGABoardIDRegister) };
+
+        if (ok && (offset == k_FPGAAuxOutputRegister))
+        {
+            // The latch only drives the GPIO configured as outputs
+            for (uint8_t bit = 0; bit < 8u; bit++)
+            {
+                if (!m_DIOInputs[k_firstAuxOutputChannel + bit])
+                {
+                    m_DIOLevels[k_firstAuxOutputChannel + bit] = ((data >> bit) & 0x01) != 0u;
+                }
+            }
+        }
+        else if (ok)
+        {
+            m_FPGARegisters[offset] = data;
+        }
+
+        return ok;
+    }
+
+    bool SimulatedHardware::setI2CFrequency(uint32_t frequency_Hz)
+    {
+        std::lock_guard<std::mutex> lock { m_I2CMutex };
+        bool ok { (frequency_Hz > 0u) && (frequency_Hz <= k_I2CMaxFrequency_Hz) };
+
+        if (ok)
+        {
+            m_I2CFrequency_Hz = frequency_Hz;
+        }
+
+        return ok;
+    }
+
+    uint32_t SimulatedHardware::I2CMaxFrequency()
+    {
+        return k_I2CMaxFrequency_Hz;
+    }
+
+    bool SimulatedHardware::readI2CRegister(uint8_t chipAddress, uint8_t address, uint8_t& data)
+    {
+        std::lock_guard<std::mutex> lock { m_I2CMutex };
+        delay(busTime(k_I2CReadBits, m_I2CFrequency_Hz) + m_latencies.I2COverhead);
+
+        bool ok { chipAddress == k_fanPSUChipAddress };
+
+        if (ok)
+        {
+            data = m_fanPSURegisters[address];
+        }
+
+        return ok;
+    }
+
+    bool SimulatedHardware::writeI2CRegister(uint8_t chipAddress, uint8_t address, uint8_t data)
+    {
+        std::lock_guard<std::mutex> lock { m_I2CMutex };
+        delay(busTime(k_I2CWriteBits, m_I2CFrequency_Hz) + m_latencies.I2COverhead);
+
+        bool ok { chipAddress == k_fanPSUChipAddress };
+
+        if (ok && (address == k_fanPSUResetRegister))
+        {
+            // Reset returns the controller to power-on defaults (everything off)
+            if (data == k_fanPSUResetCode)
+            {
+                m_fanPSURegisters[k_fanPSUControlRegister] = 0u;
+                m_fanPSURegisters[k_fanPSUFan1Register] = 0u;
+                m_fanPSURegisters[k_fanPSUFan2Register] = 0u;
+            }
+        }
+        else if (ok)
+        {
+            m_fanPSURegisters[address] = data;
+        }
+
+        return ok;
+    }
+
+    bool SimulatedHardware::configureSPI(uint32_t clockFrequency_Hz, uint8_t mode, uint32_t frameSize)
+    {
+        std::lock_guard<std::mutex> lock { m_SPIMutex };
+        bool ok { (clockFrequency_Hz > 0u) && (mode <= 3u) && (frameSize >= 1u) && (frameSize <= 4u) };
+
+        if (ok)
+        {
+            m_SPIClockFrequency_Hz = std::min(clockFrequency_Hz, k_SPIMaxClockFrequency_Hz);
+            m_SPIFrameSize = frameSize;
+        }
+
+        return ok;
+    }
+
+    bool SimulatedHardware::setSPIFrameSize(uint32_t frameSize)
+    {
+        std::lock_guard<std::mutex> lock { m_SPIMutex };
+        bool ok { (m_SPIClockFrequency_Hz > 0u) && (frameSize >= 1u) && (frameSize <= 4u) };
+
+        if (ok)
+        {
+            m_SPIFrameSize = frameSize;
+        }
+
+        return ok;
+    }
+
+    bool SimulatedHardware::writeSPIFrame(uint32_t data)
+    {
+        std::lock_guard<std::mutex> lock { m_SPIMutex };
+        bool ok { m_SPIClockFrequency_Hz > 0u };
+
+        if (ok)
+        {
+            delay(busTime(m_SPIFrameSize * 8u, m_SPIClockFrequency_Hz) + m_latencies.SPIOverhead);
+
+            // Each 16 clocks the ADC shifts out the conversion for the channel selected by the
+            // previous control byte and latches the control byte sent in the first 8 clocks
+            uint32_t read { 0u };
+            for (uint32_t word = 0; word < (m_SPIFrameSize / 2u); word++)
+            {
+                uint8_t control { static_cast<uint8_t>(data >> (24u - (word * 16u))) };
+                read = (read << 16) | convert(m_ADCChannel);
+                m_ADCChannel = ((control & k_ADCChannelBit) != 0u) ? 1u : 0u;
+            }
+            m_SPIReadData = read;
+        }
+
+        return ok;
+    }
+
+    bool SimulatedHardware::readSPIFrame(uint32_t& data)
+    {
+        std::lock_guard<std::mutex> lock { m_SPIMutex };
+        data = m_SPIReadData;
+        return m_SPIClockFrequency_Hz > 0u;
+    }
+
+    bool SimulatedHardware::configureAnalogAutoScan(uint8_t channels)
+    {
+        std::lock_guard<std::mutex> lock { m_SPIMutex };
+        m_analogAutoScanChannels = channels;
+        return true;
+    }
+
+    bool SimulatedHardware::readAnalogInputs(uint8_t channels, AnalogInputs& volts)
+    {
+        std::lock_guard<std::mutex> lock { m_SPIMutex };
+
+        // Scanned channels take one frame each, any other channel needs a channel select frame first
+        uint32_t frames { 0u };
+        for (size_t channel = 0; channel < k_numberAnalogInputs; channel++)
+        {
+            if ((channels & (1u << channel)) != 0u)
+            {
+                volts[channel] = m_analogInputs[channel];
+                frames += ((m_analogAutoScanChannels & (1u << channel)) != 0u) ? 1u : 2u;
+            }
+        }
+        delay((busTime(k_boardADCFrameSize * 8u, k_boardADCClockFrequency_Hz) + m_latencies.SPIOverhead) * frames);
+
+        // The SPI controller is left configured for the ADC
+        m_SPIClockFrequency_Hz = k_boardADCClockFrequency_Hz;
+        m_SPIFrameSize = k_boardADCFrameSize;
+        return true;
+    }
+
+    bool SimulatedHardware::fanRPM(uint8_t pulsesPerRevolution, uint16_t& RPM)
+    {
+        delay(m_latencies.FPGA);
+        std::lock_guard<std::mutex> lock { m_I2CMutex };
+        bool enabled { (m_fanPSURegisters[k_fanPSUFan1Register] & k_fanPSUFanEnableBits) == k_fanPSUFanEnableBits };
+        RPM = enabled ? k_fanRPM : 0u;
+        return pulsesPerRevolution > 0u;
+    }
+
+    bool SimulatedHardware::enableWatchdog(uint8_t timeout_s)
+    {
+        disableWatchdog();
+
+        m_watchdogTimeout_s = timeout_s;
+        m_watchdogKicked = false;
+        m_watchdogStopRequested = false;
+
+        // clang-format off
+        m_watchdogThread = std::thread { [&] ()
+                                         {
+                                             watchdog();
+                                         }
+                                       };
+        // clang-format on
+
+        return true;
+    }
+
+    void SimulatedHardware::setWatchdogTimeout(uint8_t timeout_s)
+    {
+        {
+            std::lock_guard<std::mutex> lock { m_watchdogMutex };
+            m_watchdogTimeout_s = timeout_s;
+            m_watchdogKicked = true;
+        }
+        m_watchdogCondition.notify_one();
+    }
+
+    void SimulatedHardware::disableWatchdog()
+    {
+        {
+            std::lock_guard<std::mutex> lock { m_watchdogMutex };
+            m_watchdogStopRequested = true;
+        }
+        m_watchdogCondition.notify_one();
+
+        if (m_watchdogThread.joinable())
+        {
+            m_watchdogThread.join();
+        }
+    }
+
+    void SimulatedHardware::delay(std::chrono::nanoseconds duration) const
+    {
+        if (duration < k_spinLimit)
+        {
+            std::chrono::steady_clock::time_point end { std::chrono::steady_clock::now() + duration };
+            while (std::chrono::steady_clock::now() < end)
+            {
+            }
+        }
+        else
+        {
+            std::this_thread::sleep_for(duration);
+        }
+    }
+
+    std::chrono::nanoseconds SimulatedHardware::busTime(uint32_t bits, uint32_t frequency_Hz) const
+    {
+        return (m_latencies.busTime && (frequency_Hz > 0u))
+                   ? std::chrono::nanoseconds { (static_cast<uint64_t>(bits) * 1000000000ull) / frequency_Hz }
+                   : std::chrono::nanoseconds { 0 };
+    }
+
+    uint16_t SimulatedHardware::convert(uint8_t channel)
+    {
+        // Called with the SPI mutex held, RF is only present with the PSU and PA enabled and the PA unmuted
+        bool RFEnabled { false };
+        {
+            std::lock_guard<std::mutex> lock { m_I2CMutex };
+            RFEnabled = ((m_fanPSURegisters[k_fanPSUControlRegister] & k_fanPSUControlRFEnabled) ==
+                         k_fanPSUControlRFEnabled);
+        }
+        {
+            std::lock_guard<std::mutex> lock { m_DIOMutex };
+            RFEnabled = RFEnabled && m_DIOLevels[k_PAMuteNChannel];
+        }
+
+        uint16_t forward { k_idleADC };
+        uint16_t reverse { k_idleADC };
+
+        if (RFEnabled && m_ADCSource)
+        {
+            m_ADCSource(std::chrono::steady_clock::now() - m_openTime, forward, reverse);
+        }
+        else if (RFEnabled)
+        {
+            forward = k_defaultForwardADC;
+            reverse = k_defaultReverseADC;
+        }
+
+        return ((channel == 0u) ? forward : reverse) & k_ADCDataMask;
+    }
+
+    void SimulatedHardware::watchdog()
+    {
+        std::unique_lock<std::mutex> lock { m_watchdogMutex };
+        bool expired { false };
+
+        while (!m_watchdogStopRequested)
+        {
+            m_watchdogKicked = false;
+            bool woken { m_watchdogCondition.wait_for(lock,
+                                                      std::chrono::seconds { m_watchdogTimeout_s },
+                                                      [&] () { return m_watchdogKicked || m_watchdogStopRequested; }) };
+
+            if (!woken && !expired)
+            {
+                std::cout << "ERROR: simulated watchdog expired, the board would have been reset" << std::endl;
+            }
+            expired = !woken;
+        }
+    }
+}
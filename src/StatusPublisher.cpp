@@ -0,0 +1,266 @@
+#include "StatusPublisher.hpp"
+#include "BuildID.hpp"
+#include "Clock.hpp"
+#include "Log.hpp"
+#include "Metrics.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace mercury::blackstar
+{
+    static_assert(EPUHardware::k_numberAnalogInputs <= StatusPage::k_numberBoardValues,
+                  "Status page has too few board values");
+
+    StatusPublisher::~StatusPublisher()
+    {
+        close();
+    }
+
+    void StatusPublisher::build(std::shared_ptr<VSLBSP> BSP,
+                                std::shared_ptr<MercuryStateHandler> stateHandler,
+                                std::shared_ptr<RFPowerMonitor> powerMonitor,
+                                std::shared_ptr<VSWRProtection> VSWRProtection,
+                                std::shared_ptr<BoardTelemetry> boardTelemetry,
+                                std::shared_ptr<CANClient> client,
+                                uint8_t ECMSlot)
+    {
+        m_BSP = BSP;
+        m_stateHandler = stateHandler;
+        m_powerMonitor = powerMonitor;
+        m_VSWRProtection = VSWRProtection;
+        m_boardTelemetry = boardTelemetry;
+        m_CANClient = client;
+        m_ECMSlot = ECMSlot;
+    }
+
+    bool StatusPublisher::open(const std::string& name)
+    {
+        close();
+
+        // A segment left behind by a previous run is replaced, a reader which has it mapped sees
+        // it stop updating
+        ::shm_unlink(name.c_str());
+        int fd { ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644) };
+        if (fd < 0)
+        {
+            Log::error("could not create status page {} ({})", name, std::strerror(errno));
+            return false;
+        }
+
+        void *address { (::ftruncate(fd, sizeof(StatusPage::Layout)) == 0)
+                            ? ::mmap(nullptr, sizeof(StatusPage::Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                            : MAP_FAILED };
+        ::close(fd);
+        if (address == MAP_FAILED)
+        {
+            Log::error("could not map status page {} ({})", name, std::strerror(errno));
+            ::shm_unlink(name.c_str());
+            return false;
+        }
+
+        // The new segment is zero filled, the magic number goes in last so a reader never accepts
+        // a page which isn't set up
+        m_page = static_cast<StatusPage::Layout *>(address);
+        m_name = name;
+        m_page->version = StatusPage::k_version;
+        m_page->dataSize = sizeof(StatusPage::Data);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_page->magic = StatusPage::k_magic;
+        return true;
+    }
+
+    void StatusPublisher::run()
+    {
+        m_stopRequested = false;
+
+        // clang-format off
+        m_statusPublisherThread = std::thread { [&] ()
+                                                {
+                                                    start();
+                                                }
+                                              };
+        // clang-format on
+    }
+
+    void StatusPublisher::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock { m_wakeMutex };
+            m_stopRequested = true;
+        }
+        m_wakeCondition.notify_one();
+
+        if (m_statusPublisherThread.joinable())
+        {
+            m_statusPublisherThread.join();
+        }
+        close();
+    }
+
+    void StatusPublisher::setHeartbeat(std::shared_ptr<Heartbeat> heartbeat)
+    {
+        m_heartbeat = heartbeat;
+    }
+
+    void StatusPublisher::start()
+    {
+        using clock = std::chrono::steady_clock;
+
+        Metrics::registerThread("StatusPublisher");
+
+        StatusPage::Data data {};
+        data.buildID = k_buildID;
+        data.pid = static_cast<uint32_t>(::getpid());
+        data.ECMSlot = m_ECMSlot;
+
+        clock::time_point nextPoll { clock::now() };
+        clock::time_point nextTick { nextPoll };
+
+        while (!m_stopRequested)
+        {
+            bool changed { poll(data) };
+            if (clock::now() >= nextTick)
+            {
+                tick(data);
+                changed = true;
+                nextTick += k_tickPeriod;
+            }
+            if (changed)
+            {
+                publish(data);
+            }
+
+            if (m_heartbeat != nullptr)
+            {
+                m_heartbeat->beat();
+            }
+
+            nextPoll += k_pollPeriod;
+            std::unique_lock<std::mutex> lock { m_wakeMutex };
+            m_wakeCondition.wait_until(lock, nextPoll, [&] () { return m_stopRequested.load(); });
+        }
+
+        // Readers which still have the page mapped can tell the daemon has gone
+        poll(data);
+        tick(data);
+        data.flags &= static_cast<uint8_t>(~StatusPage::k_flagRunning);
+        publish(data);
+    }
+
+    bool StatusPublisher::poll(StatusPage::Data& data)
+    {
+        StatusPage::Data previous { data };
+
+        uint8_t flags { StatusPage::k_flagRunning };
+        if (m_stateHandler != nullptr)
+        {
+            data.state = static_cast<uint16_t>(m_stateHandler->currentState());
+            data.healthFaults = m_stateHandler->healthFaults();
+            flags |= m_stateHandler->initialised() ? StatusPage::k_flagInitialised : 0u;
+            flags |= m_stateHandler->jamming() ? StatusPage::k_flagJamming : 0u;
+        }
+        if ((m_VSWRProtection != nullptr) && m_VSWRProtection->tripped())
+        {
+            flags |= StatusPage::k_flagVSWRTripped;
+        }
+
+        BoardTelemetrySnapshot board;
+        if ((m_boardTelemetry != nullptr) && m_boardTelemetry->latest(board) && board.fanPSUStatusValid)
+        {
+            flags |= StatusPage::k_flagFanPSUValid;
+            data.fanPSUStatus = board.fanPSUStatus;
+            data.fanPSUControl = board.fanPSUControl;
+        }
+
+        data.CANBusState = static_cast<uint8_t>((m_CANClient != nullptr) ? m_CANClient->busState()
+                                                                         : CANClient::BusState::Down);
+        data.flags = static_cast<uint8_t>((data.flags & StatusPage::k_flagRFValid) | flags);
+
+        return (data.state != previous.state) || (data.healthFaults != previous.healthFaults) ||
+               (data.flags != previous.flags) || (data.CANBusState != previous.CANBusState) ||
+               (data.fanPSUStatus != previous.fanPSUStatus) || (data.fanPSUControl != previous.fanPSUControl);
+    }
+
+    void StatusPublisher::tick(StatusPage::Data& data)
+    {
+        RFPowerWindow window;
+        if ((m_powerMonitor != nullptr) && m_powerMonitor->latestWindow(window))
+        {
+            data.flags |= StatusPage::k_flagRFValid;
+            data.RFTimestamp_ns = window.timestamp_ns;
+            data.forward_dBm = window.forward_dBm;
+            data.reverse_dBm = window.reverse_dBm;
+            data.VSWR = window.VSWR;
+        }
+        if (m_VSWRProtection != nullptr)
+        {
+            data.VSWRTrips = m_VSWRProtection->statistics().tripCount;
+        }
+
+        BoardTelemetrySnapshot board;
+        if ((m_boardTelemetry != nullptr) && m_boardTelemetry->latest(board))
+        {
+            for (size_t i = 0; i < EPUHardware::k_numberAnalogInputs; i++)
+            {
+                data.boardValues[i] = board.values[i];
+            }
+            data.boardValid = board.validChannels;
+            data.fanRPM = board.fanRPMValid ? board.fanRPM : 0u;
+        }
+
+        data.CANFramesReceived = Metrics::total(Metrics::Counter::CANFramesReceived);
+        data.CANFramesSent = Metrics::total(Metrics::Counter::CANFramesSent);
+        data.CANErrorFrames = Metrics::total(Metrics::Counter::CANErrorFrames);
+        data.messagesReceived = Metrics::total(Metrics::Counter::MessagesReceived);
+        data.CRCFailures = Metrics::total(Metrics::Counter::CRCFailures);
+
+        if (m_BSP != nullptr)
+        {
+            BusScheduler::Statistics I2C { m_BSP->I2CBus().statistics() };
+            BusScheduler::Statistics SPI { m_BSP->SPIBus().statistics() };
+            data.I2CTransactions = data.I2CFailures = data.SPITransactions = data.SPIFailures = 0u;
+            for (size_t priority = 0; priority < BusScheduler::k_numberPriorities; priority++)
+            {
+                data.I2CTransactions += I2C.priorities[priority].transactions;
+                data.I2CFailures += I2C.priorities[priority].failures;
+                data.SPITransactions += SPI.priorities[priority].transactions;
+                data.SPIFailures += SPI.priorities[priority].failures;
+            }
+        }
+    }
+
+    void StatusPublisher::publish(StatusPage::Data& data)
+    {
+        if (m_page == nullptr)
+        {
+            return;
+        }
+
+        data.updateCount++;
+        data.timestamp_ns = Clock::monotonic_ns();
+        data.realTime_ns = Clock::realTime_ns();
+
+        // Odd sequence number marks the page as being written
+        uint32_t sequence { m_page->sequence.load(std::memory_order_relaxed) };
+        m_page->sequence.store(sequence + 1u, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&m_page->data, &data, sizeof(data));
+        m_page->sequence.store(sequence + 2u, std::memory_order_release);
+    }
+
+    void StatusPublisher::close()
+    {
+        if (m_page != nullptr)
+        {
+            ::munmap(m_page, sizeof(StatusPage::Layout));
+            ::shm_unlink(m_name.c_str());
+            m_page = nullptr;
+        }
+    }
+}
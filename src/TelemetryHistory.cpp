@@ -0,0 +1,326 @@
+#include "TelemetryHistory.hpp"
+#include "Clock.hpp"
+
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mercury::blackstar
+{
+    struct MetricInfo
+    {
+        const char *name;
+        uint64_t capacity;  // Records, a power of two
+        uint8_t decimals;
+    };
+
+    // clang-format off
+    // Power metrics are recorded at up to 10 per second (about 14 hours of history), the fan/PSU
+    // status once a second (about 36 hours), the rest on change
+    static const MetricInfo k_metrics[TelemetryHistory::k_numberMetrics]
+    {
+        { "forward_dBm",     1u << 19, 2u },
+        { "reverse_dBm",     1u << 19, 2u },
+        { "return_loss_dB",  1u << 19, 2u },
+        { "fan_psu_status",  1u << 17, 0u },
+        { "state",           1u << 14, 0u },
+        { "i2c_failures",    1u << 14, 0u },
+        { "i2c_retries",     1u << 14, 0u },
+        { "spi_failures",    1u << 14, 0u },
+        { "spi_retries",     1u << 14, 0u }
+    };
+    // clang-format on
+
+    static const char k_magic[4] { 'B', 'S', 'T', 'H' };
+
+    TelemetryHistory::~TelemetryHistory()
+    {
+        if (m_mapping != nullptr)
+        {
+            ::munmap(m_mapping, m_size);
+        }
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+    }
+
+    bool TelemetryHistory::open(const std::string& path, bool writable)
+    {
+        m_writable = writable;
+        m_fd = ::open(path.c_str(), writable ? (O_RDWR | O_CREAT | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC), 0644);
+        if (m_fd < 0)
+        {
+            std::cout << "ERROR: could not open telemetry history " << path << " (" << std::strerror(errno) << ")"
+                      << std::endl;
+            return false;
+        }
+
+        struct stat status {};
+        bool resize { (::fstat(m_fd, &status) != 0) || (static_cast<size_t>(status.st_size) != fileSize()) };
+        bool created { resize && (status.st_size == 0) };
+        if (resize && writable)
+        {
+            // Zero filled, so every slot starts empty
+            resize = (::ftruncate(m_fd, 0) != 0) || (::ftruncate(m_fd, static_cast<off_t>(fileSize())) != 0);
+        }
+
+        if (!resize)
+        {
+            m_size = fileSize();
+            m_mapping = ::mmap(nullptr, m_size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, m_fd, 0);
+            if (m_mapping == MAP_FAILED)
+            {
+                m_mapping = nullptr;
+            }
+        }
+
+        if (m_mapping == nullptr)
+        {
+            std::cout << "ERROR: could not map telemetry history " << path
+                      << (writable ? "" : " (not a telemetry history file?)") << std::endl;
+            ::close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+
+        m_header = static_cast<FileHeader*>(m_mapping);
+        if (!layoutValid())
+        {
+            if (!writable)
+            {
+                std::cout << "ERROR: " << path << " is not a telemetry history file" << std::endl;
+                m_header = nullptr;
+                return false;
+            }
+            if (!created)
+            {
+                std::cout << "WARNING: telemetry history " << path << " has a different layout, starting again"
+                          << std::endl;
+            }
+            initialiseLayout();
+        }
+        else if (writable)
+        {
+            for (SegmentHeader& segment : m_header->segments)
+            {
+                recoverCount(segment);
+            }
+        }
+
+        return true;
+    }
+
+    bool TelemetryHistory::isOpen() const
+    {
+        return m_header != nullptr;
+    }
+
+    void TelemetryHistory::append(Metric metric, int32_t value)
+    {
+        if (!m_writable || (m_header == nullptr))
+        {
+            return;
+        }
+
+        SegmentHeader& segment { m_header->segments[static_cast<size_t>(metric)] };
+        uint64_t index { segment.count.load(std::memory_order_relaxed) };
+        Slot& slot { slots(metric)[index & (segment.capacity - 1u)] };
+
+        // Zero sequence marks the slot as being written
+        slot.sequence.store(0u, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.time_ns = Clock::realTime_ns();
+        slot.value = value;
+        slot.sequence.store(static_cast<uint32_t>(index + 1u), std::memory_order_release);
+
+        segment.count.store(index + 1u, std::memory_order_release);
+    }
+
+    void TelemetryHistory::sync()
+    {
+        if (m_writable && (m_mapping != nullptr))
+        {
+            ::msync(m_mapping, m_size, MS_ASYNC);
+        }
+    }
+
+    void TelemetryHistory::read(Metric metric,
+                                uint64_t from_ns,
+                                uint64_t to_ns,
+                                const std::function<void(const Record&)>& handler) const
+    {
+        if (m_header == nullptr)
+        {
+            return;
+        }
+
+        const uint64_t end { count(metric) };
+        const uint64_t capacity { m_header->segments[static_cast<size_t>(metric)].capacity };
+        uint64_t first { (end > capacity) ? (end - capacity) : 0u };
+
+        // First record at or after from_ns, a record overwritten during the search counts as older
+        uint64_t last { end };
+        while (first < last)
+        {
+            uint64_t middle { first + ((last - first) / 2u) };
+            Record record;
+            if (!readSlot(metric, middle, record) || (record.time_ns < from_ns))
+            {
+                first = middle + 1u;
+            }
+            else
+            {
+                last = middle;
+            }
+        }
+
+        Record record;
+        for (uint64_t index = first; index < end; index++)
+        {
+            if (readSlot(metric, index, record))
+            {
+                if (record.time_ns >= to_ns)
+                {
+                    break;
+                }
+                handler(record);
+            }
+        }
+    }
+
+    uint64_t TelemetryHistory::count(Metric metric) const
+    {
+        return (m_header != nullptr) ? m_header->segments[static_cast<size_t>(metric)].count.load(
+                                           std::memory_order_acquire)
+                                     : 0u;
+    }
+
+    const char *TelemetryHistory::name(Metric metric)
+    {
+        return k_metrics[static_cast<size_t>(metric)].name;
+    }
+
+    bool TelemetryHistory::metric(const std::string& name, Metric& metric)
+    {
+        for (size_t i = 0; i < k_numberMetrics; i++)
+        {
+            if (name == k_metrics[i].name)
+            {
+                metric = static_cast<Metric>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint8_t TelemetryHistory::decimals(Metric metric)
+    {
+        return k_metrics[static_cast<size_t>(metric)].decimals;
+    }
+
+    size_t TelemetryHistory::fileSize()
+    {
+        size_t size { k_headerSize };
+        for (const MetricInfo& info : k_metrics)
+        {
+            size += info.capacity * sizeof(Slot);
+        }
+        return size;
+    }
+
+    bool TelemetryHistory::layoutValid() const
+    {
+        bool valid { (std::memcmp(m_header->magic, k_magic, sizeof(k_magic)) == 0) &&
+                     (m_header->version == k_version) && (m_header->metricCount == k_numberMetrics) &&
+                     (m_header->slotSize == sizeof(Slot)) };
+
+        uint64_t offset { k_headerSize };
+        for (size_t i = 0; valid && (i < k_numberMetrics); i++)
+        {
+            const SegmentHeader& segment { m_header->segments[i] };
+            valid = (segment.offset == offset) && (segment.capacity == k_metrics[i].capacity);
+            offset += segment.capacity * sizeof(Slot);
+        }
+        return valid;
+    }
+
+    void TelemetryHistory::initialiseLayout()
+    {
+        std::memset(m_mapping, 0, m_size);
+
+        uint64_t offset { k_headerSize };
+        for (size_t i = 0; i < k_numberMetrics; i++)
+        {
+            SegmentHeader& segment { m_header->segments[i] };
+            segment.offset = offset;
+            segment.capacity = k_metrics[i].capacity;
+            segment.count.store(0u, std::memory_order_relaxed);
+            offset += segment.capacity * sizeof(Slot);
+        }
+
+        // The magic number goes in last so a crash part way through is seen as an invalid file
+        m_header->version = k_version;
+        m_header->metricCount = k_numberMetrics;
+        m_header->slotSize = sizeof(Slot);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(m_header->magic, k_magic, sizeof(k_magic));
+    }
+
+    void TelemetryHistory::recoverCount(SegmentHeader& segment)
+    {
+        Slot *segmentSlots { reinterpret_cast<Slot*>(static_cast<char*>(m_mapping) + segment.offset) };
+        const uint64_t mask { segment.capacity - 1u };
+        uint64_t count { segment.count.load(std::memory_order_relaxed) };
+
+        // A record torn by a crash has a zero sequence number, drop it (and anything after it)
+        uint64_t dropped { 0u };
+        while ((count > 0u) && (dropped < segment.capacity) &&
+               (segmentSlots[(count - 1u) & mask].sequence.load(std::memory_order_relaxed) !=
+                static_cast<uint32_t>(count)))
+        {
+            count--;
+            dropped++;
+        }
+
+        // A record completed just before a crash may not have been counted yet
+        if (dropped == 0u)
+        {
+            while (segmentSlots[count & mask].sequence.load(std::memory_order_relaxed) ==
+                   static_cast<uint32_t>(count + 1u))
+            {
+                count++;
+            }
+        }
+
+        segment.count.store(count, std::memory_order_release);
+    }
+
+    TelemetryHistory::Slot *TelemetryHistory::slots(Metric metric) const
+    {
+        return reinterpret_cast<Slot*>(static_cast<char*>(m_mapping) +
+                                       m_header->segments[static_cast<size_t>(metric)].offset);
+    }
+
+    bool TelemetryHistory::readSlot(Metric metric, uint64_t index, Record& record) const
+    {
+        const Slot& slot { slots(metric)[index & (m_header->segments[static_cast<size_t>(metric)].capacity - 1u)] };
+        const uint32_t expectedSequence { static_cast<uint32_t>(index + 1u) };
+
+        bool ok { false };
+        if (slot.sequence.load(std::memory_order_acquire) == expectedSequence)
+        {
+            record.time_ns = slot.time_ns;
+            record.value = slot.value;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            ok = (slot.sequence.load(std::memory_order_relaxed) == expectedSequence);
+        }
+        return ok;
+    }
+}
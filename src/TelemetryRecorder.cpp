@@ -0,0 +1,164 @@
+#include "TelemetryRecorder.hpp"
+#include "Metrics.hpp"
+
+#include <cmath>
+
+namespace mercury::blackstar
+{
+    // Fixed-point value with two decimal places
+    static int32_t centi(float value)
+    {
+        return static_cast<int32_t>(std::lround(value * 100.0f));
+    }
+
+    void TelemetryRecorder::build(std::shared_ptr<TelemetryHistory> history,
+                                  std::shared_ptr<VSLBSP> BSP,
+                                  std::shared_ptr<RFPowerMonitor> powerMonitor,
+                                  std::shared_ptr<BoardTelemetry> boardTelemetry,
+                                  std::shared_ptr<MercuryStateHandler> stateHandler)
+    {
+        m_history = history;
+        m_BSP = BSP;
+        m_powerMonitor = powerMonitor;
+        m_boardTelemetry = boardTelemetry;
+        m_stateHandler = stateHandler;
+    }
+
+    void TelemetryRecorder::run()
+    {
+        m_stopRequested = false;
+
+        // clang-format off
+        m_telemetryRecorderThread = std::thread { [&] ()
+                                                  {
+                                                      start();
+                                                  }
+                                                };
+        // clang-format on
+    }
+
+    void TelemetryRecorder::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock { m_wakeMutex };
+            m_stopRequested = true;
+        }
+        m_wakeCondition.notify_one();
+
+        if (m_telemetryRecorderThread.joinable())
+        {
+            m_telemetryRecorderThread.join();
+        }
+
+        if (m_history != nullptr)
+        {
+            m_history->sync();
+        }
+    }
+
+    void TelemetryRecorder::setHeartbeat(std::shared_ptr<Heartbeat> heartbeat)
+    {
+        m_heartbeat = heartbeat;
+    }
+
+    void TelemetryRecorder::start()
+    {
+        Metrics::registerThread("TelemetryRecord");
+
+        using clock = std::chrono::steady_clock;
+
+        clock::time_point nextRecord { clock::now() };
+        uint32_t tick { 0u };
+
+        while (!m_stopRequested)
+        {
+            recordPower();
+            recordState();
+            if ((tick % k_slowDivider) == 0u)
+            {
+                recordFanPSUStatus();
+                recordBusErrors();
+            }
+            if ((tick % k_syncDivider) == (k_syncDivider - 1u))
+            {
+                m_history->sync();
+            }
+            tick++;
+
+            if (m_heartbeat != nullptr)
+            {
+                m_heartbeat->beat();
+            }
+
+            nextRecord += k_period;
+            std::unique_lock<std::mutex> lock { m_wakeMutex };
+            m_wakeCondition.wait_until(lock, nextRecord, [&] () { return m_stopRequested.load(); });
+        }
+    }
+
+    void TelemetryRecorder::recordPower()
+    {
+        RFPowerWindow window;
+        if ((m_powerMonitor != nullptr) && m_powerMonitor->latestWindow(window) &&
+            (window.timestamp_ns != m_lastBlock_ns))
+        {
+            m_lastBlock_ns = window.timestamp_ns;
+            m_history->append(TelemetryHistory::Metric::ForwardPower, centi(window.forward_dBm));
+            m_history->append(TelemetryHistory::Metric::ReversePower, centi(window.reverse_dBm));
+            m_history->append(TelemetryHistory::Metric::ReturnLoss, centi(window.returnLoss_dB));
+        }
+    }
+
+    void TelemetryRecorder::recordState()
+    {
+        if (m_stateHandler != nullptr)
+        {
+            recordOnChange(TelemetryHistory::Metric::State, static_cast<int64_t>(m_stateHandler->currentState()),
+                           m_lastState);
+        }
+    }
+
+    void TelemetryRecorder::recordFanPSUStatus()
+    {
+        BoardTelemetrySnapshot snapshot;
+        if ((m_boardTelemetry != nullptr) && m_boardTelemetry->latest(snapshot) && snapshot.fanPSUStatusValid &&
+            (snapshot.fanPSUStatusTimestamp_ns != m_lastFanPSUStatus_ns))
+        {
+            m_lastFanPSUStatus_ns = snapshot.fanPSUStatusTimestamp_ns;
+            m_history->append(TelemetryHistory::Metric::FanPSUStatus, snapshot.fanPSUStatus);
+        }
+    }
+
+    void TelemetryRecorder::recordBusErrors()
+    {
+        int64_t I2CFailures { 0 };
+        int64_t I2CRetries { 0 };
+        for (const BusScheduler::PriorityStatistics& priority : m_BSP->I2CBus().statistics().priorities)
+        {
+            I2CFailures += static_cast<int64_t>(priority.failures);
+            I2CRetries += static_cast<int64_t>(priority.retries);
+        }
+
+        int64_t SPIFailures { 0 };
+        int64_t SPIRetries { 0 };
+        for (const BusScheduler::PriorityStatistics& priority : m_BSP->SPIBus().statistics().priorities)
+        {
+            SPIFailures += static_cast<int64_t>(priority.failures);
+            SPIRetries += static_cast<int64_t>(priority.retries);
+        }
+
+        recordOnChange(TelemetryHistory::Metric::I2CFailures, I2CFailures, m_lastI2CFailures);
+        recordOnChange(TelemetryHistory::Metric::I2CRetries, I2CRetries, m_lastI2CRetries);
+        recordOnChange(TelemetryHistory::Metric::SPIFailures, SPIFailures, m_lastSPIFailures);
+        recordOnChange(TelemetryHistory::Metric::SPIRetries, SPIRetries, m_lastSPIRetries);
+    }
+
+    void TelemetryRecorder::recordOnChange(TelemetryHistory::Metric metric, int64_t value, int64_t& last)
+    {
+        if (value != last)
+        {
+            last = value;
+            m_history->append(metric, static_cast<int32_t>(value));
+        }
+    }
+}
@@ -0,0 +1,164 @@
+#include "Trace.hpp"
+#include "Log.hpp"
+#include "SnapshotRing.hpp"
+
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace mercury::blackstar
+{
+    struct TraceEvent
+    {
+        const char *name;
+        uint64_t start_ns;
+        uint64_t duration_ns;
+        uint64_t argument;
+    };
+
+    // Written only by the owning thread, read by dump()
+    struct TraceRing
+    {
+        SnapshotRing<TraceEvent, Trace::k_ringSize> events;
+        uint32_t tid { 0u };
+        std::string name;
+    };
+
+    // Function static so that it is constructed before the first event whatever the static
+    // initialisation order
+    struct TraceState
+    {
+        std::mutex ringsMutex;  // Held to add a ring or walk the list, never to record
+        std::vector<std::unique_ptr<TraceRing>> rings;
+    };
+
+    static TraceState& state()
+    {
+        static TraceState s_state;
+        return s_state;
+    }
+
+    static TraceRing& threadRing()
+    {
+        thread_local TraceRing *t_ring { nullptr };
+        if (t_ring == nullptr)
+        {
+            // First event on this thread, the thread has normally named itself by now
+            std::unique_ptr<TraceRing> ring { std::make_unique<TraceRing>() };
+            char name[16] {};
+            ::pthread_getname_np(::pthread_self(), name, sizeof(name));
+            ring->name = name;
+            ring->tid = static_cast<uint32_t>(::syscall(SYS_gettid));
+
+            t_ring = ring.get();
+            std::lock_guard<std::mutex> lock { state().ringsMutex };
+            state().rings.push_back(std::move(ring));
+        }
+        return *t_ring;
+    }
+
+    // Chrome trace timestamps are microseconds
+    static void appendMicroseconds(std::string& line, uint64_t time_ns)
+    {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%llu.%03u", static_cast<unsigned long long>(time_ns / 1000u),
+                      static_cast<unsigned>(time_ns % 1000u));
+        line += text;
+    }
+
+    void Trace::record(const char *name, uint64_t start_ns, uint64_t duration_ns, uint64_t argument)
+    {
+        threadRing().events.push(TraceEvent { name, start_ns, duration_ns, argument });
+    }
+
+    bool Trace::dump(const std::string& path, std::chrono::milliseconds window)
+    {
+        if (!k_enabled)
+        {
+            Log::warning("trace dump requested but tracepoints are not compiled in (BLACKSTAR_TRACE)");
+            return false;
+        }
+
+        std::ofstream file { path };
+        if (!file)
+        {
+            Log::error("could not write trace {}", path);
+            return false;
+        }
+
+        uint64_t end_ns { Clock::monotonic_ns() };
+        uint64_t window_ns { static_cast<uint64_t>(std::chrono::nanoseconds { window }.count()) };
+        uint64_t from_ns { (end_ns > window_ns) ? (end_ns - window_ns) : 0u };
+        uint32_t pid { static_cast<uint32_t>(::getpid()) };
+        size_t written { 0u };
+
+        file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        std::string line;
+        bool first { true };
+
+        std::lock_guard<std::mutex> lock { state().ringsMutex };
+        for (const std::unique_ptr<TraceRing>& ring : state().rings)
+        {
+            std::string ids { "\"pid\":" + std::to_string(pid) + ",\"tid\":" + std::to_string(ring->tid) };
+            file << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\"," << ids
+                 << ",\"args\":{\"name\":\"" << ring->name << "\"}}";
+            first = false;
+
+            // Events are recorded at the end of their scope so they are in end time order, walk
+            // back from the newest until one ends before the window (or has been overwritten)
+            uint64_t count { ring->events.count() };
+            uint64_t oldest { (count > Trace::k_ringSize) ? (count - Trace::k_ringSize) : 0u };
+            std::vector<TraceEvent> events;
+            TraceEvent event {};
+            for (uint64_t index = count; (index > oldest) && ring->events.read(index - 1u, event); index--)
+            {
+                if ((event.start_ns + event.duration_ns) < from_ns)
+                {
+                    break;
+                }
+                events.push_back(event);
+            }
+
+            for (auto it = events.rbegin(); it != events.rend(); ++it)
+            {
+                line = ",\n{\"name\":\"";
+                line += it->name;
+                line += "\",\"cat\":\"blackstar\",\"ph\":\"";
+                line += (it->duration_ns > 0u) ? "X" : "i\",\"s\":\"t";
+                line += "\",\"ts\":";
+                appendMicroseconds(line, it->start_ns);
+                if (it->duration_ns > 0u)
+                {
+                    line += ",\"dur\":";
+                    appendMicroseconds(line, it->duration_ns);
+                }
+                line += "," + ids + ",\"args\":{\"value\":" + std::to_string(it->argument) + "}}";
+                file << line;
+            }
+            written += events.size();
+        }
+        file << "\n]}\n";
+
+        Log::info("Trace of {} events over the last {} ms written to {}", written, window.count(), path);
+        return file.good();
+    }
+
+    std::string Trace::dump(std::chrono::milliseconds window)
+    {
+        ::time_t now { ::time(nullptr) };
+        ::tm local {};
+        ::localtime_r(&now, &local);
+        char name[64];
+        std::strftime(name, sizeof(name), "/BlackStarECM-trace-%Y%m%d-%H%M%S.json", &local);
+
+        std::string path { std::string { k_dumpDirectory } + name };
+        return dump(path, window) ? path : std::string {};
+    }
+}
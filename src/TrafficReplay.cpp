@@ -0,0 +1,366 @@
+#include "TrafficReplay.hpp"
+#include "CANCapture.hpp"
+#include "CANMessageHandler.hpp"
+#include "Clock.hpp"
+#include "MercuryStateHandler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <time.h>
+
+namespace mercury::blackstar
+{
+    // clang-format off
+    static const uint32_t k_pcapMagicMicroseconds { 0xA1B2C3D4 };
+    static const uint32_t k_pcapMagicNanoseconds  { 0xA1B23C4D };
+    static const uint32_t k_pcapLinkTypeSocketCAN { 227u };
+    static const size_t k_pcapHeaderSize          { 24u };
+    static const size_t k_pcapRecordHeaderSize    { 16u };
+    static const size_t k_SocketCANHeaderSize     { 8u };  // CAN ID (big endian), length, padding
+    // clang-format on
+
+    static uint32_t readU32(const uint8_t *bytes, bool bigEndian)
+    {
+        return bigEndian ? ((static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) |
+                            (static_cast<uint32_t>(bytes[2]) << 8) | bytes[3])
+                         : ((static_cast<uint32_t>(bytes[3]) << 24) | (static_cast<uint32_t>(bytes[2]) << 16) |
+                            (static_cast<uint32_t>(bytes[1]) << 8) | bytes[0]);
+    }
+
+    // Golden file line for a response
+    static std::string goldenLine(size_t frame, bool send, const std::vector<uint8_t>& response)
+    {
+        std::string line { std::to_string(frame) + (send ? " 1 " : " 0 ") };
+        for (uint8_t byte : response)
+        {
+            char hex[3];
+            std::snprintf(hex, sizeof(hex), "%02X", byte);
+            line += hex;
+        }
+        return line;
+    }
+
+    void TrafficReplay::build(std::shared_ptr<VSLBSP> BSP, const Settings& settings)
+    {
+        m_BSP = BSP;
+        m_settings = settings;
+        m_settings.passes = (m_settings.pace == Pace::Fast) ? std::max(m_settings.passes, 1u) : 1u;
+    }
+
+    bool TrafficReplay::run()
+    {
+        std::vector<Frame> frames;
+        if (!load(m_settings.path, frames))
+        {
+            std::cerr << "ERROR: could not read CAN capture " << m_settings.path << std::endl;
+            return false;
+        }
+
+        std::vector<std::string> expected;
+        bool checkGolden { !m_settings.golden.empty() && !m_settings.writeGolden };
+        if (checkGolden)
+        {
+            std::ifstream golden { m_settings.golden };
+            if (!golden)
+            {
+                std::cerr << "ERROR: could not read golden file " << m_settings.golden << std::endl;
+                return false;
+            }
+            for (std::string line; std::getline(golden, line);)
+            {
+                expected.push_back(line);
+            }
+        }
+
+        // The handlers as the daemon builds them on the simulated hardware, without the monitors
+        // so that every response depends only on the traffic
+        std::shared_ptr<MercuryStateHandler> stateHandler { std::make_shared<MercuryStateHandler>() };
+        stateHandler->build(m_BSP, nullptr, nullptr);
+        stateHandler->initialise(true);
+        std::shared_ptr<CANMessageHandler> handler { std::make_shared<CANMessageHandler>() };
+        handler->build(m_BSP->ECMSlotNumber(), stateHandler, nullptr, nullptr, nullptr);
+        handler->setAnswering(m_settings.answering);
+
+        // The first pass is checked, any more are only timed
+        std::vector<std::string> responses;
+        std::vector<uint8_t> response;
+        uint64_t numberResponses { 0u };
+        uint64_t numberSent { 0u };
+        uint64_t elapsed_ns { 0u };
+        uint64_t timedFrames { 0u };
+        for (uint32_t pass = 0; pass < m_settings.passes; pass++)
+        {
+            bool checked { pass == 0u };
+            bool timed { !checked || (m_settings.passes == 1u) };
+            uint64_t start_ns { Clock::monotonic_ns() };
+
+            for (size_t i = 0; i < frames.size(); i++)
+            {
+                if (m_settings.pace == Pace::Recorded)
+                {
+                    uint64_t offset_ns { std::max(frames[i].timestamp_ns, frames.front().timestamp_ns) -
+                                         frames.front().timestamp_ns };
+                    uint64_t due_ns { start_ns + offset_ns };
+                    ::timespec due { static_cast<time_t>(due_ns / 1000000000u),
+                                     static_cast<long>(due_ns % 1000000000u) };
+                    ::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, nullptr);
+                }
+
+                response.clear();
+                bool send { handler->processFrame(frames[i].frame, frames[i].timestamp_ns, response) };
+                if (!response.empty())
+                {
+                    numberResponses += checked ? 1u : 0u;
+                    numberSent += (checked && send) ? 1u : 0u;
+                    if (checked)
+                    {
+                        responses.push_back(goldenLine(i + 1u, send, response));
+                    }
+                }
+            }
+
+            if (timed)
+            {
+                elapsed_ns += Clock::monotonic_ns() - start_ns;
+                timedFrames += frames.size();
+            }
+        }
+
+        std::string golden { "none" };
+        size_t mismatches { 0u };
+        bool ok { true };
+        if (m_settings.writeGolden && !m_settings.golden.empty())
+        {
+            std::ofstream output { m_settings.golden };
+            for (const std::string& line : responses)
+            {
+                output << line << "\n";
+            }
+            ok = output.good();
+            golden = "written";
+            if (!ok)
+            {
+                std::cerr << "ERROR: could not write golden file " << m_settings.golden << std::endl;
+            }
+        }
+        else if (checkGolden)
+        {
+            for (size_t line = 0; line < std::max(expected.size(), responses.size()); line++)
+            {
+                const std::string& wanted { (line < expected.size()) ? expected[line] : std::string {} };
+                const std::string& got { (line < responses.size()) ? responses[line] : std::string {} };
+                if (wanted != got)
+                {
+                    if (mismatches < k_reportedMismatches)
+                    {
+                        std::cerr << "golden line " << (line + 1u) << ": expected '" << wanted << "', got '" << got
+                                  << "'" << std::endl;
+                    }
+                    mismatches++;
+                }
+            }
+            ok = (mismatches == 0u);
+            golden = ok ? "match" : "mismatch";
+        }
+
+        double elapsed_s { static_cast<double>(std::max<uint64_t>(elapsed_ns, 1u)) / 1e9 };
+        uint64_t timedPasses { (m_settings.passes > 1u) ? (m_settings.passes - 1u) : 1u };
+        double perFrame_ns { static_cast<double>(elapsed_ns) /
+                             static_cast<double>(std::max<uint64_t>(timedFrames, 1u)) };
+
+        // clang-format off
+        std::cout << std::fixed << std::setprecision(3)
+                  << "frames=" << frames.size() << "\n"
+                  << "responses=" << numberResponses << "\n"
+                  << "sent=" << numberSent << "\n"
+                  << "passes=" << m_settings.passes << "\n"
+                  << "elapsed_s=" << elapsed_s << "\n"
+                  << "frames_per_s=" << (static_cast<double>(timedFrames) / elapsed_s) << "\n"
+                  << "responses_per_s=" << (static_cast<double>(numberResponses * timedPasses) / elapsed_s) << "\n"
+                  << "ns_per_frame=" << perFrame_ns << "\n"
+                  << "golden=" << golden << "\n"
+                  << "mismatches=" << mismatches << std::endl;
+        // clang-format on
+
+        return ok;
+    }
+
+    bool TrafficReplay::load(const std::string& path, std::vector<Frame>& frames)
+    {
+        // The CAN client's own capture, error frames are left out as the client doesn't pass them
+        // to the message handler
+        frames.clear();
+        auto captured = [&frames] (uint64_t timestamp_ns, const ::can_frame& frame)
+        {
+            if ((frame.can_id & CAN_ERR_FLAG) == 0u)
+            {
+                frames.push_back({ timestamp_ns, frame });
+            }
+        };
+        if (CANCapture::read(path, captured))
+        {
+            return !frames.empty();
+        }
+
+        std::ifstream input { path, std::ios::binary };
+        if (!input)
+        {
+            return false;
+        }
+
+        uint8_t magic[4] {};
+        input.read(reinterpret_cast<char *>(magic), sizeof(magic));
+        input.clear();
+        input.seekg(0);
+
+        frames.clear();
+        uint32_t littleEndian { readU32(magic, false) };
+        uint32_t bigEndian { readU32(magic, true) };
+        bool pcap { (littleEndian == k_pcapMagicMicroseconds) || (littleEndian == k_pcapMagicNanoseconds) ||
+                    (bigEndian == k_pcapMagicMicroseconds) || (bigEndian == k_pcapMagicNanoseconds) };
+        return (pcap ? loadPcap(input, frames) : loadCandump(input, frames)) && !frames.empty();
+    }
+
+    bool TrafficReplay::loadCandump(std::istream& input, std::vector<Frame>& frames)
+    {
+        // Lines which aren't classic CAN frames (CAN FD, comments, errors) are skipped
+        for (std::string line; std::getline(input, line);)
+        {
+            std::istringstream tokens { line };
+            std::string token;
+            Frame frame {};
+            if (!(tokens >> token))
+            {
+                continue;
+            }
+
+            // Optional "(seconds.fraction)" timestamp, then the interface
+            if (token.front() == '(')
+            {
+                size_t point { token.find('.') };
+                std::string fraction { (point != std::string::npos) ? token.substr(point + 1u) : std::string {} };
+                fraction = fraction.substr(0, fraction.find(')'));
+                fraction.resize(9u, '0');
+                frame.timestamp_ns = (std::strtoull(token.c_str() + 1, nullptr, 10) * 1000000000u) +
+                                     std::strtoull(fraction.c_str(), nullptr, 10);
+                tokens >> token;
+            }
+
+            std::string ID;
+            std::string data;
+            if (!(tokens >> token))
+            {
+                continue;
+            }
+            size_t hash { token.find('#') };
+            if (hash != std::string::npos)
+            {
+                // Log format: ID#data, R for a remote frame, ## for CAN FD
+                ID = token.substr(0, hash);
+                data = token.substr(hash + 1u);
+                if (!data.empty() && (data.front() == '#'))
+                {
+                    continue;
+                }
+                if (!data.empty() && (data.front() == 'R'))
+                {
+                    frame.frame.can_id |= CAN_RTR_FLAG;
+                    data.clear();
+                }
+            }
+            else
+            {
+                // Output format: ID [length] bytes
+                ID = token;
+                std::string length;
+                tokens >> length;
+                for (std::string byte; tokens >> byte;)
+                {
+                    data += byte;
+                }
+                if ((length.size() < 3u) || (length.front() != '[') ||
+                    ((std::strtoul(length.c_str() + 1, nullptr, 10) * 2u) != data.size()))
+                {
+                    continue;
+                }
+            }
+
+            char *end { nullptr };
+            unsigned long value { std::strtoul(ID.c_str(), &end, 16) };
+            if (ID.empty() || (*end != '\0') || ((data.size() % 2u) != 0u) || (data.size() > (CAN_MAX_DLEN * 2u)))
+            {
+                continue;
+            }
+            frame.frame.can_id |= static_cast<canid_t>(value);
+            if ((ID.size() > 3u) || (value > CAN_SFF_MASK))
+            {
+                frame.frame.can_id |= CAN_EFF_FLAG;
+            }
+
+            frame.frame.can_dlc = static_cast<uint8_t>(data.size() / 2u);
+            for (size_t byte = 0; byte < frame.frame.can_dlc; byte++)
+            {
+                std::string hex { data.substr(byte * 2u, 2u) };
+                frame.frame.data[byte] = static_cast<uint8_t>(std::strtoul(hex.c_str(), nullptr, 16));
+            }
+            frames.push_back(frame);
+        }
+
+        return true;
+    }
+
+    bool TrafficReplay::loadPcap(std::istream& input, std::vector<Frame>& frames)
+    {
+        uint8_t header[k_pcapHeaderSize];
+        if (!input.read(reinterpret_cast<char *>(header), sizeof(header)))
+        {
+            return false;
+        }
+
+        // The magic number gives the file's byte order and timestamp resolution
+        bool bigEndian { (readU32(header, true) == k_pcapMagicMicroseconds) ||
+                         (readU32(header, true) == k_pcapMagicNanoseconds) };
+        bool nanoseconds { readU32(header, bigEndian) == k_pcapMagicNanoseconds };
+        if ((readU32(header + 20, bigEndian) & 0x0FFFFFFF) != k_pcapLinkTypeSocketCAN)
+        {
+            std::cerr << "ERROR: pcap capture is not SocketCAN" << std::endl;
+            return false;
+        }
+
+        uint8_t recordHeader[k_pcapRecordHeaderSize];
+        std::vector<uint8_t> packet;
+        while (input.read(reinterpret_cast<char *>(recordHeader), sizeof(recordHeader)))
+        {
+            uint32_t seconds { readU32(recordHeader, bigEndian) };
+            uint32_t fraction { readU32(recordHeader + 4, bigEndian) };
+            packet.resize(readU32(recordHeader + 8, bigEndian));
+            if (!input.read(reinterpret_cast<char *>(packet.data()), static_cast<std::streamsize>(packet.size())))
+            {
+                break;
+            }
+
+            // CAN FD frames (over 8 bytes) are skipped
+            uint8_t length { (packet.size() >= k_SocketCANHeaderSize) ? packet[4] : uint8_t { 0xFF } };
+            if (length > CAN_MAX_DLEN)
+            {
+                continue;
+            }
+
+            Frame frame {};
+            frame.timestamp_ns = (static_cast<uint64_t>(seconds) * 1000000000u) +
+                                 (static_cast<uint64_t>(fraction) * (nanoseconds ? 1u : 1000u));
+            frame.frame.can_id = readU32(packet.data(), true);
+            frame.frame.can_dlc = static_cast<uint8_t>(std::min<size_t>(length, packet.size() - k_SocketCANHeaderSize));
+            std::copy_n(packet.begin() + k_SocketCANHeaderSize, frame.frame.can_dlc, frame.frame.data);
+            frames.push_back(frame);
+        }
+
+        return true;
+    }
+}
@@ -2,24 +2,32 @@
 
 #include <unistd.h>
 #include <iostream>
-#include <cstdbool>  // Include this before VL_OSALib.h as that uses _Bool
-
-#define linux
-#include "../lib/VL_OSALib.h"
 
 namespace mercury::blackstar
 {
     // clang-format off
-    // LED DIO definitions
+    // LED DIO definitions (VersaAPI DIO_CHANNEL_17 to DIO_CHANNEL_24)
     // Ref.: VersaAPIGuide, Table 21 "EPU Board On-board DIO Channels"
-    static const uint8_t k_ECMSlot0Channel  { DIO_CHANNEL_17 }; // GPIO1
-    static const uint8_t k_ECMSlot1Channel  { DIO_CHANNEL_18 }; // GPIO2
-    static const uint8_t k_ECMSlot2Channel  { DIO_CHANNEL_19 }; // GPIO3
-    static const uint8_t k_PAMuteNChannel   { DIO_CHANNEL_20 }; // GPIO4
-    static const uint8_t k_PPSSelectChannel { DIO_CHANNEL_21 }; // GPIO5
-    static const uint8_t k_RFLEDChannel     { DIO_CHANNEL_22 }; // GPIO6
-    static const uint8_t k_GNSSResetChannel { DIO_CHANNEL_23 }; // GPIO7
-    static const uint8_t k_AlertLEDChannel  { DIO_CHANNEL_24 }; // GPIO8
+    static const uint8_t k_ECMSlot0Channel  { 0x10 }; // GPIO1
+    static const uint8_t k_ECMSlot1Channel  { 0x11 }; // GPIO2
+    static const uint8_t k_ECMSlot2Channel  { 0x12 }; // GPIO3
+    static const uint8_t k_PAMuteNChannel   { 0x13 }; // GPIO4
+    static const uint8_t k_PPSSelectChannel { 0x14 }; // GPIO5
+    static const uint8_t k_RFLEDChannel     { 0x15 }; // GPIO6
+    static const uint8_t k_GNSSResetChannel { 0x16 }; // GPIO7
+    static const uint8_t k_AlertLEDChannel  { 0x17 }; // GPIO8
+    static const uint32_t k_ECMSlotChannels { (1u << k_ECMSlot0Channel) | (1u << k_ECMSlot1Channel) |
+                                              (1u << k_ECMSlot2Channel) };
+
+    // On-board GPIO1-8 (DIO channels 17-24) are bits 0-7 of the FPGA auxiliary output register
+    static const uint8_t k_outputRegisterFirstChannel { k_ECMSlot0Channel };
+    static const uint8_t k_outputRegisterOutputMask   { VSLBSP::k_outputPAMuteN | VSLBSP::k_outputPPSSelect |
+                                                        VSLBSP::k_outputRFLED | VSLBSP::k_outputGNSSReset |
+                                                        VSLBSP::k_outputAlertLED };
+    static const uint32_t k_FPGABoardIDRegister       { 0x00 };
+    static const uint8_t k_FPGABoardIDMask            { 0x7F };
+    static const uint8_t k_FPGABoardIDEPU4562         { 0x18 };  // VL_BOARD_EPU_4562
+    static const uint32_t k_FPGAAuxOutputRegister     { 0x23 };  // BENGAL_AUX_OUT
     
     // Fan/PSU controller I2C definitions
     static const uint8_t k_fanPSUI2CChipAddress         { 0x15 };
@@ -28,80 +36,116 @@ namespace mercury::blackstar
     static const uint8_t k_fanPSUI2CFan2Register        { 0x02 };
     static const uint8_t k_fanPSUI2CStatus1Register     { 0x40 };
     static const uint8_t k_fanPSUI2CResetRegister       { 0x7F };
-    static const uint8_t k_fanPSUI2CControlBitPSUEnable { 0x01 };
-    static const uint8_t k_fanPSUI2CControlBitPAEnable  { 0x04 };
+    static const uint8_t k_fanPSUI2CControlBitPSUEnable { VSLBSP::k_fanPSUControlPSUEnable };
+    static const uint8_t k_fanPSUI2CControlBitPAEnable  { VSLBSP::k_fanPSUControlPAEnable };
     static const uint8_t k_fanPSUI2CFanBitsFanEnable    { 0x13 };
     static const uint8_t k_fanPSUI2CResetCode           { 0x34 };
     static const useconds_t k_fanPSUResetSleepTime_us   { 100000u };
+    static const uint8_t k_fanPSUI2CReadAttempts        { 3u };  // Reads (and read-modify-writes) are retried
+
+    // RF Power Monitor (ADC122S051) SPI definitions
+    static const uint32_t k_SPIClockFrequency_Hz        { 6000000u };
+    static const uint8_t k_SPIMode                      { 3u };
+    static const uint32_t k_SPIBytesPerFrame            { 2u };
+    static const uint32_t k_SPIBytesPerStreamFrame      { 4u };
+    static const uint8_t k_ADCForwardControl            { 0x00 };  // IN1
+    static const uint8_t k_ADCReverseControl            { 0x08 };  // IN2
+    static const uint32_t k_ADCDataMask                 { 0x0FFF };
+    static const uint32_t k_ADCLeadingZerosMask         { 0xF000 };
+
+    // Board telemetry definitions, 2 pulses per revolution is the standard 4-wire PC fan tachometer
+    // (Intel 4-Wire PWM Controlled Fans specification), PROVISIONAL until the fitted fan is confirmed
+    static const uint8_t k_fanPulsesPerRevolution       { 2u };
     // clang-format on
 
-    VSLBSP::VSLBSP()
+    VSLBSP::VSLBSP(std::shared_ptr<EPUHardware> hardware) : m_hardware { hardware }
     {
+        m_I2CBus.build("I2C");
+        m_SPIBus.build("SPI");
     }
 
     VSLBSP::~VSLBSP()
     {
-        VL_Close();
+        m_hardware->close();
     }
     
-    bool VSLBSP::initialise()
+    bool VSLBSP::initialise(uint32_t I2CFrequency_Hz)
     {
         m_APIOpen = false;
-        static const int32_t k_VLReturnSuccess { 0 };
-        static const uint32_t k_SPIMode { 3u };
-        static const uint32_t k_SPIBytesPerFrame { 2u };
 
-        // Open the VersaLogic API and configure settings for this BSP
-        if (VL_Open() == k_VLReturnSuccess)
+        // Open the hardware and configure settings for this BSP
+        if (m_hardware->open())
         {
             bool ok { true };
 
             // clang-format off
             // Set outputs to default values before enabling outputs
-            //VL_DIOSetChannelLevel(k_PAMuteNChannel,   DIO_CHANNEL_LOW); // Low = PA muted
-            VL_DIOSetChannelLevel(k_PPSSelectChannel, DIO_CHANNEL_LOW); // Low = Internal GNSS receiver
-            //VL_DIOSetChannelLevel(k_RFLEDChannel,     DIO_CHANNEL_LOW); // Low = RF LED off
-            VL_DIOSetChannelLevel(k_GNSSResetChannel, DIO_CHANNEL_LOW); // Low = GNSS receiver out of reset
-            VL_DIOSetChannelLevel(k_AlertLEDChannel,  DIO_CHANNEL_LOW); // Low = Alert LED off
+            //m_hardware->setDIOLevel(k_PAMuteNChannel,   false); // Low = PA muted
+            m_hardware->setDIOLevel(k_PPSSelectChannel, false); // Low = Internal GNSS receiver
+            //m_hardware->setDIOLevel(k_RFLEDChannel,     false); // Low = RF LED off
+            m_hardware->setDIOLevel(k_GNSSResetChannel, false); // Low = GNSS receiver out of reset
+            m_hardware->setDIOLevel(k_AlertLEDChannel,  false); // Low = Alert LED off
             
             // Set the digital I/O directions
-            VL_DIOSetChannelDirection(k_ECMSlot0Channel,  DIO_INPUT);
-            VL_DIOSetChannelDirection(k_ECMSlot1Channel,  DIO_INPUT);
-            VL_DIOSetChannelDirection(k_ECMSlot2Channel,  DIO_INPUT);
-            VL_DIOSetChannelDirection(k_PAMuteNChannel,   DIO_OUTPUT);
-            VL_DIOSetChannelDirection(k_PPSSelectChannel, DIO_OUTPUT);
-            VL_DIOSetChannelDirection(k_RFLEDChannel,     DIO_OUTPUT);
-            VL_DIOSetChannelDirection(k_GNSSResetChannel, DIO_OUTPUT);
-            VL_DIOSetChannelDirection(k_AlertLEDChannel,  DIO_OUTPUT);
+            m_hardware->setDIODirection(k_ECMSlot0Channel,  true);
+            m_hardware->setDIODirection(k_ECMSlot1Channel,  true);
+            m_hardware->setDIODirection(k_ECMSlot2Channel,  true);
+            m_hardware->setDIODirection(k_PAMuteNChannel,   false);
+            m_hardware->setDIODirection(k_PPSSelectChannel, false);
+            m_hardware->setDIODirection(k_RFLEDChannel,     false);
+            m_hardware->setDIODirection(k_GNSSResetChannel, false);
+            m_hardware->setDIODirection(k_AlertLEDChannel,  false);
             // clang-format on
 
-            // Configure the I2C bus to communicate with the fan/PSU controller
-            ok = ok && (VSL_I2CIsAvailable(VL_I2C_BUS_TYPE_PRIMARY) == VL_API_OK);
-            ok = ok && (VSL_I2CSetFrequency(VL_I2C_BUS_TYPE_PRIMARY, VL_I2C_FREQUENCY_100KHZ) == VL_API_OK);
+            // Output groups are only written through the FPGA register once the register has been
+            // shown to drive (and reflect) the same pins as the library calls
+            m_outputRegisterAvailable = probeOutputRegister();
+            m_outputRegisterEnabled = m_outputRegisterAvailable;
+            if (!m_outputRegisterAvailable)
+            {
+                std::cout << "WARNING: DIO output register not available, using per-channel output updates"
+                          << std::endl;
+            }
+
+            // Configure the I2C bus to communicate with the fan/PSU controller, start at standard mode
+            // (100 kHz) and only move to a faster frequency once the bus has been opened and tested
+            ok = ok && m_hardware->setI2CFrequency(k_I2CStandardFrequency_Hz);
+            m_I2CFrequency_Hz = k_I2CStandardFrequency_Hz;
+
+            uint32_t maxFrequency_Hz { ok ? m_hardware->I2CMaxFrequency() : 0u };
+            m_I2CMaxFrequency_Hz = (maxFrequency_Hz > k_I2CStandardFrequency_Hz) ? maxFrequency_Hz
+                                                                                 : k_I2CStandardFrequency_Hz;
 
             // Configure the SPI bus to read from the RF Power Monitor
             // ADC122S051 SPI parameters:
             //   Transaction length: 16 bits
             //   CPHA: 1, CPOL: 1 (SPI Mode 3)
             //   SCLK: 3.2 MHz to  8.0 MHz
-            ok = ok && (VSL_SPIIsAvailable() == VL_API_OK);
-            // VersaAPI SPI clock frequency options:
-            // SPI_CLK_FREQ0 = 0.75 MHz
-            // SPI_CLK_FREQ1 = 1.5 MHz
-            // SPI_CLK_FREQ2 = 2.0 MHz
-            // SPI_CLK_FREQ3 = 6.0 MHz <-- selected (compatible with ADC122S051)
-            ok = ok && (VSL_SPISetFrequency(SPI_CLK_FREQ3) == VL_API_OK);
-            ok = ok && (VSL_SPISetShiftDirection(SPI_DIR_LEFT) == VL_API_OK);
-            ok = ok && (VSL_SPISetFrameSize(k_SPIBytesPerFrame) == VL_API_OK);
-            ok = ok && (VSL_SPISetMode(k_SPIMode) == VL_API_OK);
+            // The VersaAPI SPI clock options are 0.75, 1.5, 2.0 and 6.0 MHz, 6.0 MHz is compatible
+            // with the ADC122S051
+            ok = ok && m_hardware->configureSPI(k_SPIClockFrequency_Hz, k_SPIMode, k_SPIBytesPerFrame);
 
             if (ok)
             {
                 m_APIOpen = true;
+
+                // Move the I2C bus up to the requested frequency, fall back to standard mode if the
+                // fan/PSU controller does not read back reliably at the higher frequency
+                if (I2CFrequency_Hz > k_I2CStandardFrequency_Hz)
+                {
+                    if (!setI2CFrequency(I2CFrequency_Hz) || !I2CSelfTest())
+                    {
+                        // Report the frequency asked for, m_I2CFrequency_Hz is still the standard
+                        // frequency if the change itself failed
+                        std::cout << "WARNING: I2C self-test failed at " << std::dec << I2CFrequency_Hz
+                                  << " Hz, falling back to " << k_I2CStandardFrequency_Hz << " Hz" << std::endl;
+                        setI2CFrequency(k_I2CStandardFrequency_Hz);
+                    }
+                }
             }
             else
             {
-                VL_Close();
+                m_hardware->close();
             }
         }
         
@@ -110,228 +154,706 @@ namespace mercury::blackstar
     
     void VSLBSP::setRFLEDOn()
     {
-        if (m_APIOpen)
-        {
-            // LED control outputs are active (LED on) high
-            VL_DIOSetChannelLevel(k_RFLEDChannel, DIO_CHANNEL_HIGH);
-        }
+        // LED control outputs are active (LED on) high
+        setOutputs(k_outputRFLED, k_outputRFLED);
     }
     
     void VSLBSP::setRFLEDOff()
     {
-        if (m_APIOpen)
-        {
-            // LED control outputs are active (LED on) high
-            VL_DIOSetChannelLevel(k_RFLEDChannel, DIO_CHANNEL_LOW);
-        }
+        setOutputs(k_outputRFLED, 0u);
     }
     
     void VSLBSP::setAlertLEDOn()
     {
-        if (m_APIOpen)
-        {
-            // LED control outputs are active (LED on) high
-            VL_DIOSetChannelLevel(k_AlertLEDChannel, DIO_CHANNEL_HIGH);
-        }
+        // LED control outputs are active (LED on) high
+        setOutputs(k_outputAlertLED, k_outputAlertLED);
     }
     
     void VSLBSP::setAlertLEDOff()    
     {
-        if (m_APIOpen)
-        {
-            // LED control outputs are active (LED on) high
-            VL_DIOSetChannelLevel(k_AlertLEDChannel, DIO_CHANNEL_LOW);
-        }
+        setOutputs(k_outputAlertLED, 0u);
     }
 
     void VSLBSP::mutePA()
+    {
+        setOutputs(k_outputPAMuteN, 0u);
+    }
+
+    void VSLBSP::unmutePA()
+    {
+        setOutputs(k_outputPAMuteN, k_outputPAMuteN);
+    }
+
+    void VSLBSP::setOutputs(uint8_t mask, uint8_t levels)
     {
         if (m_APIOpen)
         {
-            VL_DIOSetChannelLevel(k_PAMuteNChannel, DIO_CHANNEL_LOW);
+            std::lock_guard<std::mutex> lock { m_outputMutex };
+            mask &= k_outputRegisterOutputMask;
+            uint8_t shadow { static_cast<uint8_t>((m_outputShadow & ~mask) | (levels & mask)) };
+
+            if (m_outputRegisterEnabled)
+            {
+                // Write the whole latch so every output in the group changes at the same instant,
+                // the register also holds the input bits so they are written back as read
+                uint8_t latch { 0u };
+                if (!m_hardware->readFPGARegister(k_FPGAAuxOutputRegister, latch) ||
+                    !m_hardware->writeFPGARegister(k_FPGAAuxOutputRegister,
+                                                   static_cast<uint8_t>((latch & ~k_outputRegisterOutputMask) |
+                                                                        shadow)))
+                {
+                    std::cout << "WARNING: DIO output register write failed, using per-channel output updates"
+                              << std::endl;
+                    m_outputRegisterEnabled = false;
+                    m_outputRegisterAvailable = false;
+                    setOutputsPerChannel(mask, levels);
+                }
+            }
+            else
+            {
+                setOutputsPerChannel(mask, levels);
+            }
+
+            m_outputShadow = shadow;
         }
     }
 
-    void VSLBSP::unmutePA()
+    uint8_t VSLBSP::outputs() const
     {
-        if (m_APIOpen)
+        std::lock_guard<std::mutex> lock { m_outputMutex };
+        return m_outputShadow;
+    }
+
+    bool VSLBSP::setOutputRegisterEnabled(bool enabled)
+    {
+        std::lock_guard<std::mutex> lock { m_outputMutex };
+        bool ok { !enabled || m_outputRegisterAvailable };
+
+        if (ok)
         {
-            VL_DIOSetChannelLevel(k_PAMuteNChannel, DIO_CHANNEL_HIGH);
+            m_outputRegisterEnabled = enabled;
         }
+
+        return ok;
+    }
+
+    bool VSLBSP::outputRegisterAvailable() const
+    {
+        std::lock_guard<std::mutex> lock { m_outputMutex };
+        return m_outputRegisterAvailable;
     }
 
-    bool VSLBSP::resetFanPSUController()
+    bool VSLBSP::probeOutputRegister()
     {
+        // Called during initialisation, before any other thread uses the outputs
         bool ok { false };
-        if (writeFanPSURegister(k_fanPSUI2CResetRegister, k_fanPSUI2CResetCode))
+        uint8_t boardID { 0u };
+        uint8_t latch { 0u };
+
+        // The register layout is only known for the EPU-4562
+        if (m_hardware->readFPGARegister(k_FPGABoardIDRegister, boardID) &&
+            ((boardID & k_FPGABoardIDMask) == k_FPGABoardIDEPU4562) &&
+            m_hardware->readFPGARegister(k_FPGAAuxOutputRegister, latch))
+        {
+            // Toggle the alert LED (off on entry, so this is at most a brief flash) through the
+            // DIO channel and check the register follows, then through the register and check the
+            // DIO channel follows
+            uint8_t value { 0u };
+            m_hardware->setDIOLevel(k_AlertLEDChannel, true);
+            ok = m_hardware->readFPGARegister(k_FPGAAuxOutputRegister, value) && ((value & k_outputAlertLED) != 0u);
+            m_hardware->setDIOLevel(k_AlertLEDChannel, false);
+            ok = ok && m_hardware->readFPGARegister(k_FPGAAuxOutputRegister, value) &&
+                 ((value & k_outputAlertLED) == 0u);
+
+            latch = value;
+            ok = ok && m_hardware->writeFPGARegister(k_FPGAAuxOutputRegister, latch | k_outputAlertLED) &&
+                 m_hardware->DIOLevel(k_AlertLEDChannel);
+            m_hardware->writeFPGARegister(k_FPGAAuxOutputRegister, latch);
+            ok = ok && !m_hardware->DIOLevel(k_AlertLEDChannel);
+        }
+
+        // Seed the shadow latch from the pins as they are now (the PA mute and RF LED are left as
+        // they were before initialisation)
+        m_outputShadow = 0u;
+        for (uint8_t bit = 0; bit < 8u; bit++)
+        {
+            uint8_t output { static_cast<uint8_t>(1u << bit) };
+            if (((output & k_outputRegisterOutputMask) != 0u) &&
+                m_hardware->DIOLevel(k_outputRegisterFirstChannel + bit))
+            {
+                m_outputShadow |= output;
+            }
+        }
+
+        return ok;
+    }
+
+    void VSLBSP::setOutputsPerChannel(uint8_t mask, uint8_t levels)
+    {
+        // Called with the output mutex held
+        for (uint8_t bit = 0; bit < 8u; bit++)
+        {
+            uint8_t output { static_cast<uint8_t>(1u << bit) };
+            if ((mask & output) != 0u)
+            {
+                m_hardware->setDIOLevel(k_outputRegisterFirstChannel + bit, (levels & output) != 0u);
+            }
+        }
+    }
+
+    bool VSLBSP::resetFanPSUController(BusPriority priority)
+    {
+        // The bus is released while the controller comes out of reset so that a safety action
+        // (e.g. disabling the PA) isn't held up for the settle time, then the reset is complete
+        // once the controller answers again. A telemetry read in the meantime fails and is retried.
+        // clang-format off
+        bool ok { m_I2CBus.execute(priority, [&] ()
+                                   {
+                                       return writeFanPSURegisterLocked(k_fanPSUI2CResetRegister,
+                                                                        k_fanPSUI2CResetCode);
+                                   }) };
+        // clang-format on
+        if (ok)
         {
-            ok = true;
             usleep(k_fanPSUResetSleepTime_us);
+
+            uint8_t control { 0u };
+            ok = readFanPSURegister(k_fanPSUI2CControlRegister, control, priority);
         }
         return ok;
     }
-    
-    bool VSLBSP::enableFans()
+
+    bool VSLBSP::enableFans(BusPriority priority)
     {
         bool ok { true };
-        ok = setFanPSURegisterBits(k_fanPSUI2CFan1Register, k_fanPSUI2CFanBitsFanEnable) && ok;
-        ok = setFanPSURegisterBits(k_fanPSUI2CFan1Register, k_fanPSUI2CFanBitsFanEnable) && ok;
+        ok = setFanPSURegisterBits(k_fanPSUI2CFan1Register, k_fanPSUI2CFanBitsFanEnable, priority) && ok;
+        ok = setFanPSURegisterBits(k_fanPSUI2CFan1Register, k_fanPSUI2CFanBitsFanEnable, priority) && ok;
         return ok;
     }
     
-    bool VSLBSP::disableFans()
+    bool VSLBSP::disableFans(BusPriority priority)
     {
         bool ok { true };
-        ok = clearFanPSURegisterBits(k_fanPSUI2CFan1Register, k_fanPSUI2CFanBitsFanEnable) && ok;
-        ok = clearFanPSURegisterBits(k_fanPSUI2CFan1Register, k_fanPSUI2CFanBitsFanEnable) && ok;
+        ok = clearFanPSURegisterBits(k_fanPSUI2CFan1Register, k_fanPSUI2CFanBitsFanEnable, priority) && ok;
+        ok = clearFanPSURegisterBits(k_fanPSUI2CFan1Register, k_fanPSUI2CFanBitsFanEnable, priority) && ok;
         return ok;
     }
     
-    bool VSLBSP::enablePSU()
+    bool VSLBSP::enablePSU(BusPriority priority)
     {
-        return setFanPSURegisterBits(k_fanPSUI2CControlRegister, k_fanPSUI2CControlBitPSUEnable);
+        return setFanPSURegisterBits(k_fanPSUI2CControlRegister, k_fanPSUI2CControlBitPSUEnable, priority);
     }
     
-    bool VSLBSP::disablePSU()
+    bool VSLBSP::disablePSU(BusPriority priority)
     {
-        return clearFanPSURegisterBits(k_fanPSUI2CControlRegister, k_fanPSUI2CControlBitPSUEnable);
+        return clearFanPSURegisterBits(k_fanPSUI2CControlRegister, k_fanPSUI2CControlBitPSUEnable, priority);
     }
     
-    bool VSLBSP::enablePA()
+    bool VSLBSP::enablePA(BusPriority priority)
     {
-        return setFanPSURegisterBits(k_fanPSUI2CControlRegister, k_fanPSUI2CControlBitPAEnable);
+        return setFanPSURegisterBits(k_fanPSUI2CControlRegister, k_fanPSUI2CControlBitPAEnable, priority);
     }
     
-    bool VSLBSP::disablePA()
+    bool VSLBSP::disablePA(BusPriority priority)
     {
-        return clearFanPSURegisterBits(k_fanPSUI2CControlRegister, k_fanPSUI2CControlBitPAEnable);
+        return clearFanPSURegisterBits(k_fanPSUI2CControlRegister, k_fanPSUI2CControlBitPAEnable, priority);
     }
 
-    bool VSLBSP::getRFPowerMonitorReadings(uint32_t& forward_uV, uint32_t& reverse_uV)
+    bool VSLBSP::getRFPowerMonitorReadings(uint32_t& forward_mV, uint32_t& reverse_mV)
     {
+        uint16_t forwardADC { 0u };
+        uint16_t reverseADC { 0u };
+        bool ok { getRFPowerMonitorADCReadings(forwardADC, reverseADC) };
+
+        // Convert the ADC readings to millivolts
+        if (ok)
+        {
+            forward_mV = ADCToMillivolts(forwardADC);
+            reverse_mV = ADCToMillivolts(reverseADC);
+        }
+        return ok;
+    }
+
+    bool VSLBSP::getRFPowerMonitorADCReadings(uint16_t& forwardADC, uint16_t& reverseADC, BusPriority priority)
+    {
+        return m_SPIBus.execute(priority, [&] () { return readRFPowerMonitorADCLocked(forwardADC, reverseADC); });
+    }
+
+    bool VSLBSP::startRFPowerMonitorStream(bool allowWideFrames)
+    {
+        return m_SPIBus.execute(BusPriority::Telemetry,
+                                [&] () { return startRFPowerMonitorStreamLocked(allowWideFrames); });
+    }
+
+    void VSLBSP::stopRFPowerMonitorStream()
+    {
+        // clang-format off
+        m_SPIBus.execute(BusPriority::Telemetry, [&] ()
+                         {
+                             stopRFPowerMonitorStreamLocked();
+                             return true;
+                         });
+        // clang-format on
+    }
+
+    bool VSLBSP::readRFPowerMonitorStream(uint16_t& forwardADC, uint16_t& reverseADC, BusPriority priority)
+    {
+        return m_SPIBus.execute(priority, [&] () { return readRFPowerMonitorStreamLocked(forwardADC, reverseADC); });
+    }
+
+    bool VSLBSP::configureBoardADC(uint8_t channels, BusPriority priority)
+    {
+        return m_SPIBus.execute(priority,
+                                [&] () { return m_APIOpen && m_hardware->configureAnalogAutoScan(channels); });
+    }
+
+    bool VSLBSP::readBoardADC(uint8_t channels, EPUHardware::AnalogInputs& volts, BusPriority priority)
+    {
+        // clang-format off
+        return m_SPIBus.execute(priority, [&] ()
+                                {
+                                    bool ok { m_APIOpen && m_hardware->readAnalogInputs(channels, volts) };
+                                    return restoreRFPowerMonitorSPILocked() && ok;
+                                });
+        // clang-format on
+    }
+
+    bool VSLBSP::getFanRPM(uint16_t& RPM)
+    {
+        return m_APIOpen && m_hardware->fanRPM(k_fanPulsesPerRevolution, RPM);
+    }
+
+    bool VSLBSP::restoreRFPowerMonitorSPILocked()
+    {
+        if (!m_APIOpen)
+        {
+            return false;
+        }
+
+        // The ADC122S051 keeps its channel selection while it is deselected, but prime the stream
+        // again in case the scan left partial frames behind
+        uint32_t frameSize { m_RFPowerMonitorStreamFrameSize };
+        bool ok { m_hardware->configureSPI(k_SPIClockFrequency_Hz, k_SPIMode,
+                                           (frameSize != 0u) ? frameSize : k_SPIBytesPerFrame) };
+        if (ok && (frameSize == k_SPIBytesPerStreamFrame))
+        {
+            ok = m_hardware->writeSPIFrame(streamControl());
+        }
+        else if (ok && (frameSize == k_SPIBytesPerFrame))
+        {
+            ok = m_hardware->writeSPIFrame(static_cast<uint32_t>(k_ADCForwardControl) << 24);
+        }
+        return ok;
+    }
+
+    bool VSLBSP::readRFPowerMonitorADCLocked(uint16_t& forwardADC, uint16_t& reverseADC)
+    {
+        // Single transactions would upset the channel sequence of an active stream so take the
+        // next pair of readings from the stream instead
+        if (m_RFPowerMonitorStreamFrameSize != 0u)
+        {
+            return readRFPowerMonitorStreamLocked(forwardADC, reverseADC);
+        }
+
         // SPI data is shifted out to the left and the write data is in a uint32_t buffer
         // so shift the 1-byte control word left by 24-bits before initiating transfer
-        static const uint32_t k_forwardSensorControlValue { 0x00 << 24 };  // IN1
-        static const uint32_t k_reverseSensorControlValue { 0x08 << 24 };  // IN2
+        static const uint32_t k_forwardSensorControlValue { static_cast<uint32_t>(k_ADCForwardControl) << 24 };
+        static const uint32_t k_reverseSensorControlValue { static_cast<uint32_t>(k_ADCReverseControl) << 24 };
 
         bool ok { false };
 
         if (m_APIOpen)
         {
-            uint32_t forwardADC { 0u };
-            uint32_t reverseADC { 0u };
+            uint32_t forward { 0u };
+            uint32_t reverse { 0u };
             uint32_t control { 0u };
             // The ADC122S051 ADC returns the track/hold value for the channel selected in
             // the previous SPI cycle. To ensure we don't get out of sync, send 3 transactions.
-            // Note that the VSL_SPIReadDataFrame function gets the data which had been returned
-            // on the last VSL_SPIWriteDataFrame transaction.
+            // Note that readSPIFrame gets the data which had been returned on the last
+            // writeSPIFrame transaction.
             ok = true;
 
             // Transaction 1: select forward, discard returned value
             if (ok)
             {
                 control = k_forwardSensorControlValue;
-                ok = VSL_SPIWriteDataFrame(SPI_SS_SS0, &control);
+                ok = m_hardware->writeSPIFrame(control);
             }
             // Transaction 2: select reverse, read forward value
             if (ok)
             {
                 control = k_reverseSensorControlValue;
-                ok = VSL_SPIWriteDataFrame(SPI_SS_SS0, &control) && VSL_SPIReadDataFrame(&forwardADC);
+                ok = m_hardware->writeSPIFrame(control) && m_hardware->readSPIFrame(forward);
             }
             // Transaction 3: select forward, read reverse value
             // Note: channel selected on third transaction is effectively "don't care",
             // leave reverse selected
             if (ok)
             {
-                ok = VSL_SPIWriteDataFrame(SPI_SS_SS0, &control) && VSL_SPIReadDataFrame(&reverseADC);
+                ok = m_hardware->writeSPIFrame(control) && m_hardware->readSPIFrame(reverse);
             }
 
-            // Convert the ADC readings to microvolts
             if (ok)
             {
-                // 1 LSB = Va / 4096 = 5000 mV / 4096 = 1.221 mV
-                static const uint32_t va_mV { 5000u };
-                static const uint32_t bitRange { 4096u };
-                static const uint32_t bitRangeDiv2 { bitRange / 2u };
-                // Add half the denominator before dividing to round the result
-                forward_uV = ((forwardADC * va_mV) + bitRangeDiv2) / bitRange;
-                reverse_uV = ((reverseADC * va_mV) + bitRangeDiv2) / bitRange;
+                forwardADC = static_cast<uint16_t>(forward & k_ADCDataMask);
+                reverseADC = static_cast<uint16_t>(reverse & k_ADCDataMask);
+            }
+        }
+        return ok;
+    }
+
+    bool VSLBSP::startRFPowerMonitorStreamLocked(bool allowWideFrames)
+    {
+        bool ok { false };
+
+        if (m_APIOpen)
+        {
+            // Wide (4-byte) frames convert both channels in one transaction: the control byte in
+            // the first half selects the channel converted in the second half and the control byte
+            // in the second half selects the channel converted in the first half of the next frame.
+            // Prime the pipeline with one frame and check that the 4 leading zeros of each
+            // conversion are present, if they are not then the SPI controller isn't clocking the
+            // frame as expected so fall back to alternating 2-byte frames.
+            if (allowWideFrames && m_hardware->setSPIFrameSize(k_SPIBytesPerStreamFrame))
+            {
+                uint32_t control { streamControl() };
+                uint32_t data { 0u };
+                ok = m_hardware->writeSPIFrame(control) &&
+                     m_hardware->writeSPIFrame(control) &&
+                     m_hardware->readSPIFrame(data) &&
+                     ((data & ((k_ADCLeadingZerosMask << 16) | k_ADCLeadingZerosMask)) == 0u);
+
+                if (ok)
+                {
+                    m_RFPowerMonitorStreamFrameSize = k_SPIBytesPerStreamFrame;
+                }
+                else
+                {
+                    std::cout << "WARNING: RF power monitor 4-byte SPI frames not supported" << std::endl;
+                }
+            }
+
+            // Alternating 2-byte frames, prime the pipeline with the forward channel selected so that
+            // each frame returns the channel selected by the one before it
+            if (!ok)
+            {
+                uint32_t control { static_cast<uint32_t>(k_ADCForwardControl) << 24 };
+                ok = m_hardware->setSPIFrameSize(k_SPIBytesPerFrame) &&
+                     m_hardware->writeSPIFrame(control);
+
+                if (ok)
+                {
+                    m_RFPowerMonitorStreamFrameSize = k_SPIBytesPerFrame;
+                }
             }
         }
+
         return ok;
     }
 
+    void VSLBSP::stopRFPowerMonitorStreamLocked()
+    {
+        if (m_APIOpen && (m_RFPowerMonitorStreamFrameSize != k_SPIBytesPerFrame))
+        {
+            m_hardware->setSPIFrameSize(k_SPIBytesPerFrame);
+        }
+        m_RFPowerMonitorStreamFrameSize = 0u;
+    }
+
+    bool VSLBSP::readRFPowerMonitorStreamLocked(uint16_t& forwardADC, uint16_t& reverseADC)
+    {
+        bool ok { false };
+        uint32_t forward { 0u };
+        uint32_t reverse { 0u };
+
+        if (m_APIOpen && (m_RFPowerMonitorStreamFrameSize == k_SPIBytesPerStreamFrame))
+        {
+            // One transaction: forward (selected by the previous frame) then reverse
+            uint32_t control { streamControl() };
+            uint32_t data { 0u };
+            ok = m_hardware->writeSPIFrame(control) &&
+                 m_hardware->readSPIFrame(data);
+            forward = data >> 16;
+            reverse = data;
+        }
+        else if (m_APIOpen && (m_RFPowerMonitorStreamFrameSize == k_SPIBytesPerFrame))
+        {
+            // Two transactions, each returns the channel selected by the one before it and the
+            // pipeline is left with forward selected, ready for the next call
+            uint32_t control { static_cast<uint32_t>(k_ADCReverseControl) << 24 };
+            ok = m_hardware->writeSPIFrame(control) &&
+                 m_hardware->readSPIFrame(forward);
+            control = static_cast<uint32_t>(k_ADCForwardControl) << 24;
+            ok = ok && m_hardware->writeSPIFrame(control) &&
+                 m_hardware->readSPIFrame(reverse);
+        }
+
+        if (ok)
+        {
+            forwardADC = static_cast<uint16_t>(forward & k_ADCDataMask);
+            reverseADC = static_cast<uint16_t>(reverse & k_ADCDataMask);
+        }
+        else if (m_RFPowerMonitorStreamFrameSize == k_SPIBytesPerFrame)
+        {
+            // A failed transaction leaves the channel sequence unknown, prime it again
+            uint32_t control { static_cast<uint32_t>(k_ADCForwardControl) << 24 };
+            m_hardware->writeSPIFrame(control);
+        }
+
+        return ok;
+    }
+
+    uint32_t VSLBSP::RFPowerMonitorStreamFrameSize() const
+    {
+        return m_RFPowerMonitorStreamFrameSize;
+    }
+
+    uint32_t VSLBSP::streamControl()
+    {
+        // SPI data is shifted out to the left so the first control byte goes in bits 31:24 and the
+        // second (sent 16 bits later) in bits 15:8
+        return (static_cast<uint32_t>(k_ADCReverseControl) << 24) | (static_cast<uint32_t>(k_ADCForwardControl) << 8);
+    }
+
+    uint32_t VSLBSP::ADCToMillivolts(uint32_t ADC)
+    {
+        // 1 LSB = Va / 4096 = 5000 mV / 4096 = 1.221 mV
+        static const uint32_t va_mV { 5000u };
+        static const uint32_t bitRange { 4096u };
+        static const uint32_t bitRangeDiv2 { bitRange / 2u };
+        // Add half the denominator before dividing to round the result
+        return ((ADC * va_mV) + bitRangeDiv2) / bitRange;
+    }
+
     uint8_t VSLBSP::ECMSlotNumber()
     {
-        uint8_t slotNumber { 0u };
-        // Slot Bits 2:0
+        // Slot Bits 2:0 are GPIO3:1
         // Slot 0 = "000"
         // Slot 1 = "001"
         // ...
         // Slot 7 = "111"
-        if (VSL_DIOGetChannelLevel(k_ECMSlot2Channel) == 0x01)
+        return inputs() & k_inputECMSlotMask;
+    }
+
+    uint8_t VSLBSP::inputs()
+    {
+        uint8_t levels { 0u };
+
+        if (m_hardware->DIOLevel(k_ECMSlot2Channel))
         {
-            slotNumber |= 0x04;
+            levels |= k_inputECMSlot2;
         }
-        if (VSL_DIOGetChannelLevel(k_ECMSlot1Channel) == 0x01)
+        if (m_hardware->DIOLevel(k_ECMSlot1Channel))
         {
-            slotNumber |= 0x02;
+            levels |= k_inputECMSlot1;
         }
-        if (VSL_DIOGetChannelLevel(k_ECMSlot0Channel) == 0x01)
+        if (m_hardware->DIOLevel(k_ECMSlot0Channel))
         {
-            slotNumber |= 0x01;
+            levels |= k_inputECMSlot0;
         }
-        return slotNumber;
+
+        return levels;
     }
 
-    bool VSLBSP::readFanPSURegister(uint8_t address, uint8_t& data)
+    int VSLBSP::inputInterruptSignal() const
+    {
+        return m_hardware->DIOInterruptSignal();
+    }
+
+    bool VSLBSP::enableInputInterrupts()
+    {
+        return m_APIOpen && m_hardware->enableDIOInterrupts(k_ECMSlotChannels);
+    }
+
+    void VSLBSP::disableInputInterrupts()
     {
-        bool ok { false };
         if (m_APIOpen)
         {
-            ok = (VSL_I2CReadRegister(VL_I2C_BUS_TYPE_PRIMARY, k_fanPSUI2CChipAddress, address, &data) == VL_API_OK);
-            if (!ok)
-            {
-                std::cout << "READ FAILED" << std::endl;
-            }
+            m_hardware->disableDIOInterrupts(k_ECMSlotChannels);
+        }
+    }
+
+    void VSLBSP::acknowledgeInputInterrupts()
+    {
+        if (m_APIOpen)
+        {
+            m_hardware->clearDIOInterrupts(k_ECMSlotChannels);
+        }
+    }
+
+    bool VSLBSP::enableWatchdog(uint8_t timeout_s)
+    {
+        bool ok { false };
+
+        if (m_APIOpen && (timeout_s > 0u))
+        {
+            m_watchdogTimeout_s = timeout_s;
+            ok = m_hardware->enableWatchdog(timeout_s);
         }
+
         return ok;
     }
- 
-    bool VSLBSP::writeFanPSURegister(uint8_t address, uint8_t data)
+
+    void VSLBSP::kickWatchdog()
+    {
+        if (m_APIOpen && (m_watchdogTimeout_s > 0u))
+        {
+            // Writing the timeout restarts the countdown
+            m_hardware->setWatchdogTimeout(m_watchdogTimeout_s);
+        }
+    }
+
+    void VSLBSP::disableWatchdog()
+    {
+        if (m_APIOpen)
+        {
+            m_hardware->disableWatchdog();
+            m_watchdogTimeout_s = 0u;
+        }
+    }
+
+    bool VSLBSP::setI2CFrequency(uint32_t frequency_Hz)
     {
         bool ok { false };
         if (m_APIOpen)
         {
-            // Note VersaAPIGuide v1.8.2 has an error in the description of VSL_I2CWriteRegister,
-            // it states that the fourth parameter is a pointer to unsigned char but it is an unsigned char (not a pointer)
-            ok = (VSL_I2CWriteRegister(VL_I2C_BUS_TYPE_PRIMARY, k_fanPSUI2CChipAddress, address, data) == VL_API_OK);
+            // Limit the requested frequency to the range supported by the bus
+            if (frequency_Hz > m_I2CMaxFrequency_Hz)
+            {
+                frequency_Hz = m_I2CMaxFrequency_Hz;
+            }
+            else if (frequency_Hz < k_I2CStandardFrequency_Hz)
+            {
+                frequency_Hz = k_I2CStandardFrequency_Hz;
+            }
+
+            ok = m_I2CBus.execute(BusPriority::State, [&] () { return m_hardware->setI2CFrequency(frequency_Hz); });
+            if (ok)
+            {
+                m_I2CFrequency_Hz = frequency_Hz;
+            }
         }
         return ok;
     }
-    
-    bool VSLBSP::setFanPSURegisterBits(uint8_t address, uint8_t mask)
+
+    uint32_t VSLBSP::I2CFrequency() const
     {
-        bool ok { false };
-        uint8_t value { 0u };
-        if (readFanPSURegister(address, value))
+        return m_I2CFrequency_Hz;
+    }
+
+    uint32_t VSLBSP::I2CMaxFrequency() const
+    {
+        return m_I2CMaxFrequency_Hz;
+    }
+
+    bool VSLBSP::I2CSelfTest()
+    {
+        // One transaction with no retries, the test is whether the bus is reliable at this frequency
+        return m_I2CBus.execute(BusPriority::State, [this] () { return I2CSelfTestLocked(); });
+    }
+
+    bool VSLBSP::I2CSelfTestLocked()
+    {
+        static const uint8_t k_selfTestRepeats { 8u };
+        static const uint8_t k_selfTestRegisters[] { k_fanPSUI2CControlRegister,
+                                                     k_fanPSUI2CFan1Register,
+                                                     k_fanPSUI2CFan2Register };
+        static const uint8_t k_numberSelfTestRegisters { sizeof(k_selfTestRegisters) };
+
+        // Take a reference reading of the fan/PSU control registers, these are only changed by
+        // this application so every subsequent read must return the same values
+        uint8_t reference[k_numberSelfTestRegisters] {};
+        bool ok { true };
+        for (uint8_t reg = 0; ok && (reg < k_numberSelfTestRegisters); reg++)
         {
-            value |= mask;
-            ok = writeFanPSURegister(address, value);
+            ok = readFanPSURegisterLocked(k_selfTestRegisters[reg], reference[reg]);
         }
+
+        for (uint8_t repeat = 0; ok && (repeat < k_selfTestRepeats); repeat++)
+        {
+            for (uint8_t reg = 0; ok && (reg < k_numberSelfTestRegisters); reg++)
+            {
+                uint8_t value { 0u };
+                ok = readFanPSURegisterLocked(k_selfTestRegisters[reg], value) && (value == reference[reg]);
+            }
+
+            // Status register contents may change between reads, just check that it can be read
+            uint8_t status { 0u };
+            ok = ok && readFanPSURegisterLocked(k_fanPSUI2CStatus1Register, status);
+        }
+
+        // Write the control register back with its current value to check writes at this frequency
+        uint8_t control { 0u };
+        ok = ok && writeFanPSURegisterLocked(k_fanPSUI2CControlRegister, reference[0]);
+        ok = ok && readFanPSURegisterLocked(k_fanPSUI2CControlRegister, control) && (control == reference[0]);
+
         return ok;
     }
-    
-    bool VSLBSP::clearFanPSURegisterBits(uint8_t address, uint8_t mask)
+
+    bool VSLBSP::getFanPSUStatus(uint8_t& status, BusPriority priority)
     {
-        bool ok { false };
-        uint8_t value { 0u };
-        if (readFanPSURegister(address, value))
+        return readFanPSURegister(k_fanPSUI2CStatus1Register, status, priority);
+    }
+
+    bool VSLBSP::getFanPSUControl(uint8_t& control, BusPriority priority)
+    {
+        return readFanPSURegister(k_fanPSUI2CControlRegister, control, priority);
+    }
+
+    const BusScheduler& VSLBSP::I2CBus() const
+    {
+        return m_I2CBus;
+    }
+
+    const BusScheduler& VSLBSP::SPIBus() const
+    {
+        return m_SPIBus;
+    }
+
+    bool VSLBSP::readFanPSURegister(uint8_t address, uint8_t& data, BusPriority priority)
+    {
+        bool ok { m_APIOpen && m_I2CBus.execute(priority,
+                                                [&] () { return readFanPSURegisterLocked(address, data); },
+                                                k_fanPSUI2CReadAttempts) };
+        if (m_APIOpen && !ok)
         {
-            value &= ~mask;
-            ok = writeFanPSURegister(address, value);
+            std::cout << "READ FAILED" << std::endl;
         }
         return ok;
     }
+
+    bool VSLBSP::setFanPSURegisterBits(uint8_t address, uint8_t mask, BusPriority priority)
+    {
+        // Register writes are idempotent so the read-modify-write is retried as a whole
+        // clang-format off
+        return m_APIOpen && m_I2CBus.execute(priority, [&] ()
+                                             {
+                                                 uint8_t value { 0u };
+                                                 return readFanPSURegisterLocked(address, value) &&
+                                                        writeFanPSURegisterLocked(address, value | mask);
+                                             }, k_fanPSUI2CReadAttempts);
+        // clang-format on
+    }
+    
+    bool VSLBSP::clearFanPSURegisterBits(uint8_t address, uint8_t mask, BusPriority priority)
+    {
+        // clang-format off
+        return m_APIOpen && m_I2CBus.execute(priority, [&] ()
+                                             {
+                                                 uint8_t value { 0u };
+                                                 return readFanPSURegisterLocked(address, value) &&
+                                                        writeFanPSURegisterLocked(address, value & ~mask);
+                                             }, k_fanPSUI2CReadAttempts);
+        // clang-format on
+    }
+
+    bool VSLBSP::readFanPSURegisterLocked(uint8_t address, uint8_t& data)
+    {
+        return m_APIOpen && m_hardware->readI2CRegister(k_fanPSUI2CChipAddress, address, data);
+    }
+ 
+    bool VSLBSP::writeFanPSURegisterLocked(uint8_t address, uint8_t data)
+    {
+        return m_APIOpen && m_hardware->writeI2CRegister(k_fanPSUI2CChipAddress, address, data);
+    }
 }
@@ -0,0 +1,230 @@
+#include "VSWRProtection.hpp"
+#include "Clock.hpp"
+#include "Log.hpp"
+#include "Metrics.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace mercury::blackstar
+{
+    // Real-time priority for the protection thread, above everything else in the process
+    static const int k_protectionThreadPriority { 80 };
+
+    void VSWRProtection::build(const RFPowerMonitor::ReadingRing& readings,
+                               const RFPowerConverter& converter,
+                               std::function<void()> tripAction,
+                               std::function<void()> clearAction)
+    {
+        m_readings = &readings;
+        m_converter = &converter;
+        m_tripAction = tripAction;
+        m_clearAction = clearAction;
+    }
+
+    void VSWRProtection::run()
+    {
+        m_stopRequested = false;
+
+        // clang-format off
+        m_VSWRProtectionThread = std::thread { [&] ()
+                                               {
+                                                   start();
+                                               }
+                                             };
+        // clang-format on
+    }
+
+    void VSWRProtection::stop()
+    {
+        m_stopRequested = true;
+        notify();
+
+        if (m_VSWRProtectionThread.joinable())
+        {
+            m_VSWRProtectionThread.join();
+        }
+    }
+
+    void VSWRProtection::notify()
+    {
+        {
+            std::lock_guard<std::mutex> lock { m_wakeMutex };
+            m_wakeRequested = true;
+        }
+        m_wakeCondition.notify_one();
+    }
+
+    void VSWRProtection::setHeartbeat(std::shared_ptr<Heartbeat> heartbeat)
+    {
+        m_heartbeat = heartbeat;
+    }
+
+    bool VSWRProtection::setTripThreshold(uint16_t trip_cVSWR)
+    {
+        bool ok { trip_cVSWR > 100u };
+
+        if (ok)
+        {
+            m_trip_cVSWR = trip_cVSWR;
+        }
+
+        return ok;
+    }
+
+    uint16_t VSWRProtection::tripThreshold() const
+    {
+        return m_trip_cVSWR;
+    }
+
+    void VSWRProtection::setMinimumForwardPower(float power_dBm)
+    {
+        m_minimumForward_dBm = power_dBm;
+    }
+
+    void VSWRProtection::rearm()
+    {
+        if (m_tripped.exchange(false) && m_clearAction)
+        {
+            m_clearAction();
+        }
+    }
+
+    bool VSWRProtection::tripped() const
+    {
+        return m_tripped;
+    }
+
+    VSWRProtection::Statistics VSWRProtection::statistics() const
+    {
+        Statistics statistics;
+        statistics.tripCount = m_tripCount;
+        statistics.deadlineMisses = m_deadlineMisses;
+        statistics.lastLatency_ns = m_lastLatency_ns;
+        statistics.maxLatency_ns = m_maxLatency_ns;
+        statistics.readingsLost = m_readingsLost;
+        return statistics;
+    }
+
+    void VSWRProtection::start()
+    {
+        Metrics::registerThread("VSWRProtection");
+
+        if ((m_readings == nullptr) || (m_converter == nullptr))
+        {
+            Log::error("VSWR protection not built");
+            return;
+        }
+
+        // The wake-up latency is only bounded if we aren't preempted by ordinary threads
+        sched_param parameters {};
+        parameters.sched_priority = k_protectionThreadPriority;
+        int err { pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters) };
+        if (err != 0)
+        {
+            Log::warning("VSWR protection running without real-time priority ({})", std::strerror(err));
+        }
+
+        // Force the return loss threshold to be derived on first use
+        m_cachedTrip_cVSWR = 0u;
+
+        uint64_t cursor { m_readings->count() };
+
+        while (!m_stopRequested)
+        {
+            uint64_t available { m_readings->count() };
+
+            // If we have been lapped then skip to the oldest reading still in the ring
+            if ((available - cursor) > RFPowerMonitor::ReadingRing::capacity())
+            {
+                uint64_t oldest { available - RFPowerMonitor::ReadingRing::capacity() };
+                m_readingsLost += oldest - cursor;
+                cursor = oldest;
+            }
+
+            for (; cursor < available; cursor++)
+            {
+                RFPowerReading reading;
+                if (m_readings->read(cursor, reading))
+                {
+                    assess(reading);
+                }
+                else
+                {
+                    m_readingsLost++;
+                }
+            }
+
+            if (m_heartbeat != nullptr)
+            {
+                m_heartbeat->beat();
+            }
+
+            // Sleep until the next reading, waking without one only to report progress. A reading
+            // pushed since the count was read leaves the wake flag set, so it isn't missed.
+            std::unique_lock<std::mutex> lock { m_wakeMutex };
+            m_wakeCondition.wait_for(lock, k_idlePeriod, [&] () { return m_wakeRequested; });
+            m_wakeRequested = false;
+        }
+    }
+
+    void VSWRProtection::assess(const RFPowerReading& reading)
+    {
+        float forward_dBm { 0.0f };
+        float returnLoss_dB { 0.0f };
+        m_converter->convert(reading.forwardADC, reading.reverseADC, forward_dBm, returnLoss_dB);
+
+        // No meaningful VSWR without forward power (e.g. PA muted)
+        if (forward_dBm < m_minimumForward_dBm)
+        {
+            return;
+        }
+
+        // Compare in the return loss domain so there is no log or divide per reading,
+        // VSWR >= threshold is the same as return loss <= threshold return loss
+        uint16_t trip_cVSWR { m_trip_cVSWR };
+        if (trip_cVSWR != m_cachedTrip_cVSWR)
+        {
+            m_tripReturnLoss_dB = VSWRToReturnLoss(trip_cVSWR);
+            m_cachedTrip_cVSWR = trip_cVSWR;
+        }
+
+        // Once tripped the PA is muted, so there is no forward power to assess until rearm()
+        if ((returnLoss_dB <= m_tripReturnLoss_dB) && !m_tripped.exchange(true))
+        {
+            if (m_tripAction)
+            {
+                m_tripAction();
+            }
+
+            uint64_t latency_ns { Clock::monotonic_ns() - reading.timestamp_ns };
+
+            m_tripCount++;
+            m_lastLatency_ns = latency_ns;
+            if (latency_ns > m_maxLatency_ns)
+            {
+                m_maxLatency_ns = latency_ns;
+            }
+            if (latency_ns > static_cast<uint64_t>(std::chrono::nanoseconds { k_tripDeadline }.count()))
+            {
+                m_deadlineMisses++;
+            }
+
+            // Report after the trip action so logging doesn't add to the latency
+            Log::error("VSWR protection tripped, forward {} dBm, return loss {} dB, breach to mute {} us",
+                       forward_dBm, returnLoss_dB, latency_ns / 1000u);
+        }
+    }
+
+    float VSWRProtection::VSWRToReturnLoss(uint16_t VSWR_c)
+    {
+        float VSWR { static_cast<float>(VSWR_c) / 100.0f };
+        float gamma { (VSWR - 1.0f) / (VSWR + 1.0f) };
+
+        return (gamma > 0.0f) ? (-20.0f * std::log10(gamma)) : std::numeric_limits<float>::infinity();
+    }
+}
@@ -0,0 +1,238 @@
+#include "VersaLogicHardware.hpp"
+
+#include <unistd.h>
+#include <cmath>
+#include <cstdbool>  // Include this before VL_OSALib.h as that uses _Bool
+
+#define linux
+#include "../lib/VL_OSALib.h"
+
+namespace mercury::blackstar
+{
+    // clang-format off
+    // VersaAPI SPI clock frequency options, fastest first
+    static const struct
+    {
+        uint32_t frequency_Hz;
+        unsigned int setting;
+    } k_SPIClockFrequencies[] { { 6000000u, SPI_CLK_FREQ3 },
+                                { 2000000u, SPI_CLK_FREQ2 },
+                                { 1500000u, SPI_CLK_FREQ1 },
+                                {  750000u, SPI_CLK_FREQ0 } };
+    // clang-format on
+
+    static const uint8_t k_numberDIOChannels { 32u };
+
+    // The EPU-4562 ADC is an ADS8668, its widest input range is +/-10.24 V
+    static const double k_maximumAnalogInput_V { 10.24 };
+
+    VersaLogicHardware::~VersaLogicHardware()
+    {
+        close();
+    }
+
+    bool VersaLogicHardware::open()
+    {
+        static const int32_t k_VLReturnSuccess { 0 };
+
+        if (!m_open)
+        {
+            m_open = (VL_Open() == k_VLReturnSuccess);
+        }
+
+        return m_open;
+    }
+
+    void VersaLogicHardware::close()
+    {
+        if (m_open)
+        {
+            VL_Close();
+            m_open = false;
+        }
+    }
+
+    void VersaLogicHardware::setDIODirection(uint8_t channel, bool input)
+    {
+        VL_DIOSetChannelDirection(channel, input ? DIO_INPUT : DIO_OUTPUT);
+    }
+
+    void VersaLogicHardware::setDIOLevel(uint8_t channel, bool high)
+    {
+        VL_DIOSetChannelLevel(channel, high ? DIO_CHANNEL_HIGH : DIO_CHANNEL_LOW);
+    }
+
+    bool VersaLogicHardware::DIOLevel(uint8_t channel)
+    {
+        return VSL_DIOGetChannelLevel(channel) == DIO_CHANNEL_HIGH;
+    }
+
+    int VersaLogicHardware::DIOInterruptSignal() const
+    {
+        return SIG_VL_DIO;
+    }
+
+    bool VersaLogicHardware::enableDIOInterrupts(uint32_t channels)
+    {
+        bool ok { VSL_DIOSetupInterrupts(::getpid()) == VL_API_OK };
+
+        for (uint8_t channel = 0; ok && (channel < k_numberDIOChannels); channel++)
+        {
+            if ((channels & (1u << channel)) != 0u)
+            {
+                VSL_DIOClearInterruptStatus(1, channel);
+                VSL_DIOEnableInterruptGeneration(ENABLE_INT_GEN_ON, 1, channel);
+            }
+        }
+
+        return ok;
+    }
+
+    void VersaLogicHardware::disableDIOInterrupts(uint32_t channels)
+    {
+        for (uint8_t channel = 0; channel < k_numberDIOChannels; channel++)
+        {
+            if ((channels & (1u << channel)) != 0u)
+            {
+                VSL_DIOEnableInterruptGeneration(ENABLE_INT_GEN_OFF, 1, channel);
+            }
+        }
+    }
+
+    void VersaLogicHardware::clearDIOInterrupts(uint32_t channels)
+    {
+        for (uint8_t channel = 0; channel < k_numberDIOChannels; channel++)
+        {
+            if ((channels & (1u << channel)) != 0u)
+            {
+                VSL_DIOClearInterruptStatus(1, channel);
+            }
+        }
+    }
+
+    bool VersaLogicHardware::readFPGARegister(uint32_t offset, uint8_t& data)
+    {
+        return VSL_FPGAReadRegister(offset, &data) == VL_API_OK;
+    }
+
+    bool VersaLogicHardware::writeFPGARegister(uint32_t offset, uint8_t data)
+    {
+        return VSL_FPGAWriteRegister(offset, data) == VL_API_OK;
+    }
+
+    bool VersaLogicHardware::setI2CFrequency(uint32_t frequency_Hz)
+    {
+        return (VSL_I2CIsAvailable(VL_I2C_BUS_TYPE_PRIMARY) == VL_API_OK) &&
+               (VSL_I2CSetFrequency(VL_I2C_BUS_TYPE_PRIMARY, frequency_Hz) == VL_API_OK);
+    }
+
+    uint32_t VersaLogicHardware::I2CMaxFrequency()
+    {
+        unsigned long maxFrequency_Hz { 0u };
+
+        if (VSL_I2CGetMaxFrequency(VL_I2C_BUS_TYPE_PRIMARY, &maxFrequency_Hz) != VL_API_OK)
+        {
+            maxFrequency_Hz = 0u;
+        }
+
+        return static_cast<uint32_t>(maxFrequency_Hz);
+    }
+
+    bool VersaLogicHardware::readI2CRegister(uint8_t chipAddress, uint8_t address, uint8_t& data)
+    {
+        return VSL_I2CReadRegister(VL_I2C_BUS_TYPE_PRIMARY, chipAddress, address, &data) == VL_API_OK;
+    }
+
+    bool VersaLogicHardware::writeI2CRegister(uint8_t chipAddress, uint8_t address, uint8_t data)
+    {
+        // Note VersaAPIGuide v1.8.2 has an error in the description of VSL_I2CWriteRegister,
+        // it states that the fourth parameter is a pointer to unsigned char but it is an unsigned char (not a pointer)
+        return VSL_I2CWriteRegister(VL_I2C_BUS_TYPE_PRIMARY, chipAddress, address, data) == VL_API_OK;
+    }
+
+    bool VersaLogicHardware::configureSPI(uint32_t clockFrequency_Hz, uint8_t mode, uint32_t frameSize)
+    {
+        // Use the fastest clock option which doesn't exceed the requested frequency
+        unsigned int clockSetting { SPI_CLK_FREQ0 };
+        for (const auto& option : k_SPIClockFrequencies)
+        {
+            if (option.frequency_Hz <= clockFrequency_Hz)
+            {
+                clockSetting = option.setting;
+                break;
+            }
+        }
+
+        return (VSL_SPIIsAvailable() == VL_API_OK) && (VSL_SPISetFrequency(clockSetting) == VL_API_OK) &&
+               (VSL_SPISetShiftDirection(SPI_DIR_LEFT) == VL_API_OK) &&
+               (VSL_SPISetFrameSize(frameSize) == VL_API_OK) && (VSL_SPISetMode(mode) == VL_API_OK);
+    }
+
+    bool VersaLogicHardware::setSPIFrameSize(uint32_t frameSize)
+    {
+        return VSL_SPISetFrameSize(frameSize) == VL_API_OK;
+    }
+
+    bool VersaLogicHardware::writeSPIFrame(uint32_t data)
+    {
+        return VSL_SPIWriteDataFrame(SPI_SS_SS0, &data) == VL_API_OK;
+    }
+
+    bool VersaLogicHardware::readSPIFrame(uint32_t& data)
+    {
+        return VSL_SPIReadDataFrame(&data) == VL_API_OK;
+    }
+
+    bool VersaLogicHardware::configureAnalogAutoScan(uint8_t channels)
+    {
+        return VSL_ADCConfigureAnalogAutoScanMode((channels != 0u) ? YES : NO, NO, channels) == VL_API_OK;
+    }
+
+    bool VersaLogicHardware::readAnalogInputs(uint8_t channels, AnalogInputs& volts)
+    {
+        // With auto-scan enabled each read collects the next result of the scan sequence. The API
+        // doesn't return a status for a read, so a result outside the ADC input range fails the scan.
+        bool ok { true };
+        for (size_t channel = 0; channel < k_numberAnalogInputs; channel++)
+        {
+            if ((channels & (1u << channel)) != 0u)
+            {
+                volts[channel] = VSL_ADCGetAnalogInput(static_cast<unsigned char>(channel), AI_VOLTS);
+                if (!std::isfinite(volts[channel]) || (std::fabs(volts[channel]) > k_maximumAnalogInput_V))
+                {
+                    ok = false;
+                }
+            }
+        }
+        return ok;
+    }
+
+    bool VersaLogicHardware::fanRPM(uint8_t pulsesPerRevolution, uint16_t& RPM)
+    {
+        // The API doesn't return a status for the tachometer, a stopped or missing fan reads 0 RPM
+        if (pulsesPerRevolution == 0u)
+        {
+            return false;
+        }
+        RPM = VSL_FanGetRPM(pulsesPerRevolution);
+        return true;
+    }
+
+    bool VersaLogicHardware::enableWatchdog(uint8_t timeout_s)
+    {
+        VSL_WDTSetValue(timeout_s);
+        VSL_WDTResetEnable(ENABLE);
+        VSL_WDTEnable(ENABLE);
+        return VSL_WDTStatus() == 0x01;
+    }
+
+    void VersaLogicHardware::setWatchdogTimeout(uint8_t timeout_s)
+    {
+        VSL_WDTSetValue(timeout_s);
+    }
+
+    void VersaLogicHardware::disableWatchdog()
+    {
+        VSL_WDTEnable(DISABLE);
+    }
+}
@@ -0,0 +1,187 @@
+#include "WatchdogSupervisor.hpp"
+#include "Log.hpp"
+#include "Metrics.hpp"
+
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace mercury::blackstar
+{
+    void WatchdogSupervisor::build(std::shared_ptr<VSLBSP> BSP,
+                                   bool softMode,
+                                   uint8_t timeout_s,
+                                   const std::string& stallRecordPath)
+    {
+        m_BSP = BSP;
+        m_softMode = softMode;
+        m_timeout_s = timeout_s;
+        m_stallRecordPath = stallRecordPath;
+
+        reportPreviousStall();
+    }
+
+    std::shared_ptr<Heartbeat> WatchdogSupervisor::addThread(const std::string& name,
+                                                             std::chrono::milliseconds deadline)
+    {
+        std::shared_ptr<Heartbeat> heartbeat { std::make_shared<Heartbeat>() };
+        m_threads.push_back(SupervisedThread { name, deadline, heartbeat, false });
+        return heartbeat;
+    }
+
+    void WatchdogSupervisor::run()
+    {
+        m_stopRequested = false;
+
+        // The supervised threads have only just been started so give them a full deadline from now
+        for (auto& thread : m_threads)
+        {
+            thread.heartbeat->beat();
+        }
+
+        if (m_softMode)
+        {
+            Log::info("Watchdog supervisor in soft mode, stalls will be logged only");
+        }
+        else if (m_BSP->enableWatchdog(m_timeout_s))
+        {
+            Log::info("Hardware watchdog enabled, timeout {} s", m_timeout_s);
+        }
+        else
+        {
+            Log::error("could not enable hardware watchdog, stalls will be logged only");
+            m_softMode = true;
+        }
+
+        // clang-format off
+        m_watchdogThread = std::thread { [&] ()
+                                         {
+                                             start();
+                                         }
+                                       };
+        // clang-format on
+    }
+
+    void WatchdogSupervisor::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock { m_wakeMutex };
+            m_stopRequested = true;
+        }
+        m_wakeCondition.notify_one();
+
+        if (m_watchdogThread.joinable())
+        {
+            m_watchdogThread.join();
+        }
+
+        // Clean shutdown, don't let the board reset underneath whatever runs next
+        if (!m_softMode)
+        {
+            m_BSP->disableWatchdog();
+        }
+    }
+
+    std::string WatchdogSupervisor::lastStalledThread() const
+    {
+        std::lock_guard<std::mutex> lock { m_stallMutex };
+        return m_lastStalledThread;
+    }
+
+    void WatchdogSupervisor::start()
+    {
+        Metrics::registerThread("Watchdog");
+
+        std::unique_lock<std::mutex> lock { m_wakeMutex };
+
+        while (!m_stopRequested)
+        {
+            // Only kick when every thread is making progress, otherwise let the hardware
+            // watchdog expire
+            if (check() && !m_softMode)
+            {
+                m_BSP->kickWatchdog();
+            }
+
+            m_wakeCondition.wait_for(lock, k_checkPeriod, [&] () { return m_stopRequested.load(); });
+        }
+    }
+
+    bool WatchdogSupervisor::check()
+    {
+        bool allOK { true };
+
+        for (auto& thread : m_threads)
+        {
+            std::chrono::nanoseconds age { thread.heartbeat->age() };
+            bool stalled { age > thread.deadline };
+
+            if (stalled && !thread.stalled)
+            {
+                recordStall(thread, age);
+            }
+            else if (!stalled && thread.stalled)
+            {
+                Log::info("Watchdog: thread {} making progress again", thread.name);
+            }
+
+            thread.stalled = stalled;
+            allOK = allOK && !stalled;
+        }
+
+        return allOK;
+    }
+
+    void WatchdogSupervisor::recordStall(const SupervisedThread& thread, std::chrono::nanoseconds age)
+    {
+        int64_t age_ms { std::chrono::duration_cast<std::chrono::milliseconds>(age).count() };
+
+        {
+            std::lock_guard<std::mutex> lock { m_stallMutex };
+            m_lastStalledThread = thread.name;
+        }
+
+        Log::error("watchdog: thread {} missed its {} ms deadline (no progress for {} ms){}", thread.name,
+                   thread.deadline.count(), age_ms, m_softMode ? "" : ", board will be reset");
+
+        // Write the record straight to storage as the board may be reset before anything else is
+        char record[256];
+        int length { std::snprintf(record,
+                                   sizeof(record),
+                                   "%lld %s %lld %lld\n",
+                                   static_cast<long long>(std::time(nullptr)),
+                                   thread.name.c_str(),
+                                   static_cast<long long>(thread.deadline.count()),
+                                   static_cast<long long>(age_ms)) };
+        int fd { ::open(m_stallRecordPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+        if (fd >= 0)
+        {
+            if ((length <= 0) || (::write(fd, record, static_cast<size_t>(length)) != length) || (::fsync(fd) != 0))
+            {
+                Log::warning("could not write watchdog stall record {}", m_stallRecordPath);
+            }
+            ::close(fd);
+        }
+    }
+
+    void WatchdogSupervisor::reportPreviousStall()
+    {
+        // Stall record format: time, thread name, deadline (ms), time without progress (ms)
+        std::ifstream record { m_stallRecordPath };
+        long long time { 0 };
+        std::string name;
+        long long deadline_ms { 0 };
+        long long age_ms { 0 };
+
+        if (record >> time >> name >> deadline_ms >> age_ms)
+        {
+            Log::warning("previous run stalled in thread {} (no progress for {} ms, deadline {} ms) at {}", name,
+                         age_ms, deadline_ms, time);
+            record.close();
+            std::remove(m_stallRecordPath.c_str());
+        }
+    }
+}